@@ -14,7 +14,7 @@ python3 scripts/db_update_service.py 2>&1 > output.txt &
 PID=$!
 echo "$PID" > db.pid
 
-$BIN -d $PCAPDIR -o br1_output.txt -z tcp://127.0.0.1:5555 -v --timeout 5000
+$BIN -d $PCAPDIR -o br1_flows_$(date +%Y%m%d%H%M%S).pcaf -z tcp://127.0.0.1:5555 -v --timeout 5000 --manifest pcap_analyzer.manifest
 sleep 1
 kill -9 $PID
 if [[ -e db.pid ]]; then
@@ -91,7 +91,51 @@ def main():
                 'end_timestamp_s' : mcn.timestamp_s,
                 'end_timestamp_us' : mcn.timestamp_us,                
             }
+            if mcn.HasField('sni'):
+                d['sni'] = mcn.sni
+            if mcn.HasField('ja3'):
+                d['ja3'] = mcn.ja3
             tempbuf2 += [d]
+        elif gmsg.msgtype == Messages_pb2.GenericMessage.MsgType.DNS_BATCH:
+            batch = Messages_pb2.DNSBatch()
+            batch.ParseFromString(gmsg.data)
+
+            for rec in batch.records:
+                ts = float(rec.query_s) + float(float(rec.query_us) / float(10**6))
+                answers = ",".join([a.data for a in rec.answers])
+                print("DNS@%.6f (%s:%u -> %s:%u) %s type=%u rcode=%s [%s]" % (
+                    ts, rec.client, rec.client_port, rec.server, rec.server_port,
+                    rec.qname, rec.qtype,
+                    str(rec.rcode) if rec.HasField('rcode') else "-", answers
+                ))
+        elif gmsg.msgtype == Messages_pb2.GenericMessage.MsgType.HEAVY_HITTERS:
+            snap = Messages_pb2.HeavyHitterSnapshot()
+            snap.ParseFromString(gmsg.data)
+
+            ts = float(snap.start_s) + float(float(snap.start_us) / float(10**6))
+            print("WINDOW@%.6f %u packets, %u sources, %u destinations" % (
+                ts, snap.packets, snap.distinct_src, snap.distinct_dst
+            ))
+            dimensions = ["src", "dst", "dport", "flow"]
+            metrics = ["packets", "bytes"]
+            for h in snap.hitters:
+                key = "%s:%u -> %s:%u/%u" % (h.src, h.sport, h.dst, h.dport, h.protocol)
+                print("TOP@%.6f %s by %s: %s %u (+/- %u) distinct=%u" % (
+                    ts, dimensions[h.dimension], metrics[h.metric], key, h.count, h.error,
+                    h.distinct
+                ))
+        elif gmsg.msgtype == Messages_pb2.GenericMessage.MsgType.SCAN_REPORT:
+            report = Messages_pb2.ScanReport()
+            report.ParseFromString(gmsg.data)
+
+            ts = float(report.start_s) + float(float(report.start_us) / float(10**6))
+            print("SCANS@%.6f %u half-open, %u untracked" % (
+                ts, report.half_open, report.untracked
+            ))
+            for src in report.sources:
+                print("SCAN@%.6f %s vlan=%u syns=%u unanswered=%u" % (
+                    ts, src.src, src.vlan, src.syns, src.unanswered
+                ))
         elif gmsg.msgtype == Messages_pb2.GenericMessage.MsgType.SYNC:
             next_sync = True
 
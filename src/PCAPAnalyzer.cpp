@@ -19,6 +19,7 @@
 #include <getopt.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <time.h>
 #include <pcrecpp.h>
@@ -41,16 +42,33 @@
 #include "Logging.h"
 #include "PCAPSorter.h"
 
+//Input
+#include "PCAPReader.h"
+#include "IOBackend.h"
+#include "DecompressBackend.h"
+#include "PacketFilter.h"
+#include "PCAPIndex.h"
+#include "ProcessingManifest.h"
+#include "DirectoryWatcher.h"
+#include "DirectoryScanner.h"
+#include "FilePrefetcher.h"
+
 //Analysis
 #include "PacketAnalyzer.h"
 #include "PacketConnectionTracker.h"
 #include "PacketHash.h"
 #include "PacketMsgProxy.h"
+#include "DNSAnalyzer.h"
+#include "HeavyHitters.h"
 
 #include "TCPTracker.h"
 #include "UDPTracker.h"
 #include "ICMPTracker.h"
 
+//Output
+#include "IPFIXExporter.h"
+#include "ColumnarFlowFile.h"
+
 //=============================================================================
 // DEFINITIONS
 //=============================================================================
@@ -65,11 +83,30 @@ struct Args {
     argparse::ArgValue<std::string> config;
     argparse::ArgValue<uint64_t> timeout;
     argparse::ArgValue<std::string> disable;
+    argparse::ArgValue<std::string> ipfix;
+    argparse::ArgValue<size_t> ipfix_mtu;
+    argparse::ArgValue<std::string> start;
+    argparse::ArgValue<std::string> stop;
+    argparse::ArgValue<bool> index;
+    argparse::ArgValue<std::string> manifest;
+    argparse::ArgValue<bool> follow;
+    argparse::ArgValue<uint64_t> follow_interval;
+    argparse::ArgValue<std::string> sort;
+    argparse::ArgValue<bool> recursive;
+    argparse::ArgValue<size_t> scan_threads;
+    argparse::ArgValue<size_t> prefetch;
+    argparse::ArgValue<std::string> io_backend;
+    argparse::ArgValue<bool> io_bench;
+    argparse::ArgValue<size_t> decompress_threads;
+    argparse::ArgValue<std::string> filter;
+    argparse::ArgValue<uint32_t> snaplen;
+    argparse::ArgValue<bool> dns;
+    argparse::ArgValue<uint64_t> dedup_window;
+    argparse::ArgValue<uint64_t> heavy_hitters;
 };
 
 size_t g_packetCounter = 0;
 size_t g_totalPacketCounter = 0;
-FILE* g_fpOutput = NULL;
 long int g_startTime = 0xFFFFFFFFFFFFFFF;
 long int g_startTimeUs = 0xFFFFFFFFFFFFFFF;
 long int g_stopTime = 0;
@@ -78,16 +115,63 @@ std::shared_ptr<PacketMsgProxy> g_packetMsgProxy = nullptr;
 std::shared_ptr<PacketConnectionTracker> g_connTracker = nullptr;
 static Packet gs_last_packet;
 
-bool pcap_on_packet (const Packet& packet);
-bool pcap_process_file (std::string sFile, std::string sOutput);
-std::vector<std::string> pcap_get_dir_listing (std::string sDir, std::string sPattern);
+//Time window (microseconds since epoch), zero means unbounded
+uint64_t g_windowStartUs = 0;
+uint64_t g_windowStopUs = 0;
+
+//Order in which capture files are processed
+PCAPSortOrder_T g_sortOrder = PCAP_SORT_NAME;
+
+//Drops packets before they are decoded, nullptr when not filtering
+std::shared_ptr<PacketFilter> g_packetFilter = nullptr;
+
+//Pairs DNS queries with their responses, nullptr when disabled
+std::shared_ptr<DNSAnalyzer> g_dnsAnalyzer = nullptr;
+
+//Ranks the busiest hosts, ports and flows, nullptr when disabled
+std::shared_ptr<HeavyHitters> g_heavyHitters = nullptr;
+
+//Drops copies of packets seen within the dedup window, nullptr when disabled
+std::shared_ptr<PacketDeduplicator> g_packetDedup = nullptr;
+
+//Bytes of each packet that are decoded, 0 decodes whole packets
+uint32_t g_decodeSnaplen = 0;
+
+//How classic pcap files are read
+IOBackendType_T g_ioBackend = IO_BACKEND_PREAD;
+
+//Set by the signal handler, stops --follow
+volatile sig_atomic_t g_shutdown = 0;
+
+//How often tracker state and the manifest are checkpointed in --follow mode
+#define FOLLOW_CHECKPOINT_INTERVAL_S 60
+
+//Matches capture files but not their sidecar indexes
+#define PCAP_FILE_PATTERN ".*\\.pcap(?!.*\\" PCAP_INDEX_SUFFIX "(\\.tmp)?$).*"
+
+//Substring every capture file name contains, checked before the pattern
+#define PCAP_FILE_LITERAL ".pcap"
+
+//Number of threads listing directories
+size_t g_scanThreads = SCANNER_DEFAULT_THREADS;
+
+bool pcap_on_packet (const Packet& packet, uint16_t vlan, const uint8_t* pL3, uint32_t l3Len);
+bool pcap_on_sniffed_packet (const Packet& packet);
+void pcap_sniff_file (std::string sFile, PCAPReader& reader);
+bool pcap_process_file (std::string sFile, uint64_t& offset);
+void pcap_io_benchmark (const std::vector<std::string>& pcapList);
+bool pcap_follow_directory (std::string sDir, std::shared_ptr<ProcessingManifest> manifest,
+                            bool bCheckpoint, uint64_t interval);
+std::vector<std::string> pcap_get_dir_listing (std::string sDir, std::string sPattern, bool bRecursive);
 std::string timestamp_to_string (long int seconds, long int us_partial);
+bool string_to_timestamp (std::string sTime, uint64_t& timestamp_us);
 
 //=============================================================================
 // IMPLEMENTATION
 //=============================================================================
 void SignalHandler (int signal) {
     PrintSimpleLogMessage(LEVEL_DEBUG, "Received signal %d, shutting down", signal);
+    g_shutdown = 1;
 }
 
 void InitializeSigterm (void) {
@@ -114,12 +198,43 @@ std::string timestamp_to_string (long int seconds, long int us_partial) {
     return retVal;
 }
 
-bool pcap_on_packet (const Packet& packet) {
+bool string_to_timestamp (std::string sTime, uint64_t& timestamp_us) {
+    struct tm lt;
+    char* pEnd = NULL;
+
+    //Seconds since the epoch (optionally fractional)
+    double seconds = strtod(sTime.c_str(), &pEnd);
+    if (pEnd != sTime.c_str() && *pEnd == '\0') {
+        timestamp_us = (uint64_t)(seconds * 1000000.0);
+        return true;
+    }
+
+    //Local time, "YYYY-MM-DD HH:MM:SS" or "YYYY-MM-DDTHH:MM:SS"
+    const char* formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S" };
+    for (auto pFormat : formats) {
+        memset(&lt, 0, sizeof(lt));
+        pEnd = strptime(sTime.c_str(), pFormat, &lt);
+        if (pEnd && *pEnd == '\0') {
+            lt.tm_isdst = -1;
+            timestamp_us = (uint64_t)mktime(&lt) * 1000000;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool pcap_on_packet (const Packet& packet, uint16_t vlan, const uint8_t* pL3, uint32_t l3Len) {
     bool retValue = true;    
     
-    const PDU* pduPtr = packet.pdu();
     long int seconds = packet.timestamp().seconds();
     long int microseconds = packet.timestamp().microseconds();
+    uint64_t timestamp_us = seconds * 1000000 + microseconds;
+
+    if ((g_windowStartUs != 0 && timestamp_us < g_windowStartUs) ||
+        (g_windowStopUs != 0 && timestamp_us > g_windowStopUs)) {
+        return retValue;
+    }
     
     if (seconds < g_startTime &&
         microseconds < g_startTimeUs) {
@@ -133,7 +248,18 @@ bool pcap_on_packet (const Packet& packet) {
         g_stopTimeUs = microseconds;
     }
 
-    g_connTracker->on_packet(packet);
+    if (g_packetDedup != nullptr && pL3 &&
+        g_packetDedup->is_duplicate(pL3, l3Len, timestamp_us)) {
+        return retValue;
+    }
+
+    g_connTracker->on_packet(packet, vlan, pL3, l3Len);
+    if (g_dnsAnalyzer != nullptr && pL3) {
+        g_dnsAnalyzer->on_packet(pL3, l3Len, vlan, timestamp_us);
+    }
+    if (g_heavyHitters != nullptr && pL3) {
+        g_heavyHitters->on_packet(pL3, l3Len, vlan, timestamp_us);
+    }
     gs_last_packet = packet;
     g_packetCounter++;
     //Continue looping by returning true
@@ -141,12 +267,68 @@ Exit:
     return retValue;
 }
 
-std::vector<std::string> pcap_get_dir_listing (std::string sDir, std::string sPattern) {
+bool pcap_on_sniffed_packet (const Packet& packet) {
+    uint16_t vlan = 0;
+
+    //libtins nests QinQ tags, the innermost one identifies the VLAN
+    for (const PDU* pdu = packet.pdu()->find_pdu<Dot1Q>(); pdu; pdu = pdu->inner_pdu()) {
+        if (pdu->pdu_type() == PDU::DOT1Q) {
+            vlan = static_cast<const Dot1Q*>(pdu)->id();
+        }
+    }
+
+    //The capture bytes are gone by now, so fragments can't be attributed
+    return pcap_on_packet(packet, vlan, NULL, 0);
+}
+
+/**
+ * Reads a capture file that only libpcap understands (e.g. pcapng).
+ * Records are taken from libpcap as raw bytes and decoded by the
+ * reader, so they reach the trackers and payload analyzers peeled and
+ * with their IP header, the same as records of classic pcap files.
+ */
+void pcap_sniff_file (std::string sFile, PCAPReader& reader) {
+    FileSniffer sniffer(sFile.c_str(), g_packetFilter ? g_packetFilter->expression() : "");
+    pcap_t* pHandle = sniffer.get_pcap_handle();
+    struct pcap_pkthdr* pHdr = NULL;
+    const u_char* pData = NULL;
+    PCAPRecord_T rec;
+    Packet packet;
+
+    //libpcap hands back raw IP as DLT_RAW rather than its file value
+    uint32_t linkType = pcap_datalink(pHandle);
+    if (linkType == DLT_RAW) {
+        linkType = PCAP_LINKTYPE_RAW;
+    }
+
+    //Link types the reader can't decode are left to libtins
+    if (!reader.set_link_type(linkType)) {
+        sniffer.sniff_loop(pcap_on_sniffed_packet);
+        return;
+    }
+    reader.set_decode_limit(g_decodeSnaplen);
+
+    memset(&rec, 0, sizeof(rec));
+    while (pcap_next_ex(pHandle, &pHdr, &pData) == 1) {
+        rec.timestamp_s = pHdr->ts.tv_sec;
+        rec.timestamp_us = pHdr->ts.tv_usec;
+        rec.caplen = pHdr->caplen;
+        rec.origlen = pHdr->len;
+        rec.data = pData;
+
+        if (reader.decode(rec, packet)) {
+            const DecapInfo_T& layers = reader.layers();
+            pcap_on_packet(packet, layers.vlan,
+                           layers.l3_type ? rec.data + layers.l3_offset : NULL,
+                           layers.l3_type ? layers.l3_len : 0);
+        }
+    }
+}
+
+std::vector<std::string> pcap_get_dir_listing (std::string sDir, std::string sPattern, bool bRecursive) {
     struct stat fs;
-    struct dirent* pDirEntry = NULL;
-    DIR* pDir;
-    pcrecpp::RE fileSearchRegex(sPattern);
     std::vector<std::string> retValue;
+    DirectoryScanner scanner(sPattern, PCAP_FILE_LITERAL, g_scanThreads);
     
     //Stat the directory
     if (stat(sDir.c_str(), &fs) == -1) {
@@ -155,76 +337,254 @@ std::vector<std::string> pcap_get_dir_listing (std::string sDir, std::string sPa
     }
 
     //Verify that this is a directory
-    if (!(fs.st_mode & S_IFDIR)) {
+    if (!S_ISDIR(fs.st_mode)) {
         printf("Path provided is not a directory, skipping!");
         goto Exit;
     }
 
-    //Get the file listing
-    pDir = opendir(sDir.c_str());
-    if (!pDir) {
-        printf("Unable to access directory!");
-        goto Exit;
+    //Date directories (YYYY/MM/DD/HH) outside the window aren't listed
+    scanner.set_recursive(bRecursive);
+    scanner.set_window(g_windowStartUs, g_windowStopUs);
+    retValue = scanner.scan(sDir);
+
+    PrintSimpleLogMessage(LEVEL_DEBUG, "Listed %llu directories (%llu pruned, %llu stat calls)",
+                          scanner.get_dirs(), scanner.get_pruned(), scanner.get_stats());
+    
+Exit:
+    return retValue;
+}
+
+bool pcap_process_file (std::string sFile, uint64_t& offset) {
+    bool retValue = false;
+    bool bWindow = (g_windowStartUs != 0 || g_windowStopUs != 0);
+    PCAPIndex index(sFile);
+    PCAPReader reader(sFile, g_ioBackend);
+    PCAPRecord_T rec;
+    Packet packet;
+
+    //An up-to-date index lets whole files outside the window be skipped
+    //and lets the reader seek straight to the first relevant record.
+    bool bIndexed = index.load();
+    if (bIndexed && bWindow && !index.overlaps(g_windowStartUs, g_windowStopUs)) {
+        PrintSimpleLogMessage(LEVEL_DEBUG, "Skipping %s (outside time window)", sFile.c_str());
+        return true;
     }
 
-    do {
-        std::string sName;
+    //Offsets into compressed captures are positions in the decompressed
+    //stream and can't be compared with the file size, so they are only
+    //ever processed as a whole.
+    bool bCompressed = (DecompressBackend::GetCompression(sFile) != COMPRESSION_NONE);
+    if (bCompressed && offset != 0) {
+        struct stat fs;
+        PrintSimpleLogMessage(LEVEL_WARNING, "Unable to resume %s (compressed), skipping appended data",
+                              sFile.c_str());
+        offset = (stat(sFile.c_str(), &fs) == 0) ? fs.st_size : 0;
+        return true;
+    }
 
-        pDirEntry = readdir(pDir);
-        if (!pDirEntry) {
-            break;
-        }
+    g_packetCounter = 0;
 
-        if (!(pDirEntry->d_type & DT_REG)) {
-            //Skipping irregular files
-            continue;
+    if (!reader.open()) {
+        //Not a classic pcap file (e.g. pcapng), let libpcap handle it.
+        //Offsets aren't available here, so the whole file is consumed.
+        struct stat fs;
+        if (offset != 0) {
+            PrintSimpleLogMessage(LEVEL_WARNING, "Unable to resume %s (not a pcap file), skipping appended data",
+                                  sFile.c_str());
+        } else {
+            pcap_sniff_file(sFile, reader);
+        }
+        offset = (stat(sFile.c_str(), &fs) == 0) ? fs.st_size : 0;
+    } else {
+        //The index can only be built from a read that covers the whole file
+        bool bBuildIndex = !bIndexed && offset == 0;
+
+        if (offset != 0) {
+            reader.seek(offset);
+        } else if (bIndexed) {
+            reader.seek(index.find_offset(g_windowStartUs));
         }
 
-        sName = pDirEntry->d_name;
-        if (fileSearchRegex.FullMatch(sName)) {
-            retValue.push_back(sDir + "/" + sName);
+        if (bBuildIndex) {
+            index.reset();
         }
-    } while (pDirEntry);
 
-    closedir(pDir);
-    
-Exit:
-    return retValue;
-}
+        reader.set_decode_limit(g_decodeSnaplen);
+
+        while (reader.next(rec)) {
+            uint64_t timestamp_us = rec.timestamp_s * 1000000 + rec.timestamp_us;
+
+            if (bBuildIndex) {
+                //Build the index on first read
+                index.add_record(timestamp_us, rec.offset);
+            } else if (g_windowStopUs != 0 && timestamp_us > g_windowStopUs + PCAP_INDEX_REORDER_US) {
+                //Records can be slightly out of order, so only stop once
+                //they are well past the window
+                break;
+            }
+
+            if ((g_windowStartUs != 0 && timestamp_us < g_windowStartUs) ||
+                (g_windowStopUs != 0 && timestamp_us > g_windowStopUs)) {
+                continue;
+            }
+
+            if (g_packetFilter != nullptr &&
+                !g_packetFilter->match(reader.link_type(), rec.data, rec.caplen, rec.origlen)) {
+                continue;
+            }
+
+            if (reader.decode(rec, packet)) {
+                const DecapInfo_T& layers = reader.layers();
+                pcap_on_packet(packet, layers.vlan,
+                               layers.l3_type ? rec.data + layers.l3_offset : NULL,
+                               layers.l3_type ? layers.l3_len : 0);
+            }
+        }
 
-bool pcap_process_file (std::string sFile, std::string sOutput) {
-    bool retValue = false;
-    FileSniffer sniffer(sFile.c_str());
+        if (bBuildIndex) {
+            index.save();
+        }
 
-    #if 0
-    g_fpOutput = fopen(sOutput.c_str(), "a");
-    if (!g_fpOutput) {
-        PrintSimpleLogMessage(LEVEL_ERROR, "Unable to open output file!");
-        return retValue;
+        if (bCompressed) {
+            struct stat fs;
+            offset = (stat(sFile.c_str(), &fs) == 0) ? fs.st_size : 0;
+        } else {
+            offset = reader.tell();
+        }
     }
-    #endif
-
-    std::string cur_sFile = std::string(basename((char*)sFile.c_str()));
-    //fprintf(g_fpOutput, "# %s\n", basename(sFile.c_str()));
 
-    g_packetCounter = 0;
-    sniffer.sniff_loop(pcap_on_packet);
     g_totalPacketCounter += g_packetCounter;
 
     //Flush any connections not already sent to the database
+    if (g_dnsAnalyzer != nullptr) {
+        g_dnsAnalyzer->flush(false);
+    }
     g_packetMsgProxy->sync();
 
     g_connTracker->prune_connections(gs_last_packet);
 
     PrintSimpleLogMessage(LEVEL_DEBUG, "%10llu packets in %s", g_packetCounter, sFile.c_str());
 
-    //fclose(g_fpOutput);
-
     retValue = true;
 Exit:
     return retValue;
 }
 
+void pcap_io_benchmark (const std::vector<std::string>& pcapList) {
+    const IOBackendType_T backends[] = { IO_BACKEND_PREAD, IO_BACKEND_MMAP, IO_BACKEND_URING };
+
+    for (auto type : backends) {
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        std::string sName;
+
+        auto start = std::chrono::steady_clock::now();
+        for (auto pcapFile : pcapList) {
+            PCAPReader reader(pcapFile, type);
+            PCAPRecord_T rec;
+
+            //Evict the file so every backend starts from a cold cache
+            int fd = open(pcapFile.c_str(), O_RDONLY);
+            if (fd >= 0) {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                close(fd);
+            }
+
+            if (!reader.open()) {
+                continue;
+            }
+            sName = reader.backend_name();
+
+            while (reader.next(rec)) {
+                records++;
+                bytes += PCAP_RECORD_HEADER_SIZE + rec.caplen;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        //The name reported is the backend actually used after fallback
+        PrintSimpleLogMessage(LEVEL_INFO, "%-6s: %llu records, %llu bytes in %.3f s (%.1f MB/s)",
+                              sName.empty() ? "-" : sName.c_str(), records, bytes, seconds,
+                              seconds > 0 ? bytes / seconds / (1024 * 1024) : 0.0);
+    }
+}
+
+bool pcap_follow_directory (std::string sDir, std::shared_ptr<ProcessingManifest> manifest,
+                            bool bCheckpoint, uint64_t interval) {
+    DirectoryWatcher watcher(sDir);
+    pcrecpp::RE fileSearchRegex(PCAP_FILE_PATTERN);
+    time_t lastCheckpoint = time(NULL);
+
+    if (!watcher.open()) {
+        return false;
+    }
+
+    PrintSimpleLogMessage(LEVEL_INFO, "Following %s", sDir.c_str());
+
+    //Pick up anything written between the initial listing and the watch
+    //being established, the manifest skips files that are up to date.
+    bool bRescan = true;
+
+    while (!g_shutdown) {
+        std::map<std::string, uint32_t> changed;
+
+        if (bRescan) {
+            for (auto pcapFile : pcap_get_dir_listing(sDir, PCAP_FILE_PATTERN, false)) {
+                changed[pcapFile] |= IN_MODIFY;
+            }
+            bRescan = false;
+        }
+
+        if (!watcher.wait(changed.empty() ? interval : 0, changed, bRescan)) {
+            break;
+        }
+
+        //Process files in capture order so flows spanning a rotation
+        //are seen in sequence.
+        std::vector<std::string> pcapList;
+        for (auto& change : changed) {
+            std::string sName = change.first.substr(change.first.rfind('/') + 1);
+            if (fileSearchRegex.FullMatch(sName)) {
+                pcapList.push_back(change.first);
+            }
+        }
+        PCAPSortFiles(pcapList, g_sortOrder);
+
+        for (auto pcapFile : pcapList) {
+            PCAPReader probe(pcapFile);
+            uint64_t offset = 0;
+
+            if (manifest->check(pcapFile, offset) == MANIFEST_SKIP) {
+                continue;
+            }
+
+            //Only uncompressed classic pcap files can be tailed, anything
+            //else is processed once the writer is done with it.
+            bool bTail = (DecompressBackend::GetCompression(pcapFile) == COMPRESSION_NONE) && probe.open();
+            if (!bTail && !(changed[pcapFile] & WATCHER_COMPLETE_MASK)) {
+                continue;
+            }
+
+            try {
+                if (pcap_process_file(pcapFile, offset)) {
+                    manifest->update(pcapFile, offset);
+                }
+            } catch (std::exception& e) {
+                PrintSimpleLogMessage(LEVEL_ERROR, "Exception on %s", pcapFile.c_str());
+            }
+        }
+
+        if (bCheckpoint && time(NULL) - lastCheckpoint >= FOLLOW_CHECKPOINT_INTERVAL_S) {
+            manifest->save();
+            g_connTracker->save_state(manifest->state_path());
+            lastCheckpoint = time(NULL);
+        }
+    }
+
+    PrintSimpleLogMessage(LEVEL_INFO, "Stopped following %s", sDir.c_str());
+    return true;
+}
+
 
 int main (int argc, char* argv[]) {
     InitializeLogging();
@@ -247,8 +607,8 @@ int main (int argc, char* argv[]) {
         .default_value("pcaps");
     
     parser.add_argument(args.output, "--output", "-o")
-        .help("Output file")
-        .default_value("output.txt");
+        .help("Columnar flow output file (disabled if empty)")
+        .default_value("");
 
     parser.add_argument(args.zmq, "--zmq", "-z")
         .help("ZMQ router host string (tcp://ip:port)")
@@ -268,9 +628,94 @@ int main (int argc, char* argv[]) {
         .default_value("1000");
 
     parser.add_argument(args.disable, "--disable")
-        .help("Disable particular analysis (e.g. --disable tcp,udp,icmp")
+        .help("Disable particular analysis (e.g. --disable tcp,udp,icmp,tls")
+        .default_value("");
+
+    parser.add_argument(args.ipfix, "--ipfix")
+        .help("Export IPFIX flow records to a file or collector (e.g. --ipfix udp://127.0.0.1:4739)")
+        .default_value("");
+
+    parser.add_argument(args.ipfix_mtu, "--ipfix-mtu")
+        .help("MTU used to size IPFIX messages")
+        .default_value("1500");
+
+    parser.add_argument(args.start, "--start")
+        .help("Only process packets at or after this time (epoch seconds or YYYY-MM-DD HH:MM:SS)")
         .default_value("");
 
+    parser.add_argument(args.stop, "--stop")
+        .help("Only process packets at or before this time (epoch seconds or YYYY-MM-DD HH:MM:SS)")
+        .default_value("");
+
+    parser.add_argument(args.index, "--index")
+        .help("Build the time index for every PCAP file and exit")
+        .default_value("false")
+        .action(argparse::Action::STORE_TRUE);
+
+    parser.add_argument(args.manifest, "--manifest", "-m")
+        .help("Manifest of processed files; only new files and appended data are processed")
+        .default_value("");
+
+    parser.add_argument(args.follow, "--follow")
+        .help("Keep watching the input directory and process new and growing PCAP files until stopped")
+        .default_value("false")
+        .action(argparse::Action::STORE_TRUE);
+
+    parser.add_argument(args.follow_interval, "--follow-interval")
+        .help("Maximum time to wait for new data in --follow mode, in milliseconds")
+        .default_value("1000");
+
+    parser.add_argument(args.sort, "--sort")
+        .help("Order in which PCAP files are processed (name: rotation sequence, time: first packet)")
+        .default_value("name");
+
+    parser.add_argument(args.recursive, "--recursive", "-r")
+        .help("Search subdirectories of the input directory for PCAP files")
+        .default_value("false")
+        .action(argparse::Action::STORE_TRUE);
+
+    parser.add_argument(args.scan_threads, "--scan-threads")
+        .help("Number of threads listing subdirectories with --recursive")
+        .default_value("8");
+
+    parser.add_argument(args.prefetch, "--prefetch")
+        .help("Number of upcoming PCAP files to read ahead while processing (0 disables)")
+        .default_value("1");
+
+    parser.add_argument(args.io_backend, "--io-backend")
+        .help("How PCAP files are read: pread, mmap or uring (falls back to mmap, then pread)")
+        .default_value("pread");
+
+    parser.add_argument(args.io_bench, "--io-bench")
+        .help("Compare read throughput of the I/O backends on cold-cache PCAP files and exit")
+        .default_value("false")
+        .action(argparse::Action::STORE_TRUE);
+
+    parser.add_argument(args.decompress_threads, "--decompress-threads")
+        .help("Number of threads decompressing independent zstd frames of .pcap.zst files")
+        .default_value("4");
+
+    parser.add_argument(args.filter, "--filter")
+        .help("Only process packets matching a tcpdump style filter expression (e.g. \"not net 10.20.0.0/16\")")
+        .default_value("");
+
+    parser.add_argument(args.snaplen, "--snaplen")
+        .help("Only decode the first N bytes of each packet with libtins (e.g. 128 for L2-L4 headers, 0 decodes everything). DNS and TLS still see the whole captured packet")
+        .default_value("0");
+
+    parser.add_argument(args.dns, "--dns")
+        .help("Pair DNS queries with their responses and send them to the ZMQ host")
+        .default_value("false")
+        .action(argparse::Action::STORE_TRUE);
+
+    parser.add_argument(args.dedup_window, "--dedup-window")
+        .help("Drop copies of a packet seen within N microseconds, e.g. from both directions of a SPAN port (0 disables)")
+        .default_value("0");
+
+    parser.add_argument(args.heavy_hitters, "--heavy-hitters")
+        .help("Send the busiest sources, destinations, ports and flows to the ZMQ host every N seconds of packet time (0 disables)")
+        .default_value("0");
+
     parser.parse_args(argc, argv);
 
     bool bVerbose = args.verbose;
@@ -281,29 +726,182 @@ int main (int argc, char* argv[]) {
     std::string sConfig = args.config;
     uint64_t timeout = args.timeout;
     std::string sDisable = args.disable;
+    std::string sIpfix = args.ipfix;
+    size_t ipfixMtu = args.ipfix_mtu;
+    std::string sStart = args.start;
+    std::string sStop = args.stop;
+    bool bIndexOnly = args.index;
+    std::string sManifest = args.manifest;
+    bool bFollow = args.follow;
+    uint64_t followInterval = args.follow_interval;
+    std::string sSort = args.sort;
+    bool bRecursive = args.recursive;
+    g_scanThreads = args.scan_threads;
+    size_t prefetchDepth = args.prefetch;
+    std::string sIoBackend = args.io_backend;
+    bool bIoBench = args.io_bench;
+    DecompressBackend::SetThreads(args.decompress_threads);
+    std::string sFilter = args.filter;
+    g_decodeSnaplen = args.snaplen;
+    bool bDns = args.dns;
+    uint64_t dedupWindow = args.dedup_window;
+    uint64_t heavyInterval = args.heavy_hitters;
+
+    if (!PCAPGetSortOrder(sSort, g_sortOrder)) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Invalid sort order: %s", sSort.c_str());
+        return 1;
+    }
+    if (!IOBackend::GetType(sIoBackend, g_ioBackend)) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Invalid I/O backend: %s", sIoBackend.c_str());
+        return 1;
+    }
+    if (!sFilter.empty()) {
+        //Validate the expression up front, it's compiled per link type
+        g_packetFilter = std::make_shared<PacketFilter>(sFilter);
+        if (!g_packetFilter->compile(PCAP_LINKTYPE_ETHERNET)) {
+            return 1;
+        }
+        PrintSimpleLogMessage(LEVEL_INFO, "Filter: %s", sFilter.c_str());
+    }
+    if (!sStart.empty() && !string_to_timestamp(sStart, g_windowStartUs)) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Invalid start time: %s", sStart.c_str());
+        return 1;
+    }
+    if (!sStop.empty() && !string_to_timestamp(sStop, g_windowStopUs)) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Invalid stop time: %s", sStop.c_str());
+        return 1;
+    }
 
     g_packetMsgProxy = std::make_shared<PacketMsgProxy>(sZmq);
     g_connTracker = std::make_shared<PacketConnectionTracker>(timeout * 1000, sDisable);
+    if (bDns) {
+        g_dnsAnalyzer = std::make_shared<DNSAnalyzer>(g_packetMsgProxy);
+    }
+    if (heavyInterval != 0) {
+        g_heavyHitters = std::make_shared<HeavyHitters>(g_packetMsgProxy, heavyInterval * 1000000);
+    }
+    if (dedupWindow != 0) {
+        g_packetDedup = std::make_shared<PacketDeduplicator>(dedupWindow);
+    }
+
+    std::shared_ptr<IPFIXExporter> ipfixExporter = nullptr;
+    if (!sIpfix.empty()) {
+        ipfixExporter = IPFIXExporter::Create(sIpfix, ipfixMtu);
+        if (ipfixExporter == nullptr) {
+            PrintSimpleLogMessage(LEVEL_ERROR, "Unable to create IPFIX exporter for %s", sIpfix.c_str());
+            return 1;
+        }
+        g_packetMsgProxy->add_sink(ipfixExporter);
+        PrintSimpleLogMessage(LEVEL_INFO, "IPFIX export: %s", sIpfix.c_str());
+    }
+
+    std::shared_ptr<ColumnarFlowWriter> flowWriter = nullptr;
+    if (!sOutput.empty()) {
+        flowWriter = std::make_shared<ColumnarFlowWriter>(sOutput);
+        if (!flowWriter->open()) {
+            PrintSimpleLogMessage(LEVEL_ERROR, "Unable to open flow output %s", sOutput.c_str());
+            return 1;
+        }
+        g_packetMsgProxy->add_sink(flowWriter);
+        PrintSimpleLogMessage(LEVEL_INFO, "Flow output: %s", sOutput.c_str());
+    }
    
     PrintSimpleLogMessage(LEVEL_INFO, "Input directory: %s", sDir.c_str());
     PrintSimpleLogMessage(LEVEL_INFO, "ZMQ connection string: %s", sZmq.c_str());
     PrintSimpleLogMessage(LEVEL_DEBUG, "Connection timeout: %lu milliseconds", timeout);
 
-    auto pcapList = pcap_get_dir_listing(sDir, ".*\\.pcap.*");
+    auto pcapList = pcap_get_dir_listing(sDir, PCAP_FILE_PATTERN, bRecursive);
     PrintSimpleLogMessage(LEVEL_DEBUG, "Processing %u PCAP files", pcapList.size());
 
     //Sort including proper handling of the number at the end
     //of some of the pcap files.
-    std::sort(pcapList.begin(), pcapList.end(), CAPNumericalCompare());
+    PCAPSortFiles(pcapList, g_sortOrder);
+
+    if (bIoBench) {
+        pcap_io_benchmark(pcapList);
+        return 0;
+    }
+
+    if (bIndexOnly) {
+        for (auto pcapFile : pcapList) {
+            PCAPIndex::Build(pcapFile);
+        }
+        return 0;
+    }
+
+    std::shared_ptr<ProcessingManifest> manifest = nullptr;
+    if (!sManifest.empty()) {
+        manifest = std::make_shared<ProcessingManifest>(sManifest);
+        if (manifest->load()) {
+            PrintSimpleLogMessage(LEVEL_INFO, "Manifest %s: %u files already processed",
+                                  sManifest.c_str(), manifest->size());
+
+            //--flush starts with an empty connection table
+            if (!bFlushTable && g_connTracker->load_state(manifest->state_path())) {
+                PrintSimpleLogMessage(LEVEL_INFO, "Restored tracker state from %s",
+                                      manifest->state_path().c_str());
+            }
+        }
+    }
+
+    //Following needs to know how far each file has been read even
+    //without a persistent manifest.
+    if (bFollow && manifest == nullptr) {
+        manifest = std::make_shared<ProcessingManifest>("");
+    }
+
+    //Keeps the next files warm in the page cache while the current one
+    //is being tracked.
+    FilePrefetcher prefetcher(prefetchDepth);
+    prefetcher.start(pcapList);
+
+    for (size_t i = 0; i < pcapList.size(); i++) {
+        std::string pcapFile = pcapList[i];
+        uint64_t offset = 0;
+
+        if (g_shutdown) {
+            break;
+        }
+
+        prefetcher.advance(i);
+
+        if (manifest != nullptr &&
+            manifest->check(pcapFile, offset) == MANIFEST_SKIP) {
+            continue;
+        }
 
-    for (auto pcapFile : pcapList) {
         try {
-            pcap_process_file(pcapFile, sOutput);   
+            if (pcap_process_file(pcapFile, offset) && manifest != nullptr) {
+                manifest->update(pcapFile, offset);
+            }
         } catch (std::exception& e) {
             PrintSimpleLogMessage(LEVEL_ERROR, "Exception on %s", pcapFile.c_str());
         }        
     }
 
+    prefetcher.stop();
+    PrintSimpleLogMessage(LEVEL_DEBUG, "Prefetched %llu bytes from %llu files",
+                          prefetcher.get_bytes(), prefetcher.get_files());
+
+    if (bFollow) {
+        pcap_follow_directory(sDir, manifest, !sManifest.empty(), followInterval);
+    }
+
+    if (!sManifest.empty()) {
+        manifest->save();
+        g_connTracker->save_state(manifest->state_path());
+    }
+
+    //Connections pruned after the last file are still buffered by the sinks
+    if (g_dnsAnalyzer != nullptr) {
+        g_dnsAnalyzer->flush(true);
+    }
+    if (g_heavyHitters != nullptr) {
+        g_heavyHitters->flush();
+    }
+    TCPTracker::GetStaticInstance(timeout)->flush_scans();
+    g_packetMsgProxy->sync();
+
     PrintSimpleLogMessage(LEVEL_DEBUG, "Total packets: %llu", g_connTracker->packet_count());
     PrintSimpleLogMessage(LEVEL_DEBUG, "TCP connections : %-8llu opened, %-8llu closed (timeout %lu milliseconds)",
                           TCPTracker::GetStaticInstance(timeout)->get_opened(),
@@ -318,6 +916,55 @@ int main (int argc, char* argv[]) {
                           ICMPTracker::GetStaticInstance(timeout)->get_closed(),
                           timeout);
     
+    PrintSimpleLogMessage(LEVEL_DEBUG, "Fragments       : %-8llu seen, %-8llu attributed, %llu lost, %llu evicted",
+                          g_connTracker->fragments().get_fragments(),
+                          g_connTracker->fragments().get_attributed(),
+                          g_connTracker->fragments().get_lost(),
+                          g_connTracker->fragments().get_evicted());
+    PrintSimpleLogMessage(LEVEL_DEBUG, "TLS             : %-8llu hellos, %llu reassembled",
+                          TCPTracker::GetStaticInstance(timeout)->tls().get_hellos(),
+                          TCPTracker::GetStaticInstance(timeout)->tls().get_reassembled());
+    PrintSimpleLogMessage(LEVEL_DEBUG, "SYN scans       : %-8llu half-open, %-8llu answered, %llu sources reported, %llu lookups skipped",
+                          TCPTracker::GetStaticInstance(timeout)->scans().get_half_open(),
+                          TCPTracker::GetStaticInstance(timeout)->scans().get_answered(),
+                          TCPTracker::GetStaticInstance(timeout)->scans().get_reported(),
+                          TCPTracker::GetStaticInstance(timeout)->get_filtered());
+    if (g_packetDedup != nullptr) {
+        uint64_t packets = g_packetDedup->get_packets();
+        uint64_t duplicates = g_packetDedup->get_duplicates();
+        PrintSimpleLogMessage(LEVEL_DEBUG, "Dedup           : %-8llu packets, %-8llu duplicates (%.2f%%), %.1f ns/packet",
+                              packets, duplicates,
+                              packets ? 100.0 * duplicates / packets : 0.0,
+                              g_packetDedup->get_ns_per_packet());
+    }
+    if (g_dnsAnalyzer != nullptr) {
+        PrintSimpleLogMessage(LEVEL_DEBUG, "DNS             : %-8llu queries, %-8llu responses, %llu malformed",
+                              g_dnsAnalyzer->get_queries(),
+                              g_dnsAnalyzer->get_responses(),
+                              g_dnsAnalyzer->get_malformed());
+    }
+    if (g_heavyHitters != nullptr) {
+        PrintSimpleLogMessage(LEVEL_DEBUG, "Heavy hitters   : %-8llu snapshots",
+                              g_heavyHitters->get_snapshots());
+    }
+    if (g_packetFilter != nullptr) {
+        PrintSimpleLogMessage(LEVEL_DEBUG, "Filter          : %-8llu accepted, %llu rejected",
+                              g_packetFilter->get_accepted(),
+                              g_packetFilter->get_rejected());
+    }
+    if (flowWriter != nullptr) {
+        //Writes the final block and the footer index
+        flowWriter->close();
+        PrintSimpleLogMessage(LEVEL_DEBUG, "Flow output     : %-8llu rows in %llu blocks",
+                              flowWriter->get_rows(),
+                              flowWriter->get_blocks());
+    }
+    if (ipfixExporter != nullptr) {
+        PrintSimpleLogMessage(LEVEL_DEBUG, "IPFIX export    : %-8llu records in %llu messages",
+                              ipfixExporter->get_records(),
+                              ipfixExporter->get_messages());
+    }
+    
     auto startTime = timestamp_to_string(g_startTime, g_startTimeUs);
     auto stopTime = timestamp_to_string(g_stopTime, g_stopTimeUs);
     PrintSimpleLogMessage(LEVEL_DEBUG, (std::string("Start Time : ") + startTime).c_str());
@@ -0,0 +1,95 @@
+/**@file PCAPSorter.cpp
+ */
+//=============================================================================
+//INCLUDES
+//=============================================================================
+#include "PCAPSorter.h"
+#include "PCAPReader.h"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+//=============================================================================
+//IMPLEMENTATION
+//=============================================================================
+PCAPSortKey_T PCAPGetSortKey (const std::string& sFile, const char* pMarker) {
+    PCAPSortKey_T key;
+    size_t markerLen = strlen(pMarker);
+
+    key.sequence = 0;
+    key.timestamp_us = 0;
+    key.index = 0;
+
+    size_t pos = sFile.rfind(pMarker);
+    if (pos == std::string::npos) {
+        key.prefix = sFile;
+        return key;
+    }
+
+    key.prefix = sFile.substr(0, pos + markerLen);
+
+    //Only a purely numeric suffix is a sequence number
+    const char* p = sFile.c_str() + pos + markerLen;
+    uint64_t sequence = 0;
+    bool bDigits = (*p != '\0');
+    for (; *p != '\0'; p++) {
+        if (*p < '0' || *p > '9') {
+            bDigits = false;
+            break;
+        }
+        sequence = sequence * 10 + (*p - '0');
+    }
+
+    if (bDigits) {
+        key.sequence = sequence;
+    }
+
+    return key;
+}
+
+void PCAPSortFiles (std::vector<std::string>& files, PCAPSortOrder_T order) {
+    std::vector<PCAPSortKey_T> keys;
+    std::vector<std::string> sorted;
+
+    keys.reserve(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        PCAPSortKey_T key = PCAPGetSortKey(files[i], "cap");
+        key.index = i;
+
+        if (order == PCAP_SORT_TIME &&
+            !PCAPReader::ReadFirstTimestamp(files[i], key.timestamp_us)) {
+            struct stat fs;
+            if (stat(files[i].c_str(), &fs) == 0) {
+                key.timestamp_us = (uint64_t)fs.st_mtime * 1000000;
+            }
+        }
+
+        keys.push_back(key);
+    }
+
+    if (order == PCAP_SORT_TIME) {
+        std::sort(keys.begin(), keys.end(), PCAPSortKeyTimeCompare());
+    } else {
+        std::sort(keys.begin(), keys.end(), PCAPSortKeyCompare());
+    }
+
+    sorted.reserve(files.size());
+    for (auto& key : keys) {
+        sorted.push_back(std::move(files[key.index]));
+    }
+    files.swap(sorted);
+}
+
+bool PCAPGetSortOrder (const std::string& sName, PCAPSortOrder_T& order) {
+    if (sName == "name") {
+        order = PCAP_SORT_NAME;
+    } else if (sName == "time") {
+        order = PCAP_SORT_TIME;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//=============================================================================
@@ -5,85 +5,106 @@
 //=============================================================================
 //INCLUDES
 //=============================================================================
+#include <stdint.h>
 #include <string>
-#include <pcrecpp.h>
-#include <algorithm>
-#include <string.h>
-#include <stdio.h>
+#include <vector>
 
 //=============================================================================
 //DEFINITIONS
 //=============================================================================
-class CAPNumericalCompare {
-public:
-    template <class Type1, class Type2>
-    inline bool operator() (const Type1& a, const Type2 &b) {
-        char temp[128];
-        std::string &a1 = (std::string&)a;
-        std::string &b1 = (std::string&)b;
-        std::string a2;
-        std::string b2;
-        pcrecpp::RE re(".*cap(\\d+)");
-        pcrecpp::RE re2("(.*cap).*");
-        int i=-1;
-        int j=-1;
+/**
+ * How capture files are ordered before processing.
+ */
+typedef enum {
+    PCAP_SORT_NAME = 0,     //Prefix, then rotation sequence number
+    PCAP_SORT_TIME = 1      //First record timestamp, then name
+} PCAPSortOrder_T;
 
-        re2.FullMatch(a1, &a2);
-        re2.FullMatch(b1, &b2);
+/**
+ * Sort key extracted once per file.
+ *
+ * Rotated captures are named <prefix>cap<sequence> (e.g. br1.pcap,
+ * br1.pcap1, br1.pcap12). The prefix is everything up to and
+ * including the last occurrence of the marker, the sequence number
+ * is the trailing number (0 if absent).
+ */
+typedef struct {
+    std::string prefix;
+    uint64_t sequence;
+    uint64_t timestamp_us;
+    size_t index;
+} PCAPSortKey_T;
 
-        if (!re.FullMatch(a1, &i)) {
-            i=0;
-        }
-        if (!re.FullMatch(b1, &j)) {
-            j=0;
-        }
+/**
+ * Builds the name part of a sort key.
+ *
+ * @param sFile File name or path.
+ * @param pMarker Marker preceding the sequence number ("cap", "pcap").
+ * @return PCAPSortKey_T Key (timestamp_us and index are zero).
+ */
+PCAPSortKey_T PCAPGetSortKey (const std::string& sFile, const char* pMarker);
 
-        sprintf(temp, "%08d", i);
-        a2 += std::string(temp);
+/**
+ * Sorts a file listing in place.
+ *
+ * Keys are extracted once per file, so sorting costs a single pass
+ * over the names (and for PCAP_SORT_TIME, one small read per file).
+ * Files without a readable first record are ordered by mtime.
+ *
+ * @param files Listing to sort.
+ * @param order Sort order.
+ */
+void PCAPSortFiles (std::vector<std::string>& files, PCAPSortOrder_T order);
+
+/**
+ * Parses a sort order name ("name" or "time").
+ *
+ * @return bool false if the name is unknown.
+ */
+bool PCAPGetSortOrder (const std::string& sName, PCAPSortOrder_T& order);
 
-        sprintf(temp, "%08d", j);
-        b2 += std::string(temp);
-     
-        bool lt = std::less<std::string>()(a2,b2);
-        
-        return lt;
+/**
+ * Orders keys by prefix, then sequence number.
+ */
+class PCAPSortKeyCompare {
+public:
+    inline bool operator() (const PCAPSortKey_T& a, const PCAPSortKey_T& b) const {
+        int cmp = a.prefix.compare(b.prefix);
+        if (cmp != 0) {
+            return cmp < 0;
+        }
+        return a.sequence < b.sequence;
     }
 };
 
-
-class PCAPNumericalCompare {
+/**
+ * Orders keys by timestamp, then by name.
+ */
+class PCAPSortKeyTimeCompare {
 public:
-    template <class Type1, class Type2>
-    inline bool operator() (const Type1& a, const Type2 &b) {
-        char temp[128];
-        std::string &a1 = (std::string&)a;
-        std::string &b1 = (std::string&)b;
-        std::string a2;
-        std::string b2;
-        pcrecpp::RE re(".*pcap(\\d+)");
-        pcrecpp::RE re2("(.*pcap).*");
-        int i=-1;
-        int j=-1;
-
-        re2.FullMatch(a1, &a2);
-        re2.FullMatch(b1, &b2);
-
-        if (!re.FullMatch(a1, &i)) {
-            i=0;
-        }
-        if (!re.FullMatch(b1, &j)) {
-            j=0;
+    inline bool operator() (const PCAPSortKey_T& a, const PCAPSortKey_T& b) const {
+        if (a.timestamp_us != b.timestamp_us) {
+            return a.timestamp_us < b.timestamp_us;
         }
+        return PCAPSortKeyCompare()(a, b);
+    }
+};
 
-        sprintf(temp, "%08d", i);
-        a2 += std::string(temp);
+/**
+ * Compares file names directly. Prefer PCAPSortFiles() for large
+ * listings, which extracts each key once instead of per comparison.
+ */
+class CAPNumericalCompare {
+public:
+    inline bool operator() (const std::string& a, const std::string& b) const {
+        return PCAPSortKeyCompare()(PCAPGetSortKey(a, "cap"), PCAPGetSortKey(b, "cap"));
+    }
+};
 
-        sprintf(temp, "%08d", j);
-        b2 += std::string(temp);
-     
-        bool lt = std::less<std::string>()(a2,b2);
-        
-        return lt;
+class PCAPNumericalCompare {
+public:
+    inline bool operator() (const std::string& a, const std::string& b) const {
+        return PCAPSortKeyCompare()(PCAPGetSortKey(a, "pcap"), PCAPGetSortKey(b, "pcap"));
     }
 };
 
@@ -15,7 +15,8 @@
 // IMPLEMENTATION
 //=============================================================================
 PacketMsgProxy::PacketMsgProxy (std::string sConnectStr) :
-    MsgProxy(sConnectStr, MSG_PROXY_TCP, ZMQ_REQ)
+    MsgProxy(sConnectStr, MSG_PROXY_TCP, ZMQ_REQ),
+    m_sinks()
 {
 }
 
@@ -29,10 +30,20 @@ bool PacketMsgProxy::on_end_connection (
     bool retValue = false;
     pcap_analyzer::GenericMessage gmsg;
 
+    for (auto& sink : m_sinks) {
+        sink->on_flow_end(meta);
+    }
+
     pcap_analyzer::ConnectionCloseNotify notifyBuf;
     notifyBuf.set_hash(meta->hash);
     notifyBuf.set_timestamp_s(meta->timestamp_s);
     notifyBuf.set_timestamp_us(meta->timestamp_us);
+    if (!meta->sni.empty()) {
+        notifyBuf.set_sni(meta->sni);
+    }
+    if (!meta->ja3.empty()) {
+        notifyBuf.set_ja3(meta->ja3);
+    }
     std::string s = notifyBuf.SerializeAsString();
     size_t msgSize = s.size();
 
@@ -67,6 +78,10 @@ bool PacketMsgProxy::on_connection (
     bool retValue = false;
     pcap_analyzer::GenericMessage gmsg;
 
+    for (auto& sink : m_sinks) {
+        sink->on_flow_start(meta);
+    }
+
     pcap_analyzer::ConnectionNotify notifyBuf;
     notifyBuf.set_hash(meta->hash);
     notifyBuf.set_timestamp_s(meta->timestamp_s);
@@ -107,10 +122,196 @@ Exit:
     return retValue;
 }
 
+bool PacketMsgProxy::on_dns_batch (
+    const std::vector<DNSRecord_T>& records,
+    const DNSNameTable& names
+) {
+    bool retValue = false;
+    pcap_analyzer::GenericMessage gmsg;
+    pcap_analyzer::DNSBatch batchBuf;
+
+    for (auto& record : records) {
+        pcap_analyzer::DNSRecord* pRecord = batchBuf.add_records();
+        pRecord->set_query_s(record.query_us / 1000000);
+        pRecord->set_query_us(record.query_us % 1000000);
+        if (record.response_us != 0) {
+            pRecord->set_response_s(record.response_us / 1000000);
+            pRecord->set_response_us(record.response_us % 1000000);
+            pRecord->set_rcode(record.rcode);
+        }
+        pRecord->set_client(FlowAddressToString(record.key.src));
+        pRecord->set_server(FlowAddressToString(record.key.dst));
+        pRecord->set_client_port(record.key.sport);
+        pRecord->set_server_port(record.key.dport);
+        pRecord->set_vlan(record.key.vlan);
+        pRecord->set_txid(record.txid);
+        pRecord->set_qname(names.str(record.qname));
+        pRecord->set_qtype(record.qtype);
+
+        for (size_t i = 0; i < record.answer_count; i++) {
+            const DNSAnswer_T& answer = record.answers[i];
+            pcap_analyzer::DNSAnswer* pAnswer = pRecord->add_answers();
+            pAnswer->set_type(answer.type);
+            pAnswer->set_ttl(answer.ttl);
+            if (answer.type == DNS_TYPE_CNAME) {
+                pAnswer->set_data(names.str(answer.name));
+            } else {
+                pAnswer->set_data(FlowAddressToString(answer.addr));
+            }
+        }
+    }
+
+    gmsg.set_data(batchBuf.SerializeAsString());
+    gmsg.set_msgtype(pcap_analyzer::GenericMessage_MsgType_DNS_BATCH);
+    std::string s2 = gmsg.SerializeAsString();
+
+    if (!sendMessage((void*)s2.c_str(), s2.size())) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Unable to send packet");
+    } else {
+        void* msgData = NULL;
+
+        //Now receive a reply
+        if (!receiveMessageAlloc(&msgData)) {
+            PrintSimpleLogMessage(LEVEL_ERROR, "Unable to receive message");
+        }
+
+        if (msgData) {
+            free(msgData);
+        }
+
+        retValue = true;
+    }
+
+    return retValue;
+}
+
+bool PacketMsgProxy::on_heavy_hitters (
+    const HeavyWindow_T& window,
+    const std::vector<HeavyHitter_T>& hitters
+) {
+    bool retValue = false;
+    pcap_analyzer::GenericMessage gmsg;
+    pcap_analyzer::HeavyHitterSnapshot snapshotBuf;
+
+    snapshotBuf.set_start_s(window.start_us / 1000000);
+    snapshotBuf.set_start_us(window.start_us % 1000000);
+    snapshotBuf.set_end_s(window.end_us / 1000000);
+    snapshotBuf.set_end_us(window.end_us % 1000000);
+    snapshotBuf.set_packets(window.packets);
+    snapshotBuf.set_distinct_src(window.distinct_src);
+    snapshotBuf.set_distinct_dst(window.distinct_dst);
+
+    for (auto& hitter : hitters) {
+        const FlowKey_T& key = hitter.entry.key;
+        pcap_analyzer::HeavyHitter* pHitter = snapshotBuf.add_hitters();
+        pHitter->set_dimension(hitter.dimension);
+        pHitter->set_metric(hitter.metric);
+        pHitter->set_count(hitter.entry.count);
+        pHitter->set_error(hitter.entry.error);
+
+        //Only the fields the dimension keeps are sent
+        if (hitter.dimension == HEAVY_SRC || hitter.dimension == HEAVY_FLOW) {
+            pHitter->set_src(FlowAddressToString(key.src));
+        }
+        if (hitter.dimension == HEAVY_DST || hitter.dimension == HEAVY_FLOW) {
+            pHitter->set_dst(FlowAddressToString(key.dst));
+        }
+        if (hitter.dimension == HEAVY_DPORT || hitter.dimension == HEAVY_FLOW) {
+            pHitter->set_dport(key.dport);
+            pHitter->set_protocol(key.protocol);
+        }
+        if (hitter.dimension == HEAVY_FLOW) {
+            pHitter->set_sport(key.sport);
+        }
+        if (hitter.dimension != HEAVY_DPORT) {
+            pHitter->set_vlan(key.vlan);
+        }
+        if (hitter.distinct != 0) {
+            pHitter->set_distinct(hitter.distinct);
+        }
+    }
+
+    gmsg.set_data(snapshotBuf.SerializeAsString());
+    gmsg.set_msgtype(pcap_analyzer::GenericMessage_MsgType_HEAVY_HITTERS);
+    std::string s2 = gmsg.SerializeAsString();
+
+    if (!sendMessage((void*)s2.c_str(), s2.size())) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Unable to send packet");
+    } else {
+        void* msgData = NULL;
+
+        //Now receive a reply
+        if (!receiveMessageAlloc(&msgData)) {
+            PrintSimpleLogMessage(LEVEL_ERROR, "Unable to receive message");
+        }
+
+        if (msgData) {
+            free(msgData);
+        }
+
+        retValue = true;
+    }
+
+    return retValue;
+}
+
+bool PacketMsgProxy::on_scan_report (
+    const ScanWindow_T& window,
+    const std::vector<ScanSource_T>& sources
+) {
+    bool retValue = false;
+    pcap_analyzer::GenericMessage gmsg;
+    pcap_analyzer::ScanReport reportBuf;
+
+    reportBuf.set_start_s(window.start_us / 1000000);
+    reportBuf.set_start_us(window.start_us % 1000000);
+    reportBuf.set_end_s(window.end_us / 1000000);
+    reportBuf.set_end_us(window.end_us % 1000000);
+    reportBuf.set_half_open(window.half_open);
+    if (window.untracked != 0) {
+        reportBuf.set_untracked(window.untracked);
+    }
+
+    for (auto& source : sources) {
+        pcap_analyzer::ScanSource* pSource = reportBuf.add_sources();
+        pSource->set_src(FlowAddressToString(source.src));
+        pSource->set_vlan(source.vlan);
+        pSource->set_syns(source.syns);
+        pSource->set_unanswered(source.syns - source.answered);
+    }
+
+    gmsg.set_data(reportBuf.SerializeAsString());
+    gmsg.set_msgtype(pcap_analyzer::GenericMessage_MsgType_SCAN_REPORT);
+    std::string s2 = gmsg.SerializeAsString();
+
+    if (!sendMessage((void*)s2.c_str(), s2.size())) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Unable to send packet");
+    } else {
+        void* msgData = NULL;
+
+        //Now receive a reply
+        if (!receiveMessageAlloc(&msgData)) {
+            PrintSimpleLogMessage(LEVEL_ERROR, "Unable to receive message");
+        }
+
+        if (msgData) {
+            free(msgData);
+        }
+
+        retValue = true;
+    }
+
+    return retValue;
+}
+
 void PacketMsgProxy::sync (void) {
     bool retValue = false;
     pcap_analyzer::GenericMessage gmsg;
 
+    for (auto& sink : m_sinks) {
+        sink->flush();
+    }
+
     gmsg.set_data("");
     gmsg.set_msgtype(pcap_analyzer::GenericMessage_MsgType_SYNC);
     std::string s2 = gmsg.SerializeAsString();
@@ -132,4 +333,10 @@ void PacketMsgProxy::sync (void) {
     }
 }
 
+void PacketMsgProxy::add_sink (std::shared_ptr<FlowSinkInterface> sink) {
+    if (sink != nullptr) {
+        m_sinks.push_back(sink);
+    }
+}
+
 //=============================================================================
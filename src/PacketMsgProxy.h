@@ -7,8 +7,14 @@
 //=============================================================================
 #include "MsgProxy.h"
 #include "PacketConnectionTracker.h"
+#include "FlowSinkInterface.h"
+#include "DNSAnalyzer.h"
+#include "HeavyHitters.h"
+#include "ScanMonitor.h"
 #include <string>
 #include <stdint.h>
+#include <memory>
+#include <vector>
 
 //=============================================================================
 // DEFINITIONS
@@ -37,8 +43,54 @@ public:
         const ConnectionMetadata* meta
     );
 
+    /**
+     * Sends DNS transactions to the ZMQ host in a single message. 
+     *  
+     * @param records Transactions, names interned in names. 
+     * @param names Name table of the DNS analyzer. 
+     * @return bool 
+     */
+    virtual bool on_dns_batch (
+        const std::vector<DNSRecord_T>& records,
+        const DNSNameTable& names
+    );
+
+    /**
+     * Sends the heaviest keys of a window to the ZMQ host. 
+     *  
+     * @param window Time span and totals of the window. 
+     * @param hitters Top keys of every ranking. 
+     * @return bool 
+     */
+    virtual bool on_heavy_hitters (
+        const HeavyWindow_T& window,
+        const std::vector<HeavyHitter_T>& hitters
+    );
+
+    /**
+     * Sends the sources with the most unanswered SYNs of a generation 
+     * to the ZMQ host. 
+     *  
+     * @param window Time span and totals of the generation. 
+     * @param sources Reported sources. 
+     * @return bool 
+     */
+    virtual bool on_scan_report (
+        const ScanWindow_T& window,
+        const std::vector<ScanSource_T>& sources
+    );
+
     virtual void sync (void);
 
+    /**
+     * Registers an additional flow sink. Every connection 
+     * notification sent to the ZMQ host is also passed to each 
+     * registered sink, and sync() flushes the sinks. 
+     *  
+     * @param sink Flow sink.
+     */
+    virtual void add_sink (std::shared_ptr<FlowSinkInterface> sink);
+
     /**
      * Notifies the ZMQ host that a connection has ended. 
      *  
@@ -54,6 +106,9 @@ public:
         std::string hash
     );
     #endif
+
+protected:
+    std::vector<std::shared_ptr<FlowSinkInterface>> m_sinks;
 };
 
 //=============================================================================
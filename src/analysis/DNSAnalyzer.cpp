@@ -1 +1,466 @@
+/**@file DNSAnalyzer.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "DNSAnalyzer.h"
+#include "PacketMsgProxy.h"
+#include "Logging.h"
+#include <string.h>
 
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define DNS_FLAG_RESPONSE       (0x8000)
+#define DNS_OPCODE(flags)       (((flags) >> 11) & 0x0F)
+#define DNS_RCODE(flags)        ((flags) & 0x0F)
+
+//Initial size of the name index, a power of two
+#define DNS_NAME_SLOTS          (1024)
+
+static_assert((DNS_PENDING_SIZE & (DNS_PENDING_SIZE - 1)) == 0, "the pending pool must be a power of two");
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+static inline uint16_t read16 (const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t read32 (const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint32_t hash_name (const char* pName, uint32_t len) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)pName[i]) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Decodes a possibly compressed name into dotted, lowercase form.
+ *
+ * Every pointer has to point before the previous one, which bounds the
+ * number of jumps by the message length.
+ *
+ * @param pMsg DNS message.
+ * @param len Length of the message.
+ * @param offset Start of the name, moved past it.
+ * @param pOut Populated with the name, at least DNS_MAX_NAME + 1 bytes,
+ *             or NULL to only skip the name.
+ * @param outLen Populated with the length of the name.
+ * @return bool false if the name is truncated or malformed.
+ */
+static bool read_name (const uint8_t* pMsg, uint32_t len, uint32_t& offset,
+                       char* pOut, uint32_t& outLen) {
+    uint32_t pos = offset;
+    uint32_t limit = offset;
+    bool bJumped = false;
+
+    outLen = 0;
+    for (;;) {
+        if (pos >= len) {
+            return false;
+        }
+
+        uint8_t label = pMsg[pos];
+        if ((label & 0xC0) == 0xC0) {
+            if (pos + 1 >= len) {
+                return false;
+            }
+            uint32_t target = ((uint32_t)(label & 0x3F) << 8) | pMsg[pos + 1];
+            if (target >= limit) {
+                return false;
+            }
+            if (!bJumped) {
+                offset = pos + 2;
+                bJumped = true;
+            }
+            limit = target;
+            pos = target;
+            continue;
+        }
+        if (label & 0xC0) {
+            //Extended label types were never deployed
+            return false;
+        }
+        if (label == 0) {
+            if (!bJumped) {
+                offset = pos + 1;
+            }
+            return true;
+        }
+
+        uint32_t sepLen = (outLen != 0) ? 1 : 0;
+        if (pos + 1 + label > len || outLen + sepLen + label > DNS_MAX_NAME) {
+            return false;
+        }
+        if (pOut) {
+            if (sepLen) {
+                pOut[outLen] = '.';
+            }
+            for (uint32_t i = 0; i < label; i++) {
+                char c = (char)pMsg[pos + 1 + i];
+                pOut[outLen + sepLen + i] = (c >= 'A' && c <= 'Z') ? (c + ('a' - 'A')) : c;
+            }
+        }
+        outLen += sepLen + label;
+        pos += 1 + label;
+    }
+}
+
+DNSNameTable::DNSNameTable (void)
+  : m_blocks(),
+    m_blockUsed(0),
+    m_names(),
+    m_slots(DNS_NAME_SLOTS)
+{
+    memset(m_slots.data(), 0, m_slots.size() * sizeof(DNSNameSlot_T));
+}
+
+DNSName_T DNSNameTable::intern (const char* pName, uint32_t len) {
+    uint32_t h = hash_name(pName, len);
+    size_t mask = m_slots.size() - 1;
+
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        DNSNameSlot_T& slot = m_slots[i];
+        if (slot.name == 0) {
+            break;
+        }
+        if (slot.hash == h) {
+            const char* pStored = m_names[slot.name - 1];
+            if ((uint8_t)pStored[0] == len && memcmp(pStored + 1, pName, len) == 0) {
+                return slot.name;
+            }
+        }
+    }
+
+    //Kept at most half full so probes stay short
+    if ((m_names.size() + 1) * 2 > m_slots.size()) {
+        grow();
+        mask = m_slots.size() - 1;
+    }
+
+    if (m_blocks.empty() || m_blockUsed + len + 1 > DNS_ARENA_BLOCK) {
+        m_blocks.emplace_back(new char[DNS_ARENA_BLOCK]);
+        m_blockUsed = 0;
+    }
+    char* pStored = m_blocks.back().get() + m_blockUsed;
+    pStored[0] = (char)len;
+    memcpy(pStored + 1, pName, len);
+    m_blockUsed += len + 1;
+
+    m_names.push_back(pStored);
+    DNSName_T name = (DNSName_T)m_names.size();
+
+    size_t i = h & mask;
+    while (m_slots[i].name != 0) {
+        i = (i + 1) & mask;
+    }
+    m_slots[i].hash = h;
+    m_slots[i].name = name;
+    return name;
+}
+
+void DNSNameTable::grow (void) {
+    std::vector<DNSNameSlot_T> slots(m_slots.size() * 2);
+    size_t mask = slots.size() - 1;
+
+    memset(slots.data(), 0, slots.size() * sizeof(DNSNameSlot_T));
+    for (auto& slot : m_slots) {
+        if (slot.name == 0) {
+            continue;
+        }
+        size_t i = slot.hash & mask;
+        while (slots[i].name != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+    m_slots.swap(slots);
+}
+
+std::string DNSNameTable::str (DNSName_T name) const {
+    if (name == 0 || name > m_names.size()) {
+        return std::string();
+    }
+    const char* pStored = m_names[name - 1];
+    return std::string(pStored + 1, (uint8_t)pStored[0]);
+}
+
+size_t DNSNameTable::size (void) const {
+    return m_blocks.size() * DNS_ARENA_BLOCK +
+           m_names.capacity() * sizeof(const char*) +
+           m_slots.size() * sizeof(DNSNameSlot_T);
+}
+
+void DNSNameTable::clear (void) {
+    m_blocks.clear();
+    m_blockUsed = 0;
+    m_names.clear();
+    m_slots.assign(DNS_NAME_SLOTS, DNSNameSlot_T());
+}
+
+DNSAnalyzer::DNSAnalyzer (std::shared_ptr<PacketMsgProxy> proxy)
+  : m_proxy(proxy),
+    m_names(),
+    m_pending(DNS_PENDING_SIZE),
+    m_batch(),
+    m_sweep(0),
+    m_queries(0),
+    m_responses(0),
+    m_malformed(0)
+{
+    memset(m_pending.data(), 0, m_pending.size() * sizeof(DNSPending_T));
+    m_batch.reserve(DNS_BATCH_SIZE);
+}
+
+void DNSAnalyzer::on_packet (const uint8_t* pData, uint32_t len, uint16_t vlan, uint64_t timestamp_us) {
+    const uint8_t* pL4 = NULL;
+    uint32_t l4Len = 0;
+    FlowKey_T key;
+
+    if (!FlowKeyParse(pData, len, key, &pL4, l4Len) || key.protocol != 17 || l4Len < 8 ||
+        (key.sport != DNS_PORT && key.dport != DNS_PORT)) {
+        return;
+    }
+
+    uint16_t udpLen = read16(pL4 + 4);
+    if (udpLen >= 8 && udpLen < l4Len) {
+        l4Len = udpLen;
+    }
+
+    key.vlan = vlan;
+    on_message(key, pL4 + 8, l4Len - 8, timestamp_us);
+}
+
+void DNSAnalyzer::on_message (const FlowKey_T& key, const uint8_t* pMsg, uint32_t len, uint64_t timestamp_us) {
+    char name[DNS_MAX_NAME + 1];
+    uint32_t nameLen = 0;
+    uint32_t offset = DNS_HEADER_SIZE;
+
+    //Pending queries hold name IDs, so they go out before the names
+    //are dropped
+    if (m_names.size() > DNS_ARENA_LIMIT) {
+        flush(false);
+    }
+
+    for (size_t i = 0; i < DNS_SWEEP_STEP; i++) {
+        DNSPending_T& pending = m_pending[m_sweep];
+        m_sweep = (m_sweep + 1) & (DNS_PENDING_SIZE - 1);
+        if (pending.used && pending.query_us + DNS_TIMEOUT_US <= timestamp_us) {
+            expire(pending);
+        }
+    }
+
+    if (len < DNS_HEADER_SIZE) {
+        m_malformed++;
+        return;
+    }
+
+    uint16_t txid = read16(pMsg);
+    uint16_t flags = read16(pMsg + 2);
+    uint16_t qdcount = read16(pMsg + 4);
+    if (DNS_OPCODE(flags) != 0 || qdcount == 0) {
+        return;
+    }
+
+    if (!read_name(pMsg, len, offset, name, nameLen) || offset + 4 > len) {
+        m_malformed++;
+        return;
+    }
+    DNSName_T qname = m_names.intern(name, nameLen);
+    uint16_t qtype = read16(pMsg + offset);
+    offset += 4;
+
+    if (!(flags & DNS_FLAG_RESPONSE)) {
+        m_queries++;
+
+        //Retransmissions keep the time of the first query
+        if (!find_pending(key, txid)) {
+            DNSPending_T* pPending = claim_pending(key, txid, timestamp_us);
+            pPending->qname = qname;
+            pPending->qtype = qtype;
+        }
+        return;
+    }
+
+    m_responses++;
+
+    DNSRecord_T record;
+    memset(&record, 0, sizeof(record));
+
+    FlowKey_T queryKey = FlowKeyReverse(key);
+    DNSPending_T* pPending = find_pending(queryKey, txid);
+    if (pPending) {
+        record.query_us = pPending->query_us;
+        pPending->used = 0;
+    }
+    record.key = queryKey;
+    record.response_us = timestamp_us;
+    record.qname = qname;
+    record.txid = txid;
+    record.qtype = qtype;
+    record.rcode = DNS_RCODE(flags);
+
+    for (uint16_t i = 1; i < qdcount; i++) {
+        if (!read_name(pMsg, len, offset, NULL, nameLen) || offset + 4 > len) {
+            emit(record);
+            return;
+        }
+        offset += 4;
+    }
+
+    on_response(pMsg, len, offset, record);
+    emit(record);
+}
+
+void DNSAnalyzer::on_response (const uint8_t* pMsg, uint32_t len, uint32_t offset, DNSRecord_T& record) {
+    char name[DNS_MAX_NAME + 1];
+    uint32_t nameLen = 0;
+    uint16_t ancount = read16(pMsg + 6);
+
+    //A truncated response keeps the answers decoded so far
+    for (uint16_t i = 0; i < ancount && record.answer_count < DNS_MAX_ANSWERS; i++) {
+        if (!read_name(pMsg, len, offset, NULL, nameLen) || offset + 10 > len) {
+            return;
+        }
+
+        uint16_t type = read16(pMsg + offset);
+        uint32_t ttl = read32(pMsg + offset + 4);
+        uint16_t rdlen = read16(pMsg + offset + 8);
+        offset += 10;
+        if (offset + rdlen > len) {
+            return;
+        }
+
+        DNSAnswer_T& answer = record.answers[record.answer_count];
+        if (type == DNS_TYPE_A && rdlen == 4) {
+            uint32_t v4;
+            memcpy(&v4, pMsg + offset, 4);
+            FlowAddressSetV4(answer.addr, v4);
+        } else if (type == DNS_TYPE_AAAA && rdlen == FLOW_ADDR_SIZE) {
+            memcpy(answer.addr.bytes, pMsg + offset, FLOW_ADDR_SIZE);
+        } else if (type == DNS_TYPE_CNAME) {
+            uint32_t nameOffset = offset;
+            if (!read_name(pMsg, len, nameOffset, name, nameLen)) {
+                return;
+            }
+            answer.name = m_names.intern(name, nameLen);
+        } else {
+            offset += rdlen;
+            continue;
+        }
+
+        answer.type = type;
+        answer.ttl = ttl;
+        record.answer_count++;
+        offset += rdlen;
+    }
+}
+
+static inline size_t pending_index (const FlowKey_T& key, uint16_t txid) {
+    return (size_t)((FlowKeyHash(key) + txid * 0x9E3779B97F4A7C15ULL) >> 16);
+}
+
+DNSPending_T* DNSAnalyzer::find_pending (const FlowKey_T& key, uint16_t txid) {
+    size_t index = pending_index(key, txid);
+
+    for (size_t i = 0; i < DNS_PROBE_LIMIT; i++) {
+        DNSPending_T& pending = m_pending[(index + i) & (DNS_PENDING_SIZE - 1)];
+        if (pending.used && pending.txid == txid && FlowKeyEqual(pending.key, key)) {
+            return &pending;
+        }
+    }
+    return NULL;
+}
+
+DNSPending_T* DNSAnalyzer::claim_pending (const FlowKey_T& key, uint16_t txid, uint64_t timestamp_us) {
+    DNSPending_T* pSlot = NULL;
+    size_t index = pending_index(key, txid);
+
+    for (size_t i = 0; i < DNS_PROBE_LIMIT; i++) {
+        DNSPending_T& pending = m_pending[(index + i) & (DNS_PENDING_SIZE - 1)];
+        if (pending.used && pending.query_us + DNS_TIMEOUT_US <= timestamp_us) {
+            expire(pending);
+        }
+        if (!pending.used) {
+            pSlot = &pending;
+            break;
+        }
+        if (!pSlot || pending.query_us < pSlot->query_us) {
+            pSlot = &pending;
+        }
+    }
+
+    if (pSlot->used) {
+        expire(*pSlot);
+    }
+
+    pSlot->key = key;
+    pSlot->query_us = timestamp_us;
+    pSlot->txid = txid;
+    pSlot->used = 1;
+    return pSlot;
+}
+
+void DNSAnalyzer::expire (DNSPending_T& pending) {
+    DNSRecord_T record;
+
+    memset(&record, 0, sizeof(record));
+    record.key = pending.key;
+    record.query_us = pending.query_us;
+    record.qname = pending.qname;
+    record.txid = pending.txid;
+    record.qtype = pending.qtype;
+    pending.used = 0;
+
+    emit(record);
+}
+
+void DNSAnalyzer::emit (const DNSRecord_T& record) {
+    m_batch.push_back(record);
+    if (m_batch.size() >= DNS_BATCH_SIZE) {
+        m_proxy->on_dns_batch(m_batch, m_names);
+        m_batch.clear();
+    }
+}
+
+void DNSAnalyzer::flush (bool bFinal) {
+    bool bReset = m_names.size() > DNS_ARENA_LIMIT;
+
+    if (bFinal || bReset) {
+        for (auto& pending : m_pending) {
+            if (pending.used) {
+                expire(pending);
+            }
+        }
+    }
+
+    if (!m_batch.empty()) {
+        m_proxy->on_dns_batch(m_batch, m_names);
+        m_batch.clear();
+    }
+
+    if (bReset) {
+        PrintLogMessage(LEVEL_DEBUG, SUBSYSTEM_DNS, "Name table reached %zu bytes, starting over",
+                        m_names.size());
+        m_names.clear();
+    }
+}
+
+uint64_t DNSAnalyzer::get_queries (void) {
+    return m_queries;
+}
+
+uint64_t DNSAnalyzer::get_responses (void) {
+    return m_responses;
+}
+
+uint64_t DNSAnalyzer::get_malformed (void) {
+    return m_malformed;
+}
+
+//=============================================================================
@@ -1 +1,191 @@
+/**@file DNSAnalyzer.h
+ */
+#ifndef DNS_ANALYZER_H_
+#define DNS_ANALYZER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "FlowKey.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define DNS_PORT                (53)
+#define DNS_HEADER_SIZE         (12)
+#define DNS_MAX_NAME            (255)
+
+//Answers kept per response, A, AAAA and CNAME records only
+#define DNS_MAX_ANSWERS         (8)
+
+//Queries awaiting a response, a power of two
+#define DNS_PENDING_SIZE        (16384)
+#define DNS_PROBE_LIMIT         (8)
+
+//Pending slots checked for a timeout on every message
+#define DNS_SWEEP_STEP          (2)
+
+//Resolvers give up on a server well before this
+#define DNS_TIMEOUT_US          (5 * 1000000ULL)
+
+//Records sent to the ZMQ host per message
+#define DNS_BATCH_SIZE          (512)
+
+//Interned names are stored in blocks of this size and dropped once
+//they take more than DNS_ARENA_LIMIT
+#define DNS_ARENA_BLOCK         (64 * 1024)
+#define DNS_ARENA_LIMIT         (64 * 1024 * 1024)
+
+#define DNS_TYPE_A              (1)
+#define DNS_TYPE_CNAME          (5)
+#define DNS_TYPE_AAAA           (28)
+
+/**
+ * Interned domain name, 0 when there is none.
+ */
+typedef uint32_t DNSName_T;
+
+typedef struct {
+    uint16_t type;
+    uint16_t pad;
+    uint32_t ttl;
+    FlowAddress_T addr;     //A and AAAA
+    DNSName_T name;         //CNAME
+} DNSAnswer_T;
+
+/**
+ * A query and its response.
+ */
+typedef struct {
+    FlowKey_T key;          //Client to server
+    uint64_t query_us;      //0 if only the response was seen
+    uint64_t response_us;   //0 if the query went unanswered
+    DNSName_T qname;
+    uint16_t txid;
+    uint16_t qtype;
+    uint8_t rcode;
+    uint8_t answer_count;
+    DNSAnswer_T answers[DNS_MAX_ANSWERS];
+} DNSRecord_T;
+
+/**
+ * A query awaiting its response, a cache line each.
+ */
+typedef struct alignas(8) {
+    FlowKey_T key;
+    uint64_t query_us;
+    DNSName_T qname;
+    uint16_t txid;
+    uint16_t qtype;
+    uint8_t used;
+    uint8_t pad[7];
+} DNSPending_T;
+
+static_assert(sizeof(DNSPending_T) == 64, "pending queries must fill a cache line");
+
+typedef struct {
+    uint32_t hash;
+    DNSName_T name;
+} DNSNameSlot_T;
+
+/**
+ * Set of lowercased domain names. Each distinct name is stored once in
+ * an arena of fixed size blocks and is referred to by a 32-bit ID, so
+ * a name seen a million times costs one copy.
+ */
+class DNSNameTable {
+public:
+    DNSNameTable (void);
+
+    /**
+     * @param pName Name, without a trailing dot.
+     * @param len Length of the name.
+     * @return DNSName_T ID of the name.
+     */
+    DNSName_T intern (const char* pName, uint32_t len);
+
+    std::string str (DNSName_T name) const;
+
+    /**
+     * Bytes held by the arena and the index.
+     */
+    size_t size (void) const;
+
+    /**
+     * Forgets every name, invalidating their IDs.
+     */
+    void clear (void);
+
+protected:
+    void grow (void);
+
+protected:
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_blockUsed;
+    std::vector<const char*> m_names;   //Length prefixed, indexed by ID - 1
+    std::vector<DNSNameSlot_T> m_slots;
+};
+
+class PacketMsgProxy;
+
+/**
+ * Parses DNS queries and responses in place from the UDP payload,
+ * pairs them up by flow and transaction ID, and sends the pairs to the
+ * ZMQ host in batches.
+ *
+ * Names are decoded into a stack buffer, following compression
+ * pointers only backwards so that a malformed message can't loop, and
+ * then interned. Queries wait in a fixed pool of open addressed slots;
+ * one is reported unanswered when it times out, is evicted, or the
+ * analyzer is flushed at the end of the input.
+ */
+class DNSAnalyzer {
+public:
+    DNSAnalyzer (std::shared_ptr<PacketMsgProxy> proxy);
+
+    /**
+     * Handles an IP packet, anything but DNS over UDP is ignored.
+     *
+     * @param pData Captured IP header.
+     * @param len Bytes captured from pData.
+     * @param vlan VLAN ID the packet was tagged with, 0 if untagged.
+     * @param timestamp_us Capture time.
+     */
+    void on_packet (const uint8_t* pData, uint32_t len, uint16_t vlan, uint64_t timestamp_us);
+
+    /**
+     * Sends the records batched so far.
+     *
+     * @param bFinal Also reports every pending query as unanswered.
+     */
+    void flush (bool bFinal);
+
+    uint64_t get_queries (void);
+    uint64_t get_responses (void);
+    uint64_t get_malformed (void);
+
+protected:
+    void on_message (const FlowKey_T& key, const uint8_t* pMsg, uint32_t len, uint64_t timestamp_us);
+    void on_response (const uint8_t* pMsg, uint32_t len, uint32_t offset, DNSRecord_T& record);
+    DNSPending_T* find_pending (const FlowKey_T& key, uint16_t txid);
+    DNSPending_T* claim_pending (const FlowKey_T& key, uint16_t txid, uint64_t timestamp_us);
+    void expire (DNSPending_T& pending);
+    void emit (const DNSRecord_T& record);
+
+protected:
+    std::shared_ptr<PacketMsgProxy> m_proxy;
+    DNSNameTable m_names;
+    std::vector<DNSPending_T> m_pending;
+    std::vector<DNSRecord_T> m_batch;
+    size_t m_sweep;
+    uint64_t m_queries;
+    uint64_t m_responses;
+    uint64_t m_malformed;
+};
+
+//=============================================================================
+#endif //DNS_ANALYZER_H_
@@ -0,0 +1,189 @@
+/**@file FlowExpiryIndex.h
+ */
+#ifndef FLOW_EXPIRY_INDEX_H_
+#define FLOW_EXPIRY_INDEX_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "BTree.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Low key bits holding a serial number, so flows last active in the same
+//microsecond get distinct keys. Leaves 52 bits of microseconds, which
+//reaches well past 2100.
+#define FLOW_EXPIRY_SERIAL_BITS     (12)
+#define FLOW_EXPIRY_SERIAL_MASK     ((1ULL << FLOW_EXPIRY_SERIAL_BITS) - 1)
+
+/**
+ * Microseconds since the epoch of a tuple timestamp.
+ */
+inline uint64_t FlowExpiryTime (uint64_t seconds, uint64_t microseconds) {
+    return seconds * 1000000ULL + microseconds;
+}
+
+/**
+ * One flow in the index: its key, which the flow's tuple also keeps,
+ * and the flow's position in the tracker's list.
+ */
+class FlowExpiryEntry {
+public:
+    FlowExpiryEntry (uint64_t k, size_t s)
+      : key(k),
+        slot(s)
+    {
+    }
+
+    uint64_t addr (void) const {
+        return key;
+    }
+
+public:
+    uint64_t key;
+    size_t slot;
+};
+
+/**
+ * Orders a tracker's flows by last-activity time, so pruning only looks
+ * at the flows that may have been idle past the timeout.
+ *
+ * Keys are the last-activity time in microseconds shifted up by
+ * FLOW_EXPIRY_SERIAL_BITS, with a serial number in the low bits, so
+ * "idle since before t" is the key range [0, t << FLOW_EXPIRY_SERIAL_BITS).
+ *
+ * Packets don't move a flow: its key keeps the time it was added with,
+ * which is never later than its real last activity. take_idle() hands
+ * back everything whose key is before the cutoff, and the tracker adds
+ * the flows that turn out to have been active since back under their
+ * current time. Each flow is looked at about once per timeout.
+ */
+class FlowExpiryIndex {
+public:
+    FlowExpiryIndex (void)
+      : m_tree(),
+        m_serial(0)
+    {
+    }
+
+    /**
+     * Adds a flow.
+     *
+     * @param time_us Last-activity time of the flow.
+     * @param slot Position of the flow in the tracker's list.
+     * @return uint64_t Key of the flow, to be passed to move() and remove().
+     */
+    uint64_t add (uint64_t time_us, size_t slot) {
+        uint64_t base = time_us << FLOW_EXPIRY_SERIAL_BITS;
+
+        //Once every serial of a microsecond is taken the flow goes to
+        //the next microsecond, which only delays its expiry by as much
+        for (;;) {
+            for (uint64_t i = 0; i <= FLOW_EXPIRY_SERIAL_MASK; i++) {
+                uint64_t key = base | (m_serial++ & FLOW_EXPIRY_SERIAL_MASK);
+                if (m_tree.insert(FlowExpiryEntry(key, slot))) {
+                    return key;
+                }
+            }
+            base += 1ULL << FLOW_EXPIRY_SERIAL_BITS;
+        }
+    }
+
+    /**
+     * Records that the flow with a key moved to another position in
+     * the tracker's list.
+     */
+    void move (uint64_t key, size_t slot) {
+        std::shared_ptr<FlowExpiryEntry> entry = m_tree.find(key);
+        if (entry) {
+            entry->slot = slot;
+        }
+    }
+
+    void remove (uint64_t key) {
+        m_tree.remove(key);
+    }
+
+    /**
+     * Takes every flow whose key is idle since before a time out of the
+     * index, oldest key first.
+     *
+     * @param cutoff_us Flows keyed before this time are taken.
+     * @param idle Populated with the flows taken.
+     */
+    void take_idle (uint64_t cutoff_us, std::vector<FlowExpiryEntry>& idle) {
+        idle.clear();
+        if (cutoff_us == 0) {
+            return;
+        }
+
+        //Idle keys are the front of the tree, so they go in one range erase
+        uint64_t last = (cutoff_us << FLOW_EXPIRY_SERIAL_BITS) - 1;
+        m_tree.for_range(0, last, [&idle](std::shared_ptr<FlowExpiryEntry>& entry) {
+            idle.push_back(*entry);
+            return true;
+        });
+        if (!idle.empty()) {
+            m_tree.erase_range(0, last);
+        }
+    }
+
+    /**
+     * Replaces the contents of the index with a set of flows, building
+     * the tree in one pass rather than adding them one at a time.
+     *
+     * @param flows Every flow, with its last-activity time in key. On
+     *        return they are in key order and hold their keys.
+     */
+    void load (std::vector<FlowExpiryEntry>& flows) {
+        std::vector<std::shared_ptr<FlowExpiryEntry>> entries;
+        uint64_t prev = 0;
+
+        std::sort(flows.begin(), flows.end(), [](const FlowExpiryEntry& a, const FlowExpiryEntry& b) {
+            return a.key < b.key || (a.key == b.key && a.slot < b.slot);
+        });
+
+        //Flows of one microsecond take consecutive serials, spilling
+        //into the next microsecond as add() does
+        entries.reserve(flows.size());
+        for (size_t i = 0; i < flows.size(); i++) {
+            uint64_t key = flows[i].key << FLOW_EXPIRY_SERIAL_BITS;
+            if (i > 0 && key <= prev) {
+                key = prev + 1;
+            }
+            flows[i].key = key;
+            prev = key;
+            entries.push_back(std::make_shared<FlowExpiryEntry>(flows[i]));
+        }
+
+        clear();
+        m_tree.bulk_load(entries.begin(), entries.end());
+    }
+
+    /**
+     * Last-activity time a key was given.
+     */
+    static uint64_t key_time (uint64_t key) {
+        return key >> FLOW_EXPIRY_SERIAL_BITS;
+    }
+
+    void clear (void) {
+        m_tree.erase_range(0, UINT64_MAX);
+    }
+
+    size_t size (void) const {
+        return m_tree.size();
+    }
+
+protected:
+    BTree<uint64_t, FlowExpiryEntry> m_tree;
+    uint64_t m_serial;
+};
+
+//=============================================================================
+#endif //FLOW_EXPIRY_INDEX_H_
@@ -0,0 +1,146 @@
+/**@file FlowKey.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "FlowKey.h"
+#include <algorithm>
+#include <arpa/inet.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//IPv6 extension headers skipped in front of the L4 header
+#define FLOW_MAX_EXTENSIONS (8)
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+using namespace Tins;
+
+static inline uint16_t read16 (const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+std::string FlowAddressToString (const FlowAddress_T& addr) {
+    char tmpBuf[INET6_ADDRSTRLEN];
+
+    if (FlowAddressIsV4(addr)) {
+        inet_ntop(AF_INET, addr.bytes + 12, tmpBuf, sizeof(tmpBuf));
+    } else {
+        inet_ntop(AF_INET6, addr.bytes, tmpBuf, sizeof(tmpBuf));
+    }
+    return std::string(tmpBuf);
+}
+
+bool FlowKeySetAddresses (const PDU* pdu, FlowKey_T& key, uint32_t& bytes) {
+    const PDU* pIP = NULL;
+
+    //Tunnels that weren't decapsulated leave more than one IP header,
+    //the L4 header belongs to the last one.
+    for (; pdu; pdu = pdu->inner_pdu()) {
+        if (pdu->pdu_type() == PDU::IP || pdu->pdu_type() == PDU::IPv6) {
+            pIP = pdu;
+        }
+    }
+
+    if (!pIP) {
+        return false;
+    }
+
+    if (pIP->pdu_type() == PDU::IP) {
+        const IP* ipHeader = static_cast<const IP*>(pIP);
+        FlowAddressSetV4(key.src, ipHeader->src_addr());
+        FlowAddressSetV4(key.dst, ipHeader->dst_addr());
+        //Count IP bytes from the header so captures truncated to a snap
+        //length still report the size seen on the wire.
+        bytes = ipHeader->tot_len() ? ipHeader->tot_len() : ipHeader->size();
+    } else {
+        const IPv6* ipHeader = static_cast<const IPv6*>(pIP);
+        IPv6Address src = ipHeader->src_addr();
+        IPv6Address dst = ipHeader->dst_addr();
+        std::copy(src.begin(), src.end(), key.src.bytes);
+        std::copy(dst.begin(), dst.end(), key.dst.bytes);
+        //Jumbograms have a zero payload length
+        bytes = ipHeader->payload_length() ? ipHeader->payload_length() + 40 : ipHeader->size();
+    }
+
+    return true;
+}
+
+bool FlowKeyParse (const uint8_t* pData, uint32_t len, FlowKey_T& key,
+                   const uint8_t** ppL4, uint32_t& l4Len) {
+    uint32_t hdrLen = 0;
+    uint32_t ipLen = 0;
+
+    FlowKeyClear(key);
+    if (len == 0) {
+        return false;
+    }
+
+    if ((pData[0] >> 4) == 4) {
+        hdrLen = (pData[0] & 0x0F) * 4;
+        if (len < 20 || hdrLen < 20 || hdrLen > len ||
+            (read16(pData + 6) & 0x1FFF) != 0) {
+            return false;
+        }
+
+        uint32_t v4;
+        memcpy(&v4, pData + 12, 4);
+        FlowAddressSetV4(key.src, v4);
+        memcpy(&v4, pData + 16, 4);
+        FlowAddressSetV4(key.dst, v4);
+        key.protocol = pData[9];
+        ipLen = read16(pData + 2);
+    } else if ((pData[0] >> 4) == 6) {
+        if (len < 40) {
+            return false;
+        }
+
+        uint8_t next = pData[6];
+        hdrLen = 40;
+        for (size_t i = 0; i < FLOW_MAX_EXTENSIONS; i++) {
+            if (next == 44) {
+                //Only the first fragment has the L4 header
+                if (hdrLen + 8 > len || (read16(pData + hdrLen + 2) & 0xFFF8) != 0) {
+                    return false;
+                }
+                next = pData[hdrLen];
+                hdrLen += 8;
+            } else if (next == 0 || next == 43 || next == 60) {
+                if (hdrLen + 2 > len) {
+                    return false;
+                }
+                next = pData[hdrLen];
+                hdrLen += (pData[hdrLen + 1] + 1) * 8;
+            } else {
+                break;
+            }
+        }
+        if (hdrLen > len) {
+            return false;
+        }
+
+        memcpy(key.src.bytes, pData + 8, FLOW_ADDR_SIZE);
+        memcpy(key.dst.bytes, pData + 24, FLOW_ADDR_SIZE);
+        key.protocol = next;
+        ipLen = read16(pData + 4) ? read16(pData + 4) + 40 : 0;
+    } else {
+        return false;
+    }
+
+    //Frames shorter than the Ethernet minimum are padded
+    if (ipLen >= hdrLen && ipLen < len) {
+        len = ipLen;
+    }
+    *ppL4 = pData + hdrLen;
+    l4Len = len - hdrLen;
+
+    if ((key.protocol == 6 || key.protocol == 17) && l4Len >= 4) {
+        key.sport = read16(*ppL4);
+        key.dport = read16(*ppL4 + 2);
+    }
+    return true;
+}
+
+//=============================================================================
@@ -0,0 +1,158 @@
+/**@file FlowKey.h
+ */
+#ifndef FLOW_KEY_H_
+#define FLOW_KEY_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#define TINS_IS_CXX11 1
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <tins/tins.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define FLOW_ADDR_SIZE      (16)
+#define FLOW_KEY_WORDS      (5)
+
+/**
+ * IPv6 address, or an IPv4 address in its mapped form
+ * (::ffff:a.b.c.d), in network byte order.
+ */
+typedef struct {
+    uint8_t bytes[FLOW_ADDR_SIZE];
+} FlowAddress_T;
+
+/**
+ * Flow key shared by IPv4 and IPv6. It packs into five 64-bit words
+ * with no padding, so keys are compared and hashed a word at a time
+ * (which compilers turn into vector compares) and the unused pad byte
+ * must always be zero.
+ */
+typedef struct alignas(8) {
+    FlowAddress_T src;
+    FlowAddress_T dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint16_t vlan;
+    uint8_t protocol;
+    uint8_t pad;
+} FlowKey_T;
+
+static_assert(sizeof(FlowKey_T) == FLOW_KEY_WORDS * sizeof(uint64_t), "flow keys must be 40 bytes");
+static_assert(std::is_trivially_copyable<FlowKey_T>::value, "flow keys must be trivially copyable");
+
+static inline void FlowAddressSetV4 (FlowAddress_T& addr, uint32_t v4) {
+    memset(addr.bytes, 0, 10);
+    addr.bytes[10] = 0xFF;
+    addr.bytes[11] = 0xFF;
+    memcpy(addr.bytes + 12, &v4, 4);
+}
+
+static inline bool FlowAddressIsV4 (const FlowAddress_T& addr) {
+    static const uint8_t prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+    return memcmp(addr.bytes, prefix, sizeof(prefix)) == 0;
+}
+
+/**
+ * IPv4 address of a mapped address, in network byte order.
+ */
+static inline uint32_t FlowAddressGetV4 (const FlowAddress_T& addr) {
+    uint32_t v4;
+    memcpy(&v4, addr.bytes + 12, 4);
+    return v4;
+}
+
+static inline void FlowKeyClear (FlowKey_T& key) {
+    memset(&key, 0, sizeof(key));
+}
+
+static inline bool FlowKeyEqual (const FlowKey_T& a, const FlowKey_T& b) {
+    uint64_t wa[FLOW_KEY_WORDS];
+    uint64_t wb[FLOW_KEY_WORDS];
+    uint64_t diff = 0;
+
+    memcpy(wa, &a, sizeof(wa));
+    memcpy(wb, &b, sizeof(wb));
+    for (size_t i = 0; i < FLOW_KEY_WORDS; i++) {
+        diff |= wa[i] ^ wb[i];
+    }
+    return diff == 0;
+}
+
+/**
+ * Key of the same flow seen in the opposite direction.
+ */
+static inline FlowKey_T FlowKeyReverse (const FlowKey_T& key) {
+    FlowKey_T rev = key;
+    rev.src = key.dst;
+    rev.dst = key.src;
+    rev.sport = key.dport;
+    rev.dport = key.sport;
+    return rev;
+}
+
+/**
+ * The direction of a flow whose source sorts first, so both directions
+ * map to the same key.
+ */
+static inline FlowKey_T FlowKeyCanonical (const FlowKey_T& key) {
+    int cmp = memcmp(key.src.bytes, key.dst.bytes, FLOW_ADDR_SIZE);
+    if (cmp > 0 || (cmp == 0 && key.sport > key.dport)) {
+        return FlowKeyReverse(key);
+    }
+    return key;
+}
+
+static inline uint64_t FlowKeyHash (const FlowKey_T& key) {
+    uint64_t w[FLOW_KEY_WORDS];
+    uint64_t h = 0;
+
+    memcpy(w, &key, sizeof(w));
+    for (size_t i = 0; i < FLOW_KEY_WORDS; i++) {
+        h = (h ^ w[i]) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+/**
+ * Formats an address with inet_ntop(), IPv4 mapped addresses in
+ * dotted quad form.
+ */
+std::string FlowAddressToString (const FlowAddress_T& addr);
+
+/**
+ * Fills in the addresses of a flow key from the innermost IPv4 or
+ * IPv6 header of a packet.
+ *
+ * @param pdu Outermost PDU of the packet.
+ * @param key Populated with the source and destination addresses.
+ * @param bytes Populated with the IP length seen on the wire.
+ * @return bool false if the packet has no IP header.
+ */
+bool FlowKeySetAddresses (const Tins::PDU* pdu, FlowKey_T& key, uint32_t& bytes);
+
+/**
+ * Fills in a flow key straight from a captured IP header, for
+ * analyzers that read L4 payloads in place instead of through libtins.
+ * IPv6 hop-by-hop, routing and destination options headers are skipped.
+ *
+ * @param pData IPv4 or IPv6 header.
+ * @param len Bytes captured from pData.
+ * @param key Populated with the addresses, the protocol and, for TCP
+ *            and UDP, the ports.
+ * @param ppL4 Populated with the L4 header.
+ * @param l4Len Populated with the bytes captured from the L4 header,
+ *              not counting any Ethernet padding.
+ * @return bool false if there is no IP header or the packet is a
+ *              fragment other than the first.
+ */
+bool FlowKeyParse (const uint8_t* pData, uint32_t len, FlowKey_T& key,
+                   const uint8_t** ppL4, uint32_t& l4Len);
+
+//=============================================================================
+#endif //FLOW_KEY_H_
@@ -0,0 +1,332 @@
+/**@file FragmentTracker.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "FragmentTracker.h"
+#include <string.h>
+#include <algorithm>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define IPV6_HEADER_SIZE        (40)
+#define IPV6_FRAGMENT_SIZE      (8)
+
+#define IP_PROTO_HOPOPTS        (0)
+#define IP_PROTO_ROUTING        (43)
+#define IP_PROTO_FRAGMENT       (44)
+#define IP_PROTO_DSTOPTS        (60)
+
+//Extension headers walked in front of the upper layer header
+#define IPV6_MAX_EXTENSIONS     (8)
+
+static_assert((FRAGMENT_POOL_SIZE & (FRAGMENT_POOL_SIZE - 1)) == 0, "the fragment pool must be a power of two");
+
+/**
+ * Fields of a fragment, pointing into the captured bytes.
+ */
+typedef struct {
+    FlowAddress_T src;
+    FlowAddress_T dst;
+    uint32_t id;
+    uint32_t offset;        //Fragment offset in bytes
+    uint32_t bytes;         //IP length seen on the wire
+    uint32_t data_len;      //Fragment payload length on the wire
+    uint8_t protocol;
+    uint8_t l4_protocol;    //First fragments only
+    bool more;
+    const uint8_t* pL4;     //First fragments only
+    uint32_t l4_len;
+} FragmentHeader_T;
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+static inline uint16_t read16 (const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t read32 (const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static bool parse_ipv4 (const uint8_t* pData, uint32_t len, FragmentHeader_T& frag) {
+    uint32_t v4;
+
+    if (len < 20) {
+        return false;
+    }
+
+    uint32_t hdrLen = (pData[0] & 0x0F) * 4;
+    uint16_t flags = read16(pData + 6);
+    if (hdrLen < 20 || hdrLen > len || (flags & 0x3FFF) == 0) {
+        return false;
+    }
+
+    memcpy(&v4, pData + 12, 4);
+    FlowAddressSetV4(frag.src, v4);
+    memcpy(&v4, pData + 16, 4);
+    FlowAddressSetV4(frag.dst, v4);
+
+    frag.id = read16(pData + 4);
+    frag.offset = (flags & 0x1FFF) * 8;
+    frag.more = (flags & 0x2000) != 0;
+    frag.protocol = pData[9];
+    frag.l4_protocol = pData[9];
+
+    uint16_t totLen = read16(pData + 2);
+    frag.bytes = totLen ? totLen : len;
+    frag.data_len = frag.bytes > hdrLen ? frag.bytes - hdrLen : 0;
+    if (totLen >= hdrLen && totLen < len) {
+        len = totLen;
+    }
+    frag.pL4 = pData + hdrLen;
+    frag.l4_len = len - hdrLen;
+    return true;
+}
+
+static bool parse_ipv6 (const uint8_t* pData, uint32_t len, FragmentHeader_T& frag) {
+    bool bFragment = false;
+    uint32_t fragmentEnd = 0;
+
+    if (len < IPV6_HEADER_SIZE) {
+        return false;
+    }
+
+    uint8_t next = pData[6];
+    uint32_t offset = IPV6_HEADER_SIZE;
+    for (size_t i = 0; i < IPV6_MAX_EXTENSIONS; i++) {
+        if (next == IP_PROTO_FRAGMENT) {
+            if (bFragment || offset + IPV6_FRAGMENT_SIZE > len) {
+                return false;
+            }
+            uint16_t flags = read16(pData + offset + 2);
+            frag.id = read32(pData + offset + 4);
+            frag.offset = flags & 0xFFF8;
+            frag.more = (flags & 0x0001) != 0;
+            frag.protocol = pData[offset];
+            bFragment = true;
+
+            next = pData[offset];
+            offset += IPV6_FRAGMENT_SIZE;
+            fragmentEnd = offset;
+
+            //Whatever follows belongs to the middle of the datagram
+            if (frag.offset != 0) {
+                break;
+            }
+        } else if (next == IP_PROTO_HOPOPTS || next == IP_PROTO_ROUTING ||
+                   next == IP_PROTO_DSTOPTS) {
+            if (offset + 2 > len) {
+                break;
+            }
+            next = pData[offset];
+            offset += (pData[offset + 1] + 1) * 8;
+        } else {
+            break;
+        }
+    }
+
+    //Atomic fragments carry the whole datagram
+    if (!bFragment || (frag.offset == 0 && !frag.more)) {
+        return false;
+    }
+
+    memcpy(frag.src.bytes, pData + 8, FLOW_ADDR_SIZE);
+    memcpy(frag.dst.bytes, pData + 24, FLOW_ADDR_SIZE);
+
+    uint16_t payloadLen = read16(pData + 4);
+    frag.bytes = payloadLen ? payloadLen + IPV6_HEADER_SIZE : len;
+    frag.data_len = frag.bytes > fragmentEnd ? frag.bytes - fragmentEnd : 0;
+    if (payloadLen && (uint32_t)payloadLen + IPV6_HEADER_SIZE < len) {
+        len = payloadLen + IPV6_HEADER_SIZE;
+    }
+    frag.l4_protocol = next;
+    frag.pL4 = (offset <= len) ? pData + offset : NULL;
+    frag.l4_len = (offset <= len) ? len - offset : 0;
+    return true;
+}
+
+static inline bool entry_matches (const FragmentEntry_T& a, const FragmentEntry_T& b) {
+    return a.id == b.id && a.protocol == b.protocol &&
+           memcmp(&a.src, &b.src, sizeof(a.src)) == 0 &&
+           memcmp(&a.dst, &b.dst, sizeof(a.dst)) == 0;
+}
+
+static inline uint64_t entry_hash (const FragmentEntry_T& entry) {
+    uint64_t w[4];
+    uint64_t h = ((uint64_t)entry.id << 8) | entry.protocol;
+
+    memcpy(w, &entry.src, sizeof(w));
+    for (size_t i = 0; i < 4; i++) {
+        h = (h ^ w[i]) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+FragmentTracker::FragmentTracker (void)
+  : m_pool(FRAGMENT_POOL_SIZE),
+    m_fragments(0),
+    m_attributed(0),
+    m_lost(0),
+    m_evicted(0)
+{
+    memset(m_pool.data(), 0, m_pool.size() * sizeof(FragmentEntry_T));
+}
+
+void FragmentTracker::release (FragmentEntry_T& entry) {
+    if (entry.state == FRAGMENT_PENDING) {
+        m_lost += entry.pending_packets;
+    }
+    entry.state = FRAGMENT_FREE;
+}
+
+FragmentEntry_T* FragmentTracker::lookup (const FragmentEntry_T& key, uint64_t timestamp_us) {
+    FragmentEntry_T* pFree = NULL;
+    FragmentEntry_T* pOldest = NULL;
+    size_t index = entry_hash(key);
+
+    //The whole window is searched, so freeing a slot never hides the
+    //entries after it
+    for (size_t i = 0; i < FRAGMENT_PROBE_LIMIT; i++) {
+        FragmentEntry_T& entry = m_pool[(index + i) & (FRAGMENT_POOL_SIZE - 1)];
+
+        if (entry.state != FRAGMENT_FREE && entry.expires_us <= timestamp_us) {
+            release(entry);
+        }
+        if (entry.state == FRAGMENT_FREE) {
+            if (!pFree) {
+                pFree = &entry;
+            }
+            continue;
+        }
+        if (entry_matches(entry, key)) {
+            return &entry;
+        }
+        if (!pOldest || entry.expires_us < pOldest->expires_us) {
+            pOldest = &entry;
+        }
+    }
+
+    if (!pFree) {
+        release(*pOldest);
+        m_evicted++;
+        pFree = pOldest;
+    }
+
+    *pFree = key;
+    pFree->state = FRAGMENT_PENDING;
+    pFree->pending_packets = 0;
+    pFree->pending_bytes = 0;
+    pFree->received = 0;
+    pFree->total = 0;
+    pFree->expires_us = timestamp_us + FRAGMENT_TIMEOUT_US;
+    return pFree;
+}
+
+bool FragmentTracker::on_packet (const uint8_t* pData, uint32_t len, uint64_t timestamp_us,
+                                 FragmentResult_T& result) {
+    FragmentHeader_T frag;
+    FragmentEntry_T key;
+
+    if (len == 0) {
+        return false;
+    }
+
+    switch (pData[0] >> 4) {
+    case 4:
+        if (!parse_ipv4(pData, len, frag)) {
+            return false;
+        }
+        break;
+    case 6:
+        if (!parse_ipv6(pData, len, frag)) {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    m_fragments++;
+
+    memset(&key, 0, sizeof(key));
+    key.src = frag.src;
+    key.dst = frag.dst;
+    key.id = frag.id;
+    key.protocol = frag.protocol;
+    FragmentEntry_T* pEntry = lookup(key, timestamp_us);
+
+    FlowKeyClear(result.key);
+    result.key.src = frag.src;
+    result.key.dst = frag.dst;
+    result.packets = 1;
+    result.bytes = frag.bytes;
+    result.l4 = NULL;
+    result.l4_len = 0;
+    result.attributed = false;
+
+    //Overlapping or duplicate fragments make this an overestimate,
+    //which at worst releases the datagram early
+    pEntry->received = std::min<uint32_t>(pEntry->received + frag.data_len, 0xFFFF);
+    if (!frag.more && frag.offset + frag.data_len <= 0xFFFF) {
+        pEntry->total = frag.offset + frag.data_len;
+    }
+
+    if (frag.offset == 0) {
+        pEntry->l4_protocol = frag.l4_protocol;
+        pEntry->sport = 0;
+        pEntry->dport = 0;
+        if ((frag.l4_protocol == 6 || frag.l4_protocol == 17) && frag.l4_len >= 4) {
+            pEntry->sport = read16(frag.pL4);
+            pEntry->dport = read16(frag.pL4 + 2);
+        }
+
+        result.l4 = frag.pL4;
+        result.l4_len = frag.l4_len;
+        result.packets += pEntry->pending_packets;
+        result.bytes += pEntry->pending_bytes;
+        pEntry->pending_packets = 0;
+        pEntry->pending_bytes = 0;
+        pEntry->state = FRAGMENT_KNOWN;
+    }
+
+    if (pEntry->state == FRAGMENT_KNOWN) {
+        result.key.sport = pEntry->sport;
+        result.key.dport = pEntry->dport;
+        result.key.protocol = pEntry->l4_protocol;
+        result.attributed = true;
+        m_attributed += result.packets;
+
+        //Fragments can still arrive after the last one, so the slot is
+        //only given up once every byte of the datagram has been seen
+        if (pEntry->total != 0 && pEntry->received >= pEntry->total) {
+            release(*pEntry);
+        }
+    } else {
+        pEntry->pending_packets++;
+        pEntry->pending_bytes += frag.bytes;
+    }
+
+    return true;
+}
+
+uint64_t FragmentTracker::get_fragments (void) {
+    return m_fragments;
+}
+
+uint64_t FragmentTracker::get_attributed (void) {
+    return m_attributed;
+}
+
+uint64_t FragmentTracker::get_lost (void) {
+    return m_lost;
+}
+
+uint64_t FragmentTracker::get_evicted (void) {
+    return m_evicted;
+}
+
+//=============================================================================
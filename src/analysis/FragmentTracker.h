@@ -0,0 +1,115 @@
+/**@file FragmentTracker.h
+ */
+#ifndef FRAGMENT_TRACKER_H_
+#define FRAGMENT_TRACKER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <vector>
+
+#include "FlowKey.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Datagrams being reassembled at once, a power of two
+#define FRAGMENT_POOL_SIZE      (4096)
+
+//Slots searched for a datagram before the oldest one is evicted
+#define FRAGMENT_PROBE_LIMIT    (8)
+
+//Same as the Linux ipfrag_time default
+#define FRAGMENT_TIMEOUT_US     (30 * 1000000ULL)
+
+typedef enum {
+    FRAGMENT_FREE       = 0,
+    FRAGMENT_PENDING    = 1,    //Fragments seen, the first one hasn't arrived
+    FRAGMENT_KNOWN      = 2     //First fragment seen, ports known
+} FragmentState_T;
+
+/**
+ * One datagram being reassembled, a cache line each. Nothing but the
+ * ports of the first fragment is kept.
+ */
+typedef struct alignas(8) {
+    FlowAddress_T src;
+    FlowAddress_T dst;
+    uint32_t id;                //IPv4 IDs are widened to 32 bits
+    uint8_t protocol;           //Next header of the fragment header
+    uint8_t state;              //FragmentState_T
+    uint8_t l4_protocol;        //Upper layer protocol, once known
+    uint8_t pad;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t pending_packets;   //Fragments seen before the first one
+    uint32_t pending_bytes;
+    uint16_t received;          //Fragment payload bytes seen, saturating
+    uint16_t total;             //Datagram payload length, 0 until the last fragment
+    uint64_t expires_us;
+} FragmentEntry_T;
+
+static_assert(sizeof(FragmentEntry_T) == 64, "fragment entries must fill a cache line");
+
+/**
+ * Flow a fragment belongs to.
+ */
+typedef struct {
+    FlowKey_T key;          //Addresses, ports and protocol, VLAN left at 0
+    uint32_t packets;       //Includes fragments held until the first arrived
+    uint32_t bytes;
+    const uint8_t* l4;      //L4 header of a first fragment, NULL otherwise
+    uint32_t l4_len;
+    bool attributed;        //false while the first fragment is missing
+} FragmentResult_T;
+
+/**
+ * Attributes IPv4 and IPv6 fragments to flows. Only the first fragment
+ * of a datagram carries the L4 header, so its ports are remembered
+ * under (src, dst, id, protocol) and looked up for the other
+ * fragments. A datagram is kept until the fragments seen add up to the
+ * length given by the last one, or until the timeout, so fragments
+ * that arrive after the last one are still attributed.
+ *
+ * Datagrams live in a fixed pool searched by open addressing, so memory
+ * doesn't grow with the number of fragmented datagrams in flight: slots
+ * that have timed out are reused first, then the oldest in the probe
+ * window is evicted. Fragments arriving ahead of the first one are only
+ * counted and are attributed together with it. No payload is copied.
+ */
+class FragmentTracker {
+public:
+    FragmentTracker (void);
+
+    /**
+     * Handles an IP packet.
+     *
+     * @param pData IPv4 or IPv6 header.
+     * @param len Bytes captured from the IP header.
+     * @param timestamp_us Capture time, which drives the timeout.
+     * @param result Populated with the flow when the packet is a fragment.
+     * @return bool true if the packet is a fragment. It must then be
+     *              counted through result instead of its own L4 header.
+     */
+    bool on_packet (const uint8_t* pData, uint32_t len, uint64_t timestamp_us,
+                    FragmentResult_T& result);
+
+    uint64_t get_fragments (void);
+    uint64_t get_attributed (void);
+    uint64_t get_lost (void);
+    uint64_t get_evicted (void);
+
+protected:
+    FragmentEntry_T* lookup (const FragmentEntry_T& key, uint64_t timestamp_us);
+    void release (FragmentEntry_T& entry);
+
+protected:
+    std::vector<FragmentEntry_T> m_pool;
+    uint64_t m_fragments;
+    uint64_t m_attributed;
+    uint64_t m_lost;        //Fragments whose first fragment never arrived
+    uint64_t m_evicted;     //Datagrams evicted before timing out
+};
+
+//=============================================================================
+#endif //FRAGMENT_TRACKER_H_
@@ -0,0 +1,517 @@
+/**@file HeavyHitters.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "HeavyHitters.h"
+#include "PacketMsgProxy.h"
+#include <string.h>
+#include <algorithm>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define IPV6_HEADER_SIZE        (40)
+
+static_assert((HEAVY_CMS_WIDTH & (HEAVY_CMS_WIDTH - 1)) == 0, "the sketch width must be a power of two");
+static_assert((HEAVY_INDEX_SIZE & (HEAVY_INDEX_SIZE - 1)) == 0, "the index size must be a power of two");
+static_assert(HEAVY_INDEX_SIZE >= 2 * HEAVY_CAPACITY, "the index must stay at most half full");
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+static inline uint16_t read16 (const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+/**
+ * IP length seen on the wire, the captured length if the header
+ * doesn't say.
+ */
+static inline uint32_t ip_length (const uint8_t* pData, uint32_t len) {
+    uint32_t ipLen = 0;
+
+    if ((pData[0] >> 4) == 4 && len >= 4) {
+        ipLen = read16(pData + 2);
+    } else if ((pData[0] >> 4) == 6 && len >= IPV6_HEADER_SIZE) {
+        ipLen = read16(pData + 4);
+        ipLen = ipLen ? ipLen + IPV6_HEADER_SIZE : 0;
+    }
+    return ipLen ? ipLen : len;
+}
+
+/**
+ * Spreads a flow key hash before it is split into row hashes.
+ */
+static inline uint64_t cms_mix (uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+CountMinSketch::CountMinSketch (void)
+  : m_cells(HEAVY_CMS_DEPTH * HEAVY_CMS_WIDTH)
+{
+    clear();
+}
+
+HeavyCounter_T CountMinSketch::add (uint64_t hash, uint64_t packets, uint64_t bytes) {
+    HeavyCounter_T result;
+    uint64_t h = cms_mix(hash);
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1;
+
+    result.value[HEAVY_PACKETS] = UINT64_MAX;
+    result.value[HEAVY_BYTES] = UINT64_MAX;
+    for (size_t row = 0; row < HEAVY_CMS_DEPTH; row++) {
+        HeavyCounter_T& cell = m_cells[row * HEAVY_CMS_WIDTH + ((h1 + row * h2) & (HEAVY_CMS_WIDTH - 1))];
+        cell.value[HEAVY_PACKETS] += packets;
+        cell.value[HEAVY_BYTES] += bytes;
+        result.value[HEAVY_PACKETS] = std::min(result.value[HEAVY_PACKETS], cell.value[HEAVY_PACKETS]);
+        result.value[HEAVY_BYTES] = std::min(result.value[HEAVY_BYTES], cell.value[HEAVY_BYTES]);
+    }
+    return result;
+}
+
+HeavyCounter_T CountMinSketch::estimate (uint64_t hash) const {
+    HeavyCounter_T result;
+    uint64_t h = cms_mix(hash);
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1;
+
+    result.value[HEAVY_PACKETS] = UINT64_MAX;
+    result.value[HEAVY_BYTES] = UINT64_MAX;
+    for (size_t row = 0; row < HEAVY_CMS_DEPTH; row++) {
+        const HeavyCounter_T& cell = m_cells[row * HEAVY_CMS_WIDTH + ((h1 + row * h2) & (HEAVY_CMS_WIDTH - 1))];
+        for (size_t m = 0; m < HEAVY_METRICS; m++) {
+            result.value[m] = std::min(result.value[m], cell.value[m]);
+        }
+    }
+    return result;
+}
+
+void CountMinSketch::merge (const CountMinSketch& other) {
+    for (size_t i = 0; i < m_cells.size(); i++) {
+        for (size_t m = 0; m < HEAVY_METRICS; m++) {
+            m_cells[i].value[m] += other.m_cells[i].value[m];
+        }
+    }
+}
+
+void CountMinSketch::clear (void) {
+    memset(m_cells.data(), 0, m_cells.size() * sizeof(HeavyCounter_T));
+}
+
+SpaceSaving::SpaceSaving (void)
+  : m_entries(),
+    m_index(HEAVY_INDEX_SIZE),
+    m_heap(),
+    m_pos(HEAVY_CAPACITY)
+{
+    m_entries.reserve(HEAVY_CAPACITY);
+    m_heap.reserve(HEAVY_CAPACITY);
+}
+
+int SpaceSaving::find (const FlowKey_T& key, uint64_t hash) const {
+    for (size_t slot = hash & (HEAVY_INDEX_SIZE - 1); m_index[slot] != 0;
+         slot = (slot + 1) & (HEAVY_INDEX_SIZE - 1)) {
+        const HeavyEntry_T& entry = m_entries[m_index[slot] - 1];
+        if (entry.hash == hash && FlowKeyEqual(entry.key, key)) {
+            return m_index[slot] - 1;
+        }
+    }
+    return -1;
+}
+
+void SpaceSaving::index_insert (uint64_t hash, size_t entry) {
+    size_t slot = hash & (HEAVY_INDEX_SIZE - 1);
+    while (m_index[slot] != 0) {
+        slot = (slot + 1) & (HEAVY_INDEX_SIZE - 1);
+    }
+    m_index[slot] = (uint16_t)(entry + 1);
+}
+
+void SpaceSaving::index_erase (uint64_t hash, size_t entry) {
+    const size_t mask = HEAVY_INDEX_SIZE - 1;
+    size_t slot = hash & mask;
+
+    while (m_index[slot] != entry + 1) {
+        slot = (slot + 1) & mask;
+    }
+
+    //Entries after the hole move back into it unless that would put
+    //them in front of their home slot, so probes never stop early
+    size_t next = slot;
+    for (;;) {
+        m_index[slot] = 0;
+        for (;;) {
+            next = (next + 1) & mask;
+            if (m_index[next] == 0) {
+                return;
+            }
+            size_t home = m_entries[m_index[next] - 1].hash & mask;
+            bool bStays = (slot <= next) ? (slot < home && home <= next)
+                                         : (slot < home || home <= next);
+            if (!bStays) {
+                break;
+            }
+        }
+        m_index[slot] = m_index[next];
+        slot = next;
+    }
+}
+
+void SpaceSaving::heap_swap (size_t a, size_t b) {
+    std::swap(m_heap[a], m_heap[b]);
+    m_pos[m_heap[a]] = (uint16_t)a;
+    m_pos[m_heap[b]] = (uint16_t)b;
+}
+
+void SpaceSaving::sift_up (size_t pos) {
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (m_entries[m_heap[parent]].count <= m_entries[m_heap[pos]].count) {
+            break;
+        }
+        heap_swap(pos, parent);
+        pos = parent;
+    }
+}
+
+void SpaceSaving::sift_down (size_t pos) {
+    for (;;) {
+        size_t lightest = pos;
+        size_t child = 2 * pos + 1;
+        for (size_t i = child; i < child + 2 && i < m_heap.size(); i++) {
+            if (m_entries[m_heap[i]].count < m_entries[m_heap[lightest]].count) {
+                lightest = i;
+            }
+        }
+        if (lightest == pos) {
+            break;
+        }
+        heap_swap(pos, lightest);
+        pos = lightest;
+    }
+}
+
+int SpaceSaving::offer (const FlowKey_T& key, uint64_t hash, uint64_t value, uint64_t estimate,
+                        bool& bNew) {
+    bNew = false;
+    int found = find(key, hash);
+    if (found >= 0) {
+        m_entries[found].count += value;
+        sift_down(m_pos[found]);
+        return found;
+    }
+
+    if (m_entries.size() < HEAVY_CAPACITY) {
+        HeavyEntry_T entry;
+        entry.key = key;
+        entry.hash = hash;
+        entry.count = value;
+        entry.error = 0;
+        m_entries.push_back(entry);
+        index_insert(hash, m_entries.size() - 1);
+        m_pos[m_entries.size() - 1] = (uint16_t)m_heap.size();
+        m_heap.push_back((uint16_t)(m_entries.size() - 1));
+        sift_up(m_heap.size() - 1);
+        bNew = true;
+        return m_entries.size() - 1;
+    }
+
+    int index = m_heap[0];
+    HeavyEntry_T& lightest = m_entries[index];
+    if (estimate <= lightest.count) {
+        return -1;
+    }
+
+    //Before this packet the key had at most the lightest count, or the
+    //sketch would have let it in earlier
+    uint64_t count = std::min(estimate, lightest.count + value);
+    index_erase(lightest.hash, index);
+    lightest.key = key;
+    lightest.hash = hash;
+    lightest.count = count;
+    lightest.error = count - value;
+    index_insert(hash, index);
+    sift_down(0);
+    bNew = true;
+    return index;
+}
+
+void SpaceSaving::merge (const SpaceSaving& other, std::vector<HeavyOrigin_T>* pOrigins) {
+    std::vector<HeavyEntry_T> merged(m_entries);
+    std::vector<HeavyOrigin_T> origins(m_entries.size());
+    std::vector<size_t> order;
+    uint64_t minThis = 0;
+    uint64_t minOther = 0;
+
+    //A key missing from a full summary may still have had up to its
+    //lightest count there
+    if (m_entries.size() == HEAVY_CAPACITY) {
+        minThis = m_entries[m_heap[0]].count;
+    }
+    if (other.m_entries.size() == HEAVY_CAPACITY) {
+        minOther = other.m_entries[other.m_heap[0]].count;
+    }
+
+    for (size_t i = 0; i < origins.size(); i++) {
+        origins[i].self = i;
+        origins[i].other = -1;
+    }
+    for (size_t i = 0; i < other.m_entries.size(); i++) {
+        const HeavyEntry_T& entry = other.m_entries[i];
+        int found = find(entry.key, entry.hash);
+        if (found >= 0) {
+            merged[found].count += entry.count;
+            merged[found].error += entry.error;
+            origins[found].other = i;
+        } else {
+            HeavyEntry_T missing = entry;
+            missing.count += minThis;
+            missing.error += minThis;
+            merged.push_back(missing);
+            origins.push_back({ -1, (int)i });
+        }
+    }
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        if (origins[i].other < 0) {
+            merged[i].count += minOther;
+            merged[i].error += minOther;
+        }
+    }
+
+    for (size_t i = 0; i < merged.size(); i++) {
+        order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&merged](size_t a, size_t b) {
+        return merged[a].count > merged[b].count;
+    });
+    if (order.size() > HEAVY_CAPACITY) {
+        order.resize(HEAVY_CAPACITY);
+    }
+
+    //Sorted heaviest first, so the heap is built from the back
+    clear();
+    if (pOrigins) {
+        pOrigins->clear();
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        m_entries.push_back(merged[order[i]]);
+        index_insert(m_entries[i].hash, i);
+        m_heap.push_back((uint16_t)(order.size() - 1 - i));
+        m_pos[order.size() - 1 - i] = (uint16_t)i;
+        if (pOrigins) {
+            pOrigins->push_back(origins[order[i]]);
+        }
+    }
+}
+
+void SpaceSaving::top (std::vector<int>& entries, size_t k) const {
+    entries.clear();
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        entries.push_back(i);
+    }
+    k = std::min(k, entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + k, entries.end(), [this](int a, int b) {
+        return m_entries[a].count > m_entries[b].count;
+    });
+    entries.resize(k);
+}
+
+const HeavyEntry_T& SpaceSaving::entry (int index) const {
+    return m_entries[index];
+}
+
+void SpaceSaving::clear (void) {
+    m_entries.clear();
+    std::fill(m_index.begin(), m_index.end(), 0);
+    m_heap.clear();
+}
+
+/**
+ * Hash of an address spread over all 64 bits, as HyperLogLog needs.
+ */
+static inline uint64_t address_hash (const FlowAddress_T& addr) {
+    uint64_t w[2];
+
+    memcpy(w, addr.bytes, sizeof(w));
+    uint64_t h = (w[0] * 0x9E3779B97F4A7C15ULL) ^ w[1];
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+HeavyHitters::HeavyHitters (std::shared_ptr<PacketMsgProxy> proxy, uint64_t interval_us)
+  : m_proxy(proxy),
+    m_interval_us(interval_us),
+    m_window_us(0),
+    m_packets(0),
+    m_snapshots(0),
+    m_distinctSrc(),
+    m_distinctDst()
+{
+    m_fanout[HEAVY_SRC].resize(HEAVY_CAPACITY);
+    m_fanout[HEAVY_DST].resize(HEAVY_CAPACITY);
+}
+
+int HeavyHitters::add (HeavyDimension_T dimension, const FlowKey_T& key, uint64_t bytes, bool& bNew) {
+    uint64_t hash = FlowKeyHash(key);
+    bool bNewBytes;
+
+    HeavyCounter_T estimate = m_sketches[dimension].add(hash, 1, bytes);
+    m_top[dimension][HEAVY_BYTES].offer(key, hash, bytes, estimate.value[HEAVY_BYTES], bNewBytes);
+    return m_top[dimension][HEAVY_PACKETS].offer(key, hash, 1, estimate.value[HEAVY_PACKETS], bNew);
+}
+
+void HeavyHitters::on_packet (const uint8_t* pData, uint32_t len, uint16_t vlan, uint64_t timestamp_us) {
+    FlowKey_T key;
+    FlowKey_T reduced;
+    const uint8_t* pL4 = NULL;
+    uint32_t l4Len = 0;
+    bool bNew;
+
+    //Only first fragments carry the ports, the rest are left out
+    if (!FlowKeyParse(pData, len, key, &pL4, l4Len)) {
+        return;
+    }
+    key.vlan = vlan;
+    uint64_t bytes = ip_length(pData, len);
+
+    if (m_window_us == 0 || timestamp_us >= m_window_us + m_interval_us) {
+        flush();
+        m_window_us = timestamp_us - (timestamp_us % m_interval_us);
+    }
+    m_packets++;
+
+    uint64_t srcHash = address_hash(key.src);
+    uint64_t dstHash = address_hash(key.dst);
+    m_distinctSrc.add(srcHash);
+    m_distinctDst.add(dstHash);
+
+    //A key that just took over an entry starts counting from here
+    FlowKeyClear(reduced);
+    reduced.src = key.src;
+    reduced.vlan = key.vlan;
+    int index = add(HEAVY_SRC, reduced, bytes, bNew);
+    if (index >= 0) {
+        if (bNew) {
+            m_fanout[HEAVY_SRC][index].clear();
+        }
+        m_fanout[HEAVY_SRC][index].add(dstHash);
+    }
+
+    FlowKeyClear(reduced);
+    reduced.dst = key.dst;
+    reduced.vlan = key.vlan;
+    index = add(HEAVY_DST, reduced, bytes, bNew);
+    if (index >= 0) {
+        if (bNew) {
+            m_fanout[HEAVY_DST][index].clear();
+        }
+        m_fanout[HEAVY_DST][index].add(srcHash);
+    }
+
+    FlowKeyClear(reduced);
+    reduced.dport = key.dport;
+    reduced.protocol = key.protocol;
+    add(HEAVY_DPORT, reduced, bytes, bNew);
+
+    add(HEAVY_FLOW, key, bytes, bNew);
+}
+
+void HeavyHitters::merge (const HeavyHitters& other) {
+    std::vector<HeavyOrigin_T> origins;
+
+    for (size_t d = 0; d < HEAVY_DIMENSIONS; d++) {
+        m_sketches[d].merge(other.m_sketches[d]);
+        m_top[d][HEAVY_BYTES].merge(other.m_top[d][HEAVY_BYTES]);
+        m_top[d][HEAVY_PACKETS].merge(other.m_top[d][HEAVY_PACKETS], &origins);
+
+        //The counters follow their keys into the merged entries
+        if (d == HEAVY_SRC || d == HEAVY_DST) {
+            std::vector<HyperLogLog> fanout(HEAVY_CAPACITY);
+            for (size_t i = 0; i < origins.size(); i++) {
+                if (origins[i].self >= 0) {
+                    fanout[i].merge(m_fanout[d][origins[i].self]);
+                }
+                if (origins[i].other >= 0) {
+                    fanout[i].merge(other.m_fanout[d][origins[i].other]);
+                }
+            }
+            m_fanout[d].swap(fanout);
+        }
+    }
+    m_distinctSrc.merge(other.m_distinctSrc);
+    m_distinctDst.merge(other.m_distinctDst);
+    m_packets += other.m_packets;
+    if (m_window_us == 0) {
+        m_window_us = other.m_window_us;
+    }
+}
+
+uint64_t HeavyHitters::distinct (size_t dimension, const HeavyEntry_T& entry) const {
+    if (dimension != HEAVY_SRC && dimension != HEAVY_DST) {
+        return 0;
+    }
+    int index = m_top[dimension][HEAVY_PACKETS].find(entry.key, entry.hash);
+    return (index >= 0) ? m_fanout[dimension][index].estimate() : 0;
+}
+
+void HeavyHitters::snapshot (std::vector<HeavyHitter_T>& hitters) const {
+    std::vector<int> entries;
+    HeavyHitter_T hitter;
+
+    hitters.clear();
+    for (size_t d = 0; d < HEAVY_DIMENSIONS; d++) {
+        for (size_t m = 0; m < HEAVY_METRICS; m++) {
+            m_top[d][m].top(entries, HEAVY_TOP_K);
+            hitter.dimension = (HeavyDimension_T)d;
+            hitter.metric = (HeavyMetric_T)m;
+            for (int index : entries) {
+                hitter.entry = m_top[d][m].entry(index);
+                hitter.distinct = distinct(d, hitter.entry);
+                hitters.push_back(hitter);
+            }
+        }
+    }
+}
+
+void HeavyHitters::flush (void) {
+    std::vector<HeavyHitter_T> hitters;
+    HeavyWindow_T window;
+
+    if (m_packets == 0) {
+        return;
+    }
+
+    window.start_us = m_window_us;
+    window.end_us = m_window_us + m_interval_us;
+    window.packets = m_packets;
+    window.distinct_src = m_distinctSrc.estimate();
+    window.distinct_dst = m_distinctDst.estimate();
+    snapshot(hitters);
+    m_proxy->on_heavy_hitters(window, hitters);
+    m_snapshots++;
+
+    for (size_t d = 0; d < HEAVY_DIMENSIONS; d++) {
+        m_sketches[d].clear();
+        for (size_t m = 0; m < HEAVY_METRICS; m++) {
+            m_top[d][m].clear();
+        }
+    }
+    m_distinctSrc.clear();
+    m_distinctDst.clear();
+    m_packets = 0;
+}
+
+uint64_t HeavyHitters::get_snapshots (void) {
+    return m_snapshots;
+}
+
+//=============================================================================
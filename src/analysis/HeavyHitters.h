@@ -0,0 +1,238 @@
+/**@file HeavyHitters.h
+ */
+#ifndef HEAVY_HITTERS_H_
+#define HEAVY_HITTERS_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "FlowKey.h"
+#include "HyperLogLog.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Count-Min rows and counters per row (a power of two). Estimates are
+//off by at most 2/width of the window's total with probability
+//1 - (1/2)^depth.
+#define HEAVY_CMS_DEPTH         (4)
+#define HEAVY_CMS_WIDTH         (4096)
+
+//Keys monitored per ranking, more than are reported so that the
+//reported ones are exact more often
+#define HEAVY_CAPACITY          (128)
+#define HEAVY_INDEX_SIZE        (256)
+
+//Keys reported per ranking in each snapshot
+#define HEAVY_TOP_K             (20)
+
+typedef enum {
+    HEAVY_SRC           = 0,    //Source address
+    HEAVY_DST           = 1,    //Destination address
+    HEAVY_DPORT         = 2,    //Protocol and destination port
+    HEAVY_FLOW          = 3,    //Full flow key
+    HEAVY_DIMENSIONS    = 4
+} HeavyDimension_T;
+
+typedef enum {
+    HEAVY_PACKETS       = 0,
+    HEAVY_BYTES         = 1,
+    HEAVY_METRICS       = 2
+} HeavyMetric_T;
+
+typedef struct {
+    uint64_t value[HEAVY_METRICS];
+} HeavyCounter_T;
+
+/**
+ * A monitored key. Its true count lies between count - error and count.
+ */
+typedef struct {
+    FlowKey_T key;
+    uint64_t hash;
+    uint64_t count;
+    uint64_t error;
+} HeavyEntry_T;
+
+typedef struct {
+    HeavyDimension_T dimension;
+    HeavyMetric_T metric;
+    HeavyEntry_T entry;
+    uint64_t distinct;      //Destinations of a source, sources of a destination
+} HeavyHitter_T;
+
+typedef struct {
+    uint64_t start_us;
+    uint64_t end_us;
+    uint64_t packets;
+    uint64_t distinct_src;
+    uint64_t distinct_dst;
+} HeavyWindow_T;
+
+/**
+ * Entries of the two summaries a merged entry came from, -1 where the
+ * key wasn't monitored.
+ */
+typedef struct {
+    int self;
+    int other;
+} HeavyOrigin_T;
+
+/**
+ * Count-Min sketch counting packets and bytes side by side, so both
+ * share the row hashes. Sketches of the same size merge by adding
+ * their counters.
+ */
+class CountMinSketch {
+public:
+    CountMinSketch (void);
+
+    /**
+     * @return HeavyCounter_T Estimate of the key's counts, including
+     *         these.
+     */
+    HeavyCounter_T add (uint64_t hash, uint64_t packets, uint64_t bytes);
+
+    /**
+     * @return HeavyCounter_T Upper bounds of the key's counts.
+     */
+    HeavyCounter_T estimate (uint64_t hash) const;
+
+    void merge (const CountMinSketch& other);
+    void clear (void);
+
+protected:
+    std::vector<HeavyCounter_T> m_cells;
+};
+
+/**
+ * Space-Saving summary of the heaviest keys of one metric.
+ *
+ * Entries are found through a small open addressed index and kept in
+ * a min-heap by count, so updates and evictions take O(log capacity).
+ * A key that isn't monitored only replaces the lightest entry when the
+ * Count-Min estimate says it is heavier, so light keys cost an index
+ * probe rather than an eviction.
+ */
+class SpaceSaving {
+public:
+    SpaceSaving (void);
+
+    /**
+     * @param key Key, already reduced to the dimension.
+     * @param hash FlowKeyHash() of key.
+     * @param value Amount added.
+     * @param estimate Count-Min estimate of the key including value.
+     * @param bNew Set if the entry was just given to the key.
+     * @return int Entry of the key, -1 if it isn't monitored.
+     */
+    int offer (const FlowKey_T& key, uint64_t hash, uint64_t value, uint64_t estimate,
+               bool& bNew);
+
+    /**
+     * Combines another summary into this one, keeping the heaviest
+     * HEAVY_CAPACITY keys of both.
+     *
+     * @param pOrigins Populated with where each entry came from.
+     */
+    void merge (const SpaceSaving& other, std::vector<HeavyOrigin_T>* pOrigins = NULL);
+
+    /**
+     * @param entries Populated with up to k entries, heaviest first.
+     */
+    void top (std::vector<int>& entries, size_t k) const;
+
+    const HeavyEntry_T& entry (int index) const;
+
+    /**
+     * @return int Entry of the key, -1 if it isn't monitored.
+     */
+    int find (const FlowKey_T& key, uint64_t hash) const;
+
+    void clear (void);
+
+protected:
+    void index_insert (uint64_t hash, size_t entry);
+    void index_erase (uint64_t hash, size_t entry);
+    void heap_swap (size_t a, size_t b);
+    void sift_up (size_t pos);
+    void sift_down (size_t pos);
+
+protected:
+    std::vector<HeavyEntry_T> m_entries;
+    std::vector<uint16_t> m_index;      //Entry + 1, 0 when free
+    std::vector<uint16_t> m_heap;       //Entries, lightest first
+    std::vector<uint16_t> m_pos;        //Heap position of each entry
+};
+
+class PacketMsgProxy;
+
+/**
+ * Finds the sources, destinations, destination ports and flows with
+ * the most packets and bytes in fixed memory.
+ *
+ * Packet time is cut into windows of a fixed length; at the end of
+ * each window the top keys are sent to the ZMQ host and the
+ * structures start over.
+ *
+ * The window's distinct sources and destinations are counted with
+ * HyperLogLog, as are the destinations of each source and the sources
+ * of each destination monitored in the packet rankings, so scans and
+ * floods show up without per pair state. Instances covering the same window, e.g. one
+ * per thread, can be combined with merge() before the snapshot.
+ */
+class HeavyHitters {
+public:
+    /**
+     * @param proxy ZMQ host the snapshots are sent to.
+     * @param interval_us Length of a window in packet time.
+     */
+    HeavyHitters (std::shared_ptr<PacketMsgProxy> proxy, uint64_t interval_us);
+
+    /**
+     * Counts an IP packet.
+     *
+     * @param pData Captured IP header.
+     * @param len Bytes captured from pData.
+     * @param vlan VLAN ID the packet was tagged with, 0 if untagged.
+     * @param timestamp_us Capture time.
+     */
+    void on_packet (const uint8_t* pData, uint32_t len, uint16_t vlan, uint64_t timestamp_us);
+
+    void merge (const HeavyHitters& other);
+
+    /**
+     * @param hitters Populated with the top keys of every ranking.
+     */
+    void snapshot (std::vector<HeavyHitter_T>& hitters) const;
+
+    /**
+     * Sends the current window, if it saw any packets, and starts a
+     * new one.
+     */
+    void flush (void);
+
+    uint64_t get_snapshots (void);
+
+protected:
+    int add (HeavyDimension_T dimension, const FlowKey_T& key, uint64_t bytes, bool& bNew);
+    uint64_t distinct (size_t dimension, const HeavyEntry_T& entry) const;
+
+protected:
+    std::shared_ptr<PacketMsgProxy> m_proxy;
+    uint64_t m_interval_us;
+    uint64_t m_window_us;               //Start of the current window
+    uint64_t m_packets;                 //Counted in the current window
+    uint64_t m_snapshots;
+    CountMinSketch m_sketches[HEAVY_DIMENSIONS];
+    SpaceSaving m_top[HEAVY_DIMENSIONS][HEAVY_METRICS];
+    HyperLogLog m_distinctSrc;
+    HyperLogLog m_distinctDst;
+    std::vector<HyperLogLog> m_fanout[2];   //By HEAVY_SRC or HEAVY_DST packets entry
+};
+
+//=============================================================================
+#endif //HEAVY_HITTERS_H_
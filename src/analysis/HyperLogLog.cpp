@@ -0,0 +1,64 @@
+/**@file HyperLogLog.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "HyperLogLog.h"
+#include <math.h>
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+HyperLogLog::HyperLogLog (void)
+{
+    clear();
+}
+
+uint64_t HyperLogLog::estimate (void) const {
+    const double m = HLL_REGISTERS;
+    const double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double sum = 0.0;
+    uint32_t zeros = 0;
+
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -m_registers[i]);
+        zeros += (m_registers[i] == 0);
+    }
+
+    double raw = alpha * m * m / sum;
+    if ((raw <= HLL_LINEAR_THRESHOLD) && (zeros != 0)) {
+        return (uint64_t)(m * log(m / zeros) + 0.5);
+    }
+    return (uint64_t)(raw + 0.5);
+}
+
+void HyperLogLog::merge (const HyperLogLog& other) {
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+        m_registers[i] = (other.m_registers[i] > m_registers[i]) ? other.m_registers[i]
+                                                                 : m_registers[i];
+    }
+}
+
+void HyperLogLog::serialize (std::vector<uint8_t>& out) const {
+    out.push_back(HLL_PRECISION);
+    out.insert(out.end(), m_registers, m_registers + HLL_REGISTERS);
+}
+
+bool HyperLogLog::deserialize (const uint8_t* pData, size_t len) {
+    if (len != 1 + HLL_REGISTERS || pData[0] != HLL_PRECISION) {
+        return false;
+    }
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+        if (pData[1 + i] > HLL_MAX_RANK) {
+            return false;
+        }
+    }
+    memcpy(m_registers, pData + 1, HLL_REGISTERS);
+    return true;
+}
+
+void HyperLogLog::clear (void) {
+    memset(m_registers, 0, sizeof(m_registers));
+}
+
+//=============================================================================
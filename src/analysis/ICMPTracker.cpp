@@ -17,10 +17,13 @@ extern std::shared_ptr<PacketMsgProxy> g_packetMsgProxy;
 //=============================================================================
 ICMPTracker::ICMPTracker (uint64_t timeout_us)
   : m_addrList(),
+    m_loaded(),
     m_timeout_us(timeout_us),
     m_opened(0),
     m_closed(0),
-    m_typenameMap()
+    m_expiry(),
+    m_typenameMap(),
+    m_typenameMap6()
 {
     m_typenameMap[0] = "ECHO_REPLY";
     m_typenameMap[1] = "RESERVED1";
@@ -57,6 +60,24 @@ ICMPTracker::ICMPTracker (uint64_t timeout_us)
     m_typenameMap[32] = "MOBILE_HOST_REDIR";
     m_typenameMap[42] = "EXTENDED_ECHO_REQ";
     m_typenameMap[43] = "EXTENDED_ECHO_REPLY";
+
+    m_typenameMap6[1] = "DEST_UNREACHABLE";
+    m_typenameMap6[2] = "PACKET_TOO_BIG";
+    m_typenameMap6[3] = "TIME_EXCEEDED";
+    m_typenameMap6[4] = "PARAM_PROBLEM";
+    m_typenameMap6[128] = "ECHO_REQUEST";
+    m_typenameMap6[129] = "ECHO_REPLY";
+    m_typenameMap6[130] = "MLD_QUERY";
+    m_typenameMap6[131] = "MLD_REPORT";
+    m_typenameMap6[132] = "MLD_DONE";
+    m_typenameMap6[133] = "ROUTER_SOLICITATION";
+    m_typenameMap6[134] = "ROUTER_ADVERTISEMENT";
+    m_typenameMap6[135] = "NEIGHBOR_SOLICITATION";
+    m_typenameMap6[136] = "NEIGHBOR_ADVERTISEMENT";
+    m_typenameMap6[137] = "REDIRECT";
+    m_typenameMap6[143] = "MLDV2_REPORT";
+    m_typenameMap6[160] = "EXTENDED_ECHO_REQ";
+    m_typenameMap6[161] = "EXTENDED_ECHO_REPLY";
 }
 
 ICMPTracker::~ICMPTracker (void)
@@ -64,10 +85,11 @@ ICMPTracker::~ICMPTracker (void)
     m_addrList.clear();
 }
 
-std::string ICMPTracker::get_type_name (long msgtype) {
+std::string ICMPTracker::get_type_name (long msgtype, uint16_t protocol) {
     std::string sRetVal = "";
-    if (m_typenameMap.count(msgtype) > 0) {
-        sRetVal = m_typenameMap[msgtype];
+    std::map<long, std::string>& typenameMap = (protocol == 58) ? m_typenameMap6 : m_typenameMap;
+    if (typenameMap.count(msgtype) > 0) {
+        sRetVal = typenameMap[msgtype];
     }
     /*
     for (size_t i=0; i<sizeof(msgtype)*8; i++) {
@@ -85,32 +107,74 @@ std::string ICMPTracker::get_type_name (long msgtype) {
     return sRetVal;
 }
 
-void ICMPTracker::on_packet (const Packet& packet) {
+void ICMPTracker::on_packet (const Packet& packet, uint16_t vlan) {
     const PDU* pduPtr = packet.pdu();
     long int seconds = packet.timestamp().seconds();
     long int microseconds = packet.timestamp().microseconds();
 
-    const IP* ipHeader = pduPtr->find_pdu<IP>();
+    uint32_t bytes = 0;
+    uint8_t msgtype = 0;
+    uint16_t seqnum = 0;
+    uint8_t protocol = 1;
+
     const ICMP* ICMPHeader = pduPtr->find_pdu<ICMP>();
-    const RawPDU* raw = pduPtr->find_pdu<RawPDU>();
+    const ICMPv6* ICMPv6Header = ICMPHeader ? NULL : pduPtr->find_pdu<ICMPv6>();
 
-    if (!ICMPHeader || !ipHeader) {
+    if (ICMPHeader) {
+        msgtype = ICMPHeader->type();
+        seqnum = ICMPHeader->sequence();
+    } else if (ICMPv6Header) {
+        msgtype = ICMPv6Header->type();
+        seqnum = ICMPv6Header->sequence();
+        protocol = 58;
+    } else {
+        return;
+    }
+
+    ICMPAddressTuple hdrTemp;
+    if (!FlowKeySetAddresses(pduPtr, hdrTemp.key, bytes)) {
         return;
     }
+    hdrTemp.key.vlan = vlan;
+    hdrTemp.key.protocol = protocol;
+    hdrTemp.timestamp_s = seconds;
+    hdrTemp.timestamp_us = microseconds;
+    hdrTemp.last_active_s = seconds;
+    hdrTemp.last_active_us = microseconds;
+    hdrTemp.packets = 1;
+    hdrTemp.bytes = bytes;
+    hdrTemp.state = ICMP_ACTIVE;
+    hdrTemp.msgtype = msgtype;
+    hdrTemp.seqnum = seqnum;
+
+    on_tuple(hdrTemp, seconds, microseconds, true);
+}
 
+void ICMPTracker::on_fragment (const FlowKey_T& key, uint32_t packets, uint32_t bytes,
+                               const uint8_t* pHeader, uint32_t len,
+                               long int seconds, long int microseconds) {
     ICMPAddressTuple hdrTemp;
-    hdrTemp.src = ipHeader->src_addr();
-    hdrTemp.dst = ipHeader->dst_addr();
-    hdrTemp.dport = 0;
-    hdrTemp.sport = 0;
+    hdrTemp.key = key;
     hdrTemp.timestamp_s = seconds;
     hdrTemp.timestamp_us = microseconds;
     hdrTemp.last_active_s = seconds;
     hdrTemp.last_active_us = microseconds;
+    hdrTemp.packets = packets;
+    hdrTemp.bytes = bytes;
     hdrTemp.state = ICMP_ACTIVE;
-    hdrTemp.msgtype = ICMPHeader->type();
-    hdrTemp.seqnum = ICMPHeader->sequence();
 
+    //Type and sequence number sit in the same place for ICMP and ICMPv6
+    //echo messages
+    if (pHeader && len >= 8) {
+        hdrTemp.msgtype = pHeader[0];
+        hdrTemp.seqnum = ((uint16_t)pHeader[6] << 8) | pHeader[7];
+    }
+
+    on_tuple(hdrTemp, seconds, microseconds, pHeader != NULL && len >= 8);
+}
+
+void ICMPTracker::on_tuple (const ICMPAddressTuple& hdrTemp, long int seconds, long int microseconds,
+                            bool bOpen) {
     auto ctmp = find_icmp(m_addrList.begin(),
                           m_addrList.end(),
                           hdrTemp,
@@ -120,72 +184,80 @@ void ICMPTracker::on_packet (const Packet& packet) {
 
     if (ctmp != m_addrList.end()) {
         if ((*ctmp).state != ICMP_CLOSED) {
+            (*ctmp).packets += hdrTemp.packets;
+            (*ctmp).bytes += hdrTemp.bytes;
+
             auto cm = ConnectionMetadata();
-            cm.src = (*ctmp).src;
-            cm.dst = (*ctmp).dst;
-            cm.l4_dst = (*ctmp).dport;
-            cm.l4_src = (*ctmp).sport;
+            cm.set_key((*ctmp).key);
             cm.msgtype = (*ctmp).msgtype;
             cm.seqnum = (*ctmp).seqnum;
-            cm.protocol = 1;
             cm.l4_protocol = 0;
             cm.timestamp_s = (*ctmp).timestamp_s;
             cm.timestamp_us = (*ctmp).timestamp_us;
             cm.update_hash();
 
-            if ((((*ctmp).last_active_s * (10^6) + 
-                  (*ctmp).last_active_us) + m_timeout_us) >
-                (seconds * (10^6) + microseconds)) {
+            uint64_t now = FlowExpiryTime(seconds, microseconds);
+            if (FlowExpiryTime((*ctmp).last_active_s, (*ctmp).last_active_us) + m_timeout_us > now) {
                 (*ctmp).last_active_s = seconds;
                 (*ctmp).last_active_us = microseconds;
+                //The expiry key catches up when the connection is next
+                //looked at by prune_connections()
             } else {
+                //Closed connections are keyed at time zero, so the next
+                //prune drops them
                 (*ctmp).state = ICMP_CLOSED;
+                m_expiry.remove((*ctmp).expiry_key);
+                (*ctmp).expiry_key = m_expiry.add(0, ctmp - m_addrList.begin());
                 cm.end_timestamp_s = seconds;
                 cm.end_timestamp_us = microseconds;
+                cm.packets = (*ctmp).packets;
+                cm.bytes = (*ctmp).bytes;
                 cm.update_hash();
 
                 #if 1
-                PrintLogMessage(
-                    LEVEL_DEBUG,
-                    SUBSYSTEM_ICMP,
-                    "ICMP CLOSE %-15s: %-15s -> %-15s:%02x/%s (seqnum = %u)",
-                    cm.hash.c_str(),
-                    cm.src_str().c_str(),
-                    cm.dst_str().c_str(),
-                    (*ctmp).msgtype,
-                    get_type_name((*ctmp).msgtype).c_str(),
-                    (*ctmp).seqnum
-                );
+                if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_ICMP)) {
+                    PrintLogMessage(
+                        LEVEL_DEBUG,
+                        SUBSYSTEM_ICMP,
+                        "ICMP CLOSE %-15s: %-15s -> %-15s:%02x/%s (seqnum = %u)",
+                        cm.hash.c_str(),
+                        cm.src_str().c_str(),
+                        cm.dst_str().c_str(),
+                        (*ctmp).msgtype,
+                        get_type_name((*ctmp).msgtype, cm.protocol).c_str(),
+                        (*ctmp).seqnum
+                    );
+                }
                 #endif
 
                 m_closed++;
                 g_packetMsgProxy->on_end_connection(&cm);
             }
         }
-    } else {
+    } else if (bOpen) {
         auto cm = ConnectionMetadata();
-        cm.src = ipHeader->src_addr();
-        cm.dst = ipHeader->dst_addr();
-        cm.l4_dst = 0;
-        cm.l4_src = 0;
-        cm.protocol = 1;
+        cm.set_key(hdrTemp.key);
         cm.l4_protocol = 0;
-        cm.msgtype = ICMPHeader->type();
-        cm.seqnum = ICMPHeader->sequence();
+        cm.msgtype = hdrTemp.msgtype;
+        cm.seqnum = hdrTemp.seqnum;
         cm.timestamp_s = seconds;
         cm.timestamp_us = microseconds;
         cm.update_hash();
 
         m_addrList.push_back(hdrTemp);
+        m_addrList.back().expiry_key = m_expiry.add(FlowExpiryTime(seconds, microseconds),
+                                                    m_addrList.size() - 1);
 
-        PrintLogMessage(
-            LEVEL_DEBUG,
-            SUBSYSTEM_ICMP,
-            "ICMP %-15s: %-15s -> %-15s:%02x/%s (seqnum = %u)",
-            cm.hash.c_str(),
-            cm.src_str().c_str(),
-            cm.dst_str().c_str(), ICMPHeader->type(), get_type_name(ICMPHeader->type()).c_str(), ICMPHeader->sequence()
-        );
+        if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_ICMP)) {
+            PrintLogMessage(
+                LEVEL_DEBUG,
+                SUBSYSTEM_ICMP,
+                "ICMP %-15s: %-15s -> %-15s:%02x/%s (seqnum = %u)",
+                cm.hash.c_str(),
+                cm.src_str().c_str(),
+                cm.dst_str().c_str(), cm.msgtype, get_type_name(cm.msgtype, cm.protocol).c_str(), cm.seqnum
+            );
+        }
 
         m_opened++;
 
@@ -197,47 +269,90 @@ void ICMPTracker::prune_connections (
     uint64_t last_s,
     uint64_t last_us
 ) {
-    bool done = false;
-    auto iter = m_addrList.begin();
-    while (!done) {
-    for_start:
-        for (;iter != m_addrList.end(); iter++) {
-            if (((*iter).state == ICMP_CLOSED) ||
-                ((((*iter).last_active_s) * 10^6 + (*iter).last_active_us + m_timeout_us) < 
-                 (last_s * (10^6) + last_us))) {
-
-                auto cm = ConnectionMetadata();
-                cm.src = (*iter).src;
-                cm.dst = (*iter).dst;
-                cm.l4_dst = (*iter).dport;
-                cm.l4_src = (*iter).sport;
-                cm.protocol = 1;
-                cm.l4_protocol = 0;
-                cm.msgtype = (*iter).msgtype;
-                cm.seqnum = (*iter).seqnum;
-                cm.timestamp_s = (*iter).timestamp_s;
-                cm.timestamp_us = (*iter).timestamp_us;
-                cm.update_hash();
+    uint64_t now = FlowExpiryTime(last_s, last_us);
+    uint64_t cutoff = (now > m_timeout_us) ? now - m_timeout_us : 0;
+    std::vector<FlowExpiryEntry> idle;
+    std::vector<size_t> expired;
 
-                #if 1
-                PrintLogMessage(
-                    LEVEL_DEBUG,
-                    SUBSYSTEM_ICMP,
-                    "ICMP CLOSE %-15s: %-15s-> %-15s:%02x/%s (seqnum = %u)",
-                    cm.hash.c_str(),
-                    cm.src_str().c_str(),
-                    cm.dst_str().c_str(), (*iter).msgtype, get_type_name((*iter).msgtype).c_str(), (*iter).seqnum
-                );
-                #endif
+    //Only connections keyed before the cutoff are looked at. Those
+    //active since go back into the index under their last activity.
+    m_expiry.take_idle(cutoff, idle);
+    for (auto& entry : idle) {
+        ICMPAddressTuple& tuple = m_addrList[entry.slot];
+        uint64_t lastActive = FlowExpiryTime(tuple.last_active_s, tuple.last_active_us);
 
-                g_packetMsgProxy->on_end_connection(&cm);
+        if (tuple.state != ICMP_CLOSED && lastActive >= cutoff) {
+            tuple.expiry_key = m_expiry.add(lastActive, entry.slot);
+            continue;
+        }
 
-                m_closed++;
-                iter = m_addrList.erase(iter);
-                goto for_start;
-            }
+        expired.push_back(entry.slot);
+        if (tuple.state == ICMP_CLOSED) {
+            continue;
+        }
+
+        //Connections closed in on_packet() have already been
+        //reported, so only timed out connections are reported here.
+        auto cm = ConnectionMetadata();
+        cm.set_key(tuple.key);
+        cm.l4_protocol = 0;
+        cm.msgtype = tuple.msgtype;
+        cm.seqnum = tuple.seqnum;
+        cm.timestamp_s = tuple.timestamp_s;
+        cm.timestamp_us = tuple.timestamp_us;
+        cm.end_timestamp_s = tuple.last_active_s;
+        cm.end_timestamp_us = tuple.last_active_us;
+        cm.packets = tuple.packets;
+        cm.bytes = tuple.bytes;
+        cm.update_hash();
+
+        #if 1
+        if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_ICMP)) {
+            PrintLogMessage(
+                LEVEL_DEBUG,
+                SUBSYSTEM_ICMP,
+                "ICMP CLOSE %-15s: %-15s-> %-15s:%02x/%s (seqnum = %u)",
+                cm.hash.c_str(),
+                cm.src_str().c_str(),
+                cm.dst_str().c_str(), tuple.msgtype, get_type_name(tuple.msgtype, cm.protocol).c_str(), tuple.seqnum
+            );
         }
-        done = true;
+        #endif
+
+        g_packetMsgProxy->on_end_connection(&cm);
+
+        m_closed++;
+    }
+
+    //Fill each gap from the back of the list. Going from the highest
+    //position down, the back is always a connection that stays.
+    std::sort(expired.begin(), expired.end(), std::greater<size_t>());
+    for (auto slot : expired) {
+        if (slot != m_addrList.size() - 1) {
+            m_addrList[slot] = m_addrList.back();
+            m_expiry.move(m_addrList[slot].expiry_key, slot);
+        }
+        m_addrList.pop_back();
+    }
+}
+
+void ICMPTracker::rebuild_expiry (void) {
+    std::vector<FlowExpiryEntry> flows;
+
+    flows.reserve(m_addrList.size());
+    for (size_t i = 0; i < m_addrList.size(); i++) {
+        ICMPAddressTuple& tuple = m_addrList[i];
+        uint64_t time_us = 0;
+
+        if (tuple.state != ICMP_CLOSED) {
+            time_us = FlowExpiryTime(tuple.last_active_s, tuple.last_active_us);
+        }
+        flows.push_back(FlowExpiryEntry(time_us, i));
+    }
+
+    m_expiry.load(flows);
+    for (auto& flow : flows) {
+        m_addrList[flow.slot].expiry_key = flow.key;
     }
 }
 
@@ -253,6 +368,21 @@ size_t ICMPTracker::get_closed (void) {
     return m_closed;
 }
 
+bool ICMPTracker::save_state (FILE* fp) {
+    return SaveTrackerState(fp, m_addrList, m_opened, m_closed);
+}
+
+bool ICMPTracker::load_state (FILE* fp) {
+    return LoadTrackerState(fp, m_loaded);
+}
+
+void ICMPTracker::commit_state (bool bApply) {
+    CommitTrackerState(m_loaded, bApply, m_addrList, m_opened, m_closed);
+    if (bApply) {
+        rebuild_expiry();
+    }
+}
+
 std::shared_ptr<ICMPTracker> ICMPTracker::GetStaticInstance (uint64_t timeout_us) {
     if (gs_ICMPTracker == nullptr) {
         gs_ICMPTracker = std::make_shared<ICMPTracker>(timeout_us);
@@ -26,8 +26,10 @@
 #include "TrackerInterface.h"
 #include "Logging.h"
 #include "BTree.h"
+#include "FlowExpiryIndex.h"
 #include "PacketMsgProxy.h"
 #include "MD5ByteContainer.h"
+#include "FlowKey.h"
 
 //=============================================================================
 // DEFINITIONS
@@ -46,36 +48,39 @@ typedef enum {
 class ICMPAddressTuple {
 public:
     ICMPAddressTuple (void)
-     : src(0),
-       dst(0),
-       dport(0),
-       sport(0),
+     : key(),
        timestamp_s(0),
        timestamp_us(0),
        last_active_s(0),
        last_active_us(0),
+       packets(0),
+       bytes(0),
        state(ICMP_ACTIVE),
        msgtype(0),
-       seqnum(0)
+       seqnum(0),
+       expiry_key(0)
     {
     }
 
 public:
-    uint32_t src;
-    uint32_t dst;
-    uint16_t dport;
-    uint16_t sport;
+    FlowKey_T key;
     uint64_t timestamp_s;
     uint64_t timestamp_us;
     uint64_t last_active_s;
     uint64_t last_active_us;
+    uint64_t packets;
+    uint64_t bytes;
     ICMP_State_T state;
     long msgtype;
     long seqnum;
+    uint64_t expiry_key;            //Key in the tracker's FlowExpiryIndex, at or before last activity
 };
 
+/**
+ * Finds the connection a packet belongs to, in either direction.
+ */
 template<class InputIt, class T>
-constexpr InputIt find_icmp (
+InputIt find_icmp (
     InputIt first,
     InputIt last,
     const T& value,
@@ -83,15 +88,10 @@ constexpr InputIt find_icmp (
     uint64_t last_us,
     uint64_t timeout_us
 ) {
+    FlowKey_T rev = FlowKeyReverse(value.key);
     for (; first != last; ++first) {
-        if ((((*first).src == value.dst &&
-            (*first).dst == value.src) ||
-            ((*first).src == value.src ||
-            (*first).dst == value.dst)) &&
-            ((*first).dport == value.dport ||
-             (*first).sport == value.sport ||
-             (*first).dport == value.sport ||
-             (*first).sport == value.dport)) {
+        if (FlowKeyEqual((*first).key, value.key) ||
+            FlowKeyEqual((*first).key, rev)) {
 
             #if 0
             if ((((*first).last_active_s * (10^6) + 
@@ -120,11 +120,28 @@ public:
      * This routine handles packets.
      *  
      * @param packet Reference to packet just received.
+     * @param vlan VLAN ID the packet was tagged with, 0 if untagged.
+     */
+    virtual void on_packet (const Packet& packet, uint16_t vlan = 0);
+
+    /**
+     * Counts IP fragments towards their datagram's conversation. Only a
+     * first fragment, which carries the ICMP header, opens one.
+     *  
+     * @param key Conversation of the datagram.
+     * @param packets Number of fragments.
+     * @param bytes IP bytes of the fragments.
+     * @param pHeader ICMP header of a first fragment, NULL otherwise.
+     * @param len Bytes captured from pHeader.
      */
-    virtual void on_packet (const Packet& packet);
+    virtual void on_fragment (const FlowKey_T& key, uint32_t packets, uint32_t bytes,
+                              const uint8_t* pHeader, uint32_t len,
+                              long int seconds, long int microseconds);
 
     /**
-     * Prunes all closed connections. 
+     * Prunes closed connections and reports and prunes the ones idle 
+     * for longer than the timeout. Only the connections the expiry 
+     * index holds under a key before the cutoff are looked at. 
      */
     virtual void prune_connections (
         uint64_t last_s,
@@ -142,17 +159,32 @@ public:
 
     virtual size_t get_closed (void);
 
-    virtual std::string get_type_name (long msgtype);
+    virtual bool save_state (FILE* fp);
+    virtual bool load_state (FILE* fp);
+    virtual void commit_state (bool bApply);
+
+    /**
+     * Name of an ICMP (protocol 1) or ICMPv6 (protocol 58) type.
+     */
+    virtual std::string get_type_name (long msgtype, uint16_t protocol = 1);
 
 public:
     static std::shared_ptr<ICMPTracker> GetStaticInstance (uint64_t timeout_us);
 
+protected:
+    void on_tuple (const ICMPAddressTuple& hdrTemp, long int seconds, long int microseconds,
+                   bool bOpen);
+    void rebuild_expiry (void);
+
 protected:
     std::deque<ICMPAddressTuple> m_addrList;
+    TrackerState<ICMPAddressTuple> m_loaded;          //Staged by load_state()
     uint64_t m_timeout_us;
     size_t m_opened;
     size_t m_closed;
+    FlowExpiryIndex m_expiry;                       //Connections by last activity, closed ones first
     std::map<long, std::string> m_typenameMap;
+    std::map<long, std::string> m_typenameMap6;
 };
 
 //=============================================================================
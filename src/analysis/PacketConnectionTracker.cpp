@@ -18,7 +18,8 @@ PacketConnectionTracker::PacketConnectionTracker (uint64_t timeout_us, std::stri
    m_timeout_us(timeout_us),
    m_enable_tcp(true),
    m_enable_udp(true),
-   m_enable_icmp(true)
+   m_enable_icmp(true),
+   m_fragments()
 {
     if (sDisable.find(std::string("tcp")) != std::string::npos) {
         m_enable_tcp = false;
@@ -29,6 +30,9 @@ PacketConnectionTracker::PacketConnectionTracker (uint64_t timeout_us, std::stri
     if (sDisable.find(std::string("icmp")) != std::string::npos) {
         m_enable_icmp = false;
     }
+    if (sDisable.find(std::string("tls")) != std::string::npos) {
+        TCPTracker::GetStaticInstance(m_timeout_us)->set_tls_inspection(false);
+    }
 }
 
 void PacketConnectionTracker::prune_connections (const Packet& last_packet) {
@@ -40,30 +44,73 @@ void PacketConnectionTracker::prune_connections (const Packet& last_packet) {
     ICMPTracker::GetStaticInstance(m_timeout_us)->prune_connections(seconds, microseconds);    
 }
 
-void PacketConnectionTracker::on_packet (const Packet& packet) {
+void PacketConnectionTracker::on_packet (const Packet& packet, uint16_t vlan,
+                                         const uint8_t* pL3, uint32_t l3Len) {
     const PDU* pduPtr = packet.pdu();
     long int seconds = packet.timestamp().seconds();
     long int microseconds = packet.timestamp().microseconds();
 
-    const IP* ipHeader = pduPtr->find_pdu<IP>();
+    //libtins hands fragments back as raw payload (or, for IPv6, decodes
+    //the middle of a datagram as if it were an L4 header), so they are
+    //counted against the flow of their first fragment instead
+    FragmentResult_T frag;
+    if (pL3 && m_fragments.on_packet(pL3, l3Len, seconds * 1000000ULL + microseconds, frag)) {
+        if (frag.attributed) {
+            on_fragment(frag, vlan, seconds, microseconds);
+        }
+        m_packetCount++;
+        return;
+    }
+
     const TCP* tcpHeader = pduPtr->find_pdu<TCP>();
     const UDP* udpHeader = pduPtr->find_pdu<UDP>();
-    const ICMP* icmpHeader = pduPtr->find_pdu<ICMP>();
-    const RawPDU* raw = pduPtr->find_pdu<RawPDU>();
+    const PDU* icmpHeader = pduPtr->find_pdu<ICMP>();
+    if (!icmpHeader) {
+        icmpHeader = pduPtr->find_pdu<ICMPv6>();
+    }
 
     if (tcpHeader && m_enable_tcp) {
-        TCPTracker::GetStaticInstance(m_timeout_us)->on_packet(packet);
+        TCPTracker::GetStaticInstance(m_timeout_us)->on_packet(packet, vlan, pL3, l3Len);
     }
     if (udpHeader && m_enable_udp) {
-        UDPTracker::GetStaticInstance(m_timeout_us)->on_packet(packet);
+        UDPTracker::GetStaticInstance(m_timeout_us)->on_packet(packet, vlan);
     } 
     if (icmpHeader && m_enable_icmp) {
-        ICMPTracker::GetStaticInstance(m_timeout_us)->on_packet(packet);
+        ICMPTracker::GetStaticInstance(m_timeout_us)->on_packet(packet, vlan);
     }
 
     m_packetCount++;
 }
 
+void PacketConnectionTracker::on_fragment (FragmentResult_T& frag, uint16_t vlan,
+                                           long int seconds, long int microseconds) {
+    frag.key.vlan = vlan;
+
+    switch (frag.key.protocol) {
+    case 6:
+        if (m_enable_tcp) {
+            TCPTracker::GetStaticInstance(m_timeout_us)->on_fragment(frag.key, frag.packets, frag.bytes);
+        }
+        break;
+    case 17:
+        if (m_enable_udp) {
+            UDPTracker::GetStaticInstance(m_timeout_us)->on_fragment(frag.key, frag.packets, frag.bytes,
+                                                                     seconds, microseconds);
+        }
+        break;
+    case 1:
+    case 58:
+        if (m_enable_icmp) {
+            ICMPTracker::GetStaticInstance(m_timeout_us)->on_fragment(frag.key, frag.packets, frag.bytes,
+                                                                      frag.l4, frag.l4_len,
+                                                                      seconds, microseconds);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
 void PacketConnectionTracker::on_connection (uint64_t cid, std::string hash) {
     PrintLogMessage(
         LEVEL_VERBOSE,
@@ -78,4 +125,68 @@ size_t PacketConnectionTracker::packet_count (void) {
     return m_packetCount;
 }
 
+FragmentTracker& PacketConnectionTracker::fragments (void) {
+    return m_fragments;
+}
+
+bool PacketConnectionTracker::save_state (std::string sPath) {
+    std::string sTemp = sPath + ".tmp";
+    uint64_t packetCount = m_packetCount;
+
+    FILE* fp = fopen(sTemp.c_str(), "wb");
+    if (!fp) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_CONN_TRACK,
+                        "Unable to write tracker state %s", sPath.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&packetCount, sizeof(packetCount), 1, fp) == 1 &&
+              TCPTracker::GetStaticInstance(m_timeout_us)->save_state(fp) &&
+              UDPTracker::GetStaticInstance(m_timeout_us)->save_state(fp) &&
+              ICMPTracker::GetStaticInstance(m_timeout_us)->save_state(fp);
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(sTemp.c_str(), sPath.c_str()) != 0) {
+        remove(sTemp.c_str());
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_CONN_TRACK,
+                        "Unable to write tracker state %s", sPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool PacketConnectionTracker::load_state (std::string sPath) {
+    uint64_t packetCount = 0;
+    std::shared_ptr<TCPTracker> tcp = TCPTracker::GetStaticInstance(m_timeout_us);
+    std::shared_ptr<UDPTracker> udp = UDPTracker::GetStaticInstance(m_timeout_us);
+    std::shared_ptr<ICMPTracker> icmp = ICMPTracker::GetStaticInstance(m_timeout_us);
+
+    FILE* fp = fopen(sPath.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+
+    //Every section is staged first so that a bad UDP or ICMP section
+    //can't leave the TCP connections restored on their own.
+    bool ok = fread(&packetCount, sizeof(packetCount), 1, fp) == 1 &&
+              tcp->load_state(fp) &&
+              udp->load_state(fp) &&
+              icmp->load_state(fp);
+    fclose(fp);
+
+    tcp->commit_state(ok);
+    udp->commit_state(ok);
+    icmp->commit_state(ok);
+
+    if (!ok) {
+        PrintLogMessage(LEVEL_WARNING, SUBSYSTEM_CONN_TRACK,
+                        "Ignoring invalid or incompatible tracker state %s", sPath.c_str());
+        return false;
+    }
+
+    m_packetCount = packetCount;
+    return true;
+}
+
 //=============================================================================
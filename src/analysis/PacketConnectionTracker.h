@@ -20,9 +20,10 @@
 #include <algorithm>
 
 #include "Logging.h"
-#include "BTree.h"
 #include "PacketMsgProxy.h"
 #include "MD5ByteContainer.h"
+#include "FlowKey.h"
+#include "FragmentTracker.h"
 
 //=============================================================================
 // DEFINITIONS
@@ -33,27 +34,42 @@ class ConnectionMetadata {
 public:
     ConnectionMetadata (void) :
         hash(""),
-        src(0),
-        dst(0),
+        src(),
+        dst(),
         protocol(0),
         l4_protocol(0),
         l4_src(0),
         l4_dst(0),
+        vlan(0),
         timestamp_s(0),
         timestamp_us(0),
         end_timestamp_s(0),
         end_timestamp_us(0),
         msgtype(0),
-        seqnum(0)
+        seqnum(0),
+        packets(0),
+        bytes(0),
+        sni(""),
+        ja3("")
     {
     }
 
     void update_hash (void) {
         std::string tmp;
-        uint32_t addr = src ^ dst;
         uint16_t l4 = l4_src ^ l4_dst;
         uint16_t p = protocol;
-        tmp += std::string((char*)&addr, 4);
+        if (is_ipv4()) {
+            //IPv4 connections keep the hashes they had before IPv6
+            //was tracked
+            uint32_t addr = FlowAddressGetV4(src) ^ FlowAddressGetV4(dst);
+            tmp += std::string((char*)&addr, 4);
+        } else {
+            FlowAddress_T addr;
+            for (size_t i = 0; i < FLOW_ADDR_SIZE; i++) {
+                addr.bytes[i] = src.bytes[i] ^ dst.bytes[i];
+            }
+            tmp += std::string((char*)addr.bytes, FLOW_ADDR_SIZE);
+        }
         //tmp += std::string((char*)&dst, 4);
         tmp += std::string((char*)&p, 2);
         //tmp += std::string((char*)&l4_protocol, 2);
@@ -63,47 +79,62 @@ public:
         tmp += std::string((char*)&seqnum, 4);
         tmp += std::string((char*)&timestamp_s, 8);
         tmp += std::string((char*)&timestamp_us, 8);
+        //Untagged connections keep the hashes they had before VLANs
+        //were tracked
+        if (vlan != 0) {
+            tmp += std::string((char*)&vlan, 2);
+        }
 
         MD5ByteContainer md5Container((uint8_t*)tmp.c_str(), tmp.size());
         hash = md5Container.toHexString();
     }
 
+    /**
+     * Fills in the addresses, ports, protocol and VLAN from a flow key.
+     */
+    void set_key (const FlowKey_T& key) {
+        src = key.src;
+        dst = key.dst;
+        l4_src = key.sport;
+        l4_dst = key.dport;
+        protocol = key.protocol;
+        vlan = key.vlan;
+    }
+
+    bool is_ipv4 (void) const {
+        return FlowAddressIsV4(src) && FlowAddressIsV4(dst);
+    }
+
+    /**
+     * Addresses are only formatted when they are exported or logged.
+     */
     const std::string src_str (void) const {
-        char tmpBuf[512];
-        snprintf(tmpBuf, sizeof(tmpBuf),
-                 "%u.%u.%u.%u", 
-                 (src >> 0) & 0xFF,
-                 (src >> 8) & 0xFF,
-                 (src >> 16) & 0xFF,
-                 (src >> 24) & 0xFF);
-        return std::string(tmpBuf);
+        return FlowAddressToString(src);
     }
 
     const std::string dst_str (void) const {
-        char tmpBuf[512];
-        snprintf(tmpBuf, sizeof(tmpBuf),
-                 "%u.%u.%u.%u", 
-                 (dst >> 0) & 0xFF,
-                 (dst >> 8) & 0xFF,
-                 (dst >> 16) & 0xFF,
-                 (dst >> 24) & 0xFF);
-        return std::string(tmpBuf);
+        return FlowAddressToString(dst);
     }
 
 public:
     std::string hash;
-    uint32_t src;
-    uint32_t dst;
+    FlowAddress_T src;
+    FlowAddress_T dst;
     uint16_t protocol;
     uint16_t l4_protocol;
     uint16_t l4_src;
     uint16_t l4_dst;
+    uint16_t vlan;
     long int timestamp_s;
     long int timestamp_us;
     long int end_timestamp_s;
     long int end_timestamp_us;
     long msgtype;
     long seqnum;
+    uint64_t packets;
+    uint64_t bytes;
+    std::string sni;        //Server name from a TLS ClientHello
+    std::string ja3;        //JA3 fingerprint of the ClientHello, in hex
 };
 
 /**
@@ -123,8 +154,16 @@ public:
      * This routine handles packets. 
      *  
      * @param packet Reference to packet just received.
+     * @param vlan VLAN ID the packet was tagged with, 0 if untagged. 
+     *             Connections on different VLANs are tracked
+     *             separately.
+     * @param pL3 Captured IP header, used to attribute fragments to 
+     *            the flow of their first fragment. NULL when the
+     *            capture bytes aren't at hand.
+     * @param l3Len Bytes captured from pL3.
      */
-    virtual void on_packet (const Packet& p);
+    virtual void on_packet (const Packet& p, uint16_t vlan = 0,
+                            const uint8_t* pL3 = NULL, uint32_t l3Len = 0);
 
     /**
      * This routine is called whenever a connection is made. 
@@ -144,16 +183,42 @@ public:
      */
     virtual size_t packet_count (void);
 
+    /**
+     * Fragment attribution counters. 
+     */
+    virtual FragmentTracker& fragments (void);
+
     virtual void prune_connections (const Packet& last_packet);
 
+    /**
+     * Writes a snapshot of every tracker's open connections. 
+     *  
+     * @param sPath Snapshot file path. 
+     * @return bool true on success, false on failure. 
+     */
+    virtual bool save_state (std::string sPath);
+
+    /**
+     * Restores a snapshot written by save_state(). Nothing is 
+     * restored unless every tracker's state is valid. 
+     *  
+     * @param sPath Snapshot file path. 
+     * @return bool true on success, false on failure. 
+     */
+    virtual bool load_state (std::string sPath);
+
+protected:
+    void on_fragment (FragmentResult_T& frag, uint16_t vlan, long int seconds, long int microseconds);
+
 protected:
-    //BTree<uint64_t, ConnectionMetadata> m_btree;
     size_t m_packetCount;
     uint64_t m_timeout_us;
 
     bool m_enable_tcp;
     bool m_enable_udp;
     bool m_enable_icmp;
+
+    FragmentTracker m_fragments;
 };
 
 
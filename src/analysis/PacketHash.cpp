@@ -0,0 +1,244 @@
+/**@file PacketHash.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "PacketHash.h"
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define IPV4_HEADER_SIZE        (20)
+#define IPV6_HEADER_SIZE        (40)
+#define UDP_HEADER_SIZE         (8)
+#define TCP_HEADER_SIZE         (20)
+
+static_assert((DEDUP_BUCKETS & (DEDUP_BUCKETS - 1)) == 0, "dedup buckets must be a power of two");
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+static inline uint16_t read16 (const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint64_t hash_mix (uint64_t h, uint64_t v) {
+    h ^= v * 0x9E3779B97F4A7C15ULL;
+    h = ((h << 31) | (h >> 33)) * 0xC2B2AE3D27D4EB4FULL;
+    return h;
+}
+
+static uint64_t hash_bytes (uint64_t h, const uint8_t* p, uint32_t len) {
+    uint64_t v;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&v, p, 8);
+        h = hash_mix(h, v);
+    }
+    if (len) {
+        v = 0;
+        memcpy(&v, p, len);
+        h = hash_mix(h, v ^ ((uint64_t)len << 56));
+    }
+    return h;
+}
+
+/**
+ * Bytes of the L4 header followed by the payload prefix.
+ */
+static inline uint32_t l4_prefix (uint8_t protocol, const uint8_t* pL4, uint32_t len) {
+    uint32_t hdrLen = UDP_HEADER_SIZE;
+
+    if (protocol == 6 && len >= TCP_HEADER_SIZE) {
+        hdrLen = (pL4[12] >> 4) * 4;
+    }
+    return std::min(hdrLen + DEDUP_PAYLOAD_PREFIX, len);
+}
+
+uint64_t PacketHashInvariant (const uint8_t* pData, uint32_t len) {
+    uint64_t h = 0x84222325CBF29CE4ULL;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    switch (pData[0] >> 4) {
+    case 4: {
+        uint32_t hdrLen = (pData[0] & 0x0F) * 4;
+        if (len < IPV4_HEADER_SIZE || hdrLen < IPV4_HEADER_SIZE || hdrLen > len) {
+            return 0;
+        }
+        uint16_t totLen = read16(pData + 2);
+        if (totLen >= hdrLen && totLen < len) {
+            len = totLen;
+        }
+
+        //Version to fragment offset, protocol and addresses. Options
+        //are left out along with the TTL and checksum.
+        h = hash_bytes(h, pData, 8);
+        h = hash_mix(h, pData[9]);
+        h = hash_bytes(h, pData + 12, 8);
+        h = hash_bytes(h, pData + hdrLen, l4_prefix(pData[9], pData + hdrLen, len - hdrLen));
+        break;
+    }
+    case 6: {
+        if (len < IPV6_HEADER_SIZE) {
+            return 0;
+        }
+        uint16_t payloadLen = read16(pData + 4);
+        if (payloadLen && (uint32_t)payloadLen + IPV6_HEADER_SIZE < len) {
+            len = payloadLen + IPV6_HEADER_SIZE;
+        }
+
+        //Everything but the hop limit, extension headers are hashed as
+        //if they were the L4 header
+        h = hash_bytes(h, pData, 7);
+        h = hash_bytes(h, pData + 8, 32);
+        h = hash_bytes(h, pData + IPV6_HEADER_SIZE,
+                       l4_prefix(pData[6], pData + IPV6_HEADER_SIZE, len - IPV6_HEADER_SIZE));
+        break;
+    }
+    default:
+        return 0;
+    }
+
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+static inline size_t alt_bucket (size_t index, uint32_t fingerprint) {
+    return (index ^ (fingerprint * 0x5BD1E995U)) & (DEDUP_BUCKETS - 1);
+}
+
+PacketDeduplicator::PacketDeduplicator (uint64_t window_us)
+  : m_buckets(DEDUP_BUCKETS),
+    m_window_us(window_us),
+    m_kick(0),
+    m_packets(0),
+    m_duplicates(0),
+    m_timed(0),
+    m_timed_ns(0),
+    m_clock_ns(0)
+{
+    memset(m_buckets.data(), 0, m_buckets.size() * sizeof(DedupBucket_T));
+
+    //Reading the clock costs about as much as a lookup, it isn't
+    //counted against the stage
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < DEDUP_TIMING_SAMPLE; i++) {
+        std::chrono::steady_clock::now();
+    }
+    m_clock_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count() / DEDUP_TIMING_SAMPLE;
+}
+
+bool PacketDeduplicator::is_live (const DedupSlot_T& slot, uint64_t timestamp_us) {
+    if (slot.fingerprint == 0) {
+        return false;
+    }
+    //Packets from files read out of order can go back in time
+    uint64_t age = (timestamp_us >= slot.seen_us) ? timestamp_us - slot.seen_us
+                                                  : slot.seen_us - timestamp_us;
+    return age <= m_window_us;
+}
+
+bool PacketDeduplicator::lookup (uint64_t hash, uint64_t timestamp_us) {
+    uint32_t fingerprint = (uint32_t)(hash >> 32) | 1;
+    size_t index = hash & (DEDUP_BUCKETS - 1);
+    const DedupBucket_T& b1 = m_buckets[index];
+    const DedupBucket_T& b2 = m_buckets[alt_bucket(index, fingerprint)];
+
+    for (size_t i = 0; i < DEDUP_BUCKET_SLOTS; i++) {
+        if ((b1.slots[i].fingerprint == fingerprint && is_live(b1.slots[i], timestamp_us)) ||
+            (b2.slots[i].fingerprint == fingerprint && is_live(b2.slots[i], timestamp_us))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PacketDeduplicator::insert (uint64_t hash, uint64_t timestamp_us) {
+    DedupSlot_T entry;
+
+    entry.fingerprint = (uint32_t)(hash >> 32) | 1;
+    entry.pad = 0;
+    entry.seen_us = timestamp_us;
+
+    size_t index = hash & (DEDUP_BUCKETS - 1);
+    for (size_t n = 0; n <= DEDUP_MAX_KICKS; n++) {
+        size_t other = alt_bucket(index, entry.fingerprint);
+        DedupBucket_T& b1 = m_buckets[index];
+        DedupBucket_T& b2 = m_buckets[other];
+
+        for (size_t i = 0; i < DEDUP_BUCKET_SLOTS; i++) {
+            if (!is_live(b1.slots[i], timestamp_us)) {
+                b1.slots[i] = entry;
+                return;
+            }
+            if (!is_live(b2.slots[i], timestamp_us)) {
+                b2.slots[i] = entry;
+                return;
+            }
+        }
+
+        //Both buckets are full, displace an entry to its other bucket.
+        //It comes from the bucket the walk just reached, taking it from
+        //the one the last displaced entry was put in would only shuffle
+        //that bucket.
+        DedupSlot_T& victim = b1.slots[m_kick++ % DEDUP_BUCKET_SLOTS];
+        std::swap(entry, victim);
+        index = alt_bucket(index, entry.fingerprint);
+    }
+
+    //The entry left over is forgotten, at worst one duplicate is kept
+}
+
+bool PacketDeduplicator::is_duplicate (const uint8_t* pData, uint32_t len, uint64_t timestamp_us) {
+    std::chrono::steady_clock::time_point start;
+    bool bDuplicate = false;
+
+    bool bTimed = (m_packets++ % DEDUP_TIMING_SAMPLE) == 0;
+    if (bTimed) {
+        start = std::chrono::steady_clock::now();
+    }
+
+    uint64_t hash = PacketHashInvariant(pData, len);
+    if (hash != 0) {
+        bDuplicate = lookup(hash, timestamp_us);
+        if (bDuplicate) {
+            m_duplicates++;
+        } else {
+            insert(hash, timestamp_us);
+        }
+    }
+
+    if (bTimed) {
+        m_timed++;
+        m_timed_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    return bDuplicate;
+}
+
+uint64_t PacketDeduplicator::get_packets (void) {
+    return m_packets;
+}
+
+uint64_t PacketDeduplicator::get_duplicates (void) {
+    return m_duplicates;
+}
+
+double PacketDeduplicator::get_ns_per_packet (void) {
+    if (!m_timed) {
+        return 0.0;
+    }
+    double ns = (double)m_timed_ns / m_timed - m_clock_ns;
+    return (ns > 0.0) ? ns : 0.0;
+}
+
+//=============================================================================
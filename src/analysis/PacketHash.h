@@ -0,0 +1,104 @@
+/**@file PacketHash.h
+ */
+#ifndef PACKET_HASH_H_
+#define PACKET_HASH_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <vector>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Payload bytes hashed after the L4 header
+#define DEDUP_PAYLOAD_PREFIX    (32)
+
+//Buckets of the filter, a power of two. Four slots each, so the
+//default holds 256K packets in 4 MB.
+#define DEDUP_BUCKETS           (64 * 1024)
+#define DEDUP_BUCKET_SLOTS      (4)
+
+//Entries moved to make room before the one left over is dropped
+#define DEDUP_MAX_KICKS         (16)
+
+//One in this many lookups is timed to estimate the cost of the stage
+#define DEDUP_TIMING_SAMPLE     (64)
+
+/**
+ * Hash of the parts of an IP packet a router or a mirror port leave
+ * alone: the IP header without the TTL (hop limit) and checksum, the
+ * L4 header and the first DEDUP_PAYLOAD_PREFIX bytes of payload.
+ *
+ * @param pData Captured IP header.
+ * @param len Bytes captured from pData.
+ * @return uint64_t Hash, 0 if pData isn't an IP packet.
+ */
+uint64_t PacketHashInvariant (const uint8_t* pData, uint32_t len);
+
+typedef struct {
+    uint32_t fingerprint;   //0 when free
+    uint32_t pad;
+    uint64_t seen_us;
+} DedupSlot_T;
+
+typedef struct alignas(64) {
+    DedupSlot_T slots[DEDUP_BUCKET_SLOTS];
+} DedupBucket_T;
+
+static_assert(sizeof(DedupBucket_T) == 64, "dedup buckets must fill a cache line");
+
+/**
+ * Drops packets seen twice within a time window, such as the copies a
+ * SPAN port delivers once per direction of the mirrored link.
+ *
+ * Packet hashes are kept in a fixed size cuckoo filter: a 32-bit
+ * fingerprint lives in one of two buckets, the second derived from
+ * the first and the fingerprint, so entries can be moved without the
+ * packet. Slots older than the window count as free, so the filter
+ * never needs clearing. It belongs to the thread reading packets and
+ * takes no locks.
+ */
+class PacketDeduplicator {
+public:
+    /**
+     * @param window_us Copies further apart than this are both kept.
+     */
+    PacketDeduplicator (uint64_t window_us);
+
+    /**
+     * Records a packet.
+     *
+     * @param pData Captured IP header.
+     * @param len Bytes captured from pData.
+     * @param timestamp_us Capture time.
+     * @return bool true if the same packet was seen within the window.
+     */
+    bool is_duplicate (const uint8_t* pData, uint32_t len, uint64_t timestamp_us);
+
+    uint64_t get_packets (void);
+    uint64_t get_duplicates (void);
+
+    /**
+     * Estimated time is_duplicate() takes per packet.
+     */
+    double get_ns_per_packet (void);
+
+protected:
+    bool lookup (uint64_t hash, uint64_t timestamp_us);
+    bool is_live (const DedupSlot_T& slot, uint64_t timestamp_us);
+    void insert (uint64_t hash, uint64_t timestamp_us);
+
+protected:
+    std::vector<DedupBucket_T> m_buckets;
+    uint64_t m_window_us;
+    uint32_t m_kick;
+    uint64_t m_packets;
+    uint64_t m_duplicates;
+    uint64_t m_timed;
+    uint64_t m_timed_ns;
+    uint64_t m_clock_ns;
+};
+
+//=============================================================================
+#endif //PACKET_HASH_H_
@@ -0,0 +1,156 @@
+/**@file ScanMonitor.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ScanMonitor.h"
+#include <algorithm>
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+BlockedBloomFilter::BlockedBloomFilter (size_t blocks)
+  : m_blocks(blocks),
+    m_mask(blocks - 1)
+{
+    clear();
+}
+
+void BlockedBloomFilter::clear (void) {
+    memset(m_blocks.data(), 0, m_blocks.size() * sizeof(BloomBlock_T));
+}
+
+ScanMonitor::ScanMonitor (void)
+  : m_halfOpen{ BlockedBloomFilter(SCAN_FILTER_BLOCKS), BlockedBloomFilter(SCAN_FILTER_BLOCKS) },
+    m_current(0),
+    m_sources(SCAN_SOURCES),
+    m_generation_us(0),
+    m_last_us(0),
+    m_window_half_open(0),
+    m_untracked(0),
+    m_half_open(0),
+    m_answered(0),
+    m_reported(0)
+{
+    memset(m_sources.data(), 0, m_sources.size() * sizeof(ScanSource_T));
+}
+
+bool ScanMonitor::on_syn (const FlowKey_T& key, uint64_t timestamp_us) {
+    uint64_t hash = FlowKeyHash(key);
+
+    if (m_generation_us == 0) {
+        m_generation_us = timestamp_us;
+    }
+    m_last_us = timestamp_us;
+
+    //Retransmissions
+    if (m_halfOpen[0].contains(hash) || m_halfOpen[1].contains(hash)) {
+        return false;
+    }
+    m_halfOpen[m_current].add(hash);
+    m_window_half_open++;
+    m_half_open++;
+
+    ScanSource_T* pSource = find_source(key.src, key.vlan, true);
+    if (pSource) {
+        pSource->syns++;
+    } else {
+        m_untracked++;
+    }
+    return true;
+}
+
+bool ScanMonitor::on_syn_ack (const FlowKey_T& key) {
+    FlowKey_T syn = FlowKeyReverse(key);
+    uint64_t hash = FlowKeyHash(syn);
+
+    if (!m_halfOpen[0].contains(hash) && !m_halfOpen[1].contains(hash)) {
+        return false;
+    }
+    m_answered++;
+
+    //SYNs of the previous generation were already reported
+    ScanSource_T* pSource = find_source(syn.src, syn.vlan, false);
+    if (pSource && pSource->answered < pSource->syns) {
+        pSource->answered++;
+    }
+    return true;
+}
+
+void ScanMonitor::rotate (uint64_t timestamp_us, ScanWindow_T& window,
+                          std::vector<ScanSource_T>& sources) {
+    if (timestamp_us == 0) {
+        timestamp_us = m_last_us;
+    }
+
+    window.start_us = m_generation_us;
+    window.end_us = timestamp_us;
+    window.half_open = m_window_half_open;
+    window.untracked = m_untracked;
+
+    sources.clear();
+    for (auto& source : m_sources) {
+        if (source.syns - source.answered >= SCAN_REPORT_MIN) {
+            sources.push_back(source);
+        }
+    }
+    std::sort(sources.begin(), sources.end(),
+              [](const ScanSource_T& a, const ScanSource_T& b) {
+                  return (a.syns - a.answered) > (b.syns - b.answered);
+              });
+    if (sources.size() > SCAN_REPORT_MAX) {
+        sources.resize(SCAN_REPORT_MAX);
+    }
+    m_reported += sources.size();
+
+    //The older filter is recycled for the next generation, unless the
+    //capture skipped ahead past both
+    m_current ^= 1;
+    m_halfOpen[m_current].clear();
+    if (m_generation_us && timestamp_us >= m_generation_us + 2 * SCAN_GENERATION_US) {
+        m_halfOpen[m_current ^ 1].clear();
+    }
+
+    memset(m_sources.data(), 0, m_sources.size() * sizeof(ScanSource_T));
+    m_generation_us = timestamp_us;
+    m_window_half_open = 0;
+    m_untracked = 0;
+}
+
+ScanSource_T* ScanMonitor::find_source (const FlowAddress_T& src, uint16_t vlan, bool bCreate) {
+    FlowKey_T key;
+    FlowKeyClear(key);
+    key.src = src;
+    key.vlan = vlan;
+
+    size_t slot = FlowKeyHash(key) & (SCAN_SOURCES - 1);
+    for (size_t i = 0; i < SCAN_SOURCE_PROBES; i++) {
+        ScanSource_T& source = m_sources[(slot + i) & (SCAN_SOURCES - 1)];
+        if (source.syns == 0) {
+            if (!bCreate) {
+                return NULL;
+            }
+            source.src = src;
+            source.vlan = vlan;
+            return &source;
+        }
+        if (source.vlan == vlan && memcmp(source.src.bytes, src.bytes, FLOW_ADDR_SIZE) == 0) {
+            return &source;
+        }
+    }
+    return NULL;
+}
+
+uint64_t ScanMonitor::get_half_open (void) {
+    return m_half_open;
+}
+
+uint64_t ScanMonitor::get_answered (void) {
+    return m_answered;
+}
+
+uint64_t ScanMonitor::get_reported (void) {
+    return m_reported;
+}
+
+//=============================================================================
@@ -0,0 +1,168 @@
+/**@file ScanMonitor.h
+ */
+#ifndef SCAN_MONITOR_H_
+#define SCAN_MONITOR_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <vector>
+
+#include "FlowKey.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Bits set per key, each in one 64-bit word of the key's block
+#define BLOOM_HASHES            (4)
+
+//Half-open tuples are remembered for one to two generations, in 256 KB
+//per generation
+#define SCAN_GENERATION_US      (30 * 1000000ULL)
+#define SCAN_FILTER_BLOCKS      (4096)
+
+//Sources followed per generation (a power of two) and slots probed
+//before a source is given up on
+#define SCAN_SOURCES            (4096)
+#define SCAN_SOURCE_PROBES      (8)
+
+//Unanswered SYNs a source needs to be reported, and the most sources
+//reported per generation
+#define SCAN_REPORT_MIN         (16)
+#define SCAN_REPORT_MAX         (64)
+
+typedef struct alignas(64) {
+    uint64_t words[8];
+} BloomBlock_T;
+
+/**
+ * Bloom filter whose keys each set BLOOM_HASHES bits within a single
+ * cache line, so a lookup costs one memory access. All bits come from
+ * one 64-bit hash, which must be well mixed.
+ */
+class BlockedBloomFilter {
+public:
+    /**
+     * @param blocks Number of 512-bit blocks, a power of two.
+     */
+    BlockedBloomFilter (size_t blocks);
+
+    inline void add (uint64_t hash) {
+        BloomBlock_T& block = m_blocks[(hash >> 40) & m_mask];
+        for (size_t i = 0; i < BLOOM_HASHES; i++) {
+            uint64_t bits = hash >> (9 * i);
+            block.words[bits & 7] |= 1ULL << ((bits >> 3) & 63);
+        }
+    }
+
+    /**
+     * @return bool false if the hash was never added, true if it
+     *         probably was.
+     */
+    inline bool contains (uint64_t hash) const {
+        const BloomBlock_T& block = m_blocks[(hash >> 40) & m_mask];
+        for (size_t i = 0; i < BLOOM_HASHES; i++) {
+            uint64_t bits = hash >> (9 * i);
+            if (!(block.words[bits & 7] & (1ULL << ((bits >> 3) & 63)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void clear (void);
+
+protected:
+    std::vector<BloomBlock_T> m_blocks;
+    uint64_t m_mask;
+};
+
+/**
+ * A source that sent SYNs during a generation. Free while syns is 0.
+ */
+typedef struct {
+    FlowAddress_T src;
+    uint16_t vlan;
+    uint16_t pad;
+    uint32_t syns;          //Distinct half-open tuples
+    uint32_t answered;      //Of those, answered by a SYN/ACK
+} ScanSource_T;
+
+typedef struct {
+    uint64_t start_us;
+    uint64_t end_us;
+    uint64_t half_open;     //Distinct SYNs seen
+    uint64_t untracked;     //SYNs of sources the table had no room for
+} ScanWindow_T;
+
+/**
+ * Follows TCP handshakes that were never answered.
+ *
+ * SYNs are remembered in two rotating blocked Bloom filters, so a
+ * retransmitted SYN isn't counted twice and a SYN/ACK can be matched
+ * to its SYN without any per tuple state. Each source's SYNs and
+ * answers are counted in a fixed table; at the end of a generation the
+ * sources with the most unanswered SYNs are reported and the older
+ * filter is cleared.
+ */
+class ScanMonitor {
+public:
+    ScanMonitor (void);
+
+    /**
+     * Records a SYN without ACK.
+     *
+     * @param key Tuple of the SYN.
+     * @param timestamp_us Capture time.
+     * @return bool true if the tuple wasn't already half-open.
+     */
+    bool on_syn (const FlowKey_T& key, uint64_t timestamp_us);
+
+    /**
+     * Records a SYN/ACK that opened a connection.
+     *
+     * @param key Tuple of the SYN/ACK.
+     * @return bool true if it answered a SYN that was seen.
+     */
+    bool on_syn_ack (const FlowKey_T& key);
+
+    /**
+     * @return bool true once the current generation has ended.
+     */
+    inline bool is_due (uint64_t timestamp_us) const {
+        return m_generation_us && timestamp_us >= m_generation_us + SCAN_GENERATION_US;
+    }
+
+    /**
+     * Ends the current generation.
+     *
+     * @param timestamp_us Capture time, 0 for the last SYN seen.
+     * @param window Populated with the span and totals of the generation.
+     * @param sources Populated with the sources having at least
+     *                SCAN_REPORT_MIN unanswered SYNs, most first.
+     */
+    void rotate (uint64_t timestamp_us, ScanWindow_T& window,
+                 std::vector<ScanSource_T>& sources);
+
+    uint64_t get_half_open (void);
+    uint64_t get_answered (void);
+    uint64_t get_reported (void);
+
+protected:
+    ScanSource_T* find_source (const FlowAddress_T& src, uint16_t vlan, bool bCreate);
+
+protected:
+    BlockedBloomFilter m_halfOpen[2];
+    size_t m_current;                   //Filter SYNs are added to
+    std::vector<ScanSource_T> m_sources;
+    uint64_t m_generation_us;           //Start of the current generation
+    uint64_t m_last_us;
+    uint64_t m_window_half_open;
+    uint64_t m_untracked;
+    uint64_t m_half_open;
+    uint64_t m_answered;
+    uint64_t m_reported;
+};
+
+//=============================================================================
+#endif //SCAN_MONITOR_H_
@@ -17,9 +17,15 @@ extern std::shared_ptr<PacketMsgProxy> g_packetMsgProxy;
 //=============================================================================
 TCPTracker::TCPTracker (uint64_t timeout_us)
   : m_addrList(),
+    m_loaded(),
     m_timeout_us(timeout_us),
     m_opened(0),
-    m_closed(0)
+    m_closed(0),
+    m_tls(),
+    m_bTls(true),
+    m_live(TCP_LIVE_FILTER_BLOCKS),
+    m_scans(),
+    m_filtered(0)
 {
 }
 
@@ -28,54 +34,82 @@ TCPTracker::~TCPTracker (void)
     m_addrList.clear();
 }
 
-void TCPTracker::on_packet (const Packet& packet) {
+void TCPTracker::on_packet (const Packet& packet, uint16_t vlan,
+                            const uint8_t* pL3, uint32_t l3Len) {
     const PDU* pduPtr = packet.pdu();
     long int seconds = packet.timestamp().seconds();
     long int microseconds = packet.timestamp().microseconds();
+    uint32_t bytes = 0;
 
-    const IP* ipHeader = pduPtr->find_pdu<IP>();
     const TCP* tcpHeader = pduPtr->find_pdu<TCP>();
-    const RawPDU* raw = pduPtr->find_pdu<RawPDU>();
-
-    if (!tcpHeader || !ipHeader) {
+    if (!tcpHeader) {
         return;
     }
 
     TCPAddressTuple hdrTemp;
-    hdrTemp.src = ipHeader->src_addr();
-    hdrTemp.dst = ipHeader->dst_addr();
-    hdrTemp.dport = tcpHeader->dport();
-    hdrTemp.sport = tcpHeader->sport();
+    FlowKeyClear(hdrTemp.key);
+    if (!FlowKeySetAddresses(pduPtr, hdrTemp.key, bytes)) {
+        return;
+    }
+    hdrTemp.key.dport = tcpHeader->dport();
+    hdrTemp.key.sport = tcpHeader->sport();
+    hdrTemp.key.vlan = vlan;
+    hdrTemp.key.protocol = 6;
     hdrTemp.timestamp_s = seconds;
     hdrTemp.timestamp_us = microseconds;
+    hdrTemp.packets = 1;
+    hdrTemp.bytes = bytes;
     hdrTemp.state = TCP_LISTEN;
+    memset(&hdrTemp.tls, 0, sizeof(hdrTemp.tls));
+    hdrTemp.tls.state = m_bTls ? TLS_INSPECT : TLS_DONE;
+
+    uint64_t timestamp_us = seconds * 1000000ULL + microseconds;
+    if (m_scans.is_due(timestamp_us)) {
+        report_scans(timestamp_us);
+    }
+
+    uint64_t liveHash = FlowKeyHash(FlowKeyCanonical(hdrTemp.key));
+    auto ctmp = m_addrList.end();
+    if (m_live.contains(liveHash)) {
+        ctmp = find_tcp(m_addrList.begin(), m_addrList.end(), hdrTemp);
+    } else {
+        m_filtered++;
+    }
 
-    auto ctmp = find_tcp(m_addrList.begin(), m_addrList.end(), hdrTemp);
     if (ctmp != m_addrList.end()) {
+        (*ctmp).packets++;
+        (*ctmp).bytes += bytes;
+
+        if ((*ctmp).tls.state != TLS_DONE) {
+            inspect_tls(*ctmp, hdrTemp, tcpHeader, pL3, l3Len);
+        }
+
         if ((*ctmp).state != TCP_CLOSED &&
             tcpHeader->get_flag(TCP::FIN)) {
             auto cm = ConnectionMetadata();
-            cm.src = (*ctmp).src;
-            cm.dst = (*ctmp).dst;
-            cm.l4_dst = (*ctmp).dport;
-            cm.l4_src = (*ctmp).sport;
-            cm.protocol = 6;
+            cm.set_key((*ctmp).key);
             cm.l4_protocol = 6;
             cm.timestamp_s = (*ctmp).timestamp_s;
             cm.timestamp_us = (*ctmp).timestamp_us;
             cm.end_timestamp_s = seconds;
             cm.end_timestamp_us = microseconds;
+            cm.packets = (*ctmp).packets;
+            cm.bytes = (*ctmp).bytes;
+            cm.sni = m_tls.sni((*ctmp).tls);
+            cm.ja3 = m_tls.ja3((*ctmp).tls);
             cm.update_hash();
             (*ctmp).state = TCP_CLOSED;
 
-            PrintLogMessage(
-                LEVEL_DEBUG,
-                SUBSYSTEM_TCP,
-                "TCP CLOSE %-15s: %-15s:%5u -> %-15s:%5u",
-                cm.hash.c_str(),
-                cm.src_str().c_str(), (*ctmp).sport,
-                cm.dst_str().c_str(), (*ctmp).dport
-            );
+            if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_TCP)) {
+                PrintLogMessage(
+                    LEVEL_DEBUG,
+                    SUBSYSTEM_TCP,
+                    "TCP CLOSE %-15s: %-15s:%5u -> %-15s:%5u",
+                    cm.hash.c_str(),
+                    cm.src_str().c_str(), cm.l4_src,
+                    cm.dst_str().c_str(), cm.l4_dst
+                );
+            }
 
             m_closed++;
 
@@ -84,30 +118,107 @@ void TCPTracker::on_packet (const Packet& packet) {
     } else if (tcpHeader->get_flag(TCP::SYN) &&
                tcpHeader->get_flag(TCP::ACK)) {
         auto cm = ConnectionMetadata();
-        cm.src = ipHeader->dst_addr();  //transposed s/d addrs
-        cm.dst = ipHeader->src_addr();
-        cm.l4_dst = tcpHeader->sport(); //transposed s/d ports
-        cm.l4_src = tcpHeader->dport();
-        cm.protocol = 6;
+        cm.set_key(FlowKeyReverse(hdrTemp.key)); //transposed s/d addrs and ports
         cm.l4_protocol = 6;
         cm.timestamp_s = seconds;
         cm.timestamp_us = microseconds;
         cm.update_hash();
 
         m_addrList.push_back(hdrTemp);
+        m_live.add(liveHash);
+        m_scans.on_syn_ack(hdrTemp.key);
 
-        PrintLogMessage(
-            LEVEL_DEBUG,
-            SUBSYSTEM_TCP,
-            "TCP OPEN  %-15s: %-15s:%5u -> %-15s:%5u",
-            cm.hash.c_str(),
-            cm.src_str().c_str(), cm.l4_src,
-            cm.dst_str().c_str(), cm.l4_dst
-        );
+        if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_TCP)) {
+            PrintLogMessage(
+                LEVEL_DEBUG,
+                SUBSYSTEM_TCP,
+                "TCP OPEN  %-15s: %-15s:%5u -> %-15s:%5u",
+                cm.hash.c_str(),
+                cm.src_str().c_str(), cm.l4_src,
+                cm.dst_str().c_str(), cm.l4_dst
+            );
+        }
 
         m_opened++;
 
         g_packetMsgProxy->on_connection(&cm);
+    } else if (tcpHeader->get_flag(TCP::SYN) &&
+               !tcpHeader->get_flag(TCP::ACK)) {
+        m_scans.on_syn(hdrTemp.key, timestamp_us);
+    }
+}
+
+void TCPTracker::report_scans (uint64_t timestamp_us) {
+    ScanWindow_T window;
+    std::vector<ScanSource_T> sources;
+
+    m_scans.rotate(timestamp_us, window, sources);
+    if (sources.empty()) {
+        return;
+    }
+
+    if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_TCP)) {
+        for (auto& source : sources) {
+            PrintLogMessage(
+                LEVEL_DEBUG,
+                SUBSYSTEM_TCP,
+                "TCP SCAN  %-15s: %u SYNs, %u unanswered",
+                FlowAddressToString(source.src).c_str(),
+                source.syns, source.syns - source.answered
+            );
+        }
+    }
+
+    g_packetMsgProxy->on_scan_report(window, sources);
+}
+
+void TCPTracker::inspect_tls (TCPAddressTuple& tuple, const TCPAddressTuple& hdrTemp,
+                              const TCP* tcpHeader, const uint8_t* pL3, uint32_t l3Len) {
+    FlowKey_T key;
+    const uint8_t* pL4 = NULL;
+    uint32_t l4Len = 0;
+
+    //Connections are keyed by their SYN/ACK, so the client sends the
+    //other way
+    if (FlowKeyEqual(tuple.key, hdrTemp.key)) {
+        return;
+    }
+
+    //The captured bytes hold the whole payload even when libtins only
+    //decoded the headers
+    if (pL3 && FlowKeyParse(pL3, l3Len, key, &pL4, l4Len) &&
+        key.protocol == 6 && l4Len >= 20) {
+        uint32_t dataOffset = (pL4[12] >> 4) * 4;
+        if (dataOffset >= 20 && l4Len > dataOffset) {
+            m_tls.on_segment(tuple.tls, tcpHeader->seq(), pL4 + dataOffset,
+                             l4Len - dataOffset);
+        }
+        return;
+    }
+
+    const RawPDU* raw = tcpHeader->find_pdu<RawPDU>();
+    if (!raw || raw->payload_size() == 0) {
+        return;
+    }
+
+    m_tls.on_segment(tuple.tls, tcpHeader->seq(), raw->payload().data(),
+                     raw->payload_size());
+}
+
+void TCPTracker::on_fragment (const FlowKey_T& key, uint32_t packets, uint32_t bytes) {
+    TCPAddressTuple hdrTemp;
+    hdrTemp.key = key;
+
+    //Connections are only opened and closed on segments whose flags
+    //libtins decoded, fragments just add to them
+    if (!m_live.contains(FlowKeyHash(FlowKeyCanonical(key)))) {
+        return;
+    }
+
+    auto ctmp = find_tcp(m_addrList.begin(), m_addrList.end(), hdrTemp);
+    if (ctmp != m_addrList.end()) {
+        (*ctmp).packets += packets;
+        (*ctmp).bytes += bytes;
     }
 }
 
@@ -124,9 +235,21 @@ void TCPTracker::prune_connections (void) {
         }
         done = true;
     }
+
+    m_tls.compact(m_addrList);
+    rebuild_filter();
+}
+
+void TCPTracker::rebuild_filter (void) {
+    //Bloom filters can't forget, so pruned connections are dropped by
+    //starting over from the ones left
+    m_live.clear();
+    for (auto& tuple : m_addrList) {
+        m_live.add(FlowKeyHash(FlowKeyCanonical(tuple.key)));
+    }
 }
 
-void TCPTracker::on_state_update (const Packet& p) {
+void TCPTracker::on_state_update (const Packet& /*p*/) {
 
 }
 
@@ -138,6 +261,50 @@ size_t TCPTracker::get_closed (void) {
     return m_closed;
 }
 
+bool TCPTracker::save_state (FILE* fp) {
+    return SaveTrackerState(fp, m_addrList, m_opened, m_closed);
+}
+
+bool TCPTracker::load_state (FILE* fp) {
+    return LoadTrackerState(fp, m_loaded);
+}
+
+void TCPTracker::commit_state (bool bApply) {
+    CommitTrackerState(m_loaded, bApply, m_addrList, m_opened, m_closed);
+    if (!bApply) {
+        return;
+    }
+
+    //Server names and reassembly buffers aren't saved with the tuples
+    for (auto& tuple : m_addrList) {
+        tuple.tls.sni = 0;
+        if (tuple.tls.state == TLS_BUFFERED) {
+            tuple.tls.state = TLS_DONE;
+        }
+    }
+    rebuild_filter();
+}
+
+void TCPTracker::set_tls_inspection (bool bEnabled) {
+    m_bTls = bEnabled;
+}
+
+TLSInspector& TCPTracker::tls (void) {
+    return m_tls;
+}
+
+ScanMonitor& TCPTracker::scans (void) {
+    return m_scans;
+}
+
+void TCPTracker::flush_scans (void) {
+    report_scans(0);
+}
+
+uint64_t TCPTracker::get_filtered (void) {
+    return m_filtered;
+}
+
 std::shared_ptr<TCPTracker> TCPTracker::GetStaticInstance (uint64_t timeout_us) {
     if (gs_tcpTracker == nullptr) {
         gs_tcpTracker = std::make_shared<TCPTracker>(timeout_us);
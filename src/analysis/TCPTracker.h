@@ -27,12 +27,18 @@
 #include "BTree.h"
 #include "PacketMsgProxy.h"
 #include "MD5ByteContainer.h"
+#include "FlowKey.h"
+#include "TLSInspector.h"
+#include "ScanMonitor.h"
 
 //=============================================================================
 // DEFINITIONS
 //=============================================================================
 using namespace Tins;
 
+//Blocks of the filter of tracked connections, 128 KB
+#define TCP_LIVE_FILTER_BLOCKS  (2048)
+
 /**
  * Describes all possible TCP states. 
  */
@@ -52,28 +58,26 @@ typedef enum {
 
 class TCPAddressTuple {
 public:
-    uint32_t src;
-    uint32_t dst;
-    uint16_t dport;
-    uint16_t sport;
+    FlowKey_T key;
     uint64_t timestamp_s;
     uint64_t timestamp_us;
+    uint64_t packets;
+    uint64_t bytes;
 
     TCP_State_T state;
+    TLSFlowState_T tls;
 };
 
+/**
+ * Finds the connection a packet belongs to, in either direction.
+ */
 template<class InputIt, class T>
-constexpr InputIt find_tcp(InputIt first, InputIt last, const T& value)
+InputIt find_tcp(InputIt first, InputIt last, const T& value)
 {
+    FlowKey_T rev = FlowKeyReverse(value.key);
     for (; first != last; ++first) {
-        if ((((*first).src == value.dst &&
-            (*first).dst == value.src) ||
-            ((*first).src == value.src ||
-            (*first).dst == value.dst)) &&
-            ((*first).dport == value.dport ||
-             (*first).sport == value.sport ||
-             (*first).dport == value.sport ||
-             (*first).sport == value.dport)) {
+        if (FlowKeyEqual((*first).key, value.key) ||
+            FlowKeyEqual((*first).key, rev)) {
             return first;
         }
     }
@@ -84,16 +88,19 @@ class TCPAddressCompare {
 public:
     template <class Type1, class Type2>
     inline bool operator() (const Type1& a, const Type2 &b) {
-        bool lt = std::less<uint32_t>()(a.src, b.src) &
-                  std::less<uint32_t>()(a.dst, b.dst) &
-                  std::less<uint16_t>()(a.dport, b.dport) &
-                  std::less<uint16_t>()(a.sport, b.sport);
-        return lt;
+        return memcmp(&a.key, &b.key, sizeof(FlowKey_T)) < 0;
     }
 };
 
 /**
  * This object tracks TCP connections.
+ *
+ * Connections are only created by a SYN/ACK, yet every other packet
+ * would still search the whole connection list. A Bloom filter of the
+ * tracked connections lets packets that can't belong to one, like the
+ * SYNs and RSTs of a port scan, skip the search; it is rebuilt when
+ * connections are pruned. Unanswered SYNs are counted per source by a
+ * ScanMonitor and reported as scan telemetry.
  */
 class TCPTracker :
     public TrackerInterface 
@@ -106,8 +113,24 @@ public:
      * This routine handles packets.
      *  
      * @param packet Reference to packet just received.
+     * @param vlan VLAN ID the packet was tagged with, 0 if untagged.
+     * @param pL3 Captured IP header. ClientHellos are read from here
+     *            when given, since the packet's PDUs may have been
+     *            decoded from only part of the capture (--snaplen).
+     * @param l3Len Bytes captured from pL3.
      */
-    virtual void on_packet (const Packet& packet);
+    virtual void on_packet (const Packet& packet, uint16_t vlan = 0,
+                            const uint8_t* pL3 = NULL, uint32_t l3Len = 0);
+
+    /**
+     * Counts IP fragments towards an existing connection.
+     *  
+     * @param key Connection of the datagram, ports taken from its first 
+     *            fragment.
+     * @param packets Number of fragments.
+     * @param bytes IP bytes of the fragments.
+     */
+    virtual void on_fragment (const FlowKey_T& key, uint32_t packets, uint32_t bytes);
 
     /**
      * Prunes all closed connections. 
@@ -123,14 +146,49 @@ public:
 
     virtual size_t get_opened (void);
     virtual size_t get_closed (void);
+
+    virtual bool save_state (FILE* fp);
+    virtual bool load_state (FILE* fp);
+    virtual void commit_state (bool bApply);
+
+    /**
+     * Turns ClientHello inspection of new connections on or off.
+     */
+    virtual void set_tls_inspection (bool bEnabled);
+
+    TLSInspector& tls (void);
+    ScanMonitor& scans (void);
+
+    /**
+     * Sends the unanswered SYNs of the current generation.
+     */
+    virtual void flush_scans (void);
+
+    /**
+     * @return uint64_t Packets that skipped the connection lookup.
+     */
+    uint64_t get_filtered (void);
+
 public:
     static std::shared_ptr<TCPTracker> GetStaticInstance (uint64_t timeout_us);
 
+protected:
+    void inspect_tls (TCPAddressTuple& tuple, const TCPAddressTuple& hdrTemp,
+                      const TCP* tcpHeader, const uint8_t* pL3, uint32_t l3Len);
+    void report_scans (uint64_t timestamp_us);
+    void rebuild_filter (void);
+
 protected:
     std::deque<TCPAddressTuple> m_addrList;
+    TrackerState<TCPAddressTuple> m_loaded;          //Staged by load_state()
     uint64_t m_timeout_us;
     size_t m_opened;
     size_t m_closed;
+    TLSInspector m_tls;
+    bool m_bTls;
+    BlockedBloomFilter m_live;          //Canonical key hashes of m_addrList
+    ScanMonitor m_scans;
+    uint64_t m_filtered;
 };
 
 //=============================================================================
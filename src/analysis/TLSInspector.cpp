@@ -0,0 +1,351 @@
+/**@file TLSInspector.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "TLSInspector.h"
+#include "MD5ByteContainer.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TLS_RECORD_HEADER_SIZE      (5)
+#define TLS_HANDSHAKE_HEADER_SIZE   (4)
+#define TLS_CONTENT_HANDSHAKE       (22)
+#define TLS_HANDSHAKE_CLIENT_HELLO  (1)
+
+#define TLS_EXT_SERVER_NAME         (0)
+#define TLS_EXT_SUPPORTED_GROUPS    (10)
+#define TLS_EXT_POINT_FORMATS       (11)
+#define TLS_SNI_HOST_NAME           (0)
+
+//Version, random and session ID length
+#define TLS_HELLO_FIXED_SIZE        (35)
+
+/**
+ * Result of looking at the start of a client payload.
+ */
+typedef enum {
+    TLS_PARSE_OK    = 0,
+    TLS_PARSE_MORE  = 1,    //A ClientHello continuing past the segment
+    TLS_PARSE_FAIL  = 2
+} TLSParse_T;
+
+/**
+ * JA3 string under construction, in a stack buffer.
+ */
+typedef struct {
+    char text[TLS_JA3_MAX];
+    size_t len;
+    bool overflow;
+} TLSJa3Text_T;
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+static inline uint16_t read16 (const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t read24 (const uint8_t* p) {
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+/**
+ * GREASE values (RFC 8701) are random per connection and left out of
+ * the fingerprint.
+ */
+static inline bool is_grease (uint16_t value) {
+    return (value & 0x0F0F) == 0x0A0A && (value >> 8) == (value & 0xFF);
+}
+
+static void ja3_append (TLSJa3Text_T& ja3, const char* pText, size_t len) {
+    if (ja3.overflow || ja3.len + len >= sizeof(ja3.text)) {
+        ja3.overflow = true;
+        return;
+    }
+    memcpy(ja3.text + ja3.len, pText, len);
+    ja3.len += len;
+}
+
+static void ja3_append_number (TLSJa3Text_T& ja3, uint32_t value, bool& bFirst) {
+    char buf[16];
+
+    int n = snprintf(buf, sizeof(buf), bFirst ? "%u" : "-%u", value);
+    ja3_append(ja3, buf, n);
+    bFirst = false;
+}
+
+/**
+ * Appends a list of 16-bit values, followed by a comma unless it is the
+ * last field.
+ */
+static void ja3_append_list16 (TLSJa3Text_T& ja3, const uint8_t* pData, uint32_t len,
+                               bool bLast) {
+    bool bFirst = true;
+
+    for (uint32_t i = 0; i + 2 <= len; i += 2) {
+        uint16_t value = read16(pData + i);
+        if (!is_grease(value)) {
+            ja3_append_number(ja3, value, bFirst);
+        }
+    }
+    if (!bLast) {
+        ja3_append(ja3, ",", 1);
+    }
+}
+
+/**
+ * Checks the record and handshake headers in front of a ClientHello.
+ *
+ * @param needed Set to the bytes up to the end of the hello.
+ */
+static TLSParse_T parse_record (const uint8_t* pData, uint32_t len, uint32_t& needed) {
+    if (len < TLS_RECORD_HEADER_SIZE + TLS_HANDSHAKE_HEADER_SIZE ||
+        pData[0] != TLS_CONTENT_HANDSHAKE || pData[1] != 3 ||
+        pData[5] != TLS_HANDSHAKE_CLIENT_HELLO) {
+        return TLS_PARSE_FAIL;
+    }
+
+    //A hello split over several records isn't worth following
+    uint32_t recordLen = read16(pData + 3);
+    uint32_t helloLen = read24(pData + 6);
+    if (helloLen + TLS_HANDSHAKE_HEADER_SIZE > recordLen) {
+        return TLS_PARSE_FAIL;
+    }
+
+    needed = TLS_RECORD_HEADER_SIZE + TLS_HANDSHAKE_HEADER_SIZE + helloLen;
+    return (len < needed) ? TLS_PARSE_MORE : TLS_PARSE_OK;
+}
+
+TLSInspector::TLSInspector (void)
+  : m_buffers(TLS_BUFFER_SLOTS),
+    m_nextSlot(0),
+    m_nextTag(1),
+    m_hellos(0),
+    m_reassembled(0)
+{
+    for (auto& buf : m_buffers) {
+        buf.tag = 0;
+        buf.next_seq = 0;
+        buf.len = 0;
+        buf.needed = 0;
+    }
+}
+
+bool TLSInspector::parse_hello (const uint8_t* pData, uint32_t len, TLSFlowState_T& flow) {
+    TLSJa3Text_T ja3;
+    char name[DNS_MAX_NAME];
+    uint32_t nameLen = 0;
+    const uint8_t* pGroups = NULL;
+    const uint8_t* pFormats = NULL;
+    uint32_t groupsLen = 0;
+    uint32_t formatsLen = 0;
+    bool bFirst = true;
+
+    if (len < TLS_HELLO_FIXED_SIZE) {
+        return false;
+    }
+
+    ja3.len = 0;
+    ja3.overflow = false;
+    ja3_append_number(ja3, read16(pData), bFirst);
+    ja3_append(ja3, ",", 1);
+
+    uint32_t offset = TLS_HELLO_FIXED_SIZE + pData[TLS_HELLO_FIXED_SIZE - 1];
+    if (offset + 2 > len) {
+        return false;
+    }
+    uint32_t ciphersLen = read16(pData + offset);
+    offset += 2;
+    if (offset + ciphersLen + 1 > len) {
+        return false;
+    }
+    ja3_append_list16(ja3, pData + offset, ciphersLen, false);
+    offset += ciphersLen;
+
+    //Compression methods
+    offset += 1 + pData[offset];
+    if (offset > len) {
+        return false;
+    }
+
+    //Extensions are optional
+    uint32_t end = offset;
+    if (offset + 2 <= len) {
+        end = offset + 2 + read16(pData + offset);
+        offset += 2;
+        if (end > len) {
+            return false;
+        }
+    }
+
+    bFirst = true;
+    while (offset + 4 <= end) {
+        uint16_t type = read16(pData + offset);
+        uint32_t extLen = read16(pData + offset + 2);
+        const uint8_t* pExt = pData + offset + 4;
+        offset += 4 + extLen;
+        if (offset > end) {
+            return false;
+        }
+
+        if (!is_grease(type)) {
+            ja3_append_number(ja3, type, bFirst);
+        }
+
+        switch (type) {
+        case TLS_EXT_SERVER_NAME:
+            //The first host name of the list, kept once the rest of the
+            //hello has been checked
+            if (extLen >= 5 && pExt[2] == TLS_SNI_HOST_NAME && nameLen == 0) {
+                uint32_t hostLen = read16(pExt + 3);
+                if (hostLen > 0 && hostLen <= DNS_MAX_NAME && 5 + hostLen <= extLen) {
+                    for (uint32_t i = 0; i < hostLen; i++) {
+                        char c = (char)pExt[5 + i];
+                        name[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+                    }
+                    nameLen = hostLen;
+                }
+            }
+            break;
+        case TLS_EXT_SUPPORTED_GROUPS:
+            if (extLen >= 2) {
+                pGroups = pExt + 2;
+                groupsLen = std::min<uint32_t>(read16(pExt), extLen - 2);
+            }
+            break;
+        case TLS_EXT_POINT_FORMATS:
+            if (extLen >= 1) {
+                pFormats = pExt + 1;
+                formatsLen = std::min<uint32_t>(pExt[0], extLen - 1);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    ja3_append(ja3, ",", 1);
+
+    ja3_append_list16(ja3, pGroups, groupsLen, false);
+    bFirst = true;
+    for (uint32_t i = 0; i < formatsLen; i++) {
+        ja3_append_number(ja3, pFormats[i], bFirst);
+    }
+
+    if (nameLen != 0) {
+        flow.sni = m_names.intern(name, nameLen);
+    }
+    if (!ja3.overflow) {
+        MD5ByteContainer hash((uint8_t*)ja3.text, ja3.len);
+        memcpy(flow.ja3, hash.data(), TLS_JA3_SIZE);
+    }
+
+    m_hellos++;
+    return true;
+}
+
+void TLSInspector::on_segment (TLSFlowState_T& flow, uint32_t seq, const uint8_t* pData,
+                               uint32_t len) {
+    uint32_t needed = 0;
+
+    if (flow.state == TLS_INSPECT) {
+        switch (parse_record(pData, len, needed)) {
+        case TLS_PARSE_OK:
+            parse_hello(pData + TLS_RECORD_HEADER_SIZE + TLS_HANDSHAKE_HEADER_SIZE,
+                        needed - TLS_RECORD_HEADER_SIZE - TLS_HANDSHAKE_HEADER_SIZE, flow);
+            break;
+        case TLS_PARSE_MORE:
+            if (needed <= TLS_MAX_HELLO) {
+                //The oldest buffer is taken over, its owner notices the
+                //tag changed when its next segment arrives
+                TLSBuffer_T& buf = m_buffers[m_nextSlot];
+                if (!buf.data) {
+                    buf.data.reset(new uint8_t[TLS_MAX_HELLO]);
+                }
+                buf.tag = m_nextTag++;
+                if (m_nextTag == 0) {
+                    m_nextTag = 1;
+                }
+                buf.next_seq = seq + len;
+                buf.len = len;
+                buf.needed = needed;
+                memcpy(buf.data.get(), pData, len);
+
+                flow.slot = (uint16_t)m_nextSlot;
+                flow.tag = buf.tag;
+                flow.state = TLS_BUFFERED;
+                m_nextSlot = (m_nextSlot + 1) % TLS_BUFFER_SLOTS;
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        flow.state = TLS_DONE;
+        return;
+    }
+
+    TLSBuffer_T& buf = m_buffers[flow.slot];
+    if (buf.tag != flow.tag) {
+        flow.state = TLS_DONE;
+        return;
+    }
+
+    //A retransmission of the buffered segment
+    if (seq == buf.next_seq - buf.len) {
+        return;
+    }
+
+    if (seq == buf.next_seq) {
+        uint32_t copyLen = std::min(len, buf.needed - buf.len);
+        memcpy(buf.data.get() + buf.len, pData, copyLen);
+        buf.len += copyLen;
+        if (buf.len == buf.needed) {
+            m_reassembled++;
+            parse_hello(buf.data.get() + TLS_RECORD_HEADER_SIZE + TLS_HANDSHAKE_HEADER_SIZE,
+                        buf.needed - TLS_RECORD_HEADER_SIZE - TLS_HANDSHAKE_HEADER_SIZE, flow);
+        }
+    }
+
+    //Out of order or spanning a third segment, either way it ends here
+    buf.tag = 0;
+    flow.state = TLS_DONE;
+}
+
+std::string TLSInspector::sni (const TLSFlowState_T& flow) const {
+    return m_names.str(flow.sni);
+}
+
+std::string TLSInspector::ja3 (const TLSFlowState_T& flow) const {
+    static const char* gs_hex = "0123456789abcdef";
+    uint8_t any = 0;
+    std::string sHex;
+
+    for (size_t i = 0; i < TLS_JA3_SIZE; i++) {
+        any |= flow.ja3[i];
+    }
+    if (!any) {
+        return sHex;
+    }
+
+    sHex.reserve(TLS_JA3_SIZE * 2);
+    for (size_t i = 0; i < TLS_JA3_SIZE; i++) {
+        sHex.push_back(gs_hex[flow.ja3[i] >> 4]);
+        sHex.push_back(gs_hex[flow.ja3[i] & 0x0F]);
+    }
+    return sHex;
+}
+
+uint64_t TLSInspector::get_hellos (void) {
+    return m_hellos;
+}
+
+uint64_t TLSInspector::get_reassembled (void) {
+    return m_reassembled;
+}
+
+//=============================================================================
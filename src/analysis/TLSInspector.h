@@ -0,0 +1,129 @@
+/**@file TLSInspector.h
+ */
+#ifndef TLS_INSPECTOR_H_
+#define TLS_INSPECTOR_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DNSAnalyzer.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Largest ClientHello reassembled from two segments. Hellos with post
+//quantum key shares are around 1.8 KB, more than one segment.
+#define TLS_MAX_HELLO           (8192)
+
+//Connections buffering the first segment of a ClientHello at once
+#define TLS_BUFFER_SLOTS        (256)
+
+//Longest JA3 string hashed, longer ones only report the server name
+#define TLS_JA3_MAX             (4096)
+
+#define TLS_JA3_SIZE            (16)
+
+//Server names stay interned while their connections are tracked,
+//the table is rebuilt from the live connections past this size
+#define TLS_NAME_LIMIT          (16 * 1024 * 1024)
+
+typedef enum {
+    TLS_INSPECT     = 0,    //Waiting for the client's first payload
+    TLS_BUFFERED    = 1,    //First segment of a ClientHello buffered
+    TLS_DONE        = 2     //Parsed or given up on, never looked at again
+} TLSState_T;
+
+/**
+ * Per connection state, kept in the TCP tuple.
+ */
+typedef struct {
+    uint8_t state;              //TLSState_T
+    uint8_t pad;
+    uint16_t slot;              //Buffer of a TLS_BUFFERED connection
+    uint32_t tag;               //Checked against the buffer's owner
+    DNSName_T sni;              //0 if there was no server name
+    uint8_t ja3[TLS_JA3_SIZE];  //MD5 of the JA3 string, all zero if none
+} TLSFlowState_T;
+
+typedef struct {
+    uint32_t tag;               //0 when free
+    uint32_t next_seq;          //Sequence number of the second segment
+    uint32_t len;
+    uint32_t needed;            //Size of the record holding the hello
+    std::unique_ptr<uint8_t[]> data;
+} TLSBuffer_T;
+
+/**
+ * Extracts the server name and a JA3 fingerprint from the ClientHello
+ * of TCP connections.
+ *
+ * Only the client's first payload segment is looked at, in place. A
+ * hello that continues into the next segment is copied into one of a
+ * fixed number of buffers, so at most two segments are ever involved;
+ * anything else ends the inspection of the connection.
+ */
+class TLSInspector {
+public:
+    TLSInspector (void);
+
+    /**
+     * Handles a client payload segment of a connection that isn't
+     * TLS_DONE.
+     *
+     * @param flow Connection state.
+     * @param seq TCP sequence number of the segment.
+     * @param pData Payload.
+     * @param len Payload length.
+     */
+    void on_segment (TLSFlowState_T& flow, uint32_t seq, const uint8_t* pData, uint32_t len);
+
+    std::string sni (const TLSFlowState_T& flow) const;
+
+    /**
+     * @return std::string JA3 hash in hex, empty if there is none.
+     */
+    std::string ja3 (const TLSFlowState_T& flow) const;
+
+    /**
+     * Re-interns the server names of the connections still tracked once
+     * the name table has grown past TLS_NAME_LIMIT.
+     *
+     * @param tuples Every tracked connection, with a tls member.
+     */
+    template <class Container>
+    void compact (Container& tuples) {
+        if (m_names.size() <= TLS_NAME_LIMIT) {
+            return;
+        }
+
+        DNSNameTable names;
+        for (auto& tuple : tuples) {
+            if (tuple.tls.sni != 0) {
+                std::string sName = m_names.str(tuple.tls.sni);
+                tuple.tls.sni = names.intern(sName.c_str(), sName.size());
+            }
+        }
+        m_names = std::move(names);
+    }
+
+    uint64_t get_hellos (void);
+    uint64_t get_reassembled (void);
+
+protected:
+    bool parse_hello (const uint8_t* pData, uint32_t len, TLSFlowState_T& flow);
+
+protected:
+    DNSNameTable m_names;
+    std::vector<TLSBuffer_T> m_buffers;
+    size_t m_nextSlot;
+    uint32_t m_nextTag;
+    uint64_t m_hellos;
+    uint64_t m_reassembled;
+};
+
+//=============================================================================
+#endif //TLS_INSPECTOR_H_
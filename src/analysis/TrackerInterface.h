@@ -6,18 +6,131 @@
 // INCLUDES
 //=============================================================================
 #include <stdint.h>
+#include <stdio.h>
 #include <string>
 #include <deque>
+#include <type_traits>
 
 //=============================================================================
 // DEFINITIONS
 //=============================================================================
+//Changed whenever tuple fields change without changing the tuple size
+#define TRACKER_STATE_MAGIC (0x324B5254) //"TRK2"
 
 class TrackerInterface {
 public:
     virtual size_t get_opened (void) = 0;
     virtual size_t get_closed (void) = 0;
+
+    /**
+     * Writes the tracker's open connections and counters so that a 
+     * later run can resume exactly where this one stopped. 
+     *  
+     * @param fp Output file. 
+     * @return bool true on success, false on failure. 
+     */
+    virtual bool save_state (FILE* fp) = 0;
+
+    /**
+     * Reads state written by save_state(). The state is only staged; 
+     * the tracker's connections are left alone until commit_state(). 
+     *  
+     * @param fp Input file. 
+     * @return bool true on success, false if the state is missing or 
+     *         was written by an incompatible build.
+     */
+    virtual bool load_state (FILE* fp) = 0;
+
+    /**
+     * Replaces the tracker's connections and counters with the state 
+     * staged by load_state(), or drops the staged state. 
+     *  
+     * @param bApply true to apply the staged state, false to drop it. 
+     */
+    virtual void commit_state (bool bApply) = 0;
+};
+
+/**
+ * Tuple list and counters read by LoadTrackerState() and held until 
+ * CommitTrackerState(). 
+ */
+template <typename T>
+struct TrackerState {
+    std::deque<T> list;
+    uint64_t opened;
+    uint64_t closed;
 };
 
+/**
+ * Writes a tracker's address tuple list and counters. 
+ *  
+ * Tuples are written as raw structures along with their size, so a 
+ * snapshot written by a build with a different tuple layout is 
+ * rejected by LoadTrackerState() rather than misread. 
+ */
+template <typename T>
+bool SaveTrackerState (FILE* fp, const std::deque<T>& list, uint64_t opened, uint64_t closed) {
+    static_assert(std::is_trivially_copyable<T>::value, "tracker tuples must be trivially copyable");
+
+    uint64_t hdr[5] = { TRACKER_STATE_MAGIC, sizeof(T), opened, closed, list.size() };
+    if (fwrite(hdr, sizeof(hdr), 1, fp) != 1) {
+        return false;
+    }
+
+    for (auto& t : list) {
+        if (fwrite(&t, sizeof(T), 1, fp) != 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Reads a tracker's address tuple list and counters written by 
+ * SaveTrackerState() into a staging area. 
+ */
+template <typename T>
+bool LoadTrackerState (FILE* fp, TrackerState<T>& state) {
+    static_assert(std::is_trivially_copyable<T>::value, "tracker tuples must be trivially copyable");
+
+    std::deque<T>().swap(state.list);
+
+    uint64_t hdr[5];
+    if (fread(hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr[0] != TRACKER_STATE_MAGIC ||
+        hdr[1] != sizeof(T)) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < hdr[4]; i++) {
+        T t;
+        if (fread(&t, sizeof(T), 1, fp) != 1) {
+            std::deque<T>().swap(state.list);
+            return false;
+        }
+        state.list.push_back(t);
+    }
+
+    state.opened = hdr[2];
+    state.closed = hdr[3];
+    return true;
+}
+
+/**
+ * Moves staged state into a tracker's list and counters, or just 
+ * releases it. 
+ */
+template <typename T>
+void CommitTrackerState (TrackerState<T>& state, bool bApply,
+                         std::deque<T>& list, size_t& opened, size_t& closed) {
+    if (bApply) {
+        list.swap(state.list);
+        opened = state.opened;
+        closed = state.closed;
+    }
+    std::deque<T>().swap(state.list);
+}
+
 //=============================================================================
 #endif //TRACKER_INTERFACE_H_
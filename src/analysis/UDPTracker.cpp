@@ -17,9 +17,11 @@ extern std::shared_ptr<PacketMsgProxy> g_packetMsgProxy;
 //=============================================================================
 UDPTracker::UDPTracker (uint64_t timeout_us)
   : m_addrList(),
+    m_loaded(),
     m_timeout_us(timeout_us),
     m_opened(0),
-    m_closed(0)
+    m_closed(0),
+    m_expiry()
 {
 }
 
@@ -28,30 +30,53 @@ UDPTracker::~UDPTracker (void)
     m_addrList.clear();
 }
 
-void UDPTracker::on_packet (const Packet& packet) {
+void UDPTracker::on_packet (const Packet& packet, uint16_t vlan) {
     const PDU* pduPtr = packet.pdu();
     long int seconds = packet.timestamp().seconds();
     long int microseconds = packet.timestamp().microseconds();
 
-    const IP* ipHeader = pduPtr->find_pdu<IP>();
+    uint32_t bytes = 0;
+
     const UDP* UDPHeader = pduPtr->find_pdu<UDP>();
-    const RawPDU* raw = pduPtr->find_pdu<RawPDU>();
+    if (!UDPHeader) {
+        return;
+    }
 
-    if (!UDPHeader || !ipHeader) {
+    UDPAddressTuple hdrTemp;
+    if (!FlowKeySetAddresses(pduPtr, hdrTemp.key, bytes)) {
         return;
     }
+    hdrTemp.key.dport = UDPHeader->dport();
+    hdrTemp.key.sport = UDPHeader->sport();
+    hdrTemp.key.vlan = vlan;
+    hdrTemp.key.protocol = 17;
+    hdrTemp.timestamp_s = seconds;
+    hdrTemp.timestamp_us = microseconds;
+    hdrTemp.last_active_s = seconds;
+    hdrTemp.last_active_us = microseconds;
+    hdrTemp.packets = 1;
+    hdrTemp.bytes = bytes;
+    hdrTemp.state = UDP_ACTIVE;
 
+    on_tuple(hdrTemp, seconds, microseconds);
+}
+
+void UDPTracker::on_fragment (const FlowKey_T& key, uint32_t packets, uint32_t bytes,
+                              long int seconds, long int microseconds) {
     UDPAddressTuple hdrTemp;
-    hdrTemp.src = ipHeader->src_addr();
-    hdrTemp.dst = ipHeader->dst_addr();
-    hdrTemp.dport = UDPHeader->dport();
-    hdrTemp.sport = UDPHeader->sport();
+    hdrTemp.key = key;
     hdrTemp.timestamp_s = seconds;
     hdrTemp.timestamp_us = microseconds;
     hdrTemp.last_active_s = seconds;
     hdrTemp.last_active_us = microseconds;
+    hdrTemp.packets = packets;
+    hdrTemp.bytes = bytes;
     hdrTemp.state = UDP_ACTIVE;
 
+    on_tuple(hdrTemp, seconds, microseconds);
+}
+
+void UDPTracker::on_tuple (const UDPAddressTuple& hdrTemp, long int seconds, long int microseconds) {
     auto ctmp = find_udp(m_addrList.begin(),
                          m_addrList.end(),
                          hdrTemp,
@@ -61,36 +86,44 @@ void UDPTracker::on_packet (const Packet& packet) {
 
     if (ctmp != m_addrList.end()) {
         if ((*ctmp).state != UDP_CLOSED) {
+            (*ctmp).packets += hdrTemp.packets;
+            (*ctmp).bytes += hdrTemp.bytes;
+
             auto cm = ConnectionMetadata();
-            cm.src = (*ctmp).src;
-            cm.dst = (*ctmp).dst;
-            cm.l4_dst = (*ctmp).dport;
-            cm.l4_src = (*ctmp).sport;
-            cm.protocol = 17;
+            cm.set_key((*ctmp).key);
             cm.l4_protocol = 17;
             cm.timestamp_s = (*ctmp).timestamp_s;
             cm.timestamp_us = (*ctmp).timestamp_us;
             cm.update_hash();
 
-            if ((((*ctmp).last_active_s * (10^6) + 
-                  (*ctmp).last_active_us) + m_timeout_us) >
-                (seconds * (10^6) + microseconds)) {
+            uint64_t now = FlowExpiryTime(seconds, microseconds);
+            if (FlowExpiryTime((*ctmp).last_active_s, (*ctmp).last_active_us) + m_timeout_us > now) {
                 (*ctmp).last_active_s = seconds;
                 (*ctmp).last_active_us = microseconds;
+                //The expiry key catches up when the connection is next
+                //looked at by prune_connections()
             } else {
+                //Closed connections are keyed at time zero, so the next
+                //prune drops them
                 (*ctmp).state = UDP_CLOSED;
+                m_expiry.remove((*ctmp).expiry_key);
+                (*ctmp).expiry_key = m_expiry.add(0, ctmp - m_addrList.begin());
                 cm.end_timestamp_s = seconds;
                 cm.end_timestamp_us = microseconds;
+                cm.packets = (*ctmp).packets;
+                cm.bytes = (*ctmp).bytes;
                 cm.update_hash();
 
-                PrintLogMessage(
-                    LEVEL_DEBUG,
-                    SUBSYSTEM_UDP,
-                    "UDP CLOSE %-15s: %-15s:%5u -> %-15s:%5u",
-                    cm.hash.c_str(),
-                    cm.src_str().c_str(), (*ctmp).sport,
-                    cm.dst_str().c_str(), (*ctmp).dport
-                );
+                if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_UDP)) {
+                    PrintLogMessage(
+                        LEVEL_DEBUG,
+                        SUBSYSTEM_UDP,
+                        "UDP CLOSE %-15s: %-15s:%5u -> %-15s:%5u",
+                        cm.hash.c_str(),
+                        cm.src_str().c_str(), cm.l4_src,
+                        cm.dst_str().c_str(), cm.l4_dst
+                    );
+                }
 
                 m_closed++;
 
@@ -99,11 +132,7 @@ void UDPTracker::on_packet (const Packet& packet) {
         }
     } else {
         auto cm = ConnectionMetadata();
-        cm.src = ipHeader->src_addr();
-        cm.dst = ipHeader->dst_addr();
-        cm.l4_dst = UDPHeader->dport();
-        cm.l4_src = UDPHeader->sport();
-        cm.protocol = 17;
+        cm.set_key(hdrTemp.key);
         cm.l4_protocol = 17;
         cm.timestamp_s = seconds;
         cm.timestamp_us = microseconds;
@@ -112,15 +141,19 @@ void UDPTracker::on_packet (const Packet& packet) {
         cm.update_hash();
 
         m_addrList.push_back(hdrTemp);
+        m_addrList.back().expiry_key = m_expiry.add(FlowExpiryTime(seconds, microseconds),
+                                                    m_addrList.size() - 1);
 
-        PrintLogMessage(
-            LEVEL_DEBUG,
-            SUBSYSTEM_UDP,
-            "UDP OPEN  %-15s: %-15s:%5u -> %-15s:%5u",
-            cm.hash.c_str(),
-            cm.src_str().c_str(), cm.l4_src,
-            cm.dst_str().c_str(), cm.l4_dst
-        );
+        if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_UDP)) {
+            PrintLogMessage(
+                LEVEL_DEBUG,
+                SUBSYSTEM_UDP,
+                "UDP OPEN  %-15s: %-15s:%5u -> %-15s:%5u",
+                cm.hash.c_str(),
+                cm.src_str().c_str(), cm.l4_src,
+                cm.dst_str().c_str(), cm.l4_dst
+            );
+        }
 
         m_opened++;
 
@@ -132,43 +165,86 @@ void UDPTracker::prune_connections (
     uint64_t last_s,
     uint64_t last_us
 ) {
-    bool done = false;
-    auto iter = m_addrList.begin();
-    while (!done) {
-    for_start:
-        for (;iter != m_addrList.end(); iter++) {
-            if (((*iter).state == UDP_CLOSED) ||
-                ((((*iter).last_active_s) * 10^6 + (*iter).last_active_us + m_timeout_us) < 
-                 (last_s * (10^6) + last_us))) {
-
-                auto cm = ConnectionMetadata();
-                cm.src = (*iter).src;
-                cm.dst = (*iter).dst;
-                cm.l4_dst = (*iter).dport;
-                cm.l4_src = (*iter).sport;
-                cm.protocol = 17;
-                cm.l4_protocol = 17;
-                cm.timestamp_s = (*iter).timestamp_s;
-                cm.timestamp_us = (*iter).timestamp_us;
-                cm.update_hash();
+    uint64_t now = FlowExpiryTime(last_s, last_us);
+    uint64_t cutoff = (now > m_timeout_us) ? now - m_timeout_us : 0;
+    std::vector<FlowExpiryEntry> idle;
+    std::vector<size_t> expired;
 
-                PrintLogMessage(
-                    LEVEL_DEBUG,
-                    SUBSYSTEM_UDP,
-                    "UDP CLOSE %-15s: %-15s:%5u -> %-15s:%5u",
-                    cm.hash.c_str(),
-                    cm.src_str().c_str(), (*iter).sport,
-                    cm.dst_str().c_str(), (*iter).dport
-                );
+    //Only connections keyed before the cutoff are looked at. Those
+    //active since go back into the index under their last activity.
+    m_expiry.take_idle(cutoff, idle);
+    for (auto& entry : idle) {
+        UDPAddressTuple& tuple = m_addrList[entry.slot];
+        uint64_t lastActive = FlowExpiryTime(tuple.last_active_s, tuple.last_active_us);
 
-                g_packetMsgProxy->on_end_connection(&cm);
+        if (tuple.state != UDP_CLOSED && lastActive >= cutoff) {
+            tuple.expiry_key = m_expiry.add(lastActive, entry.slot);
+            continue;
+        }
 
-                m_closed++;
-                iter = m_addrList.erase(iter);
-                goto for_start;
-            }
+        expired.push_back(entry.slot);
+        if (tuple.state == UDP_CLOSED) {
+            continue;
+        }
+
+        //Connections closed in on_packet() have already been
+        //reported, so only timed out connections are reported here.
+        auto cm = ConnectionMetadata();
+        cm.set_key(tuple.key);
+        cm.l4_protocol = 17;
+        cm.timestamp_s = tuple.timestamp_s;
+        cm.timestamp_us = tuple.timestamp_us;
+        cm.end_timestamp_s = tuple.last_active_s;
+        cm.end_timestamp_us = tuple.last_active_us;
+        cm.packets = tuple.packets;
+        cm.bytes = tuple.bytes;
+        cm.update_hash();
+
+        if (IsLogEnabled(LEVEL_DEBUG, SUBSYSTEM_UDP)) {
+            PrintLogMessage(
+                LEVEL_DEBUG,
+                SUBSYSTEM_UDP,
+                "UDP CLOSE %-15s: %-15s:%5u -> %-15s:%5u",
+                cm.hash.c_str(),
+                cm.src_str().c_str(), cm.l4_src,
+                cm.dst_str().c_str(), cm.l4_dst
+            );
+        }
+
+        g_packetMsgProxy->on_end_connection(&cm);
+
+        m_closed++;
+    }
+
+    //Fill each gap from the back of the list. Going from the highest
+    //position down, the back is always a connection that stays.
+    std::sort(expired.begin(), expired.end(), std::greater<size_t>());
+    for (auto slot : expired) {
+        if (slot != m_addrList.size() - 1) {
+            m_addrList[slot] = m_addrList.back();
+            m_expiry.move(m_addrList[slot].expiry_key, slot);
         }
-        done = true;
+        m_addrList.pop_back();
+    }
+}
+
+void UDPTracker::rebuild_expiry (void) {
+    std::vector<FlowExpiryEntry> flows;
+
+    flows.reserve(m_addrList.size());
+    for (size_t i = 0; i < m_addrList.size(); i++) {
+        UDPAddressTuple& tuple = m_addrList[i];
+        uint64_t time_us = 0;
+
+        if (tuple.state != UDP_CLOSED) {
+            time_us = FlowExpiryTime(tuple.last_active_s, tuple.last_active_us);
+        }
+        flows.push_back(FlowExpiryEntry(time_us, i));
+    }
+
+    m_expiry.load(flows);
+    for (auto& flow : flows) {
+        m_addrList[flow.slot].expiry_key = flow.key;
     }
 }
 
@@ -184,6 +260,21 @@ size_t UDPTracker::get_closed (void) {
     return m_closed;
 }
 
+bool UDPTracker::save_state (FILE* fp) {
+    return SaveTrackerState(fp, m_addrList, m_opened, m_closed);
+}
+
+bool UDPTracker::load_state (FILE* fp) {
+    return LoadTrackerState(fp, m_loaded);
+}
+
+void UDPTracker::commit_state (bool bApply) {
+    CommitTrackerState(m_loaded, bApply, m_addrList, m_opened, m_closed);
+    if (bApply) {
+        rebuild_expiry();
+    }
+}
+
 std::shared_ptr<UDPTracker> UDPTracker::GetStaticInstance (uint64_t timeout_us) {
     if (gs_UDPTracker == nullptr) {
         gs_UDPTracker = std::make_shared<UDPTracker>(timeout_us);
@@ -25,8 +25,10 @@
 #include "TrackerInterface.h"
 #include "Logging.h"
 #include "BTree.h"
+#include "FlowExpiryIndex.h"
 #include "PacketMsgProxy.h"
 #include "MD5ByteContainer.h"
+#include "FlowKey.h"
 
 //=============================================================================
 // DEFINITIONS
@@ -45,32 +47,35 @@ typedef enum {
 class UDPAddressTuple {
 public:
     UDPAddressTuple (void)
-     : src(0),
-       dst(0),
-       dport(0),
-       sport(0),
+     : key(),
        timestamp_s(0),
        timestamp_us(0),
        last_active_s(0),
        last_active_us(0),
-       state(UDP_ACTIVE)
+       packets(0),
+       bytes(0),
+       state(UDP_ACTIVE),
+       expiry_key(0)
     {
     }
 
 public:
-    uint32_t src;
-    uint32_t dst;
-    uint16_t dport;
-    uint16_t sport;
+    FlowKey_T key;
     uint64_t timestamp_s;
     uint64_t timestamp_us;
     uint64_t last_active_s;
     uint64_t last_active_us;
+    uint64_t packets;
+    uint64_t bytes;
     UDP_State_T state;
+    uint64_t expiry_key;            //Key in the tracker's FlowExpiryIndex, at or before last activity
 };
 
+/**
+ * Finds the connection a packet belongs to, in either direction.
+ */
 template<class InputIt, class T>
-constexpr InputIt find_udp (
+InputIt find_udp (
     InputIt first,
     InputIt last,
     const T& value,
@@ -78,15 +83,10 @@ constexpr InputIt find_udp (
     uint64_t last_us,
     uint64_t timeout_us
 ) {
+    FlowKey_T rev = FlowKeyReverse(value.key);
     for (; first != last; ++first) {
-        if ((((*first).src == value.dst &&
-            (*first).dst == value.src) ||
-            ((*first).src == value.src ||
-            (*first).dst == value.dst)) &&
-            ((*first).dport == value.dport ||
-             (*first).sport == value.sport ||
-             (*first).dport == value.sport ||
-             (*first).sport == value.dport)) {
+        if (FlowKeyEqual((*first).key, value.key) ||
+            FlowKeyEqual((*first).key, rev)) {
 
             #if 0
             if ((((*first).last_active_s * (10^6) + 
@@ -115,11 +115,25 @@ public:
      * This routine handles packets.
      *  
      * @param packet Reference to packet just received.
+     * @param vlan VLAN ID the packet was tagged with, 0 if untagged.
      */
-    virtual void on_packet (const Packet& packet);
+    virtual void on_packet (const Packet& packet, uint16_t vlan = 0);
 
     /**
-     * Prunes all closed connections. 
+     * Counts IP fragments towards their datagram's flow, which the
+     * first fragment opens like any other packet.
+     *  
+     * @param key Flow of the datagram, ports taken from its first fragment.
+     * @param packets Number of fragments.
+     * @param bytes IP bytes of the fragments.
+     */
+    virtual void on_fragment (const FlowKey_T& key, uint32_t packets, uint32_t bytes,
+                              long int seconds, long int microseconds);
+
+    /**
+     * Prunes closed connections and reports and prunes the ones idle 
+     * for longer than the timeout. Only the connections the expiry 
+     * index holds under a key before the cutoff are looked at. 
      */
     virtual void prune_connections (
         uint64_t last_s,
@@ -137,14 +151,24 @@ public:
 
     virtual size_t get_closed (void);
 
+    virtual bool save_state (FILE* fp);
+    virtual bool load_state (FILE* fp);
+    virtual void commit_state (bool bApply);
+
 public:
     static std::shared_ptr<UDPTracker> GetStaticInstance (uint64_t timeout_us);
 
+protected:
+    void on_tuple (const UDPAddressTuple& hdrTemp, long int seconds, long int microseconds);
+    void rebuild_expiry (void);
+
 protected:
     std::deque<UDPAddressTuple> m_addrList;
+    TrackerState<UDPAddressTuple> m_loaded;          //Staged by load_state()
     uint64_t m_timeout_us;
     size_t m_opened;
     size_t m_closed;
+    FlowExpiryIndex m_expiry;                       //Connections by last activity, closed ones first
 };
 
 //=============================================================================
@@ -1,38 +1,54 @@
-/* @file BTree.h 
- * 
- * ============================================================================ 
- * Description: 
- * ============================================================================ 
- * - This B-Tree implementation is of a B-linked Tree with full 
- *   concurrency support, with minimal locking.
- * - All reads can be achieved with zero locking and no risk of dead-locking. 
- * - All insertions, deletions, splits, and merges require minimal locking. 
- * - A right-most pointer is maintained at the leaf-node level to allow for 
- *   concurrent traversal of the tree as well as simpler range searching.
- * - A maximum-key value is maintained for every node to simplify searching. 
- * - All code is based on B+-Trees, with B-linked Tree changes. 
- *  
- * ============================================================================ 
- * Usage: 
- * ============================================================================ 
- * - This is a template-based B-Tree implementation, requiring an 
- *   object data type with an (uint64_t addr()) method that is
- *   compared against an arbitrary key data type (usually uint64_t
+/* @file BTree.h
+ *
+ * ============================================================================
+ * Description:
+ * ============================================================================
+ * - This B-Tree implementation is of a B-linked Tree (Lehman and Yao) with
+ *   concurrency support and minimal locking.
+ * - All values live in the leaves; regular nodes only hold separator keys.
+ * - Every node keeps a right pointer to the next node of its level and a
+ *   high key that bounds the keys it covers. A reader that reaches a node
+ *   which has split since it read the parent follows the right pointer
+ *   instead of starting over, so readers never hold more than one node
+ *   lock and never wait on a whole insertion or deletion.
+ * - Range searches descend once and then walk the leaf chain, so they
+ *   take O(log n + k) for k results.
+ * - Writers are serialized by a single tree lock; a node's arrays are only
+ *   ever changed under that node's m_unstable lock, which readers take
+ *   while they look at the node.
+ * - Nodes are freed when they become empty rather than merged when they
+ *   are under-full, which suits indexes whose keys are mostly removed in
+ *   order (e.g. expiry by time) and keeps deletion to one path.
+ * - A node's keys are kept in one cache-line aligned array, searched four
+ *   at a time with AVX2 for 64-bit keys when the build targets it. Orders
+ *   whose keys fill whole cache lines (e.g. 9 or 17 for 64-bit keys) make
+ *   the best use of it. Building with BTREE_DEQUE_KEYS keeps the keys in
+ *   a std::deque instead.
+ *
+ * ============================================================================
+ * Usage:
+ * ============================================================================
+ * - This is a template-based B-Tree implementation, requiring an
+ *   object data type with a (K addr() const) method returning its key,
+ *   where K is ordered by operator< and operator== (usually uint64_t
  *   or int64_t -- preferrably unsigned).
- * - Instantiate a BTree<...> object and then begin to add user-defined 
+ * - Keys are unique. An index of flows by last-activity time, for
+ *   example, keys each flow by its time in the upper bits and a serial
+ *   number in the lower bits, so a time range maps to a key range.
+ * - Instantiate a BTree<...> object and then begin to add user-defined
  *   objects to the tree.
- *  
- * ============================================================================ 
- * Standards: 
- * ============================================================================ 
- * - All threading should be libpthread-based. 
- * - All locks and atomics should be C++11/C++14/C++17 based 
+ *
+ * ============================================================================
+ * Standards:
+ * ============================================================================
+ * - All threading should be libpthread-based.
+ * - All locks and atomics should be C++11/C++14/C++17 based
  *   where possible, unless this is incompatible with using
  *   libpthread-based threads.
- * - libpthread-based threads are used to maintain backwards 
+ * - libpthread-based threads are used to maintain backwards
  *   compatibility with ZMQ (which is incompatible with C++11 or later
  *   built-in threading features) -- the ZMQ threads just don't work
- *   at all if started from a newly created C++11 or later built-in thread. 
+ *   at all if started from a newly created C++11 or later built-in thread.
  */
 #ifndef BTREE_H_
 #define BTREE_H_
@@ -40,1127 +56,1439 @@
 // INCLUDES
 //=============================================================================
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <deque>
+#include <vector>
 #include <algorithm>
 #include <memory>
 #include <utility>
-#include <queue>
-#include <thread>
+#include <atomic>
 #include <mutex>
-#include <condition_variable>
-#include <tuple>
 #include <functional>
+#include <new>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 //=============================================================================
 // DEFINITIONS
 //=============================================================================
-#define DEFAULT_ORDER (10)
+//Sixteen 64-bit keys, two cache lines
+#define DEFAULT_ORDER (17)
 
-template <typename K, typename T>
-class BTree;
+//bulk_load rebuilds the tree only for runs of at least 1/BTREE_BULK_RATIO
+//of the values already in it; smaller runs are cheaper to insert
+#define BTREE_BULK_RATIO (8)
+
+//bulk_load fills nodes to about this percentage of the order, so the
+//inserts that follow a load don't split every node they reach
+#define BTREE_BULK_FILL (75)
+
+//Alignment and allocation granularity of node key arrays
+#define BTREE_KEY_LINE (64)
 
 /**
- * The type of the current node. 
+ * Counts the keys <= key in a sorted array.
+ *
+ * @param keys Sorted keys.
+ * @param count Number of keys.
+ * @param key Search key.
+ * @return size_t Number of keys <= key.
  */
-typedef enum {
-    Leaf    = 0,
-    Regular = 1
-} BTreeNodeType;
+template <typename K>
+inline size_t btree_upper_index (const K* keys, size_t count, const K& key) {
+    size_t index = 0;
+    while (index < count && !(key < keys[index])) {
+        index++;
+    }
+    return index;
+}
 
+#if defined(__AVX2__)
 /**
- * The direction of the current node. 
+ * Counts the keys greater than the search key four at a time, without
+ * branching on the keys: node searches land at random slots, so an
+ * early exit costs more in mispredictions than it saves.
+ *
+ * Keys must start on a 32-byte boundary and be readable up to the end
+ * of the last block, as a BTreeKeyArray is; lanes past count are
+ * ignored.
+ *
+ * @param bias Xor'd into every key before the signed compare.
  */
-typedef enum {
-    Left    = 0,
-    Right   = 1
-} BTreeNodeDirection;
+inline size_t btree_upper_index_avx2 (const int64_t* keys, size_t count,
+                                      int64_t key, int64_t bias) {
+    const __m256i flip = _mm256_set1_epi64x(bias);
+    const __m256i needle = _mm256_xor_si256(_mm256_set1_epi64x(key), flip);
+    size_t greater = 0;
+
+    for (size_t index = 0; index < count; index += 4) {
+        __m256i block = _mm256_xor_si256(
+            _mm256_load_si256((const __m256i*)(keys + index)), flip);
+        unsigned mask = _mm256_movemask_pd(
+            _mm256_castsi256_pd(_mm256_cmpgt_epi64(block, needle)));
+        if (count - index < 4) {
+            mask &= (1u << (count - index)) - 1;
+        }
+        greater += __builtin_popcount(mask);
+    }
+    return count - greater;
+}
+
+template <>
+inline size_t btree_upper_index<int64_t> (const int64_t* keys, size_t count,
+                                          const int64_t& key) {
+    return btree_upper_index_avx2(keys, count, key, 0);
+}
+
+template <>
+inline size_t btree_upper_index<uint64_t> (const uint64_t* keys, size_t count,
+                                           const uint64_t& key) {
+    //AVX2 only compares signed lanes; flipping the sign bit of both
+    //sides orders unsigned keys the same way
+    return btree_upper_index_avx2((const int64_t*)keys, count, (int64_t)key, INT64_MIN);
+}
+#endif
 
 /**
- * Defines an individual B-Tree node that can be independently 
- * locked depending on the situation (insertion, deletion, 
- * splitting, merging, etc...). 
- *
+ * The keys of a node, contiguous and cache-line aligned, with the parts
+ * of the std::deque interface the nodes use. Storage grows a cache line
+ * at a time and is zeroed past the keys, so whole lines can be read.
  */
-template <typename K, typename T>
-class BTreeNode {
+template <typename K>
+class BTreeKeyArray {
 public:
-    BTreeNode (void)
-      : m_lock(),
-        m_unstable(),
-        m_entries(),
-        m_children(),
-        m_left(nullptr),
-        m_right(nullptr),
-        m_type(BTreeNodeType::Regular)
+    static_assert(std::is_trivially_copyable<K>::value, "keys must be trivially copyable");
+
+    BTreeKeyArray (void)
+      : m_keys(nullptr),
+        m_size(0),
+        m_capacity(0)
     {
     }
 
-    BTreeNode (BTreeNodeType t)
-      : m_lock(),
-        m_unstable(),
-        m_entries(),
-        m_children(),
-        m_left(nullptr),
-        m_right(nullptr),
-        m_type(t)
-    {        
+    ~BTreeKeyArray (void) {
+        free(m_keys);
     }
 
-    /**
-     * Builds a new leaf node.
-     * 
-     * @return std::shared_ptr<BTreeNode<K,T>>
-     */
-    static std::shared_ptr<BTreeNode<K,T>> new_leaf (void) {
-        return std::make_shared<BTreeNode<K,T>>(BTreeNodeType::Leaf);
+    BTreeKeyArray (const BTreeKeyArray&) = delete;
+    BTreeKeyArray& operator= (const BTreeKeyArray&) = delete;
+
+    size_t size (void) const {
+        return m_size;
     }
 
-    /**
-     * Builds a new regular interior node.
-     * 
-     * @return std::shared_ptr<BTreeNode<K,T>>
-     */
-    static std::shared_ptr<BTreeNode<K,T>> new_regular (void) {
-        return std::make_shared<BTreeNode<K,T>>(BTreeNodeType::Regular);
+    bool empty (void) const {
+        return m_size == 0;
     }
 
-    /**
-     * Retrieves the length of the node's children array. 
-     *  
-     * @return uint64_t Length of children array.
-     */
-    uint64_t len (void) {
-        return m_children.size() + 1;
+    K* begin (void) {
+        return m_keys;
     }
 
-    /**
-     * Splits the current node. 
-     *  
-     * @note This is a locking operation. 
-     * 
-     * @return std::pair<std::shared_ptr<T>,
-     *                   std::shared_ptr<BTreeNode<K,T>>> Pair data.
-     * 
-     */
-    std::pair<std::shared_ptr<T>, std::shared_ptr<BTreeNode<K,T>>>
-        split (void)
-    {
-        //Lock the current node.
-        lock();
+    K* end (void) {
+        return m_keys + m_size;
+    }
 
-        std::shared_ptr<BTreeNode<K,T>> sibling =
-            std::make_shared<BTreeNode<K,T>>(m_type);
+    const K* data (void) const {
+        return m_keys;
+    }
 
-        //Update right pointer first, since the sibling is new in
-        //the overall B-Tree.
-        sibling->m_right = m_right;
+    K& operator[] (size_t index) {
+        return m_keys[index];
+    }
 
-        //Always update this before beginning to erase things.
-        //
-        //This node starts out empty, so the searching algorithm
-        //needs to take this situation into account when searching.
-        m_right = sibling;
-        
-        unsigned int split_at = m_entries.size() / 2;
+    const K& operator[] (size_t index) const {
+        return m_keys[index];
+    }
 
-        //Locks m_unstable due to change in array ops.
-        m_unstable.lock();
+    void push_back (const K& key) {
+        reserve(m_size + 1);
+        m_keys[m_size++] = key;
+    }
 
-        std::shared_ptr<T> dev = m_entries[split_at];
-        m_entries.erase(m_entries.begin() + split_at);
+    void insert (K* position, const K& key) {
+        size_t index = position - m_keys;
+        reserve(m_size + 1);
+        memmove(m_keys + index + 1, m_keys + index, (m_size - index) * sizeof(K));
+        m_keys[index] = key;
+        m_size++;
+    }
 
-        std::shared_ptr<BTreeNode<K,T>> node = m_children[split_at];
-        m_children.erase(m_children.begin() + split_at);
+    void erase (K* position) {
+        erase(position, position + 1);
+    }
 
-        //Unlocks m_unstable in preparation for next set of array ops.
-        m_unstable.unlock();
+    void erase (K* first, K* last) {
+        memmove(first, last, (end() - last) * sizeof(K));
+        m_size -= last - first;
+        memset((void*)(m_keys + m_size), 0, (last - first) * sizeof(K));
+    }
 
-        std::shared_ptr<T> device = nullptr;
-        std::shared_ptr<BTreeNode<K,T>> child = nullptr;
+    void resize (size_t count) {
+        reserve(count);
+        if (count < m_size) {
+            memset((void*)(m_keys + count), 0, (m_size - count) * sizeof(K));
+        }
+        m_size = count;
+    }
 
-        size_t count = m_entries.size();
-        for (size_t i = (size_t)split_at; i < count; i++) {
-            m_unstable.lock();
+    void assign (const K* first, const K* last) {
+        reserve(last - first);
+        memset((void*)m_keys, 0, m_capacity * sizeof(K));
+        memcpy((void*)m_keys, first, (last - first) * sizeof(K));
+        m_size = last - first;
+    }
 
-            device = m_entries[m_entries.size() - 1];
-            child = m_children[m_children.size() - 1];
-           
-            m_entries.pop_back();
-            m_children.pop_back();
-            
-            sibling->add_key(device->addr(), device, child);
+protected:
+    void reserve (size_t count) {
+        if (count <= m_capacity) {
+            return;
+        }
 
-            m_unstable.unlock();
+        size_t bytes = (count * sizeof(K) + BTREE_KEY_LINE - 1) / BTREE_KEY_LINE * BTREE_KEY_LINE;
+        K* keys = (K*)aligned_alloc(BTREE_KEY_LINE, bytes);
+        if (keys == nullptr) {
+            throw std::bad_alloc();
         }
+        memset((void*)keys, 0, bytes);
+        if (m_keys != nullptr) {
+            memcpy((void*)keys, m_keys, m_size * sizeof(K));
+            free(m_keys);
+        }
+        m_keys = keys;
+        m_capacity = bytes / sizeof(K);
+    }
 
-        sibling->add_left_child(node);
+protected:
+    K* m_keys;
+    size_t m_size;
+    size_t m_capacity;
+};
 
-        //Unlock the current node.
-        //
-        //All locking for the sibling node occurs within the add_* 
-        //routines and therefore doesn't need to occur in this routine
-        //to avoid a dead-lock situation.
-        unlock();
+template <typename K, typename T>
+class BTree;
+
+/**
+ * The type of the current node.
+ */
+typedef enum {
+    Leaf    = 0,
+    Regular = 1
+} BTreeNodeType;
 
-        return std::pair<std::shared_ptr<T>, std::shared_ptr<BTreeNode<K,T>>>(
-            dev, sibling
-        );
+/**
+ * Defines an individual B-Tree node.
+ *
+ * A leaf holds sorted keys and their values. A regular node holds
+ * sorted separator keys and one more child than keys; child i covers
+ * the keys from separator i - 1 (inclusive) to separator i (exclusive).
+ */
+template <typename K, typename T>
+class BTreeNode {
+public:
+    BTreeNode (BTreeNodeType t)
+      : m_unstable(),
+        m_keys(),
+        m_entries(),
+        m_children(),
+        m_right(nullptr),
+        m_high(),
+        m_bHigh(false),
+        m_bDeleted(false),
+        m_type(t)
+    {
     }
 
     /**
-     * Manually sets the m_left pointer to point to another shared 
-     * pointer of another B-Tree node. 
-     *  
-     * @param node Left node shared pointer.
+     * Builds a new leaf node.
+     *
+     * @return std::shared_ptr<BTreeNode<K,T>>
      */
-    void add_left_child (
-        std::shared_ptr<BTreeNode<K,T>> node
-    ) {
-        m_left = node;
+    static std::shared_ptr<BTreeNode<K,T>> new_leaf (void) {
+        return std::make_shared<BTreeNode<K,T>>(BTreeNodeType::Leaf);
     }
 
     /**
-     * Adds a key to the B-Tree and automatically performs 
-     * any splitting that is necessary. 
-     * 
-     * @param key Key
-     * @param device Device
-     * @param tree B-Tree
-     * @return bool true on success, false on failure.
+     * Builds a new regular interior node.
+     *
+     * @return std::shared_ptr<BTreeNode<K,T>>
      */
-    bool add_key (
-        const K key,
-        std::shared_ptr<T> device,
-        std::shared_ptr<BTreeNode<K,T>> tree
-    ) {
-        size_t index = 0;
-        auto pos = find_closest_index(key, index);
-
-        if (pos == BTreeNodeDirection::Right) {
-            index += 1;
-        }       
-
-        m_unstable.lock();
-
-        if (index >= m_entries.size()) {
-            m_entries.push_back(device);
-            m_children.push_back(tree);
-        } else {
-            m_entries.insert(m_entries.begin() + index, device);
-            m_children.insert(m_children.begin() + index, tree);
-        }
-
-        m_unstable.unlock();
-
-        return true;
+    static std::shared_ptr<BTreeNode<K,T>> new_regular (void) {
+        return std::make_shared<BTreeNode<K,T>>(BTreeNodeType::Regular);
     }
 
     /**
-     * Removes a key based on the key value. 
-     *  
-     * This recursively searches the B-Tree for compatible key 
-     * values. 
-     * 
-     * @param id 
+     * Retrieves the number of keys in the node.
+     *
+     * @return uint64_t Number of keys.
      */
-    void remove_key (K id) {
-        auto next_child = get_child(id);
-        if (next_child != nullptr) {
-            if (next_child->m_type != BTreeNodeType::Leaf) {
-                next_child->remove_key(id);
-            } else {
-                next_child->remove_key_r(id);
-            }
-        }
-    }
-
-    void remove_key_empty (K id) {
-        auto next_child = get_child(id);
-        if (next_child != nullptr) {
-            if (next_child->m_type != BTreeNodeType::Leaf) {
-                next_child->remove_key_empty(id);
-            } else {
-                next_child->remove_key_empty_r(id);
-            }
-        }
+    uint64_t len (void) const {
+        return m_keys.size();
     }
 
     /**
-     * Actually performs the recursive key removal operation. 
-     *  
-     * @param key Key to remove recursively. 
-     *  
-     * @return std::tuple<K, 
-     *                    std::shared_ptr<T>,
-     *                    std::shared_ptr<BTreeNode<K,T>>> Removed
-     *                    key data.
+     * Counts the keys that are <= the search key.
+     *
+     * In a regular node this is the child the key belongs to, in a
+     * leaf it is the slot just after the key if the key is present.
+     *
+     * @param key Search key.
+     * @return size_t Number of keys <= key.
      */
-    std::tuple<K, std::shared_ptr<T>, std::shared_ptr<BTreeNode<K,T>>>
-        remove_key_r (const K key)
-    {
+    size_t find_closest_index (const K key) const {
+#ifdef BTREE_DEQUE_KEYS
         size_t index = 0;
-        auto k = find_closest_index(key, index);
-
-        if (k == BTreeNodeDirection::Left) {
-            m_unstable.lock();
-
-            auto tree = m_left;
-            if (m_left != nullptr) {
-                m_left = nullptr;
-            }
-
-            m_unstable.unlock();
-
-            return std::make_tuple(key, nullptr, tree);
-        } else {
-            m_unstable.lock();
-
-            auto dev = m_entries[index];
-            auto tree = m_children[index];
-
-            m_entries.erase(m_entries.begin() + index);
-            m_children.erase(m_children.begin() + index);
-
-            m_unstable.unlock();
-
-            return std::make_tuple(dev->addr(), dev, tree);
+        while (index < m_keys.size() && !(key < m_keys[index])) {
+            index++;
         }
+        return index;
+#else
+        return btree_upper_index(m_keys.data(), m_keys.size(), key);
+#endif
     }
 
-    std::tuple<K, std::shared_ptr<T>, std::shared_ptr<BTreeNode<K,T>>>
-        remove_key_empty_r (const K key)
-    {
-        size_t index = 0;
-        auto k = find_closest_index_empty(key, index);
-
-        if (k == BTreeNodeDirection::Left) {
-            m_unstable.lock();
-
-            auto tree = m_left;
-            if (m_left != nullptr) {
-                m_left = nullptr;
-            }
-
-            m_unstable.unlock();
-
-            return std::make_tuple(key, nullptr, tree);
-        } else {
-            m_unstable.lock();
-
-            auto dev = m_entries[index];
-            auto tree = m_children[index];
-
-            m_entries.erase(m_entries.begin() + index);
-            m_children.erase(m_children.begin() + index);
-
-            m_unstable.unlock();
-
-            return std::make_tuple(dev->addr(), dev, tree);
+    /**
+     * Retrieves a value from a leaf.
+     *
+     * @note The caller must hold m_unstable or be the writer.
+     *
+     * @param key Key to look up.
+     * @return std::shared_ptr<T> Value, nullptr if not present.
+     */
+    std::shared_ptr<T> get_device (const K key) const {
+        size_t index = find_closest_index(key);
+        if (index > 0 && m_keys[index - 1] == key) {
+            return m_entries[index - 1];
         }
+        return nullptr;
     }
 
     /**
-     * Locates the next closest index to the given search key. 
-     *  
-     * @note This method returns the right most entry that is <= the
-     *       search key.
-     *  
-     * @param key Search key.
-     * @param index Index. 
-     *  
-     * @return BTreeNodeDirection Current node's direction.
+     * @return bool true unless the key belongs to a node further right
+     *         (the node split after its parent was read).
      */
-    BTreeNodeDirection find_closest_index (const K key, size_t &index) {
-        BTreeNodeDirection retVal = BTreeNodeDirection::Left;
-        index = 0;
-
-        for (size_t i = 0; i < m_entries.size(); i++) {
-            auto p = m_entries[i];
-            if (p->addr() <= key) {
-                index = i;
-                retVal = BTreeNodeDirection::Right;
-            } else {
-                break;
-            }
-        }
-
-        return retVal;
+    bool covers (const K key) const {
+        return !m_bHigh || key < m_high;
     }
 
-    BTreeNodeDirection find_closest_index_empty (const K key, size_t &index) {
-        BTreeNodeDirection retVal = BTreeNodeDirection::Left;
-        index = 0;
-
-        for (size_t i = 0; i < m_entries.size(); i++) {
-            auto p = m_entries[i];
-            if ((p->addr() <= key)) {
-                index = i;
-                retVal = BTreeNodeDirection::Right;
-            } else {
-                break;
-            }
-        }
-
-        return retVal;
+    /**
+     * Adds a value to a leaf.
+     *
+     * @param index Slot, from find_closest_index().
+     */
+    void add_key (size_t index, const K key, std::shared_ptr<T> device) {
+        const std::lock_guard<std::mutex> _lock_guard(m_unstable);
+        m_keys.insert(m_keys.begin() + index, key);
+        m_entries.insert(m_entries.begin() + index, device);
     }
 
     /**
-     * Retrieves a specific device from the m_entries list.
-     *  
-     * @note This method depends on m_unstable being unlocked. 
-     *  
-     * @param key Key to look up.
-     * @return std::shared_ptr<T> Device shared pointer. 
+     * Adds a separator and the child to its right to a regular node.
+     *
+     * @param index Slot of the separator, from find_closest_index().
      */
-    std::shared_ptr<T> get_device (const K key) {
+    void add_child (size_t index, const K key, std::shared_ptr<BTreeNode<K,T>> child) {
         const std::lock_guard<std::mutex> _lock_guard(m_unstable);
-
-        if (m_entries.size() == 0) {
-            return nullptr;
-        }
-
-        for (int i = (m_entries.size() - 1); i >= 0; i--) {
-            auto device = m_entries[i];
-
-            if (device != nullptr) {
-                if (((device->addr() == key) && (device->size() == 0)) ||
-                    ((device->addr() <= key) &&
-                    ((device->addr() + device->size()) > key))) 
-                {
-                    return device;
-                }
-            }
-        }
-
-        return nullptr;
+        m_keys.insert(m_keys.begin() + index, key);
+        m_children.insert(m_children.begin() + index + 1, child);
     }
 
     /**
-     * Retrieves the appropriate child node shared pointer based on 
-     * the relevant key search value. 
-     * 
-     * @param key Key to search for.
-     * @return std::shared_ptr<BTreeNode<K,T>> Child node shared 
-     *         pointer.
+     * Removes a value from a leaf.
      */
-    std::shared_ptr<BTreeNode<K,T>> get_child (const K key) {
+    void remove_key (size_t index) {
         const std::lock_guard<std::mutex> _lock_guard(m_unstable);
-        size_t index = 0;
-
-        auto pos = find_closest_index(key, index);
-
-        if (pos == BTreeNodeDirection::Left) {
-            return m_left;
-        } else {
-            return m_children[index];
-        }
+        m_keys.erase(m_keys.begin() + index);
+        m_entries.erase(m_entries.begin() + index);
     }
 
-    std::shared_ptr<BTreeNode<K,T>> get_child_empty (const K key) {
-        //const std::lock_guard<std::mutex> _lock_guard(m_unstable);
-        size_t index = 0;
-
-        auto pos = find_closest_index_empty(key, index);
-        
-        auto retVal = m_left;
-
-        if (pos == BTreeNodeDirection::Left) {
-            PrintSimpleLogMessage(LEVEL_DEBUG, "gc_empty==%d, addr=0x%llx (1)",
-                              pos, m_left != nullptr ? m_left->m_entries[0]->addr() : NULL);
-            retVal = m_left;            
-        } else {
-            PrintSimpleLogMessage(LEVEL_DEBUG, "gc_empty==%d, addr=0x%llx (2)",
-                              pos, m_children[index] != nullptr ? m_children[index]->m_entries[0]->addr() : NULL);
-            retVal = m_children[index];
-        }
-
-        for (auto child : m_children) {
-            if (child != nullptr) {
-                child->get_child_empty(key);
-            }
-        }
-
-        if (m_left != nullptr && m_left->m_children.size() > 0) {
-            for (auto child : m_left->m_children) {
-                if (child != nullptr) {
-                    child->get_child_empty(key);
-                }
-            }
-        }
-
-        size_t c = 0;
-        bool isDone = false;
-        bool modRetVal = false;
-        while (!isDone) {
-            c = 0;
-            isDone = true;
-
-            if (retVal == nullptr) {
-                break;
-            }
-
-            for (; c < retVal->m_entries.size(); c++) {
-                if (retVal->m_entries[c]->size() == 0) {
-                    //m_unstable.lock();
-                    retVal->m_entries.erase(retVal->m_entries.begin() + c);
-                    retVal->m_children.erase(retVal->m_children.begin() + c);
-                    //m_unstable.unlock();
-                    isDone = false;
-                    modRetVal = true;
-                    c = retVal->m_entries.size() + 1;
-                    continue;
-                }
-            }
+    /**
+     * Removes a child and the separator that bounds it, the one to its
+     * left or, for the first child, the one to its right.
+     */
+    void remove_child (size_t index) {
+        const std::lock_guard<std::mutex> _lock_guard(m_unstable);
+        if (!m_keys.empty()) {
+            m_keys.erase(m_keys.begin() + (index > 0 ? index - 1 : 0));
         }
-
-        return modRetVal ? retVal : retVal;
+        m_children.erase(m_children.begin() + index);
     }
 
     /**
-     * Merges the current node with another node 'b'.
-     *  
-     * @note This method locks m_unstable and will block any 
-     *       split or other merge that occurs while this method
-     *       is still running. 
-     *  
-     * @param b Secondary node to merge into this node.
+     * Moves the upper half of the node into a new right sibling.
+     *
+     * The sibling is fully built before it is linked in, and the node
+     * is cut back and linked to it in one step, so readers see either
+     * the whole node or both halves.
+     *
+     * @return std::pair<K, std::shared_ptr<BTreeNode<K,T>>> The
+     *         separator for the parent and the sibling.
      */
-    void merge (std::shared_ptr<BTreeNode<K,T>> b) {
-        const std::lock_guard<std::mutex> _lock_guard(m_unstable);
+    std::pair<K, std::shared_ptr<BTreeNode<K,T>>> split (void) {
+        std::shared_ptr<BTreeNode<K,T>> sibling =
+            std::make_shared<BTreeNode<K,T>>(m_type);
+        size_t split_at = m_keys.size() / 2;
+        K separator = m_keys[split_at];
 
-        for (auto e : b->m_entries) {
-            m_entries.push_back(e);
+        if (m_type == BTreeNodeType::Leaf) {
+            //Leaves keep every key, the separator is copied up
+            sibling->m_keys.assign(m_keys.begin() + split_at, m_keys.end());
+            sibling->m_entries.assign(m_entries.begin() + split_at, m_entries.end());
+        } else {
+            //Regular nodes hand the separator up
+            sibling->m_keys.assign(m_keys.begin() + split_at + 1, m_keys.end());
+            sibling->m_children.assign(m_children.begin() + split_at + 1, m_children.end());
         }
-        b->m_entries.clear();
+        sibling->m_right = m_right;
+        sibling->m_high = m_high;
+        sibling->m_bHigh = m_bHigh;
 
-        for (auto c : b->m_children) {
-            m_children.push_back(c);
+        const std::lock_guard<std::mutex> _lock_guard(m_unstable);
+        if (m_type == BTreeNodeType::Leaf) {
+            m_keys.resize(split_at);
+            m_entries.resize(split_at);
+        } else {
+            m_keys.resize(split_at);
+            m_children.resize(split_at + 1);
         }
-        b->m_children.clear();
-
-        //@todo This method should split the current node into
-        //      chunks that are the size of the B-Tree's maximum
-        //      order size.
-    }
-
-    /**
-     * Locks the node's mutex. 
-     *  
-     * This should only be done for either 
-     * an insertion or a deletion operation. 
-     *  
-     * Searching shouldn't require the use of 
-     * any locks whatsoever. 
-     */ 
-    void lock (void) {
-        m_lock.lock();
-    }
+        m_right = sibling;
+        m_high = separator;
+        m_bHigh = true;
 
-    /**
-     * Attempts to lock the node's mutex. 
-     *  
-     * @return bool true if lock was successful, false if lock 
-     *         unavailable.
-     */
-    bool try_lock (void) {
-        return m_lock.try_lock();
+        return std::make_pair(separator, sibling);
     }
 
     /**
-     * Unlocks the node's mutex. 
-     *  
-     * This should only rarely occur. 
+     * @return bool true if the node holds nothing.
      */
-    void unlock (void) {
-        m_lock.unlock();
+    bool is_empty (void) const {
+        return (m_type == BTreeNodeType::Leaf) ? m_keys.empty() : m_children.empty();
     }
 
     friend BTree<K,T>;
-   
+
 protected:
-    //These are the only mutexes for this node.
-    //m_unstable is only ever locked when there is a 
-    //critical section of multiple changes to m_entries/m_children
-    //that need to happen at the same time.
-    std::mutex m_lock;
+    //Held by readers while they look at the node and by the writer
+    //while it changes it.
     std::mutex m_unstable;
 
-    //Entries array stores actual data in the B-Tree.
+    //Keys, and for leaves the values stored under them.
+#ifdef BTREE_DEQUE_KEYS
+    std::deque<K> m_keys;
+#else
+    BTreeKeyArray<K> m_keys;
+#endif
     std::deque<std::shared_ptr<T>> m_entries;
 
-    //Children array stores shared pointers to other B-Tree nodes.
+    //Children of a regular node, one more than keys.
     std::deque<std::shared_ptr<BTreeNode<K,T>>> m_children;
 
-    //The left pointer is a hold-over from the Rust code
-    //for the original B-Tree implementation. This shouldn't
-    //really be necessary any more.
-    std::shared_ptr<BTreeNode<K,T>> m_left;
-
-    //The right pointer gets updated periodically to 
-    //allow for concurrent searching while inserting or
-    //deleting nodes from the tree.
+    //Next node of the same level and the first key it covers, so
+    //readers can recover from splits they raced with.
     std::shared_ptr<BTreeNode<K,T>> m_right;
+    K m_high;
+    bool m_bHigh;
+
+    //Set once an empty node is unlinked; readers that still reach it
+    //start over from the root.
+    bool m_bDeleted;
 
     //This variable defines the type of node.
     BTreeNodeType m_type;
 };
 
 /**
- * This is the full B-linked Tree implementation. 
- */ 
+ * This is the full B-linked Tree implementation.
+ */
 template <typename K, typename T>
 class BTree {
 public:
     /**
-     * Creates a default B-Tree with a default hard-coded order 
-     * value (e.g. maximum node width or length). 
+     * Creates a default B-Tree with a default hard-coded order
+     * value (e.g. maximum node width or length).
      */
     BTree (void)
-      : m_length(0),
-        m_order(DEFAULT_ORDER)
+      : m_rootNode(nullptr),
+        m_length(0),
+        m_order(DEFAULT_ORDER),
+        m_writer()
     {
-        m_rootNode = nullptr;
     }
 
     /**
-     * Creates a B-Tree of a specific order (e.g. maximum node width 
-     * or length). 
-     * 
-     * @param order 
+     * Creates a B-Tree of a specific order (e.g. maximum node width
+     * or length).
+     *
+     * @param order Most children of a node, at least 3. A node holds
+     *              at most order - 1 keys.
      */
-    BTree (size_t order) 
-      : m_length(0),
-        m_order(order)
+    BTree (size_t order)
+      : m_rootNode(nullptr),
+        m_length(0),
+        m_order(std::max(order, (size_t)3)),
+        m_writer()
     {
-        m_rootNode = nullptr;
     }
 
+    //Node splits, not copies, are what this is for
+    BTree (const BTree&) = delete;
+    BTree& operator= (const BTree&) = delete;
+
 public:
     /* Adds a value into the BTree.
-     *  
-     * This is an alias of the insert method. 
-     *  
-     * @note This routine doesn't properly handle duplicate values, 
-     *       so don't do this since its currently unsupported. 
-     *  
+     *
+     * This is an alias of the insert method.
+     *
      * @param value Value to add to the BTree.
+     * @return bool false if the key is already present.
      */
-    void add (T value) {
-        insert(value);
+    bool add (T value) {
+        return insert(value);
     }
 
-    void add (std::shared_ptr<T> value) {
-        insert(value);
+    bool add (std::shared_ptr<T> value) {
+        return insert(value);
     }
 
     /**
      * Inserts a value into the BTree.
-     *  
-     * @note This routine doesn't properly handle duplicate values, 
-     *       so don't do this since its currently unsupported. 
-     *  
+     *
      * @param value Value to add to the BTree.
+     * @return bool false if the key is already present.
      */
-    void insert (T value) {
-        auto node = m_rootNode;
+    bool insert (T value) {
+        return insert(std::make_shared<T>(value));
+    }
+
+    bool insert (std::shared_ptr<T> value) {
+        if (value == nullptr) {
+            return false;
+        }
+
+        const std::lock_guard<std::mutex> _writer(m_writer);
+        const K key = value->addr();
+        auto node = std::atomic_load(&m_rootNode);
 
         if (node == nullptr) {
             node = BTreeNode<K,T>::new_leaf();
-        } else {
-            m_rootNode = nullptr;
+            node->add_key(0, key, value);
+            std::atomic_store(&m_rootNode, node);
+            m_length += 1;
+            return true;
         }
 
-        auto root = add_r(node, std::make_shared<T>(value), true);
+        //Only the writer changes the structure, so the path down
+        //can't go stale while it is in use.
+        std::vector<std::shared_ptr<BTreeNode<K,T>>> path;
+        while (node->m_type != BTreeNodeType::Leaf) {
+            path.push_back(node);
+            node = node->m_children[node->find_closest_index(key)];
+        }
 
-        cond.notify_one();
-        m_rootNode = std::get<0>(root);
-    }
+        size_t index = node->find_closest_index(key);
+        if (index > 0 && node->m_keys[index - 1] == key) {
+            return false;
+        }
+        node->add_key(index, key, value);
+        m_length += 1;
 
-    void insert (std::shared_ptr<T> value) {
-        auto node = m_rootNode;
+        while (node->len() >= m_order) {
+            auto p = node->split();
 
-        if (node == nullptr) {
-            node = BTreeNode<K,T>::new_leaf();
-        } else {
-            m_rootNode = nullptr;
-        }
+            if (path.empty()) {
+                auto parent = BTreeNode<K,T>::new_regular();
+                parent->m_keys.push_back(p.first);
+                parent->m_children.push_back(node);
+                parent->m_children.push_back(p.second);
+                std::atomic_store(&m_rootNode, parent);
+                break;
+            }
 
-        auto root = add_r(node, value, true);
+            auto parent = path.back();
+            path.pop_back();
+            parent->add_child(parent->find_closest_index(p.first), p.first, p.second);
+            node = parent;
+        }
 
-        cond.notify_one();
-        m_rootNode = std::get<0>(root);
+        return true;
     }
 
-private:
     /**
-     * Recursively adds an entry to the current B-Tree. 
-     * 
-     * @param node Current B-Tree node.
-     * @param device Device to add.
-     * @param is_root Is the root node?
-     * @return std::tuple<std::shared_ptr<BTreeNode<K,T>>, 
-     *                    std::shared_ptr<T>,
-     *                    std::shared_ptr<BTreeNode<K,T>>> Added
-     *                    node information/pointers.
+     * Adds a run of values sorted by key, e.g. a restored snapshot or
+     * merged shards, by building the tree bottom-up in one pass:
+     * leaves first, then each level of regular nodes over the one
+     * below. Nodes are filled to about BTREE_BULK_FILL percent. Values already in the tree are merged in, and the new
+     * tree replaces the old one in a single step.
+     *
+     * Takes O(n + m) for n values added to a tree of m. Runs shorter
+     * than m / BTREE_BULK_RATIO are inserted one at a time instead, as
+     * are values that are out of order or share a key with an earlier
+     * one.
+     *
+     * @param first Start of the values (std::shared_ptr<T>).
+     * @param last End of the values.
+     * @return size_t Number of values added.
      */
-    std::tuple<std::shared_ptr<BTreeNode<K,T>>, std::shared_ptr<T>, std::shared_ptr<BTreeNode<K,T>>>
-        add_r (std::shared_ptr<BTreeNode<K,T>> node,
-               std::shared_ptr<T> device,
-               bool is_root)
-    {
-        auto id = device->addr();
-
-        switch (node->m_type) {
-        case BTreeNodeType::Leaf:
-            {
-                node->add_key(id, device, nullptr);
-                m_length += 1;
-                break;
-            }
-        case BTreeNodeType::Regular:
-            {
-                auto x = node->remove_key_r(id);
-                auto n = add_r(std::get<2>(x), device, false);
-                if (std::get<1>(x) == nullptr) {
-                    node->add_left_child(std::get<0>(n));
+    template <typename Iterator>
+    size_t bulk_load (Iterator first, Iterator last) {
+        std::vector<std::shared_ptr<T>> stragglers;
+        size_t added = 0;
+        {
+            const std::lock_guard<std::mutex> _writer(m_writer);
+            auto root = std::atomic_load(&m_rootNode);
+
+            std::vector<std::shared_ptr<T>> incoming;
+            for (; first != last; ++first) {
+                std::shared_ptr<T> value = *first;
+                if (value == nullptr) {
+                    continue;
+                }
+                if (!incoming.empty() && !(incoming.back()->addr() < value->addr())) {
+                    stragglers.push_back(value);
                 } else {
-                    node->add_key(std::get<0>(x),
-                                  std::get<1>(x),
-                                  std::get<0>(n));
+                    incoming.push_back(value);
                 }
+            }
 
-                //auto split_result = std::get<1>(n);
-                if (std::get<1>(n) != nullptr) {
-                    auto new_id = std::get<1>(n);
-                    node->add_key(new_id->addr(),
-                                  std::get<1>(n),
-                                  std::get<2>(n));
+            if (incoming.size() * BTREE_BULK_RATIO < m_length) {
+                //Ahead of the stragglers, so the first value of a key wins
+                stragglers.insert(stragglers.begin(), incoming.begin(), incoming.end());
+            } else if (!incoming.empty()) {
+                std::vector<std::shared_ptr<T>> existing;
+                existing.reserve(m_length);
+                collect(root, existing);
+
+                //Merge, keeping the existing value of a key in both
+                std::vector<std::shared_ptr<T>> values;
+                values.reserve(existing.size() + incoming.size());
+                size_t i = 0;
+                size_t j = 0;
+                while (i < existing.size() || j < incoming.size()) {
+                    if (j == incoming.size() ||
+                        (i < existing.size() && existing[i]->addr() < incoming[j]->addr())) {
+                        values.push_back(existing[i++]);
+                    } else if (i == existing.size() ||
+                               incoming[j]->addr() < existing[i]->addr()) {
+                        values.push_back(incoming[j++]);
+                        added++;
+                    } else {
+                        values.push_back(existing[i++]);
+                        j++;
+                    }
+                }
+
+                std::atomic_store(&m_rootNode, build(values));
+                m_length = values.size();
+                if (root != nullptr) {
+                    retire_subtree(root);
                 }
-                break;
-            }
-        default:
-            {
-                break;
             }
         }
 
-        if (node->len() > m_order) {
-            auto p = node->split();
-            if (is_root) {
-                auto parent = BTreeNode<K,T>::new_regular();
-
-                parent->add_left_child(node);
-                parent->add_key(p.first->addr(), p.first, p.second);
-
-                return std::make_tuple(parent, nullptr, nullptr);
-            } else {
-                return std::make_tuple(node, p.first, p.second);
+        for (auto& value : stragglers) {
+            if (insert(value)) {
+                added++;
             }
-        } else {
-            return std::make_tuple(node, nullptr, nullptr);
+        }
+        return added;
+    }
+
+private:
+    /**
+     * Appends the values of a tree in key order.
+     */
+    void collect (std::shared_ptr<BTreeNode<K,T>> node, std::vector<std::shared_ptr<T>>& values) {
+        while (node != nullptr && node->m_type != BTreeNodeType::Leaf) {
+            node = node->m_children[0];
+        }
+        for (; node != nullptr; node = node->m_right) {
+            values.insert(values.end(), node->m_entries.begin(), node->m_entries.end());
         }
     }
 
-public:
     /**
-     * Removes a key or value based on its address. 
-     * 
-     * @param key Key or address to remove.
+     * Builds a tree over sorted, unique values.
+     *
+     * Each level is spread evenly over the fewest nodes that hold it
+     * at BTREE_BULK_FILL percent, so nodes share the slack rather than
+     * leaving a small last node.
+     *
+     * @return std::shared_ptr<BTreeNode<K,T>> Root, nullptr if empty.
      */
-    void remove (K key) {
-        remove_key(key);
+    std::shared_ptr<BTreeNode<K,T>> build (std::vector<std::shared_ptr<T>>& values) {
+        std::vector<std::shared_ptr<BTreeNode<K,T>>> level;
+        std::vector<K> lows;
+        size_t count = values.size();
+        size_t leafFill = std::max<size_t>(1, (m_order - 1) * BTREE_BULK_FILL / 100);
+        size_t fanout = std::max<size_t>(2, m_order * BTREE_BULK_FILL / 100);
+        size_t nodes = (count + leafFill - 1) / leafFill;
+
+        for (size_t n = 0, next = 0; n < nodes; n++) {
+            size_t take = (count - next + nodes - n - 1) / (nodes - n);
+            auto leaf = BTreeNode<K,T>::new_leaf();
+            for (size_t i = next; i < next + take; i++) {
+                leaf->m_keys.push_back(values[i]->addr());
+                leaf->m_entries.push_back(values[i]);
+            }
+            next += take;
+            lows.push_back(leaf->m_keys[0]);
+            level.push_back(leaf);
+        }
+        link_level(level, lows);
+
+        while (level.size() > 1) {
+            std::vector<std::shared_ptr<BTreeNode<K,T>>> parents;
+            std::vector<K> parentLows;
+            count = level.size();
+            nodes = (count + fanout - 1) / fanout;
+
+            for (size_t n = 0, next = 0; n < nodes; n++) {
+                size_t take = (count - next + nodes - n - 1) / (nodes - n);
+                auto parent = BTreeNode<K,T>::new_regular();
+                for (size_t i = next; i < next + take; i++) {
+                    if (i > next) {
+                        parent->m_keys.push_back(lows[i]);
+                    }
+                    parent->m_children.push_back(level[i]);
+                }
+                parentLows.push_back(lows[next]);
+                parents.push_back(parent);
+                next += take;
+            }
+            link_level(parents, parentLows);
+            level.swap(parents);
+            lows.swap(parentLows);
+        }
+        return level.empty() ? nullptr : level[0];
     }
 
     /**
-     * Removes a key or value based on its address. 
-     * 
-     * @param key Key or address to remove.
+     * Chains a level built left to right, each node bounded by the
+     * first key of the next.
      */
-    void remove_empty (K key) {
-        //remove_key_empty(key);
-        PrintSimpleLogMessage(LEVEL_DEBUG, "remove_empty(0x%llx)", key);
-        delete_empty_r(m_rootNode, key);
+    void link_level (std::vector<std::shared_ptr<BTreeNode<K,T>>>& level, std::vector<K>& lows) {
+        for (size_t i = 0; i + 1 < level.size(); i++) {
+            level[i]->m_right = level[i + 1];
+            level[i]->m_high = lows[i + 1];
+            level[i]->m_bHigh = true;
+        }
     }
 
+public:
     /**
-     * Determines if the current BTree is valid or not.
-     * 
-     * @return bool true if valid, false if invalid
+     * Removes a value based on its key.
+     *
+     * @param key Key to remove.
+     * @return bool false if the key wasn't present.
      */
-    bool is_a_valid_btree (void) {
-        auto root = m_rootNode;
+    bool remove (K key) {
+        const std::lock_guard<std::mutex> _writer(m_writer);
+        auto node = std::atomic_load(&m_rootNode);
 
-        if (root != nullptr) {
-            auto total = validate(root, 0);
-            return (std::get<0>(total) && 
-                    std::get<1>(total)) == std::get<2>(total);
-        } else {
+        if (node == nullptr) {
             return false;
         }
+
+        //The path down, the slot taken at each node and the node to
+        //the left of each node on the path (nullptr on the left edge),
+        //which is linked past the node if it empties.
+        std::vector<std::shared_ptr<BTreeNode<K,T>>> path;
+        std::vector<size_t> slots;
+        std::vector<std::shared_ptr<BTreeNode<K,T>>> lefts;
+        std::shared_ptr<BTreeNode<K,T>> left = nullptr;
+
+        while (node->m_type != BTreeNodeType::Leaf) {
+            size_t slot = node->find_closest_index(key);
+            path.push_back(node);
+            slots.push_back(slot);
+            lefts.push_back(left);
+
+            if (slot > 0) {
+                left = node->m_children[slot - 1];
+            } else if (left != nullptr) {
+                left = left->m_children.back();
+            }
+            node = node->m_children[slot];
+        }
+
+        size_t index = node->find_closest_index(key);
+        if (index == 0 || !(node->m_keys[index - 1] == key)) {
+            return false;
+        }
+        node->remove_key(index - 1);
+        m_length -= 1;
+
+        if (node->is_empty()) {
+            unlink_empty(node, left, path, slots, lefts);
+        }
+        collapse_root();
+        return true;
     }
 
 private:
     /**
-     * Validates that the current B-Tree is valid. 
-     * 
-     * @param node Current B-Tree node pointer.
-     * @param level Current B-Tree level. 
-     * @return std::tuple<bool,size_t,size_t> 
+     * Frees an empty node, and any ancestors it leaves empty.
+     *
+     * The first ancestor that keeps children drops the emptied child;
+     * its key range goes to the child's left sibling, or for a first
+     * child to its right sibling. The neighbors at each level below
+     * are relinked to match.
      */
-    std::tuple<bool,size_t,size_t> validate (
+    void unlink_empty (
         std::shared_ptr<BTreeNode<K,T>> node,
-        size_t level
+        std::shared_ptr<BTreeNode<K,T>> left,
+        std::vector<std::shared_ptr<BTreeNode<K,T>>>& path,
+        std::vector<size_t>& slots,
+        std::vector<std::shared_ptr<BTreeNode<K,T>>>& lefts
     ) {
-        switch (node->m_type) {
-        case BTreeNodeType::Leaf:
-            {
-                return std::make_tuple(
-                    (node->len() <= m_order), level, level
-                );
-            }
-        case BTreeNodeType::Regular:
-            {
-                auto min_children = level > 0 ? (m_order / 2) : 2;
-                auto key_rules = node->len() <= m_order && node->len() >= min_children;
-                auto total = std::make_tuple(key_rules, ((2^64) - 1), level);
-
-                for (size_t i=0; i<node->m_children.size(); i++) {
-                    auto tree = node->m_children[i];
-                    auto stats = validate(tree, level+1);
-
-                    total = std::make_tuple(
-                        std::get<0>(total) && std::get<1>(total),
-                        std::min(std::get<1>(stats), std::get<2>(total)),
-                        std::min(std::get<2>(stats), std::get<2>(total))
-                    );
-                }
+        //Find the highest node that empties
+        size_t top = path.size();
+        while (top > 0 && path[top - 1]->m_children.size() == 1) {
+            top--;
+        }
 
-                if (node->m_left != nullptr) {
-                    auto tree = node->m_left;
-                    auto stats = validate(tree, level+1);
+        if (top == 0) {
+            //Everything emptied
+            std::atomic_store(&m_rootNode, std::shared_ptr<BTreeNode<K,T>>(nullptr));
+            mark_deleted(path.empty() ? node : path[0]);
+            return;
+        }
 
-                    total = std::make_tuple(
-                        std::get<0>(total) && std::get<1>(total),
-                        std::min(std::get<1>(stats), std::get<2>(total)),
-                        std::min(std::get<2>(stats), std::get<2>(total))
-                    );
+        //Stop routing keys into the emptied subtree first; readers
+        //that are already inside it only find empty nodes.
+        bool bToLeft = slots[top - 1] > 0;
+        path[top - 1]->remove_child(slots[top - 1]);
+
+        //Then relink each emptied node's level, top down. lefts[i] is
+        //the left neighbor of path[i] and left that of the leaf.
+        for (size_t i = top; i <= path.size(); i++) {
+            auto victim = (i < path.size()) ? path[i] : node;
+            auto neighbor = (i < path.size()) ? lefts[i] : left;
+
+            if (neighbor != nullptr) {
+                const std::lock_guard<std::mutex> _lock_guard(neighbor->m_unstable);
+                neighbor->m_right = victim->m_right;
+                if (bToLeft) {
+                    neighbor->m_high = victim->m_high;
+                    neighbor->m_bHigh = victim->m_bHigh;
                 }
-
-                return total;                
             }
-        default:
+
+            const std::lock_guard<std::mutex> _lock_guard(victim->m_unstable);
+            victim->m_bDeleted = true;
+        }
+    }
+
+    void mark_deleted (std::shared_ptr<BTreeNode<K,T>> node) {
+        while (node != nullptr) {
+            std::shared_ptr<BTreeNode<K,T>> child = nullptr;
             {
-                return std::make_tuple(false,0,0);
+                const std::lock_guard<std::mutex> _lock_guard(node->m_unstable);
+                node->m_bDeleted = true;
+                if (!node->m_children.empty()) {
+                    child = node->m_children[0];
+                }
             }
+            node = child;
         }
     }
 
-public:
     /**
-     * Finds a specific value that contains the specified address 
-     * based on an address offset and size. 
-     *  
-     * @param id Address to lookup.
-     * @return std::shared_ptr<T> Return Value 
+     * Drops regular roots that are left with a single child.
      */
-    std::shared_ptr<T> find (K id) {
-        if (m_rootNode != nullptr) {
-            return find_r(m_rootNode, id);
-        } else {
-            return nullptr;
+    void collapse_root (void) {
+        auto root = std::atomic_load(&m_rootNode);
+        while (root != nullptr &&
+               root->m_type != BTreeNodeType::Leaf &&
+               root->m_children.size() == 1) {
+            //Readers still holding the old root are routed to the
+            //child, so it isn't marked deleted.
+            root = root->m_children[0];
+            std::atomic_store(&m_rootNode, root);
         }
     }
 
     /**
-     * Finds a range of data based on address and size within 
-     * the range (start,stop) inclusive. 
-     * 
-     * 
-     * @param start Start address (inclusive)
-     * @param stop Stop address (inclusive)
-     * @return std::deque<std::shared_ptr<T>> retVal
-     * 
+     * Marks every node of an unlinked subtree deleted.
+     *
+     * Right pointers are cut as well: readers never follow them out of
+     * a deleted node, and a chain of unlinked nodes held only by each
+     * other's right pointers would otherwise be freed recursively, one
+     * stack frame per node.
+     *
+     * @return size_t Number of values the subtree held.
      */
-    std::deque<std::shared_ptr<T>> find_range (K start, K stop) {
-        std::deque<std::shared_ptr<T>> retVal;
+    size_t retire_subtree (std::shared_ptr<BTreeNode<K,T>> node) {
+        {
+            const std::lock_guard<std::mutex> _lock_guard(node->m_unstable);
+            node->m_bDeleted = true;
+            node->m_right = nullptr;
+        }
 
-        if (m_rootNode != nullptr) {
-            size_t nextAddr = start;
-            while (nextAddr <= stop) {
-                auto k = find_r(m_rootNode, nextAddr);
+        //Only the writer changes the children, so they are read unlocked
+        size_t count = node->m_entries.size();
+        for (auto& child : node->m_children) {
+            count += retire_subtree(child);
+        }
+        return count;
+    }
 
-                if (k != nullptr) {
-                    nextAddr = k->addr() + k->size();
-                } else {
-                    nextAddr += 1;
+public:
+    /**
+     * Removes every value with a key in the range (start,stop)
+     * inclusive, e.g. to expire everything older than a time.
+     *
+     * Children that fall wholly in the range are unlinked from their
+     * parent in one step rather than emptied key by key, so only the
+     * nodes along the two edges of the range are changed; the nodes
+     * dropped are then visited once to mark them deleted.
+     *
+     * @param start Start key (inclusive)
+     * @param stop Stop key (inclusive)
+     * @return size_t Number of values removed.
+     */
+    size_t erase_range (K start, K stop) {
+        if (stop < start) {
+            return 0;
+        }
+
+        const std::lock_guard<std::mutex> _writer(m_writer);
+        auto root = std::atomic_load(&m_rootNode);
+
+        if (root == nullptr) {
+            return 0;
+        }
+
+        std::vector<DroppedLevel_T> levels;
+        std::vector<std::shared_ptr<BTreeNode<K,T>>> dropped;
+        size_t removed = 0;
+
+        if (trim(root, start, stop, 0, nullptr, nullptr, levels, dropped, removed)) {
+            //Everything is in the range
+            std::atomic_store(&m_rootNode, std::shared_ptr<BTreeNode<K,T>>(nullptr));
+            removed = retire_subtree(root);
+            m_length -= removed;
+            return removed;
+        }
+
+        //Link the node left of each level's dropped run to the node
+        //right of it. The left node may have taken over the run's key
+        //range, so its high key is reset from the route down to it.
+        for (size_t depth = 1; depth < levels.size(); depth++) {
+            DroppedLevel_T& level = levels[depth];
+            if (!level.bFound || !level.bLow) {
+                continue;
+            }
+
+            auto node = root;
+            const K* pHigh = nullptr;
+            for (size_t d = 0; d < depth; d++) {
+                size_t i = std::lower_bound(node->m_keys.begin(), node->m_keys.end(), level.low) -
+                           node->m_keys.begin();
+                if (i < node->m_keys.size()) {
+                    pHigh = &node->m_keys[i];
                 }
+                node = node->m_children[i];
+            }
 
-                retVal.push_back(k);
+            const std::lock_guard<std::mutex> _lock_guard(node->m_unstable);
+            node->m_right = level.last->m_right;
+            node->m_bHigh = pHigh != nullptr;
+            if (pHigh) {
+                node->m_high = *pHigh;
             }
         }
 
-        //Sort the results. This should be nearly O(n) duration at most in the normal case.
-        std::sort(retVal.begin(), retVal.end(), [](const std::shared_ptr<T> &a,
-                                                   const std::shared_ptr<T> &b) -> bool {
-                                                    return a->addr() < b->addr();
-                                                   });
-        return retVal;
+        for (auto& node : dropped) {
+            removed += retire_subtree(node);
+        }
+        m_length -= removed;
+        collapse_root();
+        return removed;
     }
 
-
 private:
     /**
-     * Performs a recursive search based on a given search key. 
-     * 
-     * @param node Current B-Tree node pointer.
-     * @param id Current search key.
-     * @return std::shared_ptr<T> Found value pointer.
+     * The span of one level's dropped nodes: where the first starts
+     * (bLow false if it was the level's first node) and the last.
      */
-    std::shared_ptr<T> find_r (
+    typedef struct {
+        bool bFound;
+        bool bLow;
+        K low;
+        bool bHigh;
+        K high;
+        std::shared_ptr<BTreeNode<K,T>> last;
+    } DroppedLevel_T;
+
+    /**
+     * Removes the keys in (start,stop) from a subtree, unlinking the
+     * children that end up holding none.
+     *
+     * @param pLow Smallest key the parent routes here, nullptr for none.
+     * @param pHigh Key the parent routes past here, nullptr for none.
+     * @param levels Widened by the span of each level's dropped nodes.
+     * @param dropped Populated with the children unlinked.
+     * @param removed Incremented by the values removed from leaves left
+     *                in the tree.
+     * @return bool true if every key of the subtree is in the range; the
+     *         subtree is then left as is for the parent to unlink.
+     */
+    bool trim (
         std::shared_ptr<BTreeNode<K,T>> node,
-        K id
+        K start,
+        K stop,
+        size_t depth,
+        const K* pLow,
+        const K* pHigh,
+        std::vector<DroppedLevel_T>& levels,
+        std::vector<std::shared_ptr<BTreeNode<K,T>>>& dropped,
+        size_t& removed
     ) {
-        if (node == nullptr) {
-            return nullptr;
-        }
+        auto& keys = node->m_keys;
 
-        auto device = node->get_device(id);
+        if (node->m_type == BTreeNodeType::Leaf) {
+            size_t first = std::lower_bound(keys.begin(), keys.end(), start) - keys.begin();
+            size_t last = node->find_closest_index(stop);
 
-        if (device != nullptr) {
-            return device;
+            if (first == 0 && last == keys.size()) {
+                return true;
+            }
+            if (first < last) {
+                const std::lock_guard<std::mutex> _lock_guard(node->m_unstable);
+                keys.erase(keys.begin() + first, keys.begin() + last);
+                node->m_entries.erase(node->m_entries.begin() + first,
+                                      node->m_entries.begin() + last);
+                removed += last - first;
+            }
+            return false;
         }
 
-        if (node->m_type != BTreeNodeType::Leaf) {
-            auto tree = node->get_child(id);
+        //Only the children holding start and stop can keep keys; the
+        //ones between them are dropped whole
+        size_t a = node->find_closest_index(start);
+        size_t b = node->find_closest_index(stop);
+        bool bFirst = trim(node->m_children[a], start, stop, depth + 1,
+                           (a > 0) ? &keys[a - 1] : pLow,
+                           (a < keys.size()) ? &keys[a] : pHigh,
+                           levels, dropped, removed);
+        bool bLast = (a == b) ? bFirst :
+                     trim(node->m_children[b], start, stop, depth + 1,
+                          &keys[b - 1],
+                          (b < keys.size()) ? &keys[b] : pHigh,
+                          levels, dropped, removed);
+
+        size_t x = bFirst ? a : a + 1;
+        size_t y = bLast ? b + 1 : b;
+        if (x >= y) {
+            return false;
+        }
+        if (x == 0 && y == node->m_children.size()) {
+            return true;
+        }
 
-            return find_r(tree, id);
+        for (size_t c = x; c < y; c++) {
+            note_dropped(levels, depth + 1, node->m_children[c],
+                         (c > 0) ? &keys[c - 1] : pLow,
+                         (c < keys.size()) ? &keys[c] : pHigh);
+            dropped.push_back(node->m_children[c]);
         }
 
-        return nullptr;
+        //The run's key range goes to the child on its left, or for the
+        //first children to the child on its right
+        size_t k = (x > 0) ? x - 1 : 0;
+        const std::lock_guard<std::mutex> _lock_guard(node->m_unstable);
+        keys.erase(keys.begin() + k, keys.begin() + k + (y - x));
+        node->m_children.erase(node->m_children.begin() + x, node->m_children.begin() + y);
+        return false;
     }
 
-    std::shared_ptr<BTreeNode<K,T>> delete_empty_r (
+    /**
+     * Widens the dropped spans by a subtree, whose leftmost node at
+     * each depth starts where it does and whose rightmost ends there.
+     */
+    void note_dropped (
+        std::vector<DroppedLevel_T>& levels,
+        size_t depth,
         std::shared_ptr<BTreeNode<K,T>> node,
-        K id
+        const K* pLow,
+        const K* pHigh
     ) {
-        if (node == nullptr) {
-            return nullptr;
-        }
+        for (; node != nullptr; depth++) {
+            if (levels.size() <= depth) {
+                levels.resize(depth + 1);
+            }
 
-        auto device = node->get_device(id);
+            DroppedLevel_T& level = levels[depth];
+            if (!level.bFound || (level.bLow && (!pLow || *pLow < level.low))) {
+                level.bLow = pLow != nullptr;
+                if (pLow) {
+                    level.low = *pLow;
+                }
+            }
+            if (!level.bFound || (level.bHigh && (!pHigh || level.high < *pHigh))) {
+                level.bHigh = pHigh != nullptr;
+                if (pHigh) {
+                    level.high = *pHigh;
+                }
+                level.last = node;
+            }
+            level.bFound = true;
 
-        if (device != nullptr && device->size() == 0) {
-            node->get_child_empty(id);
-            return node;
-        } 
-        
-        if (/*node->m_type != BTreeNodeType::Leaf*/ true) {
-            auto tree = node->get_child_empty(id);
-            delete_empty_r(tree, id);
+            node = (node->m_type == BTreeNodeType::Leaf) ? nullptr : node->m_children.back();
         }
-
-        return nullptr;
     }
 
 public:
     /**
-     * Walks the entire BTree and calls a callback function 
-     * for each value duriang a depth first search of the tree. 
-     * 
-     * @param callback Callback function
+     * Determines if the current BTree is valid or not.
+     *
+     * Checks that keys are sorted and within the range their parents
+     * route to each node, that every leaf is at the same depth, that
+     * nodes are within the order and only the root is empty, that each
+     * level's right pointers and high keys chain its nodes in order,
+     * and that the leaves hold m_length values. Under-full nodes are
+     * allowed.
+     *
+     * @note Must not run concurrently with a writer.
+     *
+     * @return bool true if valid, false if invalid
      */
-    void walk (std::function<void(T&,int)> callback) {
-        if (m_rootNode != nullptr) {
-            walk_in_order(m_rootNode, callback, 0);
+    bool is_a_valid_btree (void) {
+        auto root = std::atomic_load(&m_rootNode);
+
+        if (root == nullptr) {
+            return m_length == 0;
         }
-    }
 
-    /**
-     * Walks the entire BTree and calls a callback function 
-     * for each value during a depth first search of the tree. 
-     * 
-     * @param callback Callback function
-     */
-    void walk_shared (std::function<void(std::shared_ptr<T>&,int)> &callback) {
-        if (m_rootNode != nullptr) {
-            walk_in_order_shared(m_rootNode, callback, 0);
+        std::vector<std::vector<std::shared_ptr<BTreeNode<K,T>>>> levels;
+        size_t count = 0;
+        if (!validate(root, 0, nullptr, nullptr, levels, count)) {
+            return false;
+        }
+        if (count != m_length) {
+            return false;
         }
-    }
 
-    /**
-     * Walks the B-Tree in pairs. 
-     *  
-     * @param callback 
-     */
-    void walk_pairs (std::function<bool(T&,T&,int)> callback) {
-        if (m_rootNode != nullptr) {
-            while(walk_pairs_in_order(
-                m_rootNode,
-                m_rootNode,
-                0,
-                callback,
-                0) == true) {
-                continue;
+        for (size_t depth = 0; depth < levels.size(); depth++) {
+            auto& level = levels[depth];
+            for (size_t i = 0; i < level.size(); i++) {
+                //All leaves must be on the deepest level
+                bool bLeaf = level[i]->m_type == BTreeNodeType::Leaf;
+                if (bLeaf != (depth + 1 == levels.size())) {
+                    return false;
+                }
+                auto next = (i + 1 < level.size()) ? level[i + 1] : nullptr;
+                if (level[i]->m_right != next) {
+                    return false;
+                }
+                if (level[i]->m_bHigh != (next != nullptr)) {
+                    return false;
+                }
             }
         }
+        return true;
     }
 
 private:
-    void walk_in_order (
+    /**
+     * Validates one subtree.
+     *
+     * @param node Current B-Tree node pointer.
+     * @param level Current B-Tree level.
+     * @param pLow Smallest key the parent routes here, nullptr for none.
+     * @param pHigh Key the parent routes past here, nullptr for none.
+     * @param levels Populated with the nodes of each level, in order.
+     * @param count Incremented by the values found.
+     * @return bool true if valid.
+     */
+    bool validate (
         std::shared_ptr<BTreeNode<K,T>> node,
-        std::function<void(T&,int)> &callback,
-        int depth
+        size_t level,
+        const K* pLow,
+        const K* pHigh,
+        std::vector<std::vector<std::shared_ptr<BTreeNode<K,T>>>>& levels,
+        size_t& count
     ) {
-        if (node->m_left != nullptr) {
-            walk_in_order(node->m_left, callback, depth+1);            
+        if (node == nullptr || node->m_bDeleted) {
+            return false;
         }
+        if (levels.size() <= level) {
+            levels.resize(level + 1);
+        }
+        levels[level].push_back(node);
 
-        for (size_t i = 0; i < node->m_entries.size(); i++) {
-            auto k = node->m_entries[i];
-            if (k != nullptr) {
-                callback(*k.get(), depth);
+        if (node->len() >= m_order || (level > 0 && node->is_empty())) {
+            return false;
+        }
+        for (size_t i = 0; i < node->m_keys.size(); i++) {
+            const K& key = node->m_keys[i];
+            if (i > 0 && !(node->m_keys[i - 1] < key)) {
+                return false;
             }
-            auto c = node->m_children[i];
-            if (c != nullptr) {
-                walk_in_order(c, callback, depth+1);
+            if ((pLow && key < *pLow) || (pHigh && !(key < *pHigh))) {
+                return false;
             }
         }
-    }
+        if (pHigh && (!node->m_bHigh || !(node->m_high == *pHigh))) {
+            return false;
+        }
 
-    void walk_in_order_shared (
-        std::shared_ptr<BTreeNode<K,T>> node,
-        std::function<void(std::shared_ptr<T>&,int)> &callback,
-        int depth
-    ) {
-        if (node->m_left != nullptr) {
-            walk_in_order_shared(node->m_left, callback, depth+1);            
+        if (node->m_type == BTreeNodeType::Leaf) {
+            if (node->m_entries.size() != node->m_keys.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < node->m_entries.size(); i++) {
+                if (node->m_entries[i] == nullptr ||
+                    !(node->m_entries[i]->addr() == node->m_keys[i])) {
+                    return false;
+                }
+            }
+            count += node->m_entries.size();
+            return true;
         }
 
-        for (size_t i = 0; i < node->m_entries.size(); i++) {
-            auto k = node->m_entries[i];
-            if (k != nullptr) {
-                callback(k, depth);
+        if (node->m_children.size() != node->m_keys.size() + 1) {
+            return false;
+        }
+        for (size_t i = 0; i < node->m_children.size(); i++) {
+            const K* pChildLow = (i > 0) ? &node->m_keys[i - 1] : pLow;
+            const K* pChildHigh = (i < node->m_keys.size()) ? &node->m_keys[i] : pHigh;
+            if (!validate(node->m_children[i], level + 1, pChildLow, pChildHigh, levels, count)) {
+                return false;
             }
-            auto c = node->m_children[i];
-            if (c != nullptr) {
-                walk_in_order_shared(c, callback, depth+1);
+        }
+        return true;
+    }
+
+public:
+    /**
+     * Finds the value stored under a key.
+     *
+     * @param id Key to lookup.
+     * @return std::shared_ptr<T> Return Value, nullptr if not present.
+     */
+    std::shared_ptr<T> find (K id) {
+        auto leaf = find_leaf(id);
+        while (leaf != nullptr) {
+            std::unique_lock<std::mutex> guard(leaf->m_unstable);
+
+            if (leaf->m_bDeleted) {
+                guard.unlock();
+                leaf = find_leaf(id);
+            } else if (!leaf->covers(id)) {
+                auto next = leaf->m_right;
+                guard.unlock();
+                leaf = next;
+            } else {
+                return leaf->get_device(id);
             }
         }
+        return nullptr;
     }
 
+    /**
+     * Finds the values with keys in the range (start,stop) inclusive,
+     * in key order, by walking the leaf chain from start.
+     *
+     * @param start Start key (inclusive)
+     * @param stop Stop key (inclusive)
+     * @return std::deque<std::shared_ptr<T>> retVal
+     */
+    std::deque<std::shared_ptr<T>> find_range (K start, K stop) {
+        std::deque<std::shared_ptr<T>> retVal;
 
-    bool walk_pairs_in_order (
-        std::shared_ptr<BTreeNode<K,T>> node,
-        std::shared_ptr<BTreeNode<K,T>> parentNode,
-        size_t index,
-        std::function<bool(T&,T&,int)> &callback,
-        int depth
-    ) {
-        bool retVal = false;       
-        bool isDone = false;
+        for_range(start, stop, [&retVal](std::shared_ptr<T>& value) {
+            retVal.push_back(value);
+            return true;
+        });
+        return retVal;
+    }
 
-        while (!isDone) {
-            isDone = true;          
+    /**
+     * Calls a callback for each value with a key in the range
+     * (start,stop) inclusive, in key order.
+     *
+     * @note The callback runs with the leaf locked, so it must not
+     *       call back into the tree.
+     *
+     * @param callback Returns false to stop the walk.
+     */
+    void for_range (K start, K stop, std::function<bool(std::shared_ptr<T>&)> callback) {
+        if (stop < start) {
+            return;
+        }
 
-            if (node->m_left != nullptr) {
-                retVal = walk_pairs_in_order(node->m_left, node, 0, callback, depth+1);
+        //After a restart the keys up to and including from were
+        //already visited
+        K from = start;
+        bool bAfter = false;
+        auto leaf = find_leaf(from);
 
-                if (node->m_left != nullptr &&
-                    ((node->m_left->m_entries[0]->addr() + node->m_left->m_entries[0]->size()) == node->m_entries[0]->addr()) &&
-                    node->m_left->m_entries.size() > 0) {
-                    node->m_entries[0]->merge(node->m_left->m_entries[0]);
-                    node->m_left = nullptr;
-                    isDone = false;
-                    continue;
-                } else {
-                    if (retVal == true) {
-                        isDone = false;
-                        continue;
-                    }
-                }
+        while (leaf != nullptr) {
+            std::unique_lock<std::mutex> guard(leaf->m_unstable);
+
+            if (leaf->m_bDeleted) {
+                guard.unlock();
+                leaf = find_leaf(from);
+                continue;
             }
-            
-            if (node != parentNode &&
-                node != parentNode->m_left &&
-                node->m_entries.size() > 0 &&
-                parentNode->m_entries.size() > index &&
-                parentNode->m_children.size() > index &&
-                node->m_children.size() > 0 &&
-                ((parentNode->m_entries[index]->addr() + parentNode->m_entries[index]->size()) == node->m_entries[0]->addr())) {
-                
-                while (((parentNode->m_entries[index]->addr() + parentNode->m_entries[index]->size()) == node->m_entries[0]->addr())) {
-                    parentNode->m_entries[index]->merge(node->m_entries[0]);
-                    if (node->m_entries.size() != 0) {
-                        node->m_entries.erase(node->m_entries.begin());
-                        node->m_children.erase(node->m_children.begin());
+
+            if (leaf->covers(from)) {
+                size_t i = 0;
+                while (i < leaf->m_keys.size() &&
+                       (leaf->m_keys[i] < from || (bAfter && leaf->m_keys[i] == from))) {
+                    i++;
+                }
+
+                for (; i < leaf->m_keys.size(); i++) {
+                    if (stop < leaf->m_keys[i]) {
+                        return;
+                    }
+                    from = leaf->m_keys[i];
+                    bAfter = true;
+                    if (!callback(leaf->m_entries[i])) {
+                        return;
                     }
                 }
 
-                retVal = true;
-                return retVal;
+                if (leaf->m_bHigh && stop < leaf->m_high) {
+                    return;
+                }
             }
-            
-            for (size_t i = 0; i < (node->m_entries.size()); i++) {
-                if ((node->m_entries.size() > 0) &&
-                    (i < (node->m_entries.size() - 1))) {
-                    auto k = node->m_entries[i];
-                    auto k2 = node->m_entries[i + 1];
-                    if (k != nullptr &&
-                        k2 != nullptr) {
-
-                        //If callback returns true then merge both
-                        //child nodes.
-                        if (callback(*k.get(), *k2.get(), depth)) {
-                            k->merge(k2);
-                            node->m_entries.erase(node->m_entries.begin() + i + 1);
-
-                            auto c = node->m_children[i];
-                            auto c2 = node->m_children[i + 1];
-
-                            if (c != nullptr && 
-                                c2 != nullptr) {
-                                c->merge(c2);
-                                node->m_children.erase(node->m_children.begin() + i + 1);
-                            }
-
-                            retVal = true;
-                            isDone = false;
-                            break;
-                        }
-                    }
+
+            auto next = leaf->m_right;
+            guard.unlock();
+            leaf = next;
+        }
+    }
+
+    /**
+     * Number of values in the tree.
+     */
+    size_t size (void) const {
+        return m_length;
+    }
+
+private:
+    /**
+     * Descends to the leaf covering a key, moving right past nodes
+     * that split under the reader.
+     *
+     * @param id Current search key.
+     * @return std::shared_ptr<BTreeNode<K,T>> Leaf, unlocked, so the
+     *         caller checks again that it covers the key.
+     */
+    std::shared_ptr<BTreeNode<K,T>> find_leaf (K id) {
+        auto node = std::atomic_load(&m_rootNode);
+
+        while (node != nullptr) {
+            std::shared_ptr<BTreeNode<K,T>> next = nullptr;
+            {
+                const std::lock_guard<std::mutex> _lock_guard(node->m_unstable);
+
+                if (node->m_bDeleted) {
+                    //Unlinked under the reader, start over
+                    next = std::atomic_load(&m_rootNode);
+                } else if (!node->covers(id)) {
+                    next = node->m_right;
+                } else if (node->m_type == BTreeNodeType::Leaf) {
+                    return node;
+                } else {
+                    next = node->m_children[node->find_closest_index(id)];
                 }
+            }
+            node = next;
+        }
+        return nullptr;
+    }
 
-                auto c = node->m_children[i];
-                if (c != nullptr) {
-                    retVal = walk_pairs_in_order(c, node, i, callback, depth+1);
-
-                    if ((node->m_entries[i]->addr() + 
-                         node->m_entries[i]->size()) == parentNode->m_entries[index]->addr()) {
-                        parentNode->m_entries[index]->merge(node->m_entries[i]);
-                        parentNode->m_children[index]->merge(node->m_children[i]);
-                        node->m_entries.erase(node->m_entries.begin() + i);
-                        node->m_children.erase(node->m_children.begin() + i);
-                        isDone = false;
-                        break;
+public:
+    /**
+     * Walks the entire BTree in key order and calls a callback
+     * function for each value.
+     *
+     * @param callback Callback function, given the value and the
+     *                 depth of its leaf.
+     */
+    void walk (std::function<void(T&,int)> callback) {
+        std::function<void(std::shared_ptr<T>&,int)> shared =
+            [&callback](std::shared_ptr<T>& value, int depth) {
+                callback(*value.get(), depth);
+            };
+        walk_shared(shared);
+    }
+
+    /**
+     * Walks the entire BTree in key order and calls a callback
+     * function for each value.
+     *
+     * @param callback Callback function
+     */
+    void walk_shared (std::function<void(std::shared_ptr<T>&,int)> &callback) {
+        std::shared_ptr<BTreeNode<K,T>> node = nullptr;
+        int depth = 0;
+
+        //After a restart the keys up to and including from were
+        //already visited
+        K from = K();
+        bool bAfter = false;
+
+        for (;;) {
+            if (node == nullptr) {
+                if (bAfter) {
+                    node = find_leaf(from);
+                } else {
+                    node = std::atomic_load(&m_rootNode);
+                    depth = 0;
+                    while (node != nullptr && node->m_type != BTreeNodeType::Leaf) {
+                        const std::lock_guard<std::mutex> _lock_guard(node->m_unstable);
+                        node = node->m_children.empty() ? nullptr : node->m_children[0];
+                        depth++;
                     }
+                }
+                if (node == nullptr) {
+                    return;
+                }
+            }
+
+            std::unique_lock<std::mutex> guard(node->m_unstable);
+            if (node->m_bDeleted) {
+                //Dropped under the walk, pick up after the last key
+                guard.unlock();
+                node = nullptr;
+                continue;
+            }
 
-                    if (retVal == true) {
-                        isDone = false;
-                        break;
-                    }          
+            for (size_t i = 0; i < node->m_keys.size(); i++) {
+                if (bAfter && !(from < node->m_keys[i])) {
+                    continue;
                 }
-            }            
-        }
+                from = node->m_keys[i];
+                bAfter = true;
+                callback(node->m_entries[i], depth);
+            }
 
-        return retVal;
+            auto next = node->m_right;
+            guard.unlock();
+            if (next == nullptr) {
+                return;
+            }
+            node = next;
+        }
     }
 
 protected:
     std::shared_ptr<BTreeNode<K,T>> m_rootNode;
-    size_t m_length;
+    std::atomic<size_t> m_length;
     size_t m_order;
 
-    std::condition_variable cond;
+    //Serializes insertions and removals.
+    std::mutex m_writer;
 };
 
 //=============================================================================
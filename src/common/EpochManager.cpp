@@ -0,0 +1,66 @@
+/**@file EpochManager.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "EpochManager.h"
+#include <thread>
+#include <functional>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Slot each thread tries first, so threads rarely collide
+static thread_local size_t gs_slotHint =
+    std::hash<std::thread::id>()(std::this_thread::get_id());
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+EpochManager::EpochManager (void)
+  : m_epoch(1)
+{
+    for (size_t i = 0; i < EPOCH_SLOTS; i++) {
+        m_slots[i].epoch.store(0);
+    }
+}
+
+size_t EpochManager::enter (void) {
+    for (;;) {
+        //An epoch that is stale by the time it is announced only
+        //holds back reclamation a little longer
+        uint64_t epoch = m_epoch.load();
+
+        for (size_t i = 0; i < EPOCH_SLOTS; i++) {
+            size_t slot = (gs_slotHint + i) % EPOCH_SLOTS;
+            uint64_t expected = 0;
+            if (m_slots[slot].epoch.compare_exchange_strong(expected, epoch)) {
+                gs_slotHint = slot;
+                return slot;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+void EpochManager::exit (size_t slot) {
+    m_slots[slot].epoch.store(0, std::memory_order_release);
+}
+
+uint64_t EpochManager::current (void) const {
+    return m_epoch.load();
+}
+
+uint64_t EpochManager::advance (void) {
+    uint64_t oldest = m_epoch.fetch_add(1) + 1;
+
+    for (size_t i = 0; i < EPOCH_SLOTS; i++) {
+        uint64_t epoch = m_slots[i].epoch.load();
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+//=============================================================================
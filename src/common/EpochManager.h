@@ -0,0 +1,86 @@
+/**@file EpochManager.h
+ */
+#ifndef EPOCH_MANAGER_H_
+#define EPOCH_MANAGER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Readers that can be inside a critical section at once. More wait for a
+//free slot.
+#define EPOCH_SLOTS             (64)
+
+/**
+ * Epoch-based reclamation for structures read without locks.
+ *
+ * Readers announce the epoch they entered in; memory a writer unlinks
+ * is stamped with the epoch of the moment and only reused once every
+ * reader still inside entered in a later one, so a reader never sees
+ * memory freed under it. Each announcement sits in its own cache line,
+ * so readers on different cores don't contend.
+ */
+class EpochManager {
+public:
+    EpochManager (void);
+
+    /**
+     * Starts a critical section.
+     *
+     * @return size_t Slot to pass to exit().
+     */
+    size_t enter (void);
+
+    void exit (size_t slot);
+
+    /**
+     * @return uint64_t Epoch to stamp unlinked memory with.
+     */
+    uint64_t current (void) const;
+
+    /**
+     * Starts a new epoch.
+     *
+     * @return uint64_t Memory stamped before this epoch can be reused.
+     */
+    uint64_t advance (void);
+
+protected:
+    typedef struct alignas(64) {
+        std::atomic<uint64_t> epoch;    //0 when the slot is free
+    } EpochSlot_T;
+
+    std::atomic<uint64_t> m_epoch;
+    EpochSlot_T m_slots[EPOCH_SLOTS];
+};
+
+/**
+ * Keeps a critical section open for its scope.
+ */
+class EpochGuard {
+public:
+    EpochGuard (EpochManager& manager)
+      : m_manager(manager),
+        m_slot(manager.enter())
+    {
+    }
+
+    ~EpochGuard (void) {
+        m_manager.exit(m_slot);
+    }
+
+    EpochGuard (const EpochGuard&) = delete;
+    EpochGuard& operator= (const EpochGuard&) = delete;
+
+protected:
+    EpochManager& m_manager;
+    size_t m_slot;
+};
+
+//=============================================================================
+#endif //EPOCH_MANAGER_H_
@@ -19,6 +19,8 @@
 #define SUBSYSTEM_TCP                   0x00000005
 #define SUBSYSTEM_UDP                   0x00000006
 #define SUBSYSTEM_ICMP                  0x00000007
+#define SUBSYSTEM_EXPORT                0x00000008
+#define SUBSYSTEM_DNS                   0x00000009
 
 #define SUBSYSTEM_LOG_LEVELS \
     {\
@@ -29,7 +31,9 @@
         {SUBSYSTEM_CONN_TRACK,              LEVEL_MAX}, \
         {SUBSYSTEM_ICMP,                    LEVEL_MAX}, \
         {SUBSYSTEM_UDP,                     LEVEL_MAX}, \
-        {SUBSYSTEM_TCP,                     LEVEL_MAX}  \
+        {SUBSYSTEM_TCP,                     LEVEL_MAX}, \
+        {SUBSYSTEM_EXPORT,                  LEVEL_MAX}, \
+        {SUBSYSTEM_DNS,                     LEVEL_MAX}  \
     }
 
 //=============================================================================
@@ -0,0 +1,611 @@
+/* @file PooledBTree.h
+ *
+ * ============================================================================
+ * Description:
+ * ============================================================================
+ * - A B+-Tree variant of BTree<K,T> for large indexes that are mostly read.
+ * - Nodes are fixed size, a whole number of cache lines, and come from a
+ *   pool of slabs instead of make_shared; nodes point at each other with
+ *   raw pointers, so a lookup does no reference counting and no locking.
+ * - Keys are kept inline in a sorted array at the front of each node, so
+ *   searching a node touches as few cache lines as possible.
+ * - Published nodes are never changed. A writer copies the nodes on the
+ *   path it changes and swaps in a new root, so readers always see a
+ *   consistent tree, and range scans walk a single snapshot.
+ * - Replaced nodes are reclaimed through an EpochManager once no reader
+ *   can still be looking at them.
+ * - Writers are serialized by a single tree lock. As in BTree, nodes are
+ *   freed when they become empty rather than merged when under-full.
+ *
+ * ============================================================================
+ * Usage:
+ * ============================================================================
+ * - The value type needs a (K addr() const) method returning its key, and
+ *   K must be trivially copyable and ordered by operator< and operator==.
+ * - The tree stores T* and does not own the values. A value that was
+ *   removed may still be in use by a reader that found it earlier, so it
+ *   must outlive the readers running at the time.
+ */
+#ifndef POOLED_BTREE_H_
+#define POOLED_BTREE_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+#include "EpochManager.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Default node size, four cache lines (15 keys for 64-bit keys)
+#define POOLED_BTREE_NODE_BYTES     (256)
+
+//Nodes allocated at once when the pool runs dry
+#define POOLED_BTREE_SLAB_NODES     (4096)
+
+//Replaced nodes collected before an epoch advance frees what it can
+#define POOLED_BTREE_RECLAIM        (256)
+
+//Deepest tree supported; even three key nodes need 2^64 keys for this
+#define POOLED_BTREE_MAX_HEIGHT     (64)
+
+/**
+ * A node of N keys. Leaves keep a value beside each key, regular nodes
+ * one more child than keys; child i covers the keys from key i - 1
+ * (inclusive) to key i (exclusive).
+ */
+template <typename K, size_t N>
+struct alignas(64) PooledBTreeNode {
+    K keys[N];
+    void* slots[N + 1];
+    uint32_t count;         //Keys in use
+    uint32_t leaf;
+};
+
+/**
+ * Hands out nodes from slabs, so allocation is a pop from a free list
+ * and neighboring nodes tend to share pages. Only the tree's writer
+ * allocates and releases.
+ */
+template <typename Node>
+class BTreeNodePool {
+public:
+    BTreeNodePool (void)
+      : m_slabs(),
+        m_free(nullptr),
+        m_allocated(0)
+    {
+    }
+
+    ~BTreeNodePool (void) {
+        for (auto slab : m_slabs) {
+            free(slab);
+        }
+    }
+
+    BTreeNodePool (const BTreeNodePool&) = delete;
+    BTreeNodePool& operator= (const BTreeNodePool&) = delete;
+
+    Node* alloc (void) {
+        if (m_free == nullptr) {
+            grow();
+        }
+        Node* node = m_free;
+        memcpy(&m_free, node, sizeof(Node*));
+        m_allocated++;
+        return node;
+    }
+
+    void release (Node* node) {
+        memcpy(node, &m_free, sizeof(Node*));
+        m_free = node;
+        m_allocated--;
+    }
+
+    size_t get_allocated (void) const {
+        return m_allocated;
+    }
+
+    size_t get_reserved (void) const {
+        return m_slabs.size() * POOLED_BTREE_SLAB_NODES;
+    }
+
+protected:
+    void grow (void) {
+        Node* slab = (Node*)aligned_alloc(alignof(Node), POOLED_BTREE_SLAB_NODES * sizeof(Node));
+        if (slab == nullptr) {
+            throw std::bad_alloc();
+        }
+        m_slabs.push_back(slab);
+
+        //Hand the slab out front to back
+        for (size_t i = POOLED_BTREE_SLAB_NODES; i > 0; i--) {
+            memcpy(&slab[i - 1], &m_free, sizeof(Node*));
+            m_free = &slab[i - 1];
+        }
+    }
+
+protected:
+    std::vector<Node*> m_slabs;
+    Node* m_free;
+    size_t m_allocated;
+};
+
+/**
+ * The pooled, copy-on-write B+-Tree.
+ *
+ * @tparam Bytes Node size, a multiple of the 64-byte cache line.
+ */
+template <typename K, typename T, size_t Bytes = POOLED_BTREE_NODE_BYTES>
+class PooledBTree {
+public:
+    //Keys per node that fit the node size with the children and header
+    static const size_t Capacity =
+        (Bytes - 2 * sizeof(uint32_t) - sizeof(void*)) / (sizeof(K) + sizeof(void*));
+
+    typedef PooledBTreeNode<K, Capacity> Node;
+
+    static_assert(Capacity >= 3, "nodes must hold at least three keys");
+    static_assert(sizeof(Node) == Bytes, "node size must be a multiple of the cache line");
+    static_assert(std::is_trivially_copyable<K>::value, "keys must be trivially copyable");
+
+    PooledBTree (void)
+      : m_root(nullptr),
+        m_length(0),
+        m_writer(),
+        m_pool(),
+        m_epochs(),
+        m_retired()
+    {
+    }
+
+    PooledBTree (const PooledBTree&) = delete;
+    PooledBTree& operator= (const PooledBTree&) = delete;
+
+public:
+    /**
+     * Inserts a value.
+     *
+     * @param value Value to add, keyed by value->addr().
+     * @return bool false if the key is already present.
+     */
+    bool insert (T* value) {
+        if (value == nullptr) {
+            return false;
+        }
+
+        const std::lock_guard<std::mutex> _writer(m_writer);
+        const K key = value->addr();
+        Node* node = m_root.load();
+
+        if (node == nullptr) {
+            void* slot = value;
+            m_root.store(make(true, &key, &slot, 1));
+            m_length += 1;
+            return true;
+        }
+
+        Node* path[POOLED_BTREE_MAX_HEIGHT];
+        uint32_t slots[POOLED_BTREE_MAX_HEIGHT];
+        size_t depth = 0;
+        while (!node->leaf) {
+            uint32_t i = upper_index(node, key);
+            path[depth] = node;
+            slots[depth++] = i;
+            node = (Node*)node->slots[i];
+        }
+
+        uint32_t i = lower_index(node, key);
+        if (i < node->count && node->keys[i] == key) {
+            return false;
+        }
+
+        //Copy the leaf with the key added, splitting it if full
+        K keys[Capacity + 1];
+        void* values[Capacity + 2];
+        memcpy(keys, node->keys, i * sizeof(K));
+        memcpy(values, node->slots, i * sizeof(void*));
+        keys[i] = key;
+        values[i] = value;
+        memcpy(keys + i + 1, node->keys + i, (node->count - i) * sizeof(K));
+        memcpy(values + i + 1, node->slots + i, (node->count - i) * sizeof(void*));
+
+        Node* left = nullptr;
+        Node* right = nullptr;
+        K separator;
+        emit(true, keys, values, node->count + 1, left, right, separator);
+        retire(node);
+
+        //Copy the path up, adding the separator of any split
+        while (depth > 0) {
+            Node* parent = path[--depth];
+            uint32_t c = slots[depth];
+            uint32_t count = parent->count;
+
+            memcpy(keys, parent->keys, count * sizeof(K));
+            memcpy(values, parent->slots, (count + 1) * sizeof(void*));
+            values[c] = left;
+            if (right != nullptr) {
+                memmove(keys + c + 1, keys + c, (count - c) * sizeof(K));
+                memmove(values + c + 2, values + c + 1, (count - c) * sizeof(void*));
+                keys[c] = separator;
+                values[c + 1] = right;
+                count++;
+            }
+
+            emit(false, keys, values, count, left, right, separator);
+            retire(parent);
+        }
+
+        if (right != nullptr) {
+            void* children[2] = { left, right };
+            left = make(false, &separator, children, 1);
+        }
+
+        m_root.store(left);
+        m_length += 1;
+        reclaim();
+        return true;
+    }
+
+    /**
+     * Removes a value based on its key.
+     *
+     * @param key Key to remove.
+     * @return bool false if the key wasn't present.
+     */
+    bool remove (K key) {
+        const std::lock_guard<std::mutex> _writer(m_writer);
+        Node* node = m_root.load();
+
+        if (node == nullptr) {
+            return false;
+        }
+
+        Node* path[POOLED_BTREE_MAX_HEIGHT];
+        uint32_t slots[POOLED_BTREE_MAX_HEIGHT];
+        size_t depth = 0;
+        while (!node->leaf) {
+            uint32_t i = upper_index(node, key);
+            path[depth] = node;
+            slots[depth++] = i;
+            node = (Node*)node->slots[i];
+        }
+
+        uint32_t i = lower_index(node, key);
+        if (i >= node->count || !(node->keys[i] == key)) {
+            return false;
+        }
+
+        //A leaf that empties is dropped from its parent rather than
+        //copied, as is a parent left without children
+        K keys[Capacity];
+        void* values[Capacity + 1];
+        Node* replacement = nullptr;
+        if (node->count > 1) {
+            memcpy(keys, node->keys, i * sizeof(K));
+            memcpy(values, node->slots, i * sizeof(void*));
+            memcpy(keys + i, node->keys + i + 1, (node->count - i - 1) * sizeof(K));
+            memcpy(values + i, node->slots + i + 1, (node->count - i - 1) * sizeof(void*));
+            replacement = make(true, keys, values, node->count - 1);
+        }
+        retire(node);
+
+        while (depth > 0) {
+            Node* parent = path[--depth];
+            uint32_t c = slots[depth];
+            uint32_t count = parent->count;
+
+            if (replacement == nullptr && count == 0) {
+                retire(parent);
+                continue;
+            }
+
+            memcpy(keys, parent->keys, count * sizeof(K));
+            memcpy(values, parent->slots, (count + 1) * sizeof(void*));
+            if (replacement != nullptr) {
+                values[c] = replacement;
+            } else {
+                //Drop the child and the separator bounding it
+                uint32_t k = (c > 0) ? c - 1 : 0;
+                memmove(keys + k, keys + k + 1, (count - k - 1) * sizeof(K));
+                memmove(values + c, values + c + 1, (count - c) * sizeof(void*));
+                count--;
+            }
+
+            replacement = make(false, keys, values, count);
+            retire(parent);
+        }
+
+        //Regular roots left with one child are skipped; they were never
+        //published, so they go straight back to the pool
+        while (replacement != nullptr && !replacement->leaf && replacement->count == 0) {
+            Node* child = (Node*)replacement->slots[0];
+            m_pool.release(replacement);
+            replacement = child;
+        }
+
+        m_root.store(replacement);
+        m_length -= 1;
+        reclaim();
+        return true;
+    }
+
+    /**
+     * Finds the value stored under a key.
+     *
+     * @param key Key to lookup.
+     * @return T* Value, nullptr if not present.
+     */
+    T* find (K key) {
+        EpochGuard guard(m_epochs);
+        const Node* node = m_root.load();
+
+        if (node == nullptr) {
+            return nullptr;
+        }
+        while (!node->leaf) {
+            node = (const Node*)node->slots[upper_index(node, key)];
+        }
+
+        uint32_t i = lower_index(node, key);
+        if (i < node->count && node->keys[i] == key) {
+            return (T*)node->slots[i];
+        }
+        return nullptr;
+    }
+
+    /**
+     * Finds the values with keys in the range (start,stop) inclusive,
+     * in key order.
+     */
+    std::deque<T*> find_range (K start, K stop) {
+        std::deque<T*> retVal;
+
+        for_range(start, stop, [&retVal](T* value) {
+            retVal.push_back(value);
+            return true;
+        });
+        return retVal;
+    }
+
+    /**
+     * Calls a callback for each value with a key in the range
+     * (start,stop) inclusive, in key order, from a single snapshot of
+     * the tree. The callback may change the tree, which doesn't affect
+     * the walk.
+     *
+     * @param callback Returns false to stop the walk.
+     */
+    void for_range (K start, K stop, std::function<bool(T*)> callback) {
+        if (stop < start) {
+            return;
+        }
+
+        EpochGuard guard(m_epochs);
+        const Node* node = m_root.load();
+        const Node* path[POOLED_BTREE_MAX_HEIGHT];
+        uint32_t slots[POOLED_BTREE_MAX_HEIGHT];
+        size_t depth = 0;
+
+        if (node == nullptr) {
+            return;
+        }
+        while (!node->leaf) {
+            uint32_t i = upper_index(node, start);
+            path[depth] = node;
+            slots[depth++] = i;
+            node = (const Node*)node->slots[i];
+        }
+
+        uint32_t i = lower_index(node, start);
+        for (;;) {
+            for (; i < node->count; i++) {
+                if (stop < node->keys[i]) {
+                    return;
+                }
+                if (!callback((T*)node->slots[i])) {
+                    return;
+                }
+            }
+
+            //Up to the first ancestor with a child left, then down its
+            //left edge
+            while (depth > 0 && slots[depth - 1] >= path[depth - 1]->count) {
+                depth--;
+            }
+            if (depth == 0) {
+                return;
+            }
+            node = (const Node*)path[depth - 1]->slots[++slots[depth - 1]];
+            while (!node->leaf) {
+                path[depth] = node;
+                slots[depth++] = 0;
+                node = (const Node*)node->slots[0];
+            }
+            i = 0;
+        }
+    }
+
+    /**
+     * Number of values in the tree.
+     */
+    size_t size (void) const {
+        return m_length;
+    }
+
+    /**
+     * Nodes in use, including replaced ones not yet reclaimed.
+     */
+    size_t get_nodes (void) {
+        const std::lock_guard<std::mutex> _writer(m_writer);
+        return m_pool.get_allocated();
+    }
+
+    /**
+     * Determines if the current tree is valid or not: keys sorted and
+     * within the range their parents route to each node, every leaf at
+     * the same depth, only the root empty, and m_length values.
+     *
+     * @return bool true if valid, false if invalid
+     */
+    bool is_a_valid_btree (void) {
+        const std::lock_guard<std::mutex> _writer(m_writer);
+        const Node* root = m_root.load();
+        size_t count = 0;
+        size_t leafDepth = 0;
+
+        if (root == nullptr) {
+            return m_length == 0;
+        }
+        return validate(root, 0, nullptr, nullptr, leafDepth, count) && count == m_length;
+    }
+
+private:
+    /**
+     * Keys <= key, the child a regular node routes the key to.
+     */
+    static inline uint32_t upper_index (const Node* node, const K& key) {
+        uint32_t i = 0;
+        while (i < node->count && !(key < node->keys[i])) {
+            i++;
+        }
+        return i;
+    }
+
+    /**
+     * Keys < key, the slot of the key in a leaf.
+     */
+    static inline uint32_t lower_index (const Node* node, const K& key) {
+        uint32_t i = 0;
+        while (i < node->count && node->keys[i] < key) {
+            i++;
+        }
+        return i;
+    }
+
+    Node* make (bool bLeaf, const K* keys, void* const* slots, uint32_t count) {
+        Node* node = m_pool.alloc();
+        node->leaf = bLeaf;
+        node->count = count;
+        memcpy(node->keys, keys, count * sizeof(K));
+        memcpy(node->slots, slots, (count + (bLeaf ? 0 : 1)) * sizeof(void*));
+        return node;
+    }
+
+    /**
+     * Builds one node from the keys, or two and the separator between
+     * them if they don't fit.
+     */
+    void emit (bool bLeaf, const K* keys, void* const* slots, uint32_t count,
+               Node*& left, Node*& right, K& separator) {
+        if (count <= Capacity) {
+            left = make(bLeaf, keys, slots, count);
+            right = nullptr;
+            return;
+        }
+
+        uint32_t half = count / 2;
+        separator = keys[half];
+        left = make(bLeaf, keys, slots, half);
+        if (bLeaf) {
+            //Leaves keep every key, the separator is copied up
+            right = make(true, keys + half, slots + half, count - half);
+        } else {
+            //Regular nodes hand the separator up
+            right = make(false, keys + half + 1, slots + half + 1, count - half - 1);
+        }
+    }
+
+    void retire (Node* node) {
+        m_retired.push_back(std::make_pair(m_epochs.current(), node));
+    }
+
+    /**
+     * Returns replaced nodes no reader can reach any more to the pool.
+     */
+    void reclaim (void) {
+        if (m_retired.size() < POOLED_BTREE_RECLAIM) {
+            return;
+        }
+
+        uint64_t safe = m_epochs.advance();
+        size_t kept = 0;
+        for (auto& retired : m_retired) {
+            if (retired.first < safe) {
+                m_pool.release(retired.second);
+            } else {
+                m_retired[kept++] = retired;
+            }
+        }
+        m_retired.resize(kept);
+    }
+
+    bool validate (const Node* node, size_t depth, const K* pLow, const K* pHigh,
+                   size_t& leafDepth, size_t& count) {
+        if (node->count > Capacity || (depth > 0 && node->leaf && node->count == 0)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < node->count; i++) {
+            if (i > 0 && !(node->keys[i - 1] < node->keys[i])) {
+                return false;
+            }
+            if ((pLow && node->keys[i] < *pLow) || (pHigh && !(node->keys[i] < *pHigh))) {
+                return false;
+            }
+        }
+
+        if (node->leaf) {
+            if (leafDepth == 0) {
+                leafDepth = depth + 1;
+            }
+            if (leafDepth != depth + 1) {
+                return false;
+            }
+            for (uint32_t i = 0; i < node->count; i++) {
+                if (!(((T*)node->slots[i])->addr() == node->keys[i])) {
+                    return false;
+                }
+            }
+            count += node->count;
+            return true;
+        }
+
+        for (uint32_t i = 0; i <= node->count; i++) {
+            const K* pChildLow = (i > 0) ? &node->keys[i - 1] : pLow;
+            const K* pChildHigh = (i < node->count) ? &node->keys[i] : pHigh;
+            const Node* child = (const Node*)node->slots[i];
+            if (child == nullptr ||
+                !validate(child, depth + 1, pChildLow, pChildHigh, leafDepth, count)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+protected:
+    std::atomic<Node*> m_root;
+    std::atomic<size_t> m_length;
+
+    //Serializes insertions and removals, and with them the pool.
+    std::mutex m_writer;
+    BTreeNodePool<Node> m_pool;
+    EpochManager m_epochs;
+
+    //Replaced nodes and the epoch they were replaced in.
+    std::vector<std::pair<uint64_t, Node*>> m_retired;
+};
+
+//=============================================================================
+#endif //POOLED_BTREE_H_
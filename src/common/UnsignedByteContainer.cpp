@@ -103,7 +103,7 @@ Exit:
 
 void UnsignedByteContainer::freeBuffer (void) {
     if (m_pData) {
-        delete m_pData;
+        delete [] m_pData;
         m_pData = NULL;
     }
 }
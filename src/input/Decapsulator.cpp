@@ -0,0 +1,330 @@
+/**@file Decapsulator.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "Decapsulator.h"
+#include <string.h>
+#include <stddef.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define GRE_FLAG_CHECKSUM   (0x8000)
+#define GRE_FLAG_ROUTING    (0x4000)
+#define GRE_FLAG_KEY        (0x2000)
+#define GRE_FLAG_SEQUENCE   (0x1000)
+#define GRE_VERSION_MASK    (0x0007)
+
+#define MPLS_BOTTOM_OF_STACK (0x100)
+
+typedef enum {
+    DECAP_STATUS_CONTINUE   = 0,
+    DECAP_STATUS_DONE       = 1,
+    DECAP_STATUS_FAIL       = 2
+} DecapStatus_T;
+
+/**
+ * Peels one header at offset. On DECAP_STATUS_CONTINUE offset and type
+ * describe the next header.
+ */
+typedef DecapStatus_T (*DecapHandler_T)(const uint8_t* pData, uint32_t len, uint32_t& offset,
+                                        uint16_t& type, DecapInfo_T& info);
+
+/**
+ * Peels a tunnel header found after an IP header. Returns false if the
+ * tunnel can't be followed, leaving that IP header as the innermost.
+ */
+typedef bool (*TunnelHandler_T)(const uint8_t* pData, uint32_t len, uint32_t& offset,
+                                uint16_t& type, DecapInfo_T& info);
+
+typedef struct {
+    uint16_t type;
+    DecapHandler_T handler;
+} DecapEntry_T;
+
+typedef struct {
+    uint8_t protocol;
+    TunnelHandler_T handler;
+} TunnelEntry_T;
+
+static DecapStatus_T decap_vlan (const uint8_t*, uint32_t, uint32_t&, uint16_t&, DecapInfo_T&);
+static DecapStatus_T decap_mpls (const uint8_t*, uint32_t, uint32_t&, uint16_t&, DecapInfo_T&);
+static DecapStatus_T decap_ethernet (const uint8_t*, uint32_t, uint32_t&, uint16_t&, DecapInfo_T&);
+static DecapStatus_T decap_ipv4 (const uint8_t*, uint32_t, uint32_t&, uint16_t&, DecapInfo_T&);
+static DecapStatus_T decap_ipv6 (const uint8_t*, uint32_t, uint32_t&, uint16_t&, DecapInfo_T&);
+static bool tunnel_gre (const uint8_t*, uint32_t, uint32_t&, uint16_t&, DecapInfo_T&);
+static bool tunnel_ipv4 (const uint8_t*, uint32_t, uint32_t&, uint16_t&, DecapInfo_T&);
+static bool tunnel_ipv6 (const uint8_t*, uint32_t, uint32_t&, uint16_t&, DecapInfo_T&);
+
+//IP first, it is where every walk ends
+static const DecapEntry_T gs_etherTypes[] = {
+    { ETHERTYPE_IPV4,           decap_ipv4 },
+    { ETHERTYPE_IPV6,           decap_ipv6 },
+    { ETHERTYPE_VLAN,           decap_vlan },
+    { ETHERTYPE_QINQ,           decap_vlan },
+    { ETHERTYPE_QINQ_LEGACY,    decap_vlan },
+    { ETHERTYPE_MPLS,           decap_mpls },
+    { ETHERTYPE_MPLS_MULTI,     decap_mpls },
+    { ETHERTYPE_TEB,            decap_ethernet }
+};
+
+static const TunnelEntry_T gs_tunnels[] = {
+    { IP_PROTO_GRE,     tunnel_gre },
+    { IP_PROTO_IPIP,    tunnel_ipv4 },
+    { IP_PROTO_IPV6,    tunnel_ipv6 }
+};
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+static inline uint16_t read16 (const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t read32 (const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline const DecapEntry_T* find_ethertype (uint16_t type) {
+    for (size_t i = 0; i < sizeof(gs_etherTypes) / sizeof(gs_etherTypes[0]); i++) {
+        if (gs_etherTypes[i].type == type) {
+            return &gs_etherTypes[i];
+        }
+    }
+    return NULL;
+}
+
+static inline const TunnelEntry_T* find_tunnel (uint8_t protocol) {
+    for (size_t i = 0; i < sizeof(gs_tunnels) / sizeof(gs_tunnels[0]); i++) {
+        if (gs_tunnels[i].protocol == protocol) {
+            return &gs_tunnels[i];
+        }
+    }
+    return NULL;
+}
+
+static DecapStatus_T decap_vlan (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                                 uint16_t& type, DecapInfo_T& info) {
+    if (offset + 4 > len) {
+        return DECAP_STATUS_FAIL;
+    }
+
+    info.vlan = read16(pData + offset) & 0x0FFF;
+    info.layers |= DECAP_VLAN;
+
+    type = read16(pData + offset + 2);
+    offset += 4;
+    return DECAP_STATUS_CONTINUE;
+}
+
+static DecapStatus_T decap_mpls (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                                 uint16_t& type, DecapInfo_T& info) {
+    uint32_t entry = 0;
+
+    do {
+        if (offset + 4 > len) {
+            return DECAP_STATUS_FAIL;
+        }
+        entry = read32(pData + offset);
+        offset += 4;
+    } while (!(entry & MPLS_BOTTOM_OF_STACK));
+
+    info.layers |= DECAP_MPLS;
+
+    if (offset >= len) {
+        return DECAP_STATUS_FAIL;
+    }
+
+    //MPLS doesn't say what it carries, go by the first nibble
+    switch (pData[offset] >> 4) {
+    case 4:
+        type = ETHERTYPE_IPV4;
+        break;
+    case 6:
+        type = ETHERTYPE_IPV6;
+        break;
+    case 0:
+        //Ethernet pseudowire, assumed to have a control word
+        offset += 4;
+        return decap_ethernet(pData, len, offset, type, info);
+    default:
+        return DECAP_STATUS_FAIL;
+    }
+
+    return DECAP_STATUS_CONTINUE;
+}
+
+static DecapStatus_T decap_ethernet (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                                     uint16_t& type, DecapInfo_T& info) {
+    if (offset + ETHERNET_HEADER_SIZE > len) {
+        return DECAP_STATUS_FAIL;
+    }
+
+    type = read16(pData + offset + 12);
+    offset += ETHERNET_HEADER_SIZE;
+    info.layers |= DECAP_ETHERNET;
+    return DECAP_STATUS_CONTINUE;
+}
+
+/**
+ * Common handling of an IP header: either it is the innermost one or
+ * it carries a tunnel that can be followed.
+ */
+static DecapStatus_T decap_ip (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                               uint16_t& type, DecapInfo_T& info,
+                               uint8_t protocol, uint32_t hdrLen, bool bFragment) {
+    const TunnelEntry_T* pTunnel = bFragment ? NULL : find_tunnel(protocol);
+
+    info.l3_offset = offset;
+    info.l3_len = len - offset;
+    info.l3_type = type;
+
+    if (pTunnel) {
+        uint32_t inner = offset + hdrLen;
+        uint16_t innerType = 0;
+
+        if (pTunnel->handler(pData, len, inner, innerType, info)) {
+            info.tunnel_offset = offset;
+            offset = inner;
+            type = innerType;
+            return DECAP_STATUS_CONTINUE;
+        }
+    }
+
+    return DECAP_STATUS_DONE;
+}
+
+static DecapStatus_T decap_ipv4 (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                                 uint16_t& type, DecapInfo_T& info) {
+    if (offset + 20 > len || (pData[offset] >> 4) != 4) {
+        return DECAP_STATUS_FAIL;
+    }
+
+    uint32_t hdrLen = (pData[offset] & 0x0F) * 4;
+    if (hdrLen < 20 || offset + hdrLen > len) {
+        return DECAP_STATUS_FAIL;
+    }
+
+    //Only the first fragment has the tunnel header and it can't be
+    //decoded on its own
+    bool bFragment = (read16(pData + offset + 6) & 0x3FFF) != 0;
+    return decap_ip(pData, len, offset, type, info, pData[offset + 9], hdrLen, bFragment);
+}
+
+static DecapStatus_T decap_ipv6 (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                                 uint16_t& type, DecapInfo_T& info) {
+    if (offset + 40 > len || (pData[offset] >> 4) != 6) {
+        return DECAP_STATUS_FAIL;
+    }
+
+    //Tunnels behind extension headers aren't followed
+    return decap_ip(pData, len, offset, type, info, pData[offset + 6], 40, false);
+}
+
+static bool tunnel_gre (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                        uint16_t& type, DecapInfo_T& info) {
+    uint32_t hdrLen = 4;
+
+    if (offset + 4 > len) {
+        return false;
+    }
+
+    //Version 1 is PPTP, which carries PPP
+    uint16_t flags = read16(pData + offset);
+    uint16_t protocol = read16(pData + offset + 2);
+    if ((flags & (GRE_FLAG_ROUTING | GRE_VERSION_MASK)) || !find_ethertype(protocol)) {
+        return false;
+    }
+
+    if (flags & GRE_FLAG_CHECKSUM) {
+        hdrLen += 4;
+    }
+    if (flags & GRE_FLAG_KEY) {
+        hdrLen += 4;
+    }
+    if (flags & GRE_FLAG_SEQUENCE) {
+        hdrLen += 4;
+    }
+    if (offset + hdrLen > len) {
+        return false;
+    }
+
+    info.layers |= DECAP_GRE;
+    offset += hdrLen;
+    type = protocol;
+    return true;
+}
+
+static bool tunnel_ipv4 (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                         uint16_t& type, DecapInfo_T& info) {
+    if (offset >= len || (pData[offset] >> 4) != 4) {
+        return false;
+    }
+
+    info.layers |= DECAP_IPIP;
+    type = ETHERTYPE_IPV4;
+    return true;
+}
+
+static bool tunnel_ipv6 (const uint8_t* pData, uint32_t len, uint32_t& offset,
+                         uint16_t& type, DecapInfo_T& info) {
+    if (offset >= len || (pData[offset] >> 4) != 6) {
+        return false;
+    }
+
+    info.layers |= DECAP_IPIP;
+    type = ETHERTYPE_IPV6;
+    return true;
+}
+
+bool Decapsulator::Decap (const uint8_t* pData, uint32_t len, uint32_t offset,
+                          uint16_t type, DecapInfo_T& info) {
+    DecapInfo_T outer;
+    DecapInfo_T before;
+    bool bTunneled = false;
+
+    memset(&info, 0, sizeof(info));
+
+    for (info.depth = 0; info.depth < DECAP_MAX_DEPTH; info.depth++) {
+        const DecapEntry_T* pEntry = find_ethertype(type);
+        if (!pEntry) {
+            break;
+        }
+
+        bool bIP = (type == ETHERTYPE_IPV4 || type == ETHERTYPE_IPV6);
+        uint32_t start = offset;
+        uint16_t startType = type;
+        if (bIP) {
+            before = info;
+        }
+
+        DecapStatus_T status = pEntry->handler(pData, len, offset, type, info);
+        if (status != DECAP_STATUS_CONTINUE) {
+            info.depth++;
+            if (status == DECAP_STATUS_DONE) {
+                return true;
+            }
+            break;
+        }
+
+        //A tunnel was entered, its IP header stands in for whatever
+        //is inside if that can't be decoded
+        if (bIP) {
+            outer = before;
+            outer.l3_offset = start;
+            outer.l3_len = len - start;
+            outer.l3_type = startType;
+            bTunneled = true;
+        }
+    }
+
+    if (bTunneled) {
+        outer.depth = info.depth;
+        info = outer;
+        return true;
+    }
+    return false;
+}
+
+//=============================================================================
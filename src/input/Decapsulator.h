@@ -0,0 +1,91 @@
+/**@file Decapsulator.h
+ */
+#ifndef DECAPSULATOR_H_
+#define DECAPSULATOR_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define ETHERTYPE_IPV4          (0x0800)
+#define ETHERTYPE_IPV6          (0x86DD)
+#define ETHERTYPE_VLAN          (0x8100)
+#define ETHERTYPE_QINQ          (0x88A8)
+#define ETHERTYPE_QINQ_LEGACY   (0x9100)
+#define ETHERTYPE_MPLS          (0x8847)
+#define ETHERTYPE_MPLS_MULTI    (0x8848)
+#define ETHERTYPE_TEB           (0x6558) //Transparent Ethernet bridging (GRE)
+
+#define IP_PROTO_IPIP           (4)
+#define IP_PROTO_IPV6           (41)
+#define IP_PROTO_GRE            (47)
+
+#define ETHERNET_HEADER_SIZE    (14)
+#define SLL_HEADER_SIZE         (16)
+
+//Bounds the number of layers peeled from a single packet
+#define DECAP_MAX_DEPTH         (8)
+
+#define DECAP_NONE              (0x00)
+#define DECAP_VLAN              (0x01)
+#define DECAP_MPLS              (0x02)
+#define DECAP_GRE               (0x04)
+#define DECAP_IPIP              (0x08)
+#define DECAP_ETHERNET          (0x10) //Ethernet carried in GRE or an MPLS pseudowire
+
+/**
+ * Layers peeled from a packet. Offsets are relative to the start of
+ * the record and addresses are in network byte order, the same as the
+ * values libtins hands back.
+ */
+typedef struct {
+    uint32_t l3_offset;     //Innermost IP header
+    uint32_t l3_len;        //Bytes captured from l3_offset
+    uint16_t l3_type;       //ETHERTYPE_IPV4 or ETHERTYPE_IPV6
+    uint8_t  layers;        //DECAP_* bits
+    uint8_t  depth;         //Number of headers walked
+    uint16_t vlan;          //Innermost VLAN ID, 0 when untagged
+    uint32_t tunnel_offset; //Outer IP header (IPv4 or IPv6) of the
+                            //innermost tunnel, 0 when not tunneled
+} DecapInfo_T;
+
+/**
+ * Walks the encapsulation headers in front of the IP header of a
+ * captured frame without copying or allocating.
+ *
+ * Each header type is handled by an entry in a table keyed on the
+ * ethertype (802.1Q/QinQ tags, MPLS label stacks, bridged Ethernet)
+ * or on the IP protocol of an outer header (GRE, IP in IP). Headers
+ * that are truncated or can't be followed (e.g. PPTP GRE, a
+ * fragmented tunnel packet or bridged Ethernet carrying ARP) end the
+ * walk at the last IP header found, so such packets are tracked on
+ * their outer header.
+ */
+class Decapsulator {
+public:
+    /**
+     * Checks whether an IP protocol is a tunnel Decap() follows.
+     */
+    static inline bool IsTunnel (uint8_t protocol) {
+        return protocol == IP_PROTO_GRE || protocol == IP_PROTO_IPIP || protocol == IP_PROTO_IPV6;
+    }
+
+    /**
+     * Finds the innermost IP header of a frame.
+     *
+     * @param pData Frame bytes.
+     * @param len Number of bytes captured.
+     * @param offset Offset of the first header after the link layer.
+     * @param type Ethertype of that header.
+     * @param info Populated with the layers peeled.
+     * @return bool false if no IP header was found.
+     */
+    static bool Decap (const uint8_t* pData, uint32_t len, uint32_t offset,
+                       uint16_t type, DecapInfo_T& info);
+};
+
+//=============================================================================
+#endif //DECAPSULATOR_H_
@@ -0,0 +1,428 @@
+/**@file DecompressBackend.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "DecompressBackend.h"
+#include "Logging.h"
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <future>
+#include <stdexcept>
+#include <algorithm>
+#include <zlib.h>
+#include <zstd.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define GZIP_MAGIC_0    (0x1f)
+#define GZIP_MAGIC_1    (0x8b)
+#define ZSTD_MAGIC      (0xFD2FB528)
+
+size_t DecompressBackend::s_threads = DECOMPRESS_DEFAULT_THREADS;
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+DecompressBackend::DecompressBackend (CompressionType_T type)
+  : m_type(type),
+    m_fd(-1),
+    m_map(NULL),
+    m_mapSize(0),
+    m_thread(),
+    m_mutex(),
+    m_cond(),
+    m_queue(),
+    m_queuedBytes(0),
+    m_bDone(false),
+    m_bError(false),
+    m_bStop(false),
+    m_current(),
+    m_position(0),
+    m_skip(0),
+    m_seekOffset(0),
+    m_bSeekPending(false)
+{
+}
+
+DecompressBackend::~DecompressBackend (void)
+{
+    close();
+}
+
+const char* DecompressBackend::name (void) {
+    return (m_type == COMPRESSION_GZIP) ? "gzip" : "zstd";
+}
+
+void DecompressBackend::SetThreads (size_t threads) {
+    s_threads = threads ? threads : 1;
+}
+
+CompressionType_T DecompressBackend::GetCompression (std::string sFile) {
+    uint8_t magic[4];
+    uint32_t value = 0;
+
+    int fd = ::open(sFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return COMPRESSION_NONE;
+    }
+
+    ssize_t len = pread(fd, magic, sizeof(magic), 0);
+    ::close(fd);
+
+    if (len >= 2 && magic[0] == GZIP_MAGIC_0 && magic[1] == GZIP_MAGIC_1) {
+        return COMPRESSION_GZIP;
+    }
+
+    memcpy(&value, magic, sizeof(value));
+    if (len == sizeof(magic) && value == ZSTD_MAGIC) {
+        return COMPRESSION_ZSTD;
+    }
+
+    return COMPRESSION_NONE;
+}
+
+bool DecompressBackend::open (std::string sFile) {
+    struct stat fs;
+
+    m_fd = ::open(sFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0 || fstat(m_fd, &fs) != 0 || fs.st_size == 0) {
+        close();
+        return false;
+    }
+
+    void* pMap = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (pMap == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    madvise(pMap, fs.st_size, MADV_SEQUENTIAL);
+    m_map = (const uint8_t*)pMap;
+    m_mapSize = fs.st_size;
+
+    start();
+    return true;
+}
+
+void DecompressBackend::close (void) {
+    stop();
+
+    if (m_map) {
+        munmap((void*)m_map, m_mapSize);
+        m_map = NULL;
+        m_mapSize = 0;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void DecompressBackend::start (void) {
+    m_queue.clear();
+    m_queuedBytes = 0;
+    m_current.clear();
+    m_bDone = false;
+    m_bError = false;
+    m_bStop = false;
+    m_position = 0;
+    m_skip = 0;
+    m_thread = std::thread(&DecompressBackend::producer, this);
+}
+
+void DecompressBackend::stop (void) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+        m_cond.notify_all();
+    }
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool DecompressBackend::seek (uint64_t offset) {
+    if (m_map == NULL) {
+        return false;
+    }
+
+    //Applied by the next read, so a reader that seeks back to retry a
+    //truncated record and then closes doesn't restart decompression.
+    m_seekOffset = offset;
+    m_bSeekPending = true;
+    return true;
+}
+
+ssize_t DecompressBackend::next_chunk (const uint8_t** ppData) {
+    if (m_bSeekPending) {
+        m_bSeekPending = false;
+
+        //The stream can only be decompressed from the start
+        if (m_seekOffset < m_position) {
+            stop();
+            start();
+        }
+        m_skip = m_seekOffset - m_position;
+    }
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return !m_queue.empty() || m_bDone; });
+
+            if (m_queue.empty()) {
+                return m_bError ? -1 : 0;
+            }
+
+            m_current = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_queuedBytes -= m_current.size();
+            m_cond.notify_all();
+        }
+
+        m_position += m_current.size();
+
+        if (m_skip >= m_current.size()) {
+            m_skip -= m_current.size();
+            continue;
+        }
+
+        size_t skip = m_skip;
+        m_skip = 0;
+        *ppData = m_current.data() + skip;
+        return m_current.size() - skip;
+    }
+}
+
+bool DecompressBackend::push (std::vector<uint8_t>&& chunk) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    //A chunk larger than the byte limit still goes into an empty queue
+    m_cond.wait(lock, [this, &chunk] {
+        return m_bStop || m_queue.empty() ||
+               (m_queue.size() < DECOMPRESS_QUEUE_DEPTH &&
+                m_queuedBytes + chunk.size() <= DECOMPRESS_MAX_BUFFERED);
+    });
+
+    if (m_bStop) {
+        return false;
+    }
+
+    m_queuedBytes += chunk.size();
+    m_queue.push_back(std::move(chunk));
+    m_cond.notify_all();
+    return true;
+}
+
+void DecompressBackend::producer (void) {
+    bool bOk = (m_type == COMPRESSION_GZIP) ? inflate_gzip() : decompress_zstd();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bDone = true;
+    m_bError = !bOk && !m_bStop;
+    m_cond.notify_all();
+}
+
+bool DecompressBackend::inflate_gzip (void) {
+    z_stream zs;
+    int rc = Z_OK;
+
+    memset(&zs, 0, sizeof(zs));
+    //Accept gzip or zlib headers
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+        return false;
+    }
+
+    zs.next_in = (Bytef*)m_map;
+    zs.avail_in = 0;
+    size_t consumed = 0;
+
+    while (true) {
+        std::vector<uint8_t> chunk(IO_CHUNK_SIZE);
+
+        zs.next_out = chunk.data();
+        zs.avail_out = chunk.size();
+
+        while (zs.avail_out > 0) {
+            if (zs.avail_in == 0 && consumed < m_mapSize) {
+                size_t len = std::min(m_mapSize - consumed, (size_t)IO_CHUNK_SIZE);
+                zs.next_in = (Bytef*)(m_map + consumed);
+                zs.avail_in = len;
+                consumed += len;
+            }
+
+            rc = inflate(&zs, Z_NO_FLUSH);
+            if (rc == Z_STREAM_END) {
+                //Concatenated members (e.g. from appending to a .gz)
+                if (zs.avail_in == 0 && consumed >= m_mapSize) {
+                    break;
+                }
+                inflateReset(&zs);
+            } else if (rc == Z_BUF_ERROR && zs.avail_in == 0 && consumed >= m_mapSize) {
+                //Truncated stream, hand out what was decompressed
+                break;
+            } else if (rc != Z_OK) {
+                PrintSimpleLogMessage(LEVEL_ERROR, "gzip error: %s", zs.msg ? zs.msg : "unknown");
+                inflateEnd(&zs);
+                return false;
+            }
+        }
+
+        chunk.resize(chunk.size() - zs.avail_out);
+        bool bEnd = (zs.avail_out > 0);
+
+        if (!chunk.empty() && !push(std::move(chunk))) {
+            break;
+        }
+        if (bEnd) {
+            break;
+        }
+    }
+
+    inflateEnd(&zs);
+    return true;
+}
+
+bool DecompressBackend::stream_zstd (const uint8_t* pData, size_t len) {
+    ZSTD_DCtx* pCtx = ZSTD_createDCtx();
+    ZSTD_inBuffer in = { pData, len, 0 };
+    bool retValue = true;
+
+    if (!pCtx) {
+        return false;
+    }
+
+    while (in.pos < in.size) {
+        std::vector<uint8_t> chunk(IO_CHUNK_SIZE);
+        ZSTD_outBuffer out = { chunk.data(), chunk.size(), 0 };
+
+        while (out.pos < out.size && in.pos < in.size) {
+            size_t rc = ZSTD_decompressStream(pCtx, &out, &in);
+            if (ZSTD_isError(rc)) {
+                PrintSimpleLogMessage(LEVEL_ERROR, "zstd error: %s", ZSTD_getErrorName(rc));
+                retValue = false;
+                break;
+            }
+        }
+
+        chunk.resize(out.pos);
+        if (!chunk.empty() && !push(std::move(chunk))) {
+            break;
+        }
+        if (!retValue) {
+            break;
+        }
+    }
+
+    //Flush anything still buffered in the context
+    while (retValue) {
+        std::vector<uint8_t> chunk(IO_CHUNK_SIZE);
+        ZSTD_outBuffer out = { chunk.data(), chunk.size(), 0 };
+        ZSTD_inBuffer empty = { NULL, 0, 0 };
+
+        size_t rc = ZSTD_decompressStream(pCtx, &out, &empty);
+        if (ZSTD_isError(rc) || out.pos == 0) {
+            break;
+        }
+        chunk.resize(out.pos);
+        if (!push(std::move(chunk))) {
+            break;
+        }
+    }
+
+    ZSTD_freeDCtx(pCtx);
+    return retValue;
+}
+
+bool DecompressBackend::decompress_zstd (void) {
+    typedef struct {
+        const uint8_t* data;
+        size_t len;
+        unsigned long long size;
+    } Frame_T;
+
+    std::vector<Frame_T> frames;
+    std::deque<std::future<std::vector<uint8_t>>> pending;
+    std::deque<size_t> pendingSizes;
+    size_t pendingBytes = 0;
+    size_t pos = 0;
+
+    //Split the file into frames; a truncated last frame is streamed
+    while (pos < m_mapSize) {
+        Frame_T frame;
+        size_t len = ZSTD_findFrameCompressedSize(m_map + pos, m_mapSize - pos);
+
+        frame.data = m_map + pos;
+        if (ZSTD_isError(len)) {
+            frame.len = m_mapSize - pos;
+            frame.size = ZSTD_CONTENTSIZE_UNKNOWN;
+        } else {
+            frame.len = len;
+            frame.size = ZSTD_getFrameContentSize(frame.data, frame.len);
+        }
+        frames.push_back(frame);
+        pos += frame.len;
+    }
+
+    if (frames.size() == 1 || s_threads == 1) {
+        return stream_zstd(m_map, m_mapSize);
+    }
+
+    //Hand finished frames to the consumer in file order until at most
+    //keep frames, holding at most keepBytes, are still in flight
+    auto flush = [&](size_t keep, size_t keepBytes) -> bool {
+        while (!pending.empty() && (pending.size() > keep || pendingBytes > keepBytes)) {
+            std::vector<uint8_t> data;
+            try {
+                data = pending.front().get();
+            } catch (std::exception& e) {
+                PrintSimpleLogMessage(LEVEL_ERROR, "zstd error: %s", e.what());
+                return false;
+            }
+            pending.pop_front();
+            pendingBytes -= pendingSizes.front();
+            pendingSizes.pop_front();
+            if (!data.empty() && !push(std::move(data))) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for (auto& frame : frames) {
+        if (frame.size == ZSTD_CONTENTSIZE_UNKNOWN ||
+            frame.size == ZSTD_CONTENTSIZE_ERROR ||
+            frame.size > DECOMPRESS_MAX_FRAME_SIZE) {
+            if (!flush(0, 0) || !stream_zstd(frame.data, frame.len)) {
+                return false;
+            }
+            continue;
+        }
+
+        if (!flush(s_threads - 1, DECOMPRESS_MAX_BUFFERED - frame.size)) {
+            return false;
+        }
+        pendingBytes += frame.size;
+        pendingSizes.push_back(frame.size);
+
+        pending.push_back(std::async(std::launch::async, [frame]() -> std::vector<uint8_t> {
+            std::vector<uint8_t> data(frame.size);
+            size_t rc = ZSTD_decompress(data.data(), data.size(), frame.data, frame.len);
+            if (ZSTD_isError(rc)) {
+                throw std::runtime_error(ZSTD_getErrorName(rc));
+            }
+            data.resize(rc);
+            return data;
+        }));
+    }
+
+    return flush(0, 0);
+}
+
+//=============================================================================
@@ -0,0 +1,102 @@
+/**@file DecompressBackend.h
+ */
+#ifndef DECOMPRESS_BACKEND_H_
+#define DECOMPRESS_BACKEND_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "IOBackend.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define DECOMPRESS_QUEUE_DEPTH      (4)
+#define DECOMPRESS_DEFAULT_THREADS  (4)
+
+//Decompressed bytes held in the queue, and separately by zstd frames
+//being decompressed in parallel
+#define DECOMPRESS_MAX_BUFFERED     (128 * 1024 * 1024)
+
+//Larger (or unsized) zstd frames are streamed instead of decompressed whole
+#define DECOMPRESS_MAX_FRAME_SIZE   (32 * 1024 * 1024)
+
+typedef enum {
+    COMPRESSION_NONE    = 0,
+    COMPRESSION_GZIP    = 1,
+    COMPRESSION_ZSTD    = 2
+} CompressionType_T;
+
+/**
+ * Presents a gzip or zstd compressed file as its decompressed stream.
+ *
+ * Decompression runs on a separate thread and fills a bounded queue of
+ * chunks, so it overlaps with decoding and tracking. zstd files made up
+ * of several independent frames (e.g. written by pzstd) have their
+ * frames decompressed in parallel and delivered in order. Both the
+ * queue and the frames in flight are limited by their decompressed
+ * size, so memory use doesn't depend on how the file was compressed.
+ *
+ * Offsets are positions in the decompressed stream. Seeking forward
+ * decompresses and discards, seeking backwards starts over.
+ */
+class DecompressBackend : public IOBackend {
+public:
+    DecompressBackend (CompressionType_T type);
+    virtual ~DecompressBackend (void);
+
+    virtual bool open (std::string sFile);
+    virtual void close (void);
+    virtual bool seek (uint64_t offset);
+    virtual ssize_t next_chunk (const uint8_t** ppData);
+    virtual const char* name (void);
+
+    /**
+     * Detects the compression of a file from its magic number.
+     */
+    static CompressionType_T GetCompression (std::string sFile);
+
+    /**
+     * Number of threads decompressing zstd frames in parallel.
+     */
+    static void SetThreads (size_t threads);
+
+protected:
+    void start (void);
+    void stop (void);
+    void producer (void);
+    bool inflate_gzip (void);
+    bool decompress_zstd (void);
+    bool stream_zstd (const uint8_t* pData, size_t len);
+    bool push (std::vector<uint8_t>&& chunk);
+
+protected:
+    CompressionType_T m_type;
+    int m_fd;
+    const uint8_t* m_map;
+    size_t m_mapSize;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::vector<uint8_t>> m_queue;
+    size_t m_queuedBytes;
+    bool m_bDone;
+    bool m_bError;
+    bool m_bStop;
+
+    std::vector<uint8_t> m_current;
+    uint64_t m_position;
+    uint64_t m_skip;
+    uint64_t m_seekOffset;
+    bool m_bSeekPending;
+
+    static size_t s_threads;
+};
+
+//=============================================================================
+#endif //DECOMPRESS_BACKEND_H_
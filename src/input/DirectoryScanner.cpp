@@ -0,0 +1,321 @@
+/**@file DirectoryScanner.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "DirectoryScanner.h"
+#include "Logging.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <thread>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+/**
+ * Record returned by the getdents64 system call.
+ */
+struct linux_dirent64_t {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+DirectoryScanner::DirectoryScanner (std::string sPattern, std::string sLiteral, size_t threads)
+  : m_sPattern(sPattern),
+    m_sLiteral(sLiteral),
+    m_threads(threads ? threads : 1),
+    m_bRecursive(false),
+    m_startUs(0),
+    m_stopUs(0),
+    m_mutex(),
+    m_cond(),
+    m_queue(),
+    m_busy(0),
+    m_files(),
+    m_dirs(0),
+    m_pruned(0),
+    m_stats(0)
+{
+}
+
+DirectoryScanner::~DirectoryScanner (void)
+{
+}
+
+void DirectoryScanner::set_recursive (bool bRecursive) {
+    m_bRecursive = bRecursive;
+}
+
+void DirectoryScanner::set_window (uint64_t start_us, uint64_t stop_us) {
+    m_startUs = start_us;
+    m_stopUs = stop_us;
+}
+
+uint64_t DirectoryScanner::get_dirs (void) {
+    return m_dirs;
+}
+
+uint64_t DirectoryScanner::get_pruned (void) {
+    return m_pruned;
+}
+
+uint64_t DirectoryScanner::get_stats (void) {
+    return m_stats;
+}
+
+std::vector<std::string> DirectoryScanner::scan (std::string sRoot) {
+    std::vector<std::thread> workers;
+    ScannerDir_T root;
+    std::vector<std::string> retValue;
+
+    root.path = sRoot;
+    root.level = 0;
+    memset(&root.date, 0, sizeof(root.date));
+
+    m_files.clear();
+    m_queue.clear();
+    m_queue.push_back(root);
+    m_busy = 0;
+
+    //A flat listing has nothing to hand out to other workers
+    size_t threads = m_bRecursive ? m_threads : 1;
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&DirectoryScanner::worker, this);
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    retValue.swap(m_files);
+    return retValue;
+}
+
+void DirectoryScanner::worker (void) {
+    pcrecpp::RE regex(m_sPattern);
+    std::vector<std::string> files;
+
+    while (true) {
+        ScannerDir_T dir;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return !m_queue.empty() || m_busy == 0; });
+
+            //Nothing queued and nobody left to queue more, the scan is done
+            if (m_queue.empty()) {
+                break;
+            }
+
+            dir = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busy++;
+        }
+
+        scan_dir(dir, regex, files);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy--;
+            if (m_busy == 0 && m_queue.empty()) {
+                m_cond.notify_all();
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_files.insert(m_files.end(), files.begin(), files.end());
+}
+
+void DirectoryScanner::scan_dir (const ScannerDir_T& dir, pcrecpp::RE& regex, std::vector<std::string>& files) {
+    std::vector<char> buffer(SCANNER_DENTS_BUFFER_SIZE);
+
+    int fd = open(dir.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        PrintSimpleLogMessage(LEVEL_WARNING, "Unable to access directory %s: %s",
+                              dir.path.c_str(), strerror(errno));
+        return;
+    }
+
+    m_dirs++;
+
+    while (true) {
+        long len = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (len <= 0) {
+            if (len < 0) {
+                PrintSimpleLogMessage(LEVEL_WARNING, "Unable to list directory %s: %s",
+                                      dir.path.c_str(), strerror(errno));
+            }
+            break;
+        }
+
+        for (long i = 0; i < len; ) {
+            const linux_dirent64_t* pEntry = (const linux_dirent64_t*)(buffer.data() + i);
+            const char* pName = pEntry->d_name;
+            bool bDir = (pEntry->d_type == DT_DIR);
+            bool bFile = (pEntry->d_type == DT_REG);
+
+            i += pEntry->d_reclen;
+
+            if (pName[0] == '.' &&
+                (pName[1] == '\0' || (pName[1] == '.' && pName[2] == '\0'))) {
+                continue;
+            }
+
+            //Only stat when the filesystem doesn't report the type
+            //(or for symlinks, which are followed to files only).
+            if (pEntry->d_type == DT_UNKNOWN || pEntry->d_type == DT_LNK) {
+                if (!classify(fd, pName, bDir, bFile)) {
+                    continue;
+                }
+                if (pEntry->d_type == DT_LNK) {
+                    bDir = false;
+                }
+            }
+
+            if (bFile) {
+                if (!m_sLiteral.empty() && !strstr(pName, m_sLiteral.c_str())) {
+                    continue;
+                }
+                if (regex.FullMatch(pName)) {
+                    files.push_back(dir.path + "/" + pName);
+                }
+            } else if (bDir && m_bRecursive) {
+                ScannerDir_T child;
+
+                child.path = dir.path + "/" + pName;
+                child.level = dir.level + 1;
+                child_date(dir.date, pName, child.date);
+
+                if (!date_in_window(child.date)) {
+                    m_pruned++;
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue.push_back(std::move(child));
+                m_cond.notify_one();
+            }
+        }
+    }
+
+    close(fd);
+}
+
+bool DirectoryScanner::classify (int dirFd, const char* pName, bool& bDir, bool& bFile) {
+    mode_t mode = 0;
+
+    m_stats++;
+
+#ifdef STATX_TYPE
+    struct statx stx;
+    if (statx(dirFd, pName, AT_STATX_DONT_SYNC, STATX_TYPE, &stx) != 0) {
+        return false;
+    }
+    mode = stx.stx_mode;
+#else
+    struct stat fs;
+    if (fstatat(dirFd, pName, &fs, 0) != 0) {
+        return false;
+    }
+    mode = fs.st_mode;
+#endif
+
+    bDir = S_ISDIR(mode);
+    bFile = S_ISREG(mode);
+    return true;
+}
+
+bool DirectoryScanner::child_date (const ScannerPathDate_T& parent, const char* pName, ScannerPathDate_T& child) {
+    static const int lengths[] = { 4, 2, 2, 2 };
+    static const int minimums[] = { 1970, 1, 1, 0 };
+    static const int maximums[] = { 9999, 12, 31, 23 };
+    int value = 0;
+    int len = 0;
+
+    //Anything that isn't the next date component inherits the range
+    //of its parent.
+    child = parent;
+
+    if (parent.depth >= 4) {
+        return false;
+    }
+
+    for (; pName[len] != '\0'; len++) {
+        if (pName[len] < '0' || pName[len] > '9') {
+            return false;
+        }
+        value = value * 10 + (pName[len] - '0');
+    }
+
+    if (len != lengths[parent.depth] ||
+        value < minimums[parent.depth] ||
+        value > maximums[parent.depth]) {
+        return false;
+    }
+
+    switch (parent.depth) {
+    case 0: child.year = value;  break;
+    case 1: child.month = value; break;
+    case 2: child.day = value;   break;
+    case 3: child.hour = value;  break;
+    }
+    child.depth = parent.depth + 1;
+
+    return true;
+}
+
+bool DirectoryScanner::date_in_window (const ScannerPathDate_T& date) {
+    struct tm lt;
+
+    if (date.depth == 0 || (m_startUs == 0 && m_stopUs == 0)) {
+        return true;
+    }
+
+    memset(&lt, 0, sizeof(lt));
+    lt.tm_year = date.year - 1900;
+    lt.tm_mon = (date.depth >= 2) ? date.month - 1 : 0;
+    lt.tm_mday = (date.depth >= 3) ? date.day : 1;
+    lt.tm_hour = (date.depth >= 4) ? date.hour : 0;
+    lt.tm_isdst = -1;
+    time_t begin = mktime(&lt);
+
+    switch (date.depth) {
+    case 1: lt.tm_year++; break;
+    case 2: lt.tm_mon++;  break;
+    case 3: lt.tm_mday++; break;
+    case 4: lt.tm_hour++; break;
+    }
+    lt.tm_isdst = -1;
+    time_t end = mktime(&lt);
+
+    if (begin == (time_t)-1 || end == (time_t)-1) {
+        return true;
+    }
+
+    uint64_t beginUs = (uint64_t)begin * 1000000;
+    uint64_t endUs = (uint64_t)end * 1000000 + SCANNER_PRUNE_SLACK_US;
+
+    if (m_stopUs != 0 && beginUs > m_stopUs) {
+        return false;
+    }
+    if (m_startUs != 0 && endUs <= m_startUs) {
+        return false;
+    }
+
+    return true;
+}
+
+//=============================================================================
@@ -0,0 +1,116 @@
+/**@file DirectoryScanner.h
+ */
+#ifndef DIRECTORY_SCANNER_H_
+#define DIRECTORY_SCANNER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <pcrecpp.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define SCANNER_DENTS_BUFFER_SIZE   (64 * 1024)
+#define SCANNER_DEFAULT_THREADS     (8)
+
+//Captures in an hour directory may run past the end of that hour
+#define SCANNER_PRUNE_SLACK_US      (3600ULL * 1000000)
+
+/**
+ * Date encoded in the directory path (YYYY/MM/DD/HH), depth is the
+ * number of components seen so far (0 if the path has no date).
+ */
+typedef struct {
+    int depth;
+    int year;
+    int month;
+    int day;
+    int hour;
+} ScannerPathDate_T;
+
+typedef struct {
+    std::string path;
+    ScannerPathDate_T date;
+    size_t level;
+} ScannerDir_T;
+
+/**
+ * Lists capture files below a directory.
+ *
+ * Subdirectories are listed in parallel by a pool of workers that read
+ * entries with getdents64 and only stat entries whose type the
+ * filesystem doesn't report. When a time window is set, directories
+ * laid out as YYYY/MM/DD/HH that fall entirely outside the window are
+ * not descended into.
+ */
+class DirectoryScanner {
+public:
+    /**
+     * @param sPattern Regular expression file names must fully match.
+     * @param sLiteral Substring file names must contain, checked before
+     *                 the regular expression (may be empty).
+     * @param threads Number of worker threads.
+     */
+    DirectoryScanner (std::string sPattern, std::string sLiteral, size_t threads);
+    virtual ~DirectoryScanner (void);
+
+    /**
+     * @param bRecursive Descend into subdirectories.
+     */
+    virtual void set_recursive (bool bRecursive);
+
+    /**
+     * Restricts the scan to date directories overlapping the window.
+     *
+     * @param start_us Window start (microseconds, 0 is unbounded).
+     * @param stop_us Window stop (microseconds, 0 is unbounded).
+     */
+    virtual void set_window (uint64_t start_us, uint64_t stop_us);
+
+    /**
+     * Scans a directory tree.
+     *
+     * @param sRoot Directory to scan.
+     * @return std::vector<std::string> Matching file paths (unordered).
+     */
+    virtual std::vector<std::string> scan (std::string sRoot);
+
+    virtual uint64_t get_dirs (void);
+    virtual uint64_t get_pruned (void);
+    virtual uint64_t get_stats (void);
+
+protected:
+    void worker (void);
+    void scan_dir (const ScannerDir_T& dir, pcrecpp::RE& regex, std::vector<std::string>& files);
+    bool classify (int dirFd, const char* pName, bool& bDir, bool& bFile);
+    bool child_date (const ScannerPathDate_T& parent, const char* pName, ScannerPathDate_T& child);
+    bool date_in_window (const ScannerPathDate_T& date);
+
+protected:
+    std::string m_sPattern;
+    std::string m_sLiteral;
+    size_t m_threads;
+    bool m_bRecursive;
+    uint64_t m_startUs;
+    uint64_t m_stopUs;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<ScannerDir_T> m_queue;
+    size_t m_busy;
+    std::vector<std::string> m_files;
+
+    std::atomic<uint64_t> m_dirs;
+    std::atomic<uint64_t> m_pruned;
+    std::atomic<uint64_t> m_stats;
+};
+
+//=============================================================================
+#endif //DIRECTORY_SCANNER_H_
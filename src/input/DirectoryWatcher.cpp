@@ -0,0 +1,101 @@
+/**@file DirectoryWatcher.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "DirectoryWatcher.h"
+#include "Logging.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <vector>
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+DirectoryWatcher::DirectoryWatcher (std::string sDir)
+  : m_sDir(sDir),
+    m_fd(-1),
+    m_wd(-1)
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher (void)
+{
+    close();
+}
+
+bool DirectoryWatcher::open (void) {
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "inotify_init1 failed: %s", strerror(errno));
+        return false;
+    }
+
+    m_wd = inotify_add_watch(m_fd, m_sDir.c_str(),
+                             IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (m_wd < 0) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Unable to watch %s: %s", m_sDir.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void DirectoryWatcher::close (void) {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+        m_wd = -1;
+    }
+}
+
+bool DirectoryWatcher::wait (int timeout_ms, std::map<std::string, uint32_t>& changed, bool& overflow) {
+    std::vector<char> buffer(WATCHER_EVENT_BUFFER_SIZE);
+    struct pollfd pfd;
+
+    overflow = false;
+
+    if (m_fd < 0) {
+        return false;
+    }
+
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc < 0) {
+        //EINTR means a shutdown signal was received
+        return false;
+    } else if (rc == 0) {
+        return true;
+    }
+
+    while (true) {
+        ssize_t len = read(m_fd, buffer.data(), buffer.size());
+        if (len <= 0) {
+            //EAGAIN once the queue is drained
+            break;
+        }
+
+        for (ssize_t i = 0; i < len; ) {
+            const struct inotify_event* pEvent = (const struct inotify_event*)(buffer.data() + i);
+
+            if (pEvent->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+            } else if (pEvent->len > 0 && !(pEvent->mask & IN_ISDIR)) {
+                changed[m_sDir + "/" + pEvent->name] |= pEvent->mask;
+            }
+
+            i += sizeof(struct inotify_event) + pEvent->len;
+        }
+    }
+
+    return true;
+}
+
+//=============================================================================
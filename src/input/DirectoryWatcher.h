@@ -0,0 +1,63 @@
+/**@file DirectoryWatcher.h
+ */
+#ifndef DIRECTORY_WATCHER_H_
+#define DIRECTORY_WATCHER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <sys/inotify.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define WATCHER_EVENT_BUFFER_SIZE (64 * 1024)
+
+//Events after which a file will no longer be written to
+#define WATCHER_COMPLETE_MASK     (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/**
+ * Watches a directory with inotify and reports the names of files
+ * that were created, written to, closed after writing or moved into
+ * the directory.
+ */
+class DirectoryWatcher {
+public:
+    DirectoryWatcher (std::string sDir);
+    virtual ~DirectoryWatcher (void);
+
+    /**
+     * Starts watching the directory.
+     *
+     * @return bool true on success, false on failure.
+     */
+    virtual bool open (void);
+
+    virtual void close (void);
+
+    /**
+     * Waits for changes in the directory.
+     *
+     * Once the first event arrives every queued event is drained, so
+     * a file that is written to continuously is reported once per
+     * call.
+     *
+     * @param timeout_ms Maximum time to wait in milliseconds.
+     * @param changed Populated with the full path of each changed file
+     *                and the union of the inotify event masks seen for it.
+     * @param overflow Set to true if the kernel dropped events, in
+     *                 which case the caller should rescan the directory.
+     * @return bool false on error or if interrupted by a signal.
+     */
+    virtual bool wait (int timeout_ms, std::map<std::string, uint32_t>& changed, bool& overflow);
+
+protected:
+    std::string m_sDir;
+    int m_fd;
+    int m_wd;
+};
+
+//=============================================================================
+#endif //DIRECTORY_WATCHER_H_
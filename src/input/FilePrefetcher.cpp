@@ -0,0 +1,151 @@
+/**@file FilePrefetcher.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "FilePrefetcher.h"
+#include "Logging.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+FilePrefetcher::FilePrefetcher (size_t depth)
+  : m_depth(depth),
+    m_files(),
+    m_thread(),
+    m_mutex(),
+    m_cond(),
+    m_current(0),
+    m_next(1),
+    m_bStop(false),
+    m_filesFetched(0),
+    m_bytesFetched(0)
+{
+}
+
+FilePrefetcher::~FilePrefetcher (void)
+{
+    stop();
+}
+
+void FilePrefetcher::start (const std::vector<std::string>& files) {
+    if (m_depth == 0 || m_thread.joinable()) {
+        return;
+    }
+
+    m_files = files;
+    m_current = 0;
+    m_next = 1;
+    m_bStop = false;
+    m_thread = std::thread(&FilePrefetcher::worker, this);
+}
+
+void FilePrefetcher::advance (size_t index) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_current = index;
+    m_cond.notify_one();
+}
+
+void FilePrefetcher::stop (void) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+        m_cond.notify_one();
+    }
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+uint64_t FilePrefetcher::get_files (void) {
+    return m_filesFetched;
+}
+
+uint64_t FilePrefetcher::get_bytes (void) {
+    return m_bytesFetched;
+}
+
+void FilePrefetcher::worker (void) {
+    uint8_t* pBuffer = NULL;
+
+    if (posix_memalign((void**)&pBuffer, PREFETCH_ALIGNMENT, PREFETCH_CHUNK_SIZE) != 0) {
+        PrintSimpleLogMessage(LEVEL_WARNING, "Unable to allocate prefetch buffer");
+        return;
+    }
+
+    while (true) {
+        size_t index = 0;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            //Never fetch files the consumer has already reached
+            if (m_next <= m_current) {
+                m_next = m_current + 1;
+            }
+
+            m_cond.wait(lock, [this] {
+                return m_bStop || m_next >= m_files.size() || m_next <= m_current + m_depth;
+            });
+
+            if (m_bStop || m_next >= m_files.size()) {
+                break;
+            }
+
+            index = m_next++;
+        }
+
+        prefetch(index, pBuffer);
+    }
+
+    free(pBuffer);
+}
+
+void FilePrefetcher::prefetch (size_t index, uint8_t* pBuffer) {
+    struct stat fs;
+    uint64_t offset = 0;
+
+    int fd = open(m_files[index].c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    if (fstat(fd, &fs) == 0) {
+        posix_fadvise(fd, 0, fs.st_size, POSIX_FADV_WILLNEED);
+        readahead(fd, 0, fs.st_size);
+    }
+
+    //Hints are advisory (and ignored by some network filesystems), so
+    //read the file through as well until the consumer catches up.
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_bStop || m_current >= index) {
+                break;
+            }
+        }
+
+        ssize_t count = pread(fd, pBuffer, PREFETCH_CHUNK_SIZE, offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+
+        offset += count;
+        m_bytesFetched += count;
+    }
+
+    m_filesFetched++;
+    close(fd);
+}
+
+//=============================================================================
@@ -0,0 +1,76 @@
+/**@file FilePrefetcher.h
+ */
+#ifndef FILE_PREFETCHER_H_
+#define FILE_PREFETCHER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define PREFETCH_CHUNK_SIZE     (4 * 1024 * 1024)
+#define PREFETCH_ALIGNMENT      (4096)
+#define PREFETCH_DEFAULT_DEPTH  (1)
+
+/**
+ * Warms the page cache for the files that will be processed next.
+ *
+ * While file k is being processed a background thread hints the
+ * kernel (posix_fadvise(WILLNEED) and readahead) about files k+1 ..
+ * k+depth and then reads them through a large aligned buffer, which
+ * also works on network filesystems that ignore the hints. Reading
+ * stops as soon as the consumer reaches the file.
+ */
+class FilePrefetcher {
+public:
+    /**
+     * @param depth Number of files to fetch ahead (0 disables).
+     */
+    FilePrefetcher (size_t depth);
+    virtual ~FilePrefetcher (void);
+
+    /**
+     * Starts the background thread.
+     *
+     * @param files Files in processing order.
+     */
+    virtual void start (const std::vector<std::string>& files);
+
+    /**
+     * Signals that processing of files[index] is starting.
+     */
+    virtual void advance (size_t index);
+
+    virtual void stop (void);
+
+    virtual uint64_t get_files (void);
+    virtual uint64_t get_bytes (void);
+
+protected:
+    void worker (void);
+    void prefetch (size_t index, uint8_t* pBuffer);
+
+protected:
+    size_t m_depth;
+    std::vector<std::string> m_files;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    size_t m_current;
+    size_t m_next;
+    bool m_bStop;
+
+    std::atomic<uint64_t> m_filesFetched;
+    std::atomic<uint64_t> m_bytesFetched;
+};
+
+//=============================================================================
+#endif //FILE_PREFETCHER_H_
@@ -0,0 +1,231 @@
+/**@file IOBackend.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "IOBackend.h"
+#include "IOUringBackend.h"
+#include "DecompressBackend.h"
+#include "Logging.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+std::unique_ptr<IOBackend> IOBackend::Open (std::string sFile, IOBackendType_T type) {
+    std::unique_ptr<IOBackend> backend;
+
+    //Compressed captures are always read through the decompressor
+    CompressionType_T compression = DecompressBackend::GetCompression(sFile);
+    if (compression != COMPRESSION_NONE) {
+        backend.reset(new DecompressBackend(compression));
+        if (backend->open(sFile)) {
+            return backend;
+        }
+        return nullptr;
+    }
+
+    switch (type) {
+    case IO_BACKEND_URING:
+        backend.reset(new IOUringBackend(IO_DEFAULT_DEPTH));
+        if (backend->open(sFile)) {
+            return backend;
+        }
+        //Fall through - try mmap
+    case IO_BACKEND_MMAP:
+        backend.reset(new MmapBackend());
+        if (backend->open(sFile)) {
+            return backend;
+        }
+        //Fall through - try pread
+    case IO_BACKEND_PREAD:
+    default:
+        backend.reset(new PreadBackend());
+        if (backend->open(sFile)) {
+            return backend;
+        }
+    }
+
+    return nullptr;
+}
+
+bool IOBackend::GetType (const std::string& sName, IOBackendType_T& type) {
+    if (sName == "pread") {
+        type = IO_BACKEND_PREAD;
+    } else if (sName == "mmap") {
+        type = IO_BACKEND_MMAP;
+    } else if (sName == "uring") {
+        type = IO_BACKEND_URING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// PreadBackend
+//-----------------------------------------------------------------------------
+PreadBackend::PreadBackend (void)
+  : m_fd(-1),
+    m_buffer(NULL)
+{
+}
+
+PreadBackend::~PreadBackend (void)
+{
+    close();
+}
+
+bool PreadBackend::open (std::string sFile) {
+    m_fd = ::open(sFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (posix_memalign((void**)&m_buffer, IO_ALIGNMENT, IO_CHUNK_SIZE) != 0) {
+        m_buffer = NULL;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void PreadBackend::close (void) {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    if (m_buffer) {
+        free(m_buffer);
+        m_buffer = NULL;
+    }
+}
+
+bool PreadBackend::seek (uint64_t offset) {
+    return m_fd >= 0 && lseek(m_fd, offset, SEEK_SET) != (off_t)-1;
+}
+
+ssize_t PreadBackend::next_chunk (const uint8_t** ppData) {
+    ssize_t count;
+
+    do {
+        count = read(m_fd, m_buffer, IO_CHUNK_SIZE);
+    } while (count < 0 && errno == EINTR);
+
+    *ppData = m_buffer;
+    return count;
+}
+
+const char* PreadBackend::name (void) {
+    return "pread";
+}
+
+//-----------------------------------------------------------------------------
+// MmapBackend
+//-----------------------------------------------------------------------------
+MmapBackend::MmapBackend (void)
+  : m_fd(-1),
+    m_map(NULL),
+    m_mapSize(0),
+    m_offset(0)
+{
+}
+
+MmapBackend::~MmapBackend (void)
+{
+    close();
+}
+
+bool MmapBackend::open (std::string sFile) {
+    m_fd = ::open(sFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    m_offset = 0;
+    if (!remap()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MmapBackend::remap (void) {
+    struct stat fs;
+
+    if (fstat(m_fd, &fs) != 0) {
+        return false;
+    }
+
+    if ((uint64_t)fs.st_size == m_mapSize) {
+        return true;
+    }
+
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+        m_map = NULL;
+        m_mapSize = 0;
+    }
+
+    //Empty files can't be mapped, wait for data
+    if (fs.st_size == 0) {
+        return true;
+    }
+
+    void* pMap = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (pMap == MAP_FAILED) {
+        return false;
+    }
+
+    madvise(pMap, fs.st_size, MADV_SEQUENTIAL);
+    m_map = (uint8_t*)pMap;
+    m_mapSize = fs.st_size;
+    return true;
+}
+
+void MmapBackend::close (void) {
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+        m_map = NULL;
+        m_mapSize = 0;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool MmapBackend::seek (uint64_t offset) {
+    m_offset = offset;
+    return m_fd >= 0;
+}
+
+ssize_t MmapBackend::next_chunk (const uint8_t** ppData) {
+    if (m_offset >= m_mapSize && !remap()) {
+        return -1;
+    }
+
+    if (m_offset >= m_mapSize) {
+        return 0;
+    }
+
+    *ppData = m_map + m_offset;
+    ssize_t len = m_mapSize - m_offset;
+    m_offset = m_mapSize;
+    return len;
+}
+
+const char* MmapBackend::name (void) {
+    return "mmap";
+}
+
+//=============================================================================
@@ -0,0 +1,121 @@
+/**@file IOBackend.h
+ */
+#ifndef IO_BACKEND_H_
+#define IO_BACKEND_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <memory>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define IO_CHUNK_SIZE       (4 * 1024 * 1024)
+#define IO_ALIGNMENT        (4096)
+#define IO_DEFAULT_DEPTH    (4)
+
+typedef enum {
+    IO_BACKEND_PREAD    = 0,
+    IO_BACKEND_MMAP     = 1,
+    IO_BACKEND_URING    = 2
+} IOBackendType_T;
+
+/**
+ * Sequential reader handing out a file as a series of chunks.
+ *
+ * Chunks point into memory owned by the backend (a read buffer, a
+ * mapping or an io_uring fixed buffer) and are only valid until the
+ * next call to next_chunk(), seek() or close().
+ */
+class IOBackend {
+public:
+    virtual ~IOBackend (void) {}
+
+    virtual bool open (std::string sFile) = 0;
+    virtual void close (void) = 0;
+
+    /**
+     * Restarts reading at offset.
+     */
+    virtual bool seek (uint64_t offset) = 0;
+
+    /**
+     * Returns the next chunk of the file.
+     *
+     * @param ppData Populated with a pointer to the chunk.
+     * @return ssize_t Chunk length, 0 at the end of the file (reading
+     *         can be retried if the file grows) or -1 on error.
+     */
+    virtual ssize_t next_chunk (const uint8_t** ppData) = 0;
+
+    virtual const char* name (void) = 0;
+
+    /**
+     * Opens a file with the requested backend, falling back to mmap and
+     * then pread if it isn't available. gzip and zstd compressed files
+     * are decompressed transparently.
+     *
+     * @param sFile File to open.
+     * @param type Preferred backend.
+     * @return std::unique_ptr<IOBackend> Opened backend, nullptr if the
+     *         file can't be opened.
+     */
+    static std::unique_ptr<IOBackend> Open (std::string sFile, IOBackendType_T type);
+
+    /**
+     * Parses a backend name ("pread", "mmap", "uring").
+     *
+     * @return bool false if the name is unknown.
+     */
+    static bool GetType (const std::string& sName, IOBackendType_T& type);
+};
+
+/**
+ * Reads into a single page aligned buffer with read(2).
+ */
+class PreadBackend : public IOBackend {
+public:
+    PreadBackend (void);
+    virtual ~PreadBackend (void);
+
+    virtual bool open (std::string sFile);
+    virtual void close (void);
+    virtual bool seek (uint64_t offset);
+    virtual ssize_t next_chunk (const uint8_t** ppData);
+    virtual const char* name (void);
+
+protected:
+    int m_fd;
+    uint8_t* m_buffer;
+};
+
+/**
+ * Maps the file and hands out the unread remainder as one chunk. The
+ * mapping is extended when the file grows.
+ */
+class MmapBackend : public IOBackend {
+public:
+    MmapBackend (void);
+    virtual ~MmapBackend (void);
+
+    virtual bool open (std::string sFile);
+    virtual void close (void);
+    virtual bool seek (uint64_t offset);
+    virtual ssize_t next_chunk (const uint8_t** ppData);
+    virtual const char* name (void);
+
+protected:
+    bool remap (void);
+
+protected:
+    int m_fd;
+    uint8_t* m_map;
+    uint64_t m_mapSize;
+    uint64_t m_offset;
+};
+
+//=============================================================================
+#endif //IO_BACKEND_H_
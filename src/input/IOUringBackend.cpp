@@ -0,0 +1,382 @@
+/**@file IOUringBackend.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "IOUringBackend.h"
+#include "Logging.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <algorithm>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#ifdef __NR_io_uring_setup
+static int io_uring_setup (unsigned entries, struct io_uring_params* pParams) {
+    return syscall(__NR_io_uring_setup, entries, pParams);
+}
+
+static int io_uring_enter (int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int io_uring_register (int fd, unsigned opcode, const void* pArg, unsigned count) {
+    return syscall(__NR_io_uring_register, fd, opcode, pArg, count);
+}
+#endif
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+IOUringBackend::IOUringBackend (size_t depth)
+  : m_depth(depth ? depth : 1),
+    m_fd(-1),
+    m_ringFd(-1),
+    m_bFixed(false),
+    m_opcode(0),
+    m_sqRing(NULL),
+    m_sqRingSize(0),
+    m_cqRing(NULL),
+    m_cqRingSize(0),
+    m_sqes(NULL),
+    m_sqesSize(0),
+    m_sqTail(NULL),
+    m_sqMask(NULL),
+    m_sqArray(NULL),
+    m_cqHead(NULL),
+    m_cqTail(NULL),
+    m_cqMask(NULL),
+    m_cqes(NULL),
+    m_slots(),
+    m_head(0),
+    m_nextOffset(0),
+    m_bHeld(false),
+    m_bRestart(false),
+    m_restartOffset(0)
+{
+}
+
+IOUringBackend::~IOUringBackend (void)
+{
+    close();
+}
+
+const char* IOUringBackend::name (void) {
+    return "uring";
+}
+
+bool IOUringBackend::setup_ring (void) {
+#ifdef __NR_io_uring_setup
+    struct io_uring_params params;
+    std::vector<struct iovec> iovs;
+
+    memset(&params, 0, sizeof(params));
+    m_ringFd = io_uring_setup(m_depth, &params);
+    if (m_ringFd < 0) {
+        return false;
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_sqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        m_cqRingSize = m_sqRingSize;
+    }
+
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_ringFd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = NULL;
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_ringFd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = NULL;
+            return false;
+        }
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* pSqes = mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       m_ringFd, IORING_OFF_SQES);
+    if (pSqes == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = (struct io_uring_sqe*)pSqes;
+
+    m_sqTail = (unsigned*)((uint8_t*)m_sqRing + params.sq_off.tail);
+    m_sqMask = (unsigned*)((uint8_t*)m_sqRing + params.sq_off.ring_mask);
+    m_sqArray = (unsigned*)((uint8_t*)m_sqRing + params.sq_off.array);
+    m_cqHead = (unsigned*)((uint8_t*)m_cqRing + params.cq_off.head);
+    m_cqTail = (unsigned*)((uint8_t*)m_cqRing + params.cq_off.tail);
+    m_cqMask = (unsigned*)((uint8_t*)m_cqRing + params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)((uint8_t*)m_cqRing + params.cq_off.cqes);
+
+    IOUringSlot_T empty = { NULL, { NULL, 0 }, 0, 0, false };
+    m_slots.assign(m_depth, empty);
+    for (auto& slot : m_slots) {
+        struct iovec iov;
+
+        if (posix_memalign((void**)&slot.buffer, IO_ALIGNMENT, IO_CHUNK_SIZE) != 0) {
+            slot.buffer = NULL;
+            return false;
+        }
+
+        iov.iov_base = slot.buffer;
+        iov.iov_len = IO_CHUNK_SIZE;
+        iovs.push_back(iov);
+        slot.iov = iov;
+    }
+
+    //Registration can fail on the locked memory limit, plain reads
+    //still work in that case.
+    m_bFixed = (io_uring_register(m_ringFd, IORING_REGISTER_BUFFERS, iovs.data(), iovs.size()) == 0);
+    m_opcode = m_bFixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IOUringBackend::teardown_ring (void) {
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = NULL;
+    }
+    if (m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = NULL;
+    if (m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = NULL;
+    }
+    if (m_ringFd >= 0) {
+        ::close(m_ringFd);
+        m_ringFd = -1;
+    }
+    for (auto& slot : m_slots) {
+        free(slot.buffer);
+    }
+    m_slots.clear();
+}
+
+bool IOUringBackend::open (std::string sFile) {
+    m_fd = ::open(sFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    if (!setup_ring()) {
+        PrintSimpleLogMessage(LEVEL_DEBUG, "io_uring unavailable: %s", strerror(errno));
+        close();
+        return false;
+    }
+
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (!seek(0) || !probe()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool IOUringBackend::probe (void) {
+#ifdef __NR_io_uring_setup
+    if (!wait(0)) {
+        return false;
+    }
+    if (m_slots[0].result != -EINVAL) {
+        return true;
+    }
+
+    //IORING_OP_READ only exists from 5.6 on, older kernels reject it
+    //with EINVAL. IORING_OP_READV has been there since 5.1.
+    PrintSimpleLogMessage(LEVEL_DEBUG, "io_uring read rejected, using readv");
+    m_opcode = IORING_OP_READV;
+    if (!seek(0) || !wait(0)) {
+        return false;
+    }
+    if (m_slots[0].result == -EINVAL) {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IOUringBackend::close (void) {
+    //The kernel may still be writing into the buffers
+    drain();
+    teardown_ring();
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool IOUringBackend::submit (size_t slot, uint64_t offset) {
+#ifdef __NR_io_uring_setup
+    unsigned tail = *m_sqTail;
+    unsigned index = tail & *m_sqMask;
+    struct io_uring_sqe* pSqe = &m_sqes[index];
+
+    memset(pSqe, 0, sizeof(*pSqe));
+    pSqe->opcode = m_opcode;
+    pSqe->fd = m_fd;
+    pSqe->off = offset;
+    if (m_opcode == IORING_OP_READV) {
+        pSqe->addr = (uint64_t)(uintptr_t)&m_slots[slot].iov;
+        pSqe->len = 1;
+    } else {
+        pSqe->addr = (uint64_t)(uintptr_t)m_slots[slot].buffer;
+        pSqe->len = IO_CHUNK_SIZE;
+        pSqe->buf_index = (m_opcode == IORING_OP_READ_FIXED) ? slot : 0;
+    }
+    pSqe->user_data = slot;
+
+    m_sqArray[index] = index;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    int rc;
+    do {
+        rc = io_uring_enter(m_ringFd, 1, 0, 0);
+    } while (rc < 0 && errno == EINTR);
+
+    if (rc < 0) {
+        return false;
+    }
+
+    m_slots[slot].offset = offset;
+    m_slots[slot].pending = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IOUringBackend::reap (void) {
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe* pCqe = &m_cqes[head & *m_cqMask];
+        IOUringSlot_T& slot = m_slots[pCqe->user_data];
+
+        slot.result = pCqe->res;
+        slot.pending = false;
+    }
+
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+bool IOUringBackend::wait (size_t slot) {
+#ifdef __NR_io_uring_setup
+    reap();
+    while (m_slots[slot].pending) {
+        if (io_uring_enter(m_ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            return false;
+        }
+        reap();
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IOUringBackend::drain (void) {
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        if (m_slots[i].pending && !wait(i)) {
+            break;
+        }
+    }
+}
+
+bool IOUringBackend::seek (uint64_t offset) {
+    if (m_fd < 0 || m_ringFd < 0) {
+        return false;
+    }
+
+    drain();
+
+    m_head = 0;
+    m_bHeld = false;
+    m_bRestart = false;
+    m_nextOffset = offset;
+
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        if (!submit(i, m_nextOffset)) {
+            return false;
+        }
+        m_nextOffset += IO_CHUNK_SIZE;
+    }
+
+    return true;
+}
+
+ssize_t IOUringBackend::next_chunk (const uint8_t** ppData) {
+    if (m_fd < 0 || m_ringFd < 0) {
+        return -1;
+    }
+
+    //The chunk handed out last time is done with
+    if (m_bHeld) {
+        m_bHeld = false;
+
+        if (m_bRestart) {
+            //The last read was short, so the reads queued behind it
+            //were past the end of the file. Start over from where it
+            //ended in case the file has grown since.
+            if (!seek(m_restartOffset)) {
+                return -1;
+            }
+        } else {
+            if (!submit(m_head, m_nextOffset)) {
+                return -1;
+            }
+            m_nextOffset += IO_CHUNK_SIZE;
+            m_head = (m_head + 1) % m_slots.size();
+        }
+    }
+
+    if (!wait(m_head)) {
+        return -1;
+    }
+
+    IOUringSlot_T& slot = m_slots[m_head];
+    if (slot.result < 0) {
+        errno = -slot.result;
+        return -1;
+    }
+
+    if ((size_t)slot.result < IO_CHUNK_SIZE) {
+        m_bRestart = true;
+        m_restartOffset = slot.offset + slot.result;
+    }
+
+    m_bHeld = true;
+    *ppData = slot.buffer;
+    return slot.result;
+}
+
+//=============================================================================
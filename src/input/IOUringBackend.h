@@ -0,0 +1,94 @@
+/**@file IOUringBackend.h
+ */
+#ifndef IO_URING_BACKEND_H_
+#define IO_URING_BACKEND_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "IOBackend.h"
+#include <sys/uio.h>
+#include <vector>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * One registered buffer and the read that is (or was) using it.
+ */
+typedef struct {
+    uint8_t* buffer;
+    struct iovec iov;
+    uint64_t offset;
+    int result;
+    bool pending;
+} IOUringSlot_T;
+
+/**
+ * Reads through io_uring with a ring of registered (fixed) buffers.
+ *
+ * Up to depth reads of consecutive chunks are kept in flight. Chunks
+ * are handed out in file order straight from the registered buffer,
+ * and a buffer is resubmitted for the next unread chunk as soon as
+ * the caller asks for the following one.
+ *
+ * The ring is driven with the raw system calls so there is no
+ * dependency on liburing. open() fails if the kernel doesn't support
+ * io_uring (or it is blocked), in which case IOBackend::Open() falls
+ * back to another backend. Kernels before 5.6 have io_uring but not
+ * IORING_OP_READ; open() then switches to IORING_OP_READV.
+ */
+class IOUringBackend : public IOBackend {
+public:
+    IOUringBackend (size_t depth);
+    virtual ~IOUringBackend (void);
+
+    virtual bool open (std::string sFile);
+    virtual void close (void);
+    virtual bool seek (uint64_t offset);
+    virtual ssize_t next_chunk (const uint8_t** ppData);
+    virtual const char* name (void);
+
+protected:
+    bool setup_ring (void);
+    bool probe (void);
+    void teardown_ring (void);
+    bool submit (size_t slot, uint64_t offset);
+    void reap (void);
+    bool wait (size_t slot);
+    void drain (void);
+
+protected:
+    size_t m_depth;
+    int m_fd;
+    int m_ringFd;
+    bool m_bFixed;
+    uint8_t m_opcode;
+
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    struct io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+
+    unsigned* m_sqTail;
+    unsigned* m_sqMask;
+    unsigned* m_sqArray;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned* m_cqMask;
+    struct io_uring_cqe* m_cqes;
+
+    std::vector<IOUringSlot_T> m_slots;
+    size_t m_head;
+    uint64_t m_nextOffset;
+    bool m_bHeld;
+    bool m_bRestart;
+    uint64_t m_restartOffset;
+};
+
+//=============================================================================
+#endif //IO_URING_BACKEND_H_
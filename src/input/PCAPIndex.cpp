@@ -0,0 +1,260 @@
+/**@file PCAPIndex.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "PCAPIndex.h"
+#include "PCAPReader.h"
+#include "Logging.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+/**
+ * On-disk header of an index file, followed by entry_count
+ * PCAPIndexEntry_T structures.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t file_size;
+    uint64_t mtime;
+    uint64_t record_count;
+    uint64_t first_timestamp_us;
+    uint64_t last_timestamp_us;
+    uint64_t entry_count;
+} PCAPIndexHeader_T;
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+PCAPIndex::PCAPIndex (std::string sPcapFile)
+  : m_sPcapFile(sPcapFile),
+    m_fileSize(0),
+    m_mtime(0),
+    m_recordCount(0),
+    m_firstTimestamp(0),
+    m_lastTimestamp(0),
+    m_nextEntryTimestamp(0),
+    m_entries()
+{
+}
+
+PCAPIndex::~PCAPIndex (void)
+{
+}
+
+std::string PCAPIndex::GetIndexPath (std::string sPcapFile) {
+    return sPcapFile + PCAP_INDEX_SUFFIX;
+}
+
+bool PCAPIndex::stat_capture (uint64_t& fileSize, uint64_t& mtime) {
+    struct stat fs;
+
+    if (stat(m_sPcapFile.c_str(), &fs) == -1) {
+        return false;
+    }
+
+    fileSize = fs.st_size;
+    mtime = fs.st_mtime;
+    return true;
+}
+
+bool PCAPIndex::load (void) {
+    PCAPIndexHeader_T hdr;
+    struct stat fs;
+    uint64_t fileSize = 0;
+    uint64_t mtime = 0;
+    bool retValue = false;
+
+    std::string sPath = GetIndexPath(m_sPcapFile);
+    FILE* fp = fopen(sPath.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+
+    if (fread(&hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+        hdr.magic != PCAP_INDEX_MAGIC ||
+        hdr.version != PCAP_INDEX_VERSION) {
+        goto Exit;
+    }
+
+    //Stale if the capture changed since the index was built
+    if (!stat_capture(fileSize, mtime) ||
+        fileSize != hdr.file_size ||
+        mtime != hdr.mtime) {
+        goto Exit;
+    }
+
+    //The entries must fill the rest of the file exactly, a damaged
+    //count mustn't size the table
+    if (fstat(fileno(fp), &fs) != 0 ||
+        (uint64_t)fs.st_size < sizeof(hdr) ||
+        hdr.entry_count != ((uint64_t)fs.st_size - sizeof(hdr)) / sizeof(PCAPIndexEntry_T) ||
+        ((uint64_t)fs.st_size - sizeof(hdr)) % sizeof(PCAPIndexEntry_T) != 0) {
+        goto Exit;
+    }
+
+    m_entries.resize(hdr.entry_count);
+    if (fread(m_entries.data(), sizeof(PCAPIndexEntry_T), hdr.entry_count, fp) != hdr.entry_count ||
+        !std::is_sorted(m_entries.begin(), m_entries.end(),
+                        [](const PCAPIndexEntry_T& a, const PCAPIndexEntry_T& b) -> bool {
+                            return a.timestamp_us < b.timestamp_us;
+                        })) {
+        m_entries.clear();
+        goto Exit;
+    }
+
+    m_fileSize = hdr.file_size;
+    m_mtime = hdr.mtime;
+    m_recordCount = hdr.record_count;
+    m_firstTimestamp = hdr.first_timestamp_us;
+    m_lastTimestamp = hdr.last_timestamp_us;
+    retValue = true;
+
+Exit:
+    fclose(fp);
+    return retValue;
+}
+
+bool PCAPIndex::save (void) {
+    PCAPIndexHeader_T hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = PCAP_INDEX_MAGIC;
+    hdr.version = PCAP_INDEX_VERSION;
+    hdr.file_size = m_fileSize;
+    hdr.mtime = m_mtime;
+    hdr.record_count = m_recordCount;
+    hdr.first_timestamp_us = m_firstTimestamp;
+    hdr.last_timestamp_us = m_lastTimestamp;
+    hdr.entry_count = m_entries.size();
+
+    //Write to a temporary file first so that concurrent readers never
+    //see a partially written index.
+    std::string sPath = GetIndexPath(m_sPcapFile);
+    std::string sTemp = sPath + ".tmp";
+    FILE* fp = fopen(sTemp.c_str(), "wb");
+    if (!fp) {
+        PrintSimpleLogMessage(LEVEL_DEBUG, "Unable to write index %s", sPath.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr) &&
+              fwrite(m_entries.data(), sizeof(PCAPIndexEntry_T), m_entries.size(), fp) == m_entries.size();
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(sTemp.c_str(), sPath.c_str()) != 0) {
+        remove(sTemp.c_str());
+        PrintSimpleLogMessage(LEVEL_DEBUG, "Unable to write index %s", sPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void PCAPIndex::reset (void) {
+    m_fileSize = 0;
+    m_mtime = 0;
+    stat_capture(m_fileSize, m_mtime);
+
+    m_recordCount = 0;
+    m_firstTimestamp = 0;
+    m_lastTimestamp = 0;
+    m_nextEntryTimestamp = 0;
+    m_entries.clear();
+}
+
+void PCAPIndex::add_record (uint64_t timestamp_us, uint64_t offset) {
+    if (m_recordCount == 0) {
+        m_firstTimestamp = timestamp_us;
+    }
+    m_firstTimestamp = std::min(m_firstTimestamp, timestamp_us);
+    m_lastTimestamp = std::max(m_lastTimestamp, timestamp_us);
+    m_recordCount++;
+
+    if (m_entries.empty() || timestamp_us >= m_nextEntryTimestamp) {
+        PCAPIndexEntry_T entry;
+        entry.timestamp_us = timestamp_us;
+        entry.offset = offset;
+        m_entries.push_back(entry);
+
+        m_nextEntryTimestamp = timestamp_us + PCAP_INDEX_INTERVAL_US;
+    }
+}
+
+uint64_t PCAPIndex::find_offset (uint64_t timestamp_us) {
+    if (m_entries.empty()) {
+        return PCAP_GLOBAL_HEADER_SIZE;
+    }
+
+    //Start early enough to catch records written out of order
+    timestamp_us = (timestamp_us > PCAP_INDEX_REORDER_US) ? timestamp_us - PCAP_INDEX_REORDER_US : 0;
+
+    auto iter = std::upper_bound(
+        m_entries.begin(), m_entries.end(), timestamp_us,
+        [](uint64_t ts, const PCAPIndexEntry_T& e) -> bool {
+            return ts < e.timestamp_us;
+        });
+
+    if (iter == m_entries.begin()) {
+        return m_entries.front().offset;
+    }
+
+    return (iter - 1)->offset;
+}
+
+bool PCAPIndex::overlaps (uint64_t start_us, uint64_t stop_us) {
+    if (m_recordCount == 0) {
+        return false;
+    }
+    if (stop_us != 0 && m_firstTimestamp > stop_us) {
+        return false;
+    }
+    return m_lastTimestamp >= start_us;
+}
+
+uint64_t PCAPIndex::first_timestamp (void) {
+    return m_firstTimestamp;
+}
+
+uint64_t PCAPIndex::last_timestamp (void) {
+    return m_lastTimestamp;
+}
+
+uint64_t PCAPIndex::record_count (void) {
+    return m_recordCount;
+}
+
+size_t PCAPIndex::size (void) {
+    return m_entries.size();
+}
+
+bool PCAPIndex::Build (std::string sPcapFile) {
+    PCAPIndex index(sPcapFile);
+    PCAPReader reader(sPcapFile);
+    PCAPRecord_T rec;
+
+    if (!reader.open()) {
+        PrintSimpleLogMessage(LEVEL_WARNING, "Unable to index %s (not a pcap file)", sPcapFile.c_str());
+        return false;
+    }
+
+    index.reset();
+    while (reader.next(rec)) {
+        index.add_record(rec.timestamp_s * 1000000 + rec.timestamp_us, rec.offset);
+    }
+
+    PrintSimpleLogMessage(LEVEL_DEBUG, "Indexed %s: %llu records, %llu entries",
+                          sPcapFile.c_str(), index.record_count(), index.size());
+
+    return index.save();
+}
+
+//=============================================================================
@@ -0,0 +1,130 @@
+/**@file PCAPIndex.h
+ */
+#ifndef PCAP_INDEX_H_
+#define PCAP_INDEX_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define PCAP_INDEX_MAGIC        (0x58444950) //"PIDX"
+#define PCAP_INDEX_VERSION      (1)
+#define PCAP_INDEX_SUFFIX       ".idx"
+#define PCAP_INDEX_INTERVAL_US  (1000000)
+//How far record timestamps may run backwards in a capture (e.g. one
+//written from several interfaces or capture threads) and still be
+//found by a time window read
+#define PCAP_INDEX_REORDER_US   (1000000)
+
+/**
+ * One sparse index entry: the timestamp of the record stored at a
+ * byte offset.
+ */
+typedef struct {
+    uint64_t timestamp_us;
+    uint64_t offset;
+} PCAPIndexEntry_T;
+
+/**
+ * Sparse timestamp to byte offset table stored next to a capture
+ * file as <file>.idx.
+ *
+ * An entry is added for the first record and then for the first
+ * record of every PCAP_INDEX_INTERVAL_US of capture time. The index
+ * records the size and mtime of the capture file it was built from
+ * and is ignored once either changes.
+ *
+ * Entry timestamps always increase, but the records between them
+ * needn't be in order. Lookups assume no record is more than
+ * PCAP_INDEX_REORDER_US older than one before it in the file.
+ */
+class PCAPIndex {
+public:
+    PCAPIndex (std::string sPcapFile);
+    virtual ~PCAPIndex (void);
+
+    /**
+     * Loads the sidecar index.
+     *
+     * @return bool true if a valid, up-to-date index was loaded.
+     */
+    virtual bool load (void);
+
+    /**
+     * Writes the sidecar index.
+     *
+     * @return bool true on success, false on failure.
+     */
+    virtual bool save (void);
+
+    /**
+     * Clears the index in preparation for a rebuild against the
+     * current size/mtime of the capture file.
+     */
+    virtual void reset (void);
+
+    /**
+     * Adds a record while building the index. Records must be passed
+     * in file order.
+     *
+     * @param timestamp_us Record timestamp (microseconds).
+     * @param offset Record byte offset.
+     */
+    virtual void add_record (uint64_t timestamp_us, uint64_t offset);
+
+    /**
+     * Returns the offset of the last indexed record at or before
+     * PCAP_INDEX_REORDER_US ahead of the given time, which is where a
+     * reader should start to see every record at or after that time.
+     *
+     * @param timestamp_us Search time (microseconds).
+     * @return uint64_t Byte offset.
+     */
+    virtual uint64_t find_offset (uint64_t timestamp_us);
+
+    /**
+     * Determines if the capture overlaps [start_us, stop_us]. A
+     * stop_us of zero means unbounded.
+     */
+    virtual bool overlaps (uint64_t start_us, uint64_t stop_us);
+
+    virtual uint64_t first_timestamp (void);
+    virtual uint64_t last_timestamp (void);
+    virtual uint64_t record_count (void);
+    virtual size_t size (void);
+
+public:
+    /**
+     * Builds and saves the index for a capture file.
+     *
+     * @param sPcapFile Capture file path.
+     * @return bool true on success, false on failure.
+     */
+    static bool Build (std::string sPcapFile);
+
+    static std::string GetIndexPath (std::string sPcapFile);
+
+protected:
+    /**
+     * Retrieves the size and mtime of the capture file.
+     */
+    virtual bool stat_capture (uint64_t& fileSize, uint64_t& mtime);
+
+protected:
+    std::string m_sPcapFile;
+    uint64_t m_fileSize;
+    uint64_t m_mtime;
+    uint64_t m_recordCount;
+    uint64_t m_firstTimestamp;
+    uint64_t m_lastTimestamp;
+    uint64_t m_nextEntryTimestamp;
+    std::vector<PCAPIndexEntry_T> m_entries;
+};
+
+//=============================================================================
+#endif //PCAP_INDEX_H_
@@ -0,0 +1,408 @@
+/**@file PCAPReader.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "PCAPReader.h"
+#include "Logging.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <algorithm>
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+PCAPReader::PCAPReader (std::string sFile, IOBackendType_T backend)
+  : m_sFile(sFile),
+    m_backendType(backend),
+    m_backend(nullptr),
+    m_chunk(NULL),
+    m_chunkLen(0),
+    m_chunkPos(0),
+    m_spill(),
+    m_offset(0),
+    m_swapped(false),
+    m_nanosecond(false),
+    m_linkType(0),
+    m_snaplen(0),
+    m_decodeLimit(0),
+    m_decap()
+{
+}
+
+PCAPReader::~PCAPReader (void)
+{
+    close();
+}
+
+uint32_t PCAPReader::swap32 (uint32_t v) {
+    return m_swapped ? __builtin_bswap32(v) : v;
+}
+
+uint16_t PCAPReader::swap16 (uint16_t v) {
+    return m_swapped ? __builtin_bswap16(v) : v;
+}
+
+bool PCAPReader::take (size_t len, const uint8_t** ppData) {
+    size_t avail = m_chunkLen - m_chunkPos;
+
+    if (avail >= len) {
+        *ppData = m_chunk + m_chunkPos;
+        m_chunkPos += len;
+        return true;
+    }
+
+    //Straddles two chunks, copy it out
+    if (m_spill.size() < len) {
+        m_spill.resize(len);
+    }
+    if (avail > 0) {
+        memcpy(m_spill.data(), m_chunk + m_chunkPos, avail);
+    }
+    m_chunkPos = m_chunkLen;
+
+    size_t have = avail;
+    while (have < len) {
+        ssize_t count = m_backend->next_chunk(&m_chunk);
+        if (count <= 0) {
+            m_chunk = NULL;
+            m_chunkLen = 0;
+            m_chunkPos = 0;
+            return false;
+        }
+
+        size_t copy = std::min(len - have, (size_t)count);
+        memcpy(m_spill.data() + have, m_chunk, copy);
+        have += copy;
+
+        m_chunkLen = count;
+        m_chunkPos = copy;
+    }
+
+    *ppData = m_spill.data();
+    return true;
+}
+
+bool PCAPReader::open (void) {
+    const uint8_t* hdr = NULL;
+    uint32_t magic = 0;
+    uint16_t major = 0;
+
+    m_backend = IOBackend::Open(m_sFile, m_backendType);
+    if (m_backend == nullptr) {
+        return false;
+    }
+
+    m_chunk = NULL;
+    m_chunkLen = 0;
+    m_chunkPos = 0;
+
+    if (!take(PCAP_GLOBAL_HEADER_SIZE, &hdr)) {
+        goto ErrorExit;
+    }
+
+    memcpy(&magic, hdr, 4);
+    switch (magic) {
+    case PCAP_MAGIC_US:         m_swapped = false; m_nanosecond = false; break;
+    case PCAP_MAGIC_NS:         m_swapped = false; m_nanosecond = true;  break;
+    case PCAP_MAGIC_US_SWAPPED: m_swapped = true;  m_nanosecond = false; break;
+    case PCAP_MAGIC_NS_SWAPPED: m_swapped = true;  m_nanosecond = true;  break;
+    default:
+        goto ErrorExit;
+    }
+
+    memcpy(&major, hdr + 4, 2);
+    if (swap16(major) != 2) {
+        goto ErrorExit;
+    }
+
+    memcpy(&m_snaplen, hdr + 16, 4);
+    memcpy(&m_linkType, hdr + 20, 4);
+    m_snaplen = swap32(m_snaplen);
+    m_linkType = swap32(m_linkType) & 0x0FFFFFFF;
+
+    m_offset = PCAP_GLOBAL_HEADER_SIZE;
+    return true;
+
+ErrorExit:
+    close();
+    return false;
+}
+
+void PCAPReader::close (void) {
+    m_backend = nullptr;
+    m_chunk = NULL;
+    m_chunkLen = 0;
+    m_chunkPos = 0;
+}
+
+bool PCAPReader::seek (uint64_t offset) {
+    if (m_backend == nullptr || offset < PCAP_GLOBAL_HEADER_SIZE) {
+        return false;
+    }
+    if (!m_backend->seek(offset)) {
+        return false;
+    }
+    m_chunk = NULL;
+    m_chunkLen = 0;
+    m_chunkPos = 0;
+    m_offset = offset;
+    return true;
+}
+
+uint64_t PCAPReader::tell (void) {
+    return m_offset;
+}
+
+bool PCAPReader::next (PCAPRecord_T& rec) {
+    const uint8_t* pHdr = NULL;
+    uint32_t hdr[4];
+
+    if (m_backend == nullptr) {
+        return false;
+    }
+
+    if (!take(PCAP_RECORD_HEADER_SIZE, &pHdr)) {
+        goto ShortRead;
+    }
+
+    memcpy(hdr, pHdr, sizeof(hdr));
+    rec.offset = m_offset;
+    rec.timestamp_s = swap32(hdr[0]);
+    rec.timestamp_us = swap32(hdr[1]);
+    rec.caplen = swap32(hdr[2]);
+    rec.origlen = swap32(hdr[3]);
+
+    if (m_nanosecond) {
+        rec.timestamp_us /= 1000;
+    }
+
+    if (rec.caplen > PCAP_MAX_RECORD_SIZE) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Corrupt record at offset %llu in %s",
+                              m_offset, m_sFile.c_str());
+        return false;
+    }
+
+    if (!take(rec.caplen, &rec.data)) {
+        goto ShortRead;
+    }
+
+    m_offset += PCAP_RECORD_HEADER_SIZE + rec.caplen;
+    return true;
+
+ShortRead:
+    //The writer hasn't finished this record yet, so start over at its
+    //header on the next call.
+    seek(m_offset);
+    return false;
+}
+
+bool PCAPReader::decode (const PCAPRecord_T& rec, Packet& packet) {
+    PDU* pdu = NULL;
+    struct timeval tv;
+
+    //Encapsulation is peeled from the whole record so that layers()
+    //covers every captured byte for the payload analyzers. Only what
+    //libtins parses is cut to the decode limit.
+    uint32_t len = rec.caplen;
+    uint32_t pduLen = limit(len);
+
+    tv.tv_sec = rec.timestamp_s;
+    tv.tv_usec = rec.timestamp_us;
+
+    m_decap.layers = DECAP_NONE;
+    m_decap.vlan = 0;
+    m_decap.l3_type = 0;
+
+    try {
+        switch (m_linkType) {
+        case PCAP_LINKTYPE_ETHERNET:
+            if (decap(rec.data, len, ETHERNET_HEADER_SIZE, 12)) {
+                pdu = decap_pdu(rec.data, len);
+            } else {
+                pdu = new EthernetII(rec.data, pduLen);
+            }
+            break;
+        case PCAP_LINKTYPE_LINUX_SLL:
+            if (decap(rec.data, len, SLL_HEADER_SIZE, 14)) {
+                pdu = decap_pdu(rec.data, len);
+            } else {
+                pdu = new SLL(rec.data, pduLen);
+            }
+            break;
+        case PCAP_LINKTYPE_NULL:
+            locate_ip(rec.data, len, 4);
+            pdu = new Loopback(rec.data, pduLen);
+            break;
+        case PCAP_LINKTYPE_RAW:
+            locate_ip(rec.data, len, 0);
+            if (len > 0 && (rec.data[0] >> 4) == 6) {
+                pdu = new IPv6(rec.data, pduLen);
+            } else {
+                pdu = new IP(rec.data, pduLen);
+            }
+            break;
+        default:
+            return false;
+        }
+    } catch (std::exception& e) {
+        //Malformed packet
+        return false;
+    }
+
+    packet = Packet(pdu, Timestamp(tv), Packet::own_pdu());
+    return true;
+}
+
+bool PCAPReader::decap (const uint8_t* pData, uint32_t len, uint32_t hdrLen, uint32_t typeOffset) {
+    if (len < hdrLen) {
+        return false;
+    }
+
+    //Untagged IP is left to libtins unless it carries a tunnel
+    uint16_t type = ((uint16_t)pData[typeOffset] << 8) | pData[typeOffset + 1];
+    if (type == ETHERTYPE_IPV4 || type == ETHERTYPE_IPV6) {
+        uint32_t protoOffset = hdrLen + ((type == ETHERTYPE_IPV4) ? 9 : 6);
+        if (len <= protoOffset || !Decapsulator::IsTunnel(pData[protoOffset])) {
+            locate_ip(pData, len, hdrLen);
+            return false;
+        }
+    }
+
+    if (!Decapsulator::Decap(pData, len, hdrLen, type, m_decap)) {
+        m_decap.layers = DECAP_NONE;
+        m_decap.vlan = 0;
+        m_decap.l3_type = 0;
+        return false;
+    }
+
+    //A tunnel that can't be followed leaves nothing peeled, but the
+    //outer IP header found is still valid
+    if (m_decap.layers == DECAP_NONE) {
+        m_decap.vlan = 0;
+        return false;
+    }
+    return true;
+}
+
+void PCAPReader::locate_ip (const uint8_t* pData, uint32_t len, uint32_t offset) {
+    if (offset >= len) {
+        return;
+    }
+
+    switch (pData[offset] >> 4) {
+    case 4:
+        m_decap.l3_type = ETHERTYPE_IPV4;
+        break;
+    case 6:
+        m_decap.l3_type = ETHERTYPE_IPV6;
+        break;
+    default:
+        return;
+    }
+    m_decap.l3_offset = offset;
+    m_decap.l3_len = len - offset;
+}
+
+PDU* PCAPReader::decap_pdu (const uint8_t* pData, uint32_t len) {
+    const uint8_t* pInner = pData + m_decap.l3_offset;
+    uint32_t innerLen = limit(len - m_decap.l3_offset);
+
+    if (m_decap.l3_type == ETHERTYPE_IPV6) {
+        return new IPv6(pInner, innerLen);
+    }
+    return new IP(pInner, innerLen);
+}
+
+const DecapInfo_T& PCAPReader::layers (void) {
+    return m_decap;
+}
+
+void PCAPReader::set_decode_limit (uint32_t len) {
+    m_decodeLimit = len;
+}
+
+uint32_t PCAPReader::limit (uint32_t len) {
+    if (m_decodeLimit != 0 && len > m_decodeLimit) {
+        return m_decodeLimit;
+    }
+    return len;
+}
+
+uint32_t PCAPReader::link_type (void) {
+    return m_linkType;
+}
+
+bool PCAPReader::set_link_type (uint32_t linkType) {
+    switch (linkType) {
+    case PCAP_LINKTYPE_NULL:
+    case PCAP_LINKTYPE_ETHERNET:
+    case PCAP_LINKTYPE_RAW:
+    case PCAP_LINKTYPE_LINUX_SLL:
+        m_linkType = linkType;
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint32_t PCAPReader::snaplen (void) {
+    return m_snaplen;
+}
+
+const std::string& PCAPReader::file_name (void) {
+    return m_sFile;
+}
+
+const char* PCAPReader::backend_name (void) {
+    return m_backend ? m_backend->name() : "none";
+}
+
+bool PCAPReader::ReadFirstTimestamp (std::string sFile, uint64_t& timestamp_us) {
+    uint8_t hdr[PCAP_GLOBAL_HEADER_SIZE + PCAP_RECORD_HEADER_SIZE];
+    uint32_t magic = 0;
+    uint32_t seconds = 0;
+    uint32_t partial = 0;
+
+    int fd = ::open(sFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    ssize_t len = pread(fd, hdr, sizeof(hdr), 0);
+    ::close(fd);
+
+    if (len != (ssize_t)sizeof(hdr)) {
+        return false;
+    }
+
+    memcpy(&magic, hdr, 4);
+    memcpy(&seconds, hdr + PCAP_GLOBAL_HEADER_SIZE, 4);
+    memcpy(&partial, hdr + PCAP_GLOBAL_HEADER_SIZE + 4, 4);
+
+    if (magic == PCAP_MAGIC_US_SWAPPED || magic == PCAP_MAGIC_NS_SWAPPED) {
+        seconds = __builtin_bswap32(seconds);
+        partial = __builtin_bswap32(partial);
+    }
+
+    switch (magic) {
+    case PCAP_MAGIC_US:
+    case PCAP_MAGIC_US_SWAPPED:
+        break;
+    case PCAP_MAGIC_NS:
+    case PCAP_MAGIC_NS_SWAPPED:
+        partial /= 1000;
+        break;
+    default:
+        return false;
+    }
+
+    timestamp_us = (uint64_t)seconds * 1000000 + partial;
+    return true;
+}
+
+//=============================================================================
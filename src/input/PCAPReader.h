@@ -0,0 +1,210 @@
+/**@file PCAPReader.h
+ */
+#ifndef PCAP_READER_H_
+#define PCAP_READER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#define TINS_IS_CXX11 1
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <tins/tins.h>
+#include "IOBackend.h"
+#include "Decapsulator.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+using namespace Tins;
+
+#define PCAP_MAGIC_US           (0xa1b2c3d4)
+#define PCAP_MAGIC_NS           (0xa1b23c4d)
+#define PCAP_MAGIC_US_SWAPPED   (0xd4c3b2a1)
+#define PCAP_MAGIC_NS_SWAPPED   (0x4d3cb2a1)
+#define PCAP_GLOBAL_HEADER_SIZE (24)
+#define PCAP_RECORD_HEADER_SIZE (16)
+#define PCAP_MAX_RECORD_SIZE    (256 * 1024)
+
+#define PCAP_LINKTYPE_NULL      (0)
+#define PCAP_LINKTYPE_ETHERNET  (1)
+#define PCAP_LINKTYPE_RAW       (101)
+#define PCAP_LINKTYPE_LINUX_SLL (113)
+
+/**
+ * A single record read from a capture file. The data pointer refers
+ * to the reader's buffer and is only valid until the next call to
+ * next().
+ */
+typedef struct {
+    uint64_t offset;
+    uint64_t timestamp_s;
+    uint64_t timestamp_us;
+    uint32_t caplen;
+    uint32_t origlen;
+    const uint8_t* data;
+} PCAPRecord_T;
+
+/**
+ * Minimal reader for classic (libpcap) capture files.
+ *
+ * Unlike Tins::FileSniffer this reader exposes the byte offset of
+ * every record and can seek to a record boundary, which is what the
+ * sidecar index and incremental processing rely on. Files in other
+ * formats (e.g. pcapng) fail to open() and should be handed to
+ * FileSniffer instead.
+ *
+ * The file is read in large chunks through an IOBackend and records
+ * are handed out in place, only a record straddling two chunks is
+ * copied.
+ */
+class PCAPReader {
+public:
+    PCAPReader (std::string sFile, IOBackendType_T backend = IO_BACKEND_PREAD);
+    virtual ~PCAPReader (void);
+
+    /**
+     * Opens the file and parses the global header.
+     *
+     * @return bool true on success, false if the file is missing or
+     *         is not a classic pcap file.
+     */
+    virtual bool open (void);
+
+    virtual void close (void);
+
+    /**
+     * Seeks to a record boundary previously returned in
+     * PCAPRecord_T::offset (or PCAP_GLOBAL_HEADER_SIZE).
+     *
+     * @param offset Byte offset of a record header.
+     * @return bool true on success, false on failure.
+     */
+    virtual bool seek (uint64_t offset);
+
+    /**
+     * Byte offset of the next record to be read.
+     */
+    virtual uint64_t tell (void);
+
+    /**
+     * Reads the next record.
+     *
+     * @param rec Populated with the record.
+     * @return bool true if a complete record was read, false at the
+     *         end of the file (or at a truncated trailing record).
+     */
+    virtual bool next (PCAPRecord_T& rec);
+
+    /**
+     * Decodes a record into a packet based on the link type.
+     *
+     * VLAN tags, MPLS labels and GRE or IP in IP tunnels in front of
+     * the IP header are peeled off, the packet then starts at the
+     * innermost IP header and layers() describes what was removed.
+     *
+     * @param rec Record returned by next().
+     * @param packet Populated with the decoded packet.
+     * @return bool true on success, false on unsupported link types
+     *         or malformed packets.
+     */
+    virtual bool decode (const PCAPRecord_T& rec, Packet& packet);
+
+    /**
+     * Limits how many bytes of each record decode() hands to libtins,
+     * so that only the headers are parsed and payloads are never
+     * copied. For tunnelled packets the limit counts from the inner IP
+     * header. layers() still covers the whole captured record, so
+     * payload analyzers given rec.data see every captured byte.
+     *
+     * @param len Maximum bytes per packet (0 decodes whole records).
+     */
+    virtual void set_decode_limit (uint32_t len);
+
+    /**
+     * Encapsulation removed by the last call to decode(). Only layers,
+     * vlan and the l3_* fields are valid when nothing was removed, and
+     * l3_type is 0 if no IP header was found.
+     */
+    virtual const DecapInfo_T& layers (void);
+
+    virtual uint32_t link_type (void);
+
+    /**
+     * Sets the link type decode() assumes, for records that were read
+     * by other means (e.g. from a pcapng file through libpcap).
+     *
+     * @param linkType PCAP_LINKTYPE_* value.
+     * @return bool false if decode() can't handle the link type.
+     */
+    virtual bool set_link_type (uint32_t linkType);
+    virtual uint32_t snaplen (void);
+    virtual const std::string& file_name (void);
+    virtual const char* backend_name (void);
+
+    /**
+     * Reads the timestamp of the first record without buffering the
+     * rest of the file.
+     *
+     * @param sFile Capture file path.
+     * @param timestamp_us Populated with the timestamp (microseconds).
+     * @return bool false if the file is not a classic pcap file or
+     *         contains no records.
+     */
+    static bool ReadFirstTimestamp (std::string sFile, uint64_t& timestamp_us);
+
+protected:
+    uint32_t swap32 (uint32_t v);
+    uint16_t swap16 (uint16_t v);
+
+    /**
+     * Consumes len contiguous bytes.
+     *
+     * @param len Number of bytes.
+     * @param ppData Populated with a pointer to the bytes.
+     * @return bool false if the file ends first.
+     */
+    bool take (size_t len, const uint8_t** ppData);
+
+    /**
+     * Peels the headers between the link layer and the IP header.
+     *
+     * @param hdrLen Link layer header length.
+     * @param typeOffset Offset of the link layer's ethertype.
+     * @return bool true if the packet was encapsulated and m_decap
+     *         points at the inner IP header.
+     */
+    bool decap (const uint8_t* pData, uint32_t len, uint32_t hdrLen, uint32_t typeOffset);
+    PDU* decap_pdu (const uint8_t* pData, uint32_t len);
+
+    /**
+     * Applies the decode limit to a length.
+     */
+    uint32_t limit (uint32_t len);
+
+    /**
+     * Points m_decap at an IP header that needed no peeling.
+     */
+    void locate_ip (const uint8_t* pData, uint32_t len, uint32_t offset);
+
+protected:
+    std::string m_sFile;
+    IOBackendType_T m_backendType;
+    std::unique_ptr<IOBackend> m_backend;
+    const uint8_t* m_chunk;
+    size_t m_chunkLen;
+    size_t m_chunkPos;
+    std::vector<uint8_t> m_spill;
+    uint64_t m_offset;
+    bool m_swapped;
+    bool m_nanosecond;
+    uint32_t m_linkType;
+    uint32_t m_snaplen;
+    uint32_t m_decodeLimit;
+    DecapInfo_T m_decap;
+};
+
+//=============================================================================
+#endif //PCAP_READER_H_
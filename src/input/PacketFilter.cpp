@@ -0,0 +1,70 @@
+/**@file PacketFilter.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "PacketFilter.h"
+#include "Logging.h"
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+PacketFilter::PacketFilter (std::string sExpression)
+  : m_sExpression(sExpression),
+    m_programs(),
+    m_pProgram(NULL),
+    m_lastLinkType(0xFFFFFFFF),
+    m_accepted(0),
+    m_rejected(0)
+{
+}
+
+PacketFilter::~PacketFilter (void)
+{
+    for (auto& program : m_programs) {
+        pcap_freecode(&program.second);
+    }
+}
+
+bool PacketFilter::compile (uint32_t linkType) {
+    struct bpf_program program;
+
+    if (m_programs.find(linkType) != m_programs.end()) {
+        return true;
+    }
+
+    pcap_t* pHandle = pcap_open_dead(linkType, FILTER_SNAPLEN);
+    if (!pHandle) {
+        return false;
+    }
+
+    if (pcap_compile(pHandle, &program, m_sExpression.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Invalid filter \"%s\" for link type %u: %s",
+                              m_sExpression.c_str(), linkType, pcap_geterr(pHandle));
+        pcap_close(pHandle);
+        return false;
+    }
+
+    pcap_close(pHandle);
+    m_programs[linkType] = program;
+    return true;
+}
+
+void PacketFilter::select (uint32_t linkType) {
+    m_lastLinkType = linkType;
+    m_pProgram = compile(linkType) ? &m_programs[linkType] : NULL;
+}
+
+const std::string& PacketFilter::expression (void) {
+    return m_sExpression;
+}
+
+uint64_t PacketFilter::get_accepted (void) {
+    return m_accepted;
+}
+
+uint64_t PacketFilter::get_rejected (void) {
+    return m_rejected;
+}
+
+//=============================================================================
@@ -0,0 +1,78 @@
+/**@file PacketFilter.h
+ */
+#ifndef PACKET_FILTER_H_
+#define PACKET_FILTER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <pcap.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define FILTER_SNAPLEN  (262144)
+
+/**
+ * tcpdump style filter evaluated on raw record bytes before decoding.
+ *
+ * The expression is compiled to classic BPF with pcap_compile() once
+ * per link type and run with bpf_filter(), so rejected packets never
+ * reach the decoder or the trackers.
+ */
+class PacketFilter {
+public:
+    PacketFilter (std::string sExpression);
+    virtual ~PacketFilter (void);
+
+    /**
+     * Compiles the expression for a link type (cached).
+     *
+     * @param linkType Link type of the capture file.
+     * @return bool false if the expression is invalid for the link type.
+     */
+    virtual bool compile (uint32_t linkType);
+
+    /**
+     * Runs the filter on a record.
+     *
+     * @param linkType Link type the record was captured with.
+     * @param pData Record bytes.
+     * @param caplen Number of bytes captured.
+     * @param origlen Length of the packet on the wire.
+     * @return bool true if the packet should be processed.
+     */
+    inline bool match (uint32_t linkType, const uint8_t* pData, uint32_t caplen, uint32_t origlen) {
+        if (linkType != m_lastLinkType) {
+            select(linkType);
+        }
+        //Packets of a link type the expression can't be compiled for
+        //are rejected.
+        if (!m_pProgram || bpf_filter(m_pProgram->bf_insns, pData, origlen, caplen) == 0) {
+            m_rejected++;
+            return false;
+        }
+        m_accepted++;
+        return true;
+    }
+
+    virtual const std::string& expression (void);
+    virtual uint64_t get_accepted (void);
+    virtual uint64_t get_rejected (void);
+
+protected:
+    void select (uint32_t linkType);
+
+protected:
+    std::string m_sExpression;
+    std::map<uint32_t, struct bpf_program> m_programs;
+    struct bpf_program* m_pProgram;
+    uint32_t m_lastLinkType;
+    uint64_t m_accepted;
+    uint64_t m_rejected;
+};
+
+//=============================================================================
+#endif //PACKET_FILTER_H_
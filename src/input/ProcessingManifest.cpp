@@ -0,0 +1,160 @@
+/**@file ProcessingManifest.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ProcessingManifest.h"
+#include "Logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+ProcessingManifest::ProcessingManifest (std::string sPath)
+  : m_sPath(sPath),
+    m_entries()
+{
+}
+
+ProcessingManifest::~ProcessingManifest (void)
+{
+}
+
+bool ProcessingManifest::load (void) {
+    char line[4096];
+
+    FILE* fp = fopen(m_sPath.c_str(), "r");
+    if (!fp) {
+        return false;
+    }
+
+    m_entries.clear();
+    while (fgets(line, sizeof(line), fp)) {
+        ManifestEntry_T entry;
+        char* fields[5];
+        size_t count = 0;
+        char* pSave = NULL;
+
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+
+        for (char* p = strtok_r(line, "\t", &pSave);
+             p != NULL && count < 5;
+             p = strtok_r(NULL, "\t", &pSave)) {
+            fields[count++] = p;
+        }
+
+        //v1 lines have no inode
+        if (count != 4 && count != 5) {
+            PrintSimpleLogMessage(LEVEL_WARNING, "Ignoring malformed manifest line in %s", m_sPath.c_str());
+            continue;
+        }
+
+        entry.size = strtoull(fields[1], NULL, 10);
+        entry.mtime = strtoull(fields[2], NULL, 10);
+        entry.offset = strtoull(fields[3], NULL, 10);
+        entry.inode = count == 5 ? strtoull(fields[4], NULL, 10) : 0;
+        m_entries[fields[0]] = entry;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+bool ProcessingManifest::save (void) {
+    std::string sTemp = m_sPath + ".tmp";
+
+    FILE* fp = fopen(sTemp.c_str(), "w");
+    if (!fp) {
+        PrintSimpleLogMessage(LEVEL_ERROR, "Unable to write manifest %s", m_sPath.c_str());
+        return false;
+    }
+
+    fprintf(fp, "%s\n", MANIFEST_HEADER);
+    for (auto& e : m_entries) {
+        fprintf(fp, "%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n",
+                e.first.c_str(), e.second.size, e.second.mtime, e.second.offset,
+                e.second.inode);
+    }
+
+    if (fclose(fp) != 0 || rename(sTemp.c_str(), m_sPath.c_str()) != 0) {
+        remove(sTemp.c_str());
+        PrintSimpleLogMessage(LEVEL_ERROR, "Unable to write manifest %s", m_sPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+ManifestAction_T ProcessingManifest::check (std::string sFile, uint64_t& offset) {
+    struct stat fs;
+
+    offset = 0;
+
+    auto iter = m_entries.find(sFile);
+    if (iter == m_entries.end() || stat(sFile.c_str(), &fs) == -1) {
+        return MANIFEST_PROCESS_ALL;
+    }
+
+    const ManifestEntry_T& entry = iter->second;
+    uint64_t size = fs.st_size;
+    uint64_t mtime = fs.st_mtime;
+
+    if (entry.inode != 0 && entry.inode != (uint64_t)fs.st_ino) {
+        //Replaced by a different file (e.g. rotated or renamed over)
+        return MANIFEST_PROCESS_ALL;
+    }
+
+    if (size < entry.offset) {
+        //Smaller than what was already read, so the file was replaced
+        return MANIFEST_PROCESS_ALL;
+    }
+
+    //Appending always grows the file, so a modification that didn't
+    //(or an older mtime) means the contents were rewritten.
+    if (mtime < entry.mtime || (mtime != entry.mtime && size <= entry.size)) {
+        return MANIFEST_PROCESS_ALL;
+    }
+
+    if (size == entry.offset) {
+        return MANIFEST_SKIP;
+    }
+
+    offset = entry.offset;
+    return MANIFEST_PROCESS_TAIL;
+}
+
+void ProcessingManifest::update (std::string sFile, uint64_t offset) {
+    struct stat fs;
+    ManifestEntry_T entry;
+
+    entry.size = 0;
+    entry.mtime = 0;
+    entry.offset = offset;
+    entry.inode = 0;
+
+    if (stat(sFile.c_str(), &fs) != -1) {
+        entry.size = fs.st_size;
+        entry.mtime = fs.st_mtime;
+        entry.inode = fs.st_ino;
+    }
+
+    m_entries[sFile] = entry;
+}
+
+std::string ProcessingManifest::state_path (void) {
+    return m_sPath + MANIFEST_STATE_SUFFIX;
+}
+
+size_t ProcessingManifest::size (void) {
+    return m_entries.size();
+}
+
+//=============================================================================
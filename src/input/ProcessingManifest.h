@@ -0,0 +1,101 @@
+/**@file ProcessingManifest.h
+ */
+#ifndef PROCESSING_MANIFEST_H_
+#define PROCESSING_MANIFEST_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <string>
+#include <map>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define MANIFEST_HEADER         "# pcap_analyzer manifest v2"
+#define MANIFEST_STATE_SUFFIX   ".state"
+
+/**
+ * Describes how far a capture file has been processed.
+ */
+typedef struct {
+    uint64_t size;
+    uint64_t mtime;
+    uint64_t offset;
+    uint64_t inode;         //0 for entries written by v1 manifests
+} ManifestEntry_T;
+
+/**
+ * What needs to happen to a capture file on this run.
+ */
+typedef enum {
+    MANIFEST_PROCESS_ALL    = 0,
+    MANIFEST_PROCESS_TAIL   = 1,
+    MANIFEST_SKIP           = 2
+} ManifestAction_T;
+
+/**
+ * Persistent record of every capture file processed by previous
+ * runs. The manifest is a text file with one tab separated line per
+ * file (path, size, mtime, offset of the next unread record, inode).
+ *
+ * The open-flow snapshot taken at the end of a run is stored next to
+ * the manifest as <manifest>.state.
+ */
+class ProcessingManifest {
+public:
+    ProcessingManifest (std::string sPath);
+    virtual ~ProcessingManifest (void);
+
+    /**
+     * Loads the manifest.
+     *
+     * @return bool true if a manifest was loaded, false if none exists.
+     */
+    virtual bool load (void);
+
+    /**
+     * Writes the manifest (atomically replacing the previous one).
+     *
+     * @return bool true on success, false on failure.
+     */
+    virtual bool save (void);
+
+    /**
+     * Decides how a capture file should be processed.
+     *
+     * - New files, and files that were replaced, are processed from
+     *   the start. A file counts as replaced if its inode changed, it
+     *   shrank below the recorded offset, its mtime went backwards, or
+     *   its mtime changed without the file growing.
+     * - Files that grew are processed from the recorded offset.
+     * - Files that are unchanged are skipped.
+     *
+     * @param sFile Capture file path.
+     * @param offset Populated with the offset to start reading at.
+     * @return ManifestAction_T Action.
+     */
+    virtual ManifestAction_T check (std::string sFile, uint64_t& offset);
+
+    /**
+     * Records that a capture file has been processed up to offset.
+     *
+     * @param sFile Capture file path.
+     * @param offset Offset of the next unread record.
+     */
+    virtual void update (std::string sFile, uint64_t offset);
+
+    /**
+     * Path of the tracker state snapshot that belongs to this manifest.
+     */
+    virtual std::string state_path (void);
+
+    virtual size_t size (void);
+
+protected:
+    std::string m_sPath;
+    std::map<std::string, ManifestEntry_T> m_entries;
+};
+
+//=============================================================================
+#endif //PROCESSING_MANIFEST_H_
@@ -0,0 +1,631 @@
+/**@file ColumnarFlowFile.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ColumnarFlowFile.h"
+#include "PacketConnectionTracker.h"
+#include "Logging.h"
+#include <string.h>
+#include <arpa/inet.h>
+#include <unordered_map>
+#include <algorithm>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+/**
+ * Fixed (plain) width of every column in bytes.
+ */
+static const uint8_t gs_columnWidths[COL_COUNT] = {
+    8,  //COL_START_US
+    8,  //COL_END_US
+    8,  //COL_SRC_HI
+    8,  //COL_SRC_LO
+    8,  //COL_DST_HI
+    8,  //COL_DST_LO
+    2,  //COL_SPORT
+    2,  //COL_DPORT
+    1,  //COL_PROTO
+    8,  //COL_PACKETS
+    8   //COL_BYTES
+};
+
+//Size of a serialized ColumnarChunkInfo_T in the footer
+#define CHUNK_INFO_SIZE (8 + 4 + 1 + 1 + 2 + 8 + 8)
+
+static inline void put_le (std::vector<uint8_t>& buf, uint64_t v, uint8_t width) {
+    for (uint8_t i = 0; i < width; i++) {
+        buf.push_back((v >> (8 * i)) & 0xFF);
+    }
+}
+
+static inline uint64_t get_le (const uint8_t* p, uint8_t width) {
+    uint64_t v = 0;
+    for (uint8_t i = 0; i < width; i++) {
+        v |= ((uint64_t)p[i]) << (8 * i);
+    }
+    return v;
+}
+
+/**
+ * Half of a 16 byte address (0 for the high, 1 for the low half) as a
+ * big-endian number, so halves sort the way the addresses do.
+ */
+static inline uint64_t get_half (const FlowAddress_T& addr, size_t half) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; i++) {
+        v = (v << 8) | addr.bytes[8 * half + i];
+    }
+    return v;
+}
+
+static inline void set_half (FlowAddress_T& addr, size_t half, uint64_t v) {
+    for (size_t i = 0; i < 8; i++) {
+        addr.bytes[8 * half + 7 - i] = (v >> (8 * i)) & 0xFF;
+    }
+}
+
+/**
+ * Mask of the bits of one address half covered by a prefix length.
+ */
+static inline uint64_t half_mask (size_t half, uint8_t prefixLen) {
+    int bits = std::min<int>(std::max<int>((int)prefixLen - 64 * (int)half, 0), 64);
+    return bits == 0 ? 0 : (UINT64_MAX << (64 - bits));
+}
+
+/**
+ * Determines if a block's statistics for one address could include an
+ * address between first and last (high and low halves). The low half
+ * statistics only bound the addresses when they share one high half.
+ */
+static bool block_may_match (
+    const ColumnarChunkInfo_T& hi,
+    const ColumnarChunkInfo_T& lo,
+    const uint64_t first[2],
+    const uint64_t last[2]
+) {
+    if (hi.max < first[0] || hi.min > last[0]) {
+        return false;
+    }
+    if (hi.min == hi.max) {
+        return !(lo.max < first[1] || lo.min > last[1]);
+    }
+    return true;
+}
+
+/**
+ * Smallest number of bytes (0, 1, 2, 4 or 8) that can hold v.
+ */
+static inline uint8_t width_for (uint64_t v) {
+    if (v == 0) {
+        return 0;
+    } else if (v <= 0xFF) {
+        return 1;
+    } else if (v <= 0xFFFF) {
+        return 2;
+    } else if (v <= 0xFFFFFFFF) {
+        return 4;
+    }
+    return 8;
+}
+
+/**
+ * Checks the encoding and value width of a chunk read from a footer
+ * against what the writer can produce for the column.
+ */
+static bool chunk_valid (const ColumnarChunkInfo_T& info, uint8_t rawWidth) {
+    switch (info.encoding) {
+    case ENC_PLAIN:
+        return info.width == rawWidth;
+    case ENC_DELTA:
+        return info.width <= rawWidth;
+    case ENC_DICT:
+        return info.width == 1 || info.width == 2;
+    default:
+        return false;
+    }
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+ColumnarFlowWriter::ColumnarFlowWriter (std::string sPath)
+  : m_sPath(sPath),
+    m_fp(NULL),
+    m_offset(0),
+    m_blocks(),
+    m_rows(0),
+    m_bFailed(false)
+{
+    for (size_t i = 0; i < COL_COUNT; i++) {
+        m_columns[i].reserve(COLUMNAR_BLOCK_ROWS);
+    }
+}
+
+ColumnarFlowWriter::~ColumnarFlowWriter (void)
+{
+    close();
+}
+
+bool ColumnarFlowWriter::open (void) {
+    std::vector<uint8_t> hdr;
+
+    m_fp = fopen(m_sPath.c_str(), "wb");
+    if (!m_fp) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "Unable to open flow output file %s", m_sPath.c_str());
+        return false;
+    }
+
+    put_le(hdr, COLUMNAR_FLOW_MAGIC, 4);
+    put_le(hdr, COLUMNAR_FLOW_VERSION, 2);
+    put_le(hdr, COL_COUNT, 2);
+    m_bFailed = false;
+    m_offset = 0;
+    if (!write(hdr)) {
+        fclose(m_fp);
+        m_fp = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void ColumnarFlowWriter::close (void) {
+    std::vector<uint8_t> footer;
+
+    if (!m_fp) {
+        return;
+    }
+
+    if (m_columns[0].size() > 0) {
+        write_block();
+    }
+
+    uint64_t footerOffset = m_offset;
+
+    put_le(footer, m_blocks.size(), 4);
+    for (auto& block : m_blocks) {
+        put_le(footer, block.rows, 4);
+        for (size_t c = 0; c < COL_COUNT; c++) {
+            put_le(footer, block.columns[c].offset, 8);
+            put_le(footer, block.columns[c].length, 4);
+            put_le(footer, block.columns[c].encoding, 1);
+            put_le(footer, block.columns[c].width, 1);
+            put_le(footer, 0, 2);
+            put_le(footer, block.columns[c].min, 8);
+            put_le(footer, block.columns[c].max, 8);
+        }
+    }
+
+    put_le(footer, footerOffset, 8);
+    put_le(footer, COLUMNAR_FLOW_MAGIC, 4);
+    write(footer);
+
+    if (fclose(m_fp) != 0 && !m_bFailed) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "Unable to write flow output file %s", m_sPath.c_str());
+        m_bFailed = true;
+    }
+    m_fp = NULL;
+}
+
+bool ColumnarFlowWriter::write (const std::vector<uint8_t>& data) {
+    //After a failed write the trailer is never written, so readers
+    //reject the file instead of misreading it
+    if (m_bFailed) {
+        return false;
+    }
+    if (fwrite(data.data(), 1, data.size(), m_fp) != data.size()) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "Unable to write flow output file %s", m_sPath.c_str());
+        m_bFailed = true;
+        return false;
+    }
+    m_offset += data.size();
+    return true;
+}
+
+bool ColumnarFlowWriter::get_failed (void) {
+    return m_bFailed;
+}
+
+void ColumnarFlowWriter::on_flow_start (const ConnectionMetadata* /*meta*/) {
+    //Rows are only written once the flow is complete
+}
+
+void ColumnarFlowWriter::on_flow_end (const ConnectionMetadata* meta) {
+    ColumnarFlowRow_T row;
+
+    row.start_us = meta->timestamp_s * 1000000 + meta->timestamp_us;
+    row.end_us = row.start_us;
+    if (meta->end_timestamp_s != 0) {
+        row.end_us = meta->end_timestamp_s * 1000000 + meta->end_timestamp_us;
+    }
+    row.src = meta->src;
+    row.dst = meta->dst;
+    row.sport = meta->l4_src;
+    row.dport = meta->l4_dst;
+    row.protocol = meta->protocol;
+    row.packets = meta->packets;
+    row.bytes = meta->bytes;
+
+    append(row);
+}
+
+void ColumnarFlowWriter::flush (void) {
+    //Blocks are only written when full so that every block carries
+    //useful statistics; just push out what is already written.
+    if (m_fp) {
+        fflush(m_fp);
+    }
+}
+
+void ColumnarFlowWriter::append (const ColumnarFlowRow_T& row) {
+    m_columns[COL_START_US].push_back(row.start_us);
+    m_columns[COL_END_US].push_back(row.end_us);
+    m_columns[COL_SRC_HI].push_back(get_half(row.src, 0));
+    m_columns[COL_SRC_LO].push_back(get_half(row.src, 1));
+    m_columns[COL_DST_HI].push_back(get_half(row.dst, 0));
+    m_columns[COL_DST_LO].push_back(get_half(row.dst, 1));
+    m_columns[COL_SPORT].push_back(row.sport);
+    m_columns[COL_DPORT].push_back(row.dport);
+    m_columns[COL_PROTO].push_back(row.protocol);
+    m_columns[COL_PACKETS].push_back(row.packets);
+    m_columns[COL_BYTES].push_back(row.bytes);
+    m_rows++;
+
+    if (m_columns[0].size() >= COLUMNAR_BLOCK_ROWS) {
+        write_block();
+    }
+}
+
+size_t ColumnarFlowWriter::get_rows (void) {
+    return m_rows;
+}
+
+size_t ColumnarFlowWriter::get_blocks (void) {
+    return m_blocks.size();
+}
+
+void ColumnarFlowWriter::write_block (void) {
+    ColumnarBlockInfo_T block;
+    std::vector<uint8_t> chunk;
+
+    memset(&block, 0, sizeof(block));
+    block.rows = m_columns[0].size();
+
+    for (size_t c = 0; c < COL_COUNT; c++) {
+        chunk.clear();
+        encode_chunk(m_columns[c], gs_columnWidths[c], block.columns[c], chunk);
+
+        block.columns[c].offset = m_offset;
+        block.columns[c].length = chunk.size();
+
+        if (m_fp) {
+            write(chunk);
+        } else {
+            m_offset += chunk.size();
+        }
+
+        m_columns[c].clear();
+    }
+
+    m_blocks.push_back(block);
+}
+
+void ColumnarFlowWriter::encode_chunk (
+    const std::vector<uint64_t>& values,
+    uint8_t rawWidth,
+    ColumnarChunkInfo_T& info,
+    std::vector<uint8_t>& out
+) {
+    std::unordered_map<uint64_t, uint16_t> dict;
+    std::vector<uint64_t> dictValues;
+    bool dictOk = true;
+
+    info.min = *std::min_element(values.begin(), values.end());
+    info.max = *std::max_element(values.begin(), values.end());
+
+    for (auto v : values) {
+        if (dict.find(v) == dict.end()) {
+            if (dictValues.size() >= 0x10000) {
+                dictOk = false;
+                break;
+            }
+            dict[v] = dictValues.size();
+            dictValues.push_back(v);
+        }
+    }
+
+    uint8_t deltaWidth = width_for(info.max - info.min);
+    uint8_t indexWidth = dictValues.size() <= 0x100 ? 1 : 2;
+
+    size_t plainSize = values.size() * rawWidth;
+    size_t deltaSize = values.size() * deltaWidth;
+    size_t dictSize = dictOk ?
+        (dictValues.size() * rawWidth + values.size() * indexWidth) : plainSize + 1;
+
+    if (deltaSize <= dictSize && deltaSize < plainSize) {
+        info.encoding = ENC_DELTA;
+        info.width = deltaWidth;
+        put_le(out, 0, 4);
+        for (auto v : values) {
+            put_le(out, v - info.min, deltaWidth);
+        }
+    } else if (dictSize < plainSize) {
+        info.encoding = ENC_DICT;
+        info.width = indexWidth;
+        put_le(out, dictValues.size(), 4);
+        for (auto v : dictValues) {
+            put_le(out, v, rawWidth);
+        }
+        for (auto v : values) {
+            put_le(out, dict[v], indexWidth);
+        }
+    } else {
+        info.encoding = ENC_PLAIN;
+        info.width = rawWidth;
+        put_le(out, 0, 4);
+        for (auto v : values) {
+            put_le(out, v, rawWidth);
+        }
+    }
+}
+
+ColumnarFlowReader::ColumnarFlowReader (std::string sPath)
+  : m_sPath(sPath),
+    m_fp(NULL),
+    m_blocks()
+{
+}
+
+ColumnarFlowReader::~ColumnarFlowReader (void)
+{
+    close();
+}
+
+bool ColumnarFlowReader::open (void) {
+    uint8_t trailer[12];
+    uint8_t tmp[8];
+    std::vector<uint8_t> footer;
+    long fileSize = 0;
+    uint64_t footerOffset = 0;
+    uint32_t count = 0;
+    const uint8_t* p = NULL;
+
+    m_fp = fopen(m_sPath.c_str(), "rb");
+    if (!m_fp) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "Unable to open flow file %s", m_sPath.c_str());
+        return false;
+    }
+
+    if (fread(tmp, 1, 8, m_fp) != 8 ||
+        get_le(tmp, 4) != COLUMNAR_FLOW_MAGIC ||
+        get_le(tmp + 4, 2) != COLUMNAR_FLOW_VERSION ||
+        get_le(tmp + 6, 2) != COL_COUNT) {
+        goto ErrorExit;
+    }
+
+    fseek(m_fp, 0, SEEK_END);
+    fileSize = ftell(m_fp);
+    if (fileSize < (long)(8 + sizeof(trailer))) {
+        goto ErrorExit;
+    }
+
+    fseek(m_fp, fileSize - sizeof(trailer), SEEK_SET);
+    if (fread(trailer, 1, sizeof(trailer), m_fp) != sizeof(trailer) ||
+        get_le(trailer + 8, 4) != COLUMNAR_FLOW_MAGIC) {
+        goto ErrorExit;
+    }
+
+    footerOffset = get_le(trailer, 8);
+    if (footerOffset + 4 > (uint64_t)fileSize - sizeof(trailer)) {
+        goto ErrorExit;
+    }
+
+    footer.resize(fileSize - sizeof(trailer) - footerOffset);
+    fseek(m_fp, footerOffset, SEEK_SET);
+    if (fread(footer.data(), 1, footer.size(), m_fp) != footer.size()) {
+        goto ErrorExit;
+    }
+
+    p = footer.data();
+    count = get_le(p, 4);
+    p += 4;
+
+    if (footer.size() != 4 + (size_t)count * (4 + COL_COUNT * CHUNK_INFO_SIZE)) {
+        goto ErrorExit;
+    }
+
+    m_blocks.resize(count);
+    for (auto& block : m_blocks) {
+        block.rows = get_le(p, 4);
+        p += 4;
+        for (size_t c = 0; c < COL_COUNT; c++) {
+            block.columns[c].offset = get_le(p, 8);
+            block.columns[c].length = get_le(p + 8, 4);
+            block.columns[c].encoding = p[12];
+            block.columns[c].width = p[13];
+            block.columns[c].min = get_le(p + 16, 8);
+            block.columns[c].max = get_le(p + 24, 8);
+            p += CHUNK_INFO_SIZE;
+        }
+    }
+
+    return true;
+
+ErrorExit:
+    PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                    "Invalid or truncated flow file %s", m_sPath.c_str());
+    close();
+    return false;
+}
+
+void ColumnarFlowReader::close (void) {
+    if (m_fp) {
+        fclose(m_fp);
+        m_fp = NULL;
+    }
+    m_blocks.clear();
+}
+
+const std::vector<ColumnarBlockInfo_T>& ColumnarFlowReader::blocks (void) const {
+    return m_blocks;
+}
+
+bool ColumnarFlowReader::read_column (
+    size_t block,
+    ColumnarColumn_T column,
+    std::vector<uint64_t>& values
+) {
+    std::vector<uint8_t> chunk;
+
+    if (!m_fp || block >= m_blocks.size()) {
+        return false;
+    }
+
+    const ColumnarBlockInfo_T& b = m_blocks[block];
+    const ColumnarChunkInfo_T& info = b.columns[column];
+    uint8_t rawWidth = gs_columnWidths[column];
+
+    if (!chunk_valid(info, rawWidth)) {
+        return false;
+    }
+
+    chunk.resize(info.length);
+    fseek(m_fp, info.offset, SEEK_SET);
+    if (info.length < 4 ||
+        fread(chunk.data(), 1, chunk.size(), m_fp) != chunk.size()) {
+        return false;
+    }
+
+    uint32_t dictCount = get_le(chunk.data(), 4);
+    const uint8_t* pDict = chunk.data() + 4;
+    const uint8_t* pData = pDict + (size_t)dictCount * rawWidth;
+
+    if ((size_t)(pData - chunk.data()) + (size_t)b.rows * info.width > chunk.size()) {
+        return false;
+    }
+
+    values.resize(b.rows);
+    for (size_t i = 0; i < b.rows; i++) {
+        uint64_t v = get_le(pData + i * info.width, info.width);
+
+        switch (info.encoding) {
+        case ENC_DELTA:
+            values[i] = info.min + v;
+            break;
+        case ENC_DICT:
+            if (v >= dictCount) {
+                return false;
+            }
+            values[i] = get_le(pDict + v * rawWidth, rawWidth);
+            break;
+        default:
+            values[i] = v;
+            break;
+        }
+    }
+
+    return true;
+}
+
+size_t ColumnarFlowReader::scan (
+    uint64_t start_us,
+    uint64_t stop_us,
+    uint32_t prefix,
+    uint8_t prefixLen,
+    std::function<void(const ColumnarFlowRow_T&)> callback
+) {
+    FlowAddress_T addr;
+
+    FlowAddressSetV4(addr, htonl(prefix));
+    if (prefixLen != 0) {
+        prefixLen = 96 + std::min<uint8_t>(prefixLen, 32);
+    }
+    return scan(start_us, stop_us, addr, prefixLen, callback);
+}
+
+size_t ColumnarFlowReader::scan (
+    uint64_t start_us,
+    uint64_t stop_us,
+    const FlowAddress_T& prefix,
+    uint8_t prefixLen,
+    std::function<void(const ColumnarFlowRow_T&)> callback
+) {
+    std::vector<uint64_t> columns[COL_COUNT];
+    size_t blocksRead = 0;
+    uint64_t mask[2];
+    uint64_t first[2];
+    uint64_t last[2];
+
+    //First and last address of the prefix, by halves
+    for (size_t half = 0; half < 2; half++) {
+        mask[half] = half_mask(half, prefixLen);
+        first[half] = get_half(prefix, half) & mask[half];
+        last[half] = first[half] | ~mask[half];
+    }
+
+    for (size_t b = 0; b < m_blocks.size(); b++) {
+        const ColumnarBlockInfo_T& block = m_blocks[b];
+
+        //A flow overlaps the window if it started before the window
+        //stops and ended after the window starts.
+        if (block.columns[COL_START_US].min > stop_us ||
+            block.columns[COL_END_US].max < start_us) {
+            continue;
+        }
+
+        if (!block_may_match(block.columns[COL_SRC_HI], block.columns[COL_SRC_LO], first, last) &&
+            !block_may_match(block.columns[COL_DST_HI], block.columns[COL_DST_LO], first, last)) {
+            continue;
+        }
+
+        bool ok = true;
+        for (size_t c = 0; c < COL_COUNT && ok; c++) {
+            ok = read_column(b, (ColumnarColumn_T)c, columns[c]);
+        }
+        if (!ok) {
+            PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                            "Corrupt block %zu in %s", b, m_sPath.c_str());
+            continue;
+        }
+        blocksRead++;
+
+        for (size_t i = 0; i < block.rows; i++) {
+            ColumnarFlowRow_T row;
+            row.start_us = columns[COL_START_US][i];
+            row.end_us = columns[COL_END_US][i];
+
+            if (row.start_us > stop_us || row.end_us < start_us) {
+                continue;
+            }
+
+            bool srcMatch = (columns[COL_SRC_HI][i] & mask[0]) == first[0] &&
+                            (columns[COL_SRC_LO][i] & mask[1]) == first[1];
+            bool dstMatch = (columns[COL_DST_HI][i] & mask[0]) == first[0] &&
+                            (columns[COL_DST_LO][i] & mask[1]) == first[1];
+            if (!srcMatch && !dstMatch) {
+                continue;
+            }
+
+            set_half(row.src, 0, columns[COL_SRC_HI][i]);
+            set_half(row.src, 1, columns[COL_SRC_LO][i]);
+            set_half(row.dst, 0, columns[COL_DST_HI][i]);
+            set_half(row.dst, 1, columns[COL_DST_LO][i]);
+            row.sport = columns[COL_SPORT][i];
+            row.dport = columns[COL_DPORT][i];
+            row.protocol = columns[COL_PROTO][i];
+            row.packets = columns[COL_PACKETS][i];
+            row.bytes = columns[COL_BYTES][i];
+            callback(row);
+        }
+    }
+
+    return blocksRead;
+}
+
+//=============================================================================
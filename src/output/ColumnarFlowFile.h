@@ -0,0 +1,269 @@
+/**@file ColumnarFlowFile.h
+ *
+ * Native columnar flow file.
+ *
+ * Layout:
+ * - File header: magic (u32), version (u16), column count (u16).
+ * - Blocks of up to COLUMNAR_BLOCK_ROWS rows. Each block stores one
+ *   chunk per column; a chunk is [dict count (u32)][dictionary][values].
+ * - Footer index: block count (u32), then for every block its row count
+ *   and, per column, the chunk offset/length, encoding, value width and
+ *   min/max statistics.
+ * - Trailer: footer offset (u64), magic (u32).
+ *
+ * All integers are little-endian. Readers only need the footer to
+ * decide which blocks (and which columns of those blocks) to read.
+ */
+#ifndef COLUMNAR_FLOW_FILE_H_
+#define COLUMNAR_FLOW_FILE_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "FlowSinkInterface.h"
+#include "FlowKey.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define COLUMNAR_FLOW_MAGIC     (0x46414350) //"PCAF"
+#define COLUMNAR_FLOW_VERSION   (2)
+#define COLUMNAR_BLOCK_ROWS     (65536)
+
+/**
+ * Columns stored in a flow file. Addresses are stored in their 16 byte
+ * form (IPv4 mapped to ::ffff:a.b.c.d) as two 64-bit halves, each read
+ * as a big-endian number, so that min/max statistics can be used for
+ * prefix pruning. IPv4-only blocks have a constant zero high half,
+ * which takes no space.
+ */
+typedef enum {
+    COL_START_US    = 0,
+    COL_END_US      = 1,
+    COL_SRC_HI      = 2,
+    COL_SRC_LO      = 3,
+    COL_DST_HI      = 4,
+    COL_DST_LO      = 5,
+    COL_SPORT       = 6,
+    COL_DPORT       = 7,
+    COL_PROTO       = 8,
+    COL_PACKETS     = 9,
+    COL_BYTES       = 10,
+    COL_COUNT       = 11
+} ColumnarColumn_T;
+
+/**
+ * Column chunk encodings.
+ *
+ * - ENC_PLAIN stores the raw fixed-width values.
+ * - ENC_DELTA stores (value - block min) in the smallest width that
+ *   holds the block's range (zero bytes for constant chunks).
+ * - ENC_DICT stores the distinct values once followed by 1 or 2 byte
+ *   indexes.
+ */
+typedef enum {
+    ENC_PLAIN   = 0,
+    ENC_DELTA   = 1,
+    ENC_DICT    = 2
+} ColumnarEncoding_T;
+
+/**
+ * Footer entry describing one column chunk of a block.
+ */
+typedef struct {
+    uint64_t offset;
+    uint32_t length;
+    uint8_t encoding;
+    uint8_t width;
+    uint64_t min;
+    uint64_t max;
+} ColumnarChunkInfo_T;
+
+/**
+ * Footer entry describing one block.
+ */
+typedef struct {
+    uint32_t rows;
+    ColumnarChunkInfo_T columns[COL_COUNT];
+} ColumnarBlockInfo_T;
+
+/**
+ * A single decoded flow row.
+ */
+typedef struct {
+    uint64_t start_us;
+    uint64_t end_us;
+    FlowAddress_T src;
+    FlowAddress_T dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t protocol;
+    uint64_t packets;
+    uint64_t bytes;
+} ColumnarFlowRow_T;
+
+/**
+ * Writes completed IPv4 and IPv6 connections into a columnar flow file.
+ */
+class ColumnarFlowWriter : public FlowSinkInterface {
+public:
+    ColumnarFlowWriter (std::string sPath);
+    virtual ~ColumnarFlowWriter (void);
+
+    /**
+     * Opens the output file and writes the file header.
+     *
+     * @return bool true on success, false on failure.
+     */
+    virtual bool open (void);
+
+    /**
+     * Writes the last partial block and the footer index.
+     */
+    virtual void close (void);
+
+    virtual void on_flow_start (const ConnectionMetadata* meta);
+    virtual void on_flow_end (const ConnectionMetadata* meta);
+    virtual void flush (void);
+
+    /**
+     * Appends a single row.
+     *
+     * @param row Flow row.
+     */
+    virtual void append (const ColumnarFlowRow_T& row);
+
+    virtual size_t get_rows (void);
+    virtual size_t get_blocks (void);
+
+    /**
+     * Determines if a write to the file failed. The file is then left
+     * without its trailer, so readers reject it.
+     */
+    virtual bool get_failed (void);
+
+protected:
+    /**
+     * Writes bytes at the end of the file.
+     *
+     * @return bool false if this or an earlier write failed.
+     */
+    bool write (const std::vector<uint8_t>& data);
+
+    /**
+     * Encodes and writes the buffered rows as one block.
+     */
+    virtual void write_block (void);
+
+    /**
+     * Encodes a single column chunk.
+     *
+     * @param values Column values.
+     * @param rawWidth Fixed width of the column in bytes.
+     * @param info Chunk info that is filled in (except offset).
+     * @param out Encoded chunk bytes.
+     */
+    virtual void encode_chunk (
+        const std::vector<uint64_t>& values,
+        uint8_t rawWidth,
+        ColumnarChunkInfo_T& info,
+        std::vector<uint8_t>& out
+    );
+
+protected:
+    std::string m_sPath;
+    FILE* m_fp;
+    uint64_t m_offset;
+    std::vector<uint64_t> m_columns[COL_COUNT];
+    std::vector<ColumnarBlockInfo_T> m_blocks;
+    size_t m_rows;
+    bool m_bFailed;
+};
+
+/**
+ * Reads a columnar flow file using the footer index to skip blocks
+ * that cannot match a query.
+ */
+class ColumnarFlowReader {
+public:
+    ColumnarFlowReader (std::string sPath);
+    virtual ~ColumnarFlowReader (void);
+
+    /**
+     * Opens the file and loads the footer index.
+     *
+     * @return bool true on success, false on failure.
+     */
+    virtual bool open (void);
+
+    virtual void close (void);
+
+    /**
+     * Retrieves the block index.
+     */
+    virtual const std::vector<ColumnarBlockInfo_T>& blocks (void) const;
+
+    /**
+     * Calls the callback for every flow that was active between
+     * start_us and stop_us (inclusive) and whose source or
+     * destination address lies within prefix/prefixLen. Blocks whose
+     * statistics rule out a match are never read.
+     *
+     * @param start_us Window start (microseconds since epoch).
+     * @param stop_us Window stop (microseconds since epoch).
+     * @param prefix Address prefix, IPv4 in its mapped form.
+     * @param prefixLen Prefix length in bits, up to 128 (0 matches
+     *        every address).
+     * @param callback Called for each matching row.
+     * @return size_t Number of blocks read.
+     */
+    virtual size_t scan (
+        uint64_t start_us,
+        uint64_t stop_us,
+        const FlowAddress_T& prefix,
+        uint8_t prefixLen,
+        std::function<void(const ColumnarFlowRow_T&)> callback
+    );
+
+    /**
+     * Scans with an IPv4 prefix.
+     *
+     * @param prefix IPv4 prefix in host byte order.
+     * @param prefixLen Prefix length, up to 32 (0 matches every
+     *        address, IPv6 included).
+     */
+    virtual size_t scan (
+        uint64_t start_us,
+        uint64_t stop_us,
+        uint32_t prefix,
+        uint8_t prefixLen,
+        std::function<void(const ColumnarFlowRow_T&)> callback
+    );
+
+    /**
+     * Reads and decodes a single column chunk.
+     *
+     * @param block Block index.
+     * @param column Column to decode.
+     * @param values Decoded values.
+     * @return bool true on success, false on failure.
+     */
+    virtual bool read_column (
+        size_t block,
+        ColumnarColumn_T column,
+        std::vector<uint64_t>& values
+    );
+
+protected:
+    std::string m_sPath;
+    FILE* m_fp;
+    std::vector<ColumnarBlockInfo_T> m_blocks;
+};
+
+//=============================================================================
+#endif //COLUMNAR_FLOW_FILE_H_
@@ -0,0 +1,47 @@
+/**@file FlowSinkInterface.h 
+ */
+#ifndef FLOW_SINK_INTERFACE_H_
+#define FLOW_SINK_INTERFACE_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <string>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+class ConnectionMetadata;
+
+/**
+ * Receives the same connection notifications that are sent to the 
+ * ZMQ host. Sinks are registered with the PacketMsgProxy and write 
+ * flow records to some other destination (file, UDP collector, etc.). 
+ */
+class FlowSinkInterface {
+public:
+    virtual ~FlowSinkInterface (void) {}
+
+    /**
+     * Called when a new connection is detected. 
+     *  
+     * @param meta Connection metadata. 
+     */
+    virtual void on_flow_start (const ConnectionMetadata* meta) = 0;
+
+    /**
+     * Called when a connection is closed or times out. The end 
+     * timestamps and packet/byte counters are valid at this point. 
+     *  
+     * @param meta Connection metadata. 
+     */
+    virtual void on_flow_end (const ConnectionMetadata* meta) = 0;
+
+    /**
+     * Writes out any buffered records. 
+     */
+    virtual void flush (void) = 0;
+};
+
+//=============================================================================
+#endif //FLOW_SINK_INTERFACE_H_
@@ -0,0 +1,449 @@
+/**@file IPFIXExporter.cpp
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "IPFIXExporter.h"
+#include "PacketConnectionTracker.h"
+#include "Logging.h"
+#include <string.h>
+#include <algorithm>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+/**
+ * IPFIX information element specifier (IANA element ID and
+ * encoded length).
+ */
+typedef struct {
+    uint16_t id;
+    uint16_t length;
+} IPFIXFieldSpec_T;
+
+/**
+ * Field layout of the IPv4 flow template. Records are encoded in
+ * exactly this order.
+ */
+static const IPFIXFieldSpec_T gs_ipv4Template[] = {
+    {   8, 4 },  //sourceIPv4Address
+    {  12, 4 },  //destinationIPv4Address
+    {   7, 2 },  //sourceTransportPort
+    {  11, 2 },  //destinationTransportPort
+    {   4, 1 },  //protocolIdentifier
+    {  32, 2 },  //icmpTypeCodeIPv4
+    { 152, 8 },  //flowStartMilliseconds
+    { 153, 8 },  //flowEndMilliseconds
+    {   2, 8 },  //packetDeltaCount
+    {   1, 8 },  //octetDeltaCount
+};
+
+/**
+ * Field layout of the IPv6 flow template.
+ */
+static const IPFIXFieldSpec_T gs_ipv6Template[] = {
+    {  27, 16 }, //sourceIPv6Address
+    {  28, 16 }, //destinationIPv6Address
+    {   7, 2 },  //sourceTransportPort
+    {  11, 2 },  //destinationTransportPort
+    {   4, 1 },  //protocolIdentifier
+    { 139, 2 },  //icmpTypeCodeIPv6
+    { 152, 8 },  //flowStartMilliseconds
+    { 153, 8 },  //flowEndMilliseconds
+    {   2, 8 },  //packetDeltaCount
+    {   1, 8 },  //octetDeltaCount
+};
+
+static inline void put8 (std::vector<uint8_t>& buf, uint8_t v) {
+    buf.push_back(v);
+}
+
+static inline void put16 (std::vector<uint8_t>& buf, uint16_t v) {
+    buf.push_back((v >> 8) & 0xFF);
+    buf.push_back((v >> 0) & 0xFF);
+}
+
+static inline void put32 (std::vector<uint8_t>& buf, uint32_t v) {
+    put16(buf, (v >> 16) & 0xFFFF);
+    put16(buf, (v >> 0) & 0xFFFF);
+}
+
+static inline void put64 (std::vector<uint8_t>& buf, uint64_t v) {
+    put32(buf, (v >> 32) & 0xFFFFFFFF);
+    put32(buf, (v >> 0) & 0xFFFFFFFF);
+}
+
+static inline void patch16 (std::vector<uint8_t>& buf, size_t offset, uint16_t v) {
+    buf[offset + 0] = (v >> 8) & 0xFF;
+    buf[offset + 1] = (v >> 0) & 0xFF;
+}
+
+/**
+ * Appends a template record and returns the size of the data records
+ * it describes.
+ */
+static size_t put_template (std::vector<uint8_t>& buf, uint16_t templateId,
+                            const IPFIXFieldSpec_T* pFields, size_t count) {
+    size_t recordSize = 0;
+
+    put16(buf, templateId);
+    put16(buf, count);
+
+    for (size_t i = 0; i < count; i++) {
+        put16(buf, pFields[i].id);
+        put16(buf, pFields[i].length);
+        recordSize += pFields[i].length;
+    }
+
+    return recordSize;
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+IPFIXFileTransport::IPFIXFileTransport (std::string sPath)
+  : m_sPath(sPath),
+    m_fp(NULL)
+{
+}
+
+IPFIXFileTransport::~IPFIXFileTransport (void)
+{
+    close();
+}
+
+bool IPFIXFileTransport::open (void) {
+    m_fp = fopen(m_sPath.c_str(), "wb");
+    if (!m_fp) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "Unable to open IPFIX output file %s", m_sPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool IPFIXFileTransport::send (const uint8_t* pData, size_t dataSize) {
+    if (!m_fp) {
+        return false;
+    }
+    return fwrite(pData, 1, dataSize, m_fp) == dataSize;
+}
+
+void IPFIXFileTransport::close (void) {
+    if (m_fp) {
+        fclose(m_fp);
+        m_fp = NULL;
+    }
+}
+
+bool IPFIXFileTransport::is_datagram (void) {
+    return false;
+}
+
+IPFIXUDPTransport::IPFIXUDPTransport (std::string sHost, std::string sPort)
+  : m_sHost(sHost),
+    m_sPort(sPort),
+    m_socket(-1)
+{
+}
+
+IPFIXUDPTransport::~IPFIXUDPTransport (void)
+{
+    close();
+}
+
+bool IPFIXUDPTransport::open (void) {
+    struct addrinfo hints;
+    struct addrinfo* pResult = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    int rc = getaddrinfo(m_sHost.c_str(), m_sPort.c_str(), &hints, &pResult);
+    if (rc != 0) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "Unable to resolve IPFIX collector %s:%s (%s)",
+                        m_sHost.c_str(), m_sPort.c_str(), gai_strerror(rc));
+        return false;
+    }
+
+    for (struct addrinfo* p = pResult; p != NULL; p = p->ai_next) {
+        m_socket = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (m_socket < 0) {
+            continue;
+        }
+
+        //Connected UDP sockets allow send() and report ICMP errors
+        if (connect(m_socket, p->ai_addr, p->ai_addrlen) == 0) {
+            break;
+        }
+
+        ::close(m_socket);
+        m_socket = -1;
+    }
+
+    freeaddrinfo(pResult);
+
+    if (m_socket < 0) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "Unable to connect to IPFIX collector %s:%s",
+                        m_sHost.c_str(), m_sPort.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool IPFIXUDPTransport::send (const uint8_t* pData, size_t dataSize) {
+    if (m_socket < 0) {
+        return false;
+    }
+    return ::send(m_socket, pData, dataSize, 0) == (ssize_t)dataSize;
+}
+
+void IPFIXUDPTransport::close (void) {
+    if (m_socket >= 0) {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+}
+
+bool IPFIXUDPTransport::is_datagram (void) {
+    return true;
+}
+
+IPFIXExporter::IPFIXExporter (
+    std::shared_ptr<IPFIXTransport> transport,
+    size_t mtu,
+    uint32_t domainId
+) : m_transport(transport),
+    m_maxMessageSize(mtu - IPFIX_IP_UDP_OVERHEAD),
+    m_domainId(domainId),
+    m_templateSet(),
+    m_recordSize(0),
+    m_recordSize6(0),
+    m_message(),
+    m_dataSetOffset(0),
+    m_dataSetTemplate(0),
+    m_pendingRecords(0),
+    m_sequence(0),
+    m_messages(0),
+    m_records(0)
+{
+    build_template_set();
+    m_message.reserve(m_maxMessageSize);
+}
+
+IPFIXExporter::~IPFIXExporter (void)
+{
+    flush();
+    m_transport->close();
+}
+
+void IPFIXExporter::build_template_set (void) {
+    m_templateSet.clear();
+
+    put16(m_templateSet, IPFIX_TEMPLATE_SET_ID);
+    put16(m_templateSet, 0);
+
+    m_recordSize = put_template(m_templateSet, IPFIX_TEMPLATE_ID_IPV4, gs_ipv4Template,
+                                sizeof(gs_ipv4Template) / sizeof(IPFIXFieldSpec_T));
+    m_recordSize6 = put_template(m_templateSet, IPFIX_TEMPLATE_ID_IPV6, gs_ipv6Template,
+                                 sizeof(gs_ipv6Template) / sizeof(IPFIXFieldSpec_T));
+
+    patch16(m_templateSet, 2, m_templateSet.size());
+}
+
+void IPFIXExporter::begin_message (void) {
+    m_message.clear();
+
+    //Message header, length is patched in finish_message()
+    put16(m_message, IPFIX_VERSION);
+    put16(m_message, 0);
+    put32(m_message, (uint32_t)time(NULL));
+    put32(m_message, m_sequence);
+    put32(m_message, m_domainId);
+
+    //Streams get the template once, datagram collectors get it
+    //periodically in case a message was lost or the collector restarted.
+    if (m_messages == 0 ||
+        (m_transport->is_datagram() &&
+         (m_messages % IPFIX_TEMPLATE_RESEND_INTERVAL) == 0)) {
+        m_message.insert(m_message.end(), m_templateSet.begin(), m_templateSet.end());
+    }
+
+    m_dataSetTemplate = 0;
+    m_pendingRecords = 0;
+}
+
+void IPFIXExporter::begin_data_set (uint16_t templateId) {
+    end_data_set();
+
+    m_dataSetOffset = m_message.size();
+    m_dataSetTemplate = templateId;
+    put16(m_message, templateId);
+    put16(m_message, 0);
+}
+
+void IPFIXExporter::end_data_set (void) {
+    if (m_dataSetTemplate != 0) {
+        patch16(m_message, m_dataSetOffset + 2, m_message.size() - m_dataSetOffset);
+        m_dataSetTemplate = 0;
+    }
+}
+
+void IPFIXExporter::finish_message (void) {
+    end_data_set();
+    patch16(m_message, 2, m_message.size());
+
+    if (!m_transport->send(m_message.data(), m_message.size())) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "Unable to send IPFIX message (%zu records)",
+                        m_pendingRecords);
+    }
+
+    m_sequence += m_pendingRecords;
+    m_records += m_pendingRecords;
+    m_messages++;
+
+    m_message.clear();
+    m_pendingRecords = 0;
+}
+
+void IPFIXExporter::on_flow_start (const ConnectionMetadata* /*meta*/) {
+    //IPFIX records describe complete flows, so nothing is emitted
+    //until the connection ends.
+}
+
+void IPFIXExporter::on_flow_end (const ConnectionMetadata* meta) {
+    bool bIPv4 = meta->is_ipv4();
+    uint16_t templateId = bIPv4 ? IPFIX_TEMPLATE_ID_IPV4 : IPFIX_TEMPLATE_ID_IPV6;
+    size_t needed = bIPv4 ? m_recordSize : m_recordSize6;
+    if (templateId != m_dataSetTemplate) {
+        needed += IPFIX_SET_HEADER_SIZE;
+    }
+
+    if (m_message.empty()) {
+        begin_message();
+    } else if (m_message.size() + needed > m_maxMessageSize) {
+        finish_message();
+        begin_message();
+    }
+
+    if (templateId != m_dataSetTemplate) {
+        begin_data_set(templateId);
+    }
+
+    uint64_t start_ms = meta->timestamp_s * 1000 + meta->timestamp_us / 1000;
+    uint64_t end_ms = start_ms;
+    if (meta->end_timestamp_s != 0) {
+        end_ms = meta->end_timestamp_s * 1000 + meta->end_timestamp_us / 1000;
+    }
+
+    //Addresses are already stored in network byte order
+    if (bIPv4) {
+        const uint8_t* pSrc = meta->src.bytes + FLOW_ADDR_SIZE - 4;
+        const uint8_t* pDst = meta->dst.bytes + FLOW_ADDR_SIZE - 4;
+        m_message.insert(m_message.end(), pSrc, pSrc + 4);
+        m_message.insert(m_message.end(), pDst, pDst + 4);
+    } else {
+        m_message.insert(m_message.end(), meta->src.bytes, meta->src.bytes + FLOW_ADDR_SIZE);
+        m_message.insert(m_message.end(), meta->dst.bytes, meta->dst.bytes + FLOW_ADDR_SIZE);
+    }
+
+    put16(m_message, meta->l4_src);
+    put16(m_message, meta->l4_dst);
+    put8(m_message, meta->protocol);
+    put16(m_message, (meta->protocol == 1 || meta->protocol == 58) ? (uint16_t)(meta->msgtype << 8) : 0);
+    put64(m_message, start_ms);
+    put64(m_message, end_ms);
+    put64(m_message, meta->packets);
+    put64(m_message, meta->bytes);
+
+    m_pendingRecords++;
+}
+
+void IPFIXExporter::flush (void) {
+    if (m_pendingRecords > 0) {
+        finish_message();
+    }
+}
+
+size_t IPFIXExporter::get_messages (void) {
+    return m_messages;
+}
+
+size_t IPFIXExporter::get_records (void) {
+    return m_records;
+}
+
+size_t IPFIXExporter::get_min_mtu (void) {
+    size_t count = sizeof(gs_ipv4Template) / sizeof(IPFIXFieldSpec_T);
+    size_t count6 = sizeof(gs_ipv6Template) / sizeof(IPFIXFieldSpec_T);
+    size_t recordSize = 0;
+    size_t recordSize6 = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        recordSize += gs_ipv4Template[i].length;
+    }
+    for (size_t i = 0; i < count6; i++) {
+        recordSize6 += gs_ipv6Template[i].length;
+    }
+
+    //Template set: set header, then a 4-byte header and 4 bytes per
+    //field for each template
+    size_t templateSet = IPFIX_SET_HEADER_SIZE + (4 + 4 * count) + (4 + 4 * count6);
+
+    return IPFIX_IP_UDP_OVERHEAD + IPFIX_MESSAGE_HEADER_SIZE + templateSet +
+           IPFIX_SET_HEADER_SIZE + std::max(recordSize, recordSize6);
+}
+
+size_t IPFIXExporter::get_max_mtu (void) {
+    return IPFIX_MAX_MTU;
+}
+
+std::shared_ptr<IPFIXExporter> IPFIXExporter::Create (std::string sTarget, size_t mtu) {
+    std::shared_ptr<IPFIXTransport> transport = nullptr;
+    const std::string sUdpPrefix = "udp://";
+
+    //Smaller MTUs can't hold a record and larger ones can't be sent
+    //as one UDP datagram
+    if (mtu < get_min_mtu() || mtu > get_max_mtu()) {
+        PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                        "IPFIX MTU %zu is outside %zu-%zu",
+                        mtu, get_min_mtu(), get_max_mtu());
+        return nullptr;
+    }
+
+    if (sTarget.compare(0, sUdpPrefix.size(), sUdpPrefix) == 0) {
+        std::string sHostPort = sTarget.substr(sUdpPrefix.size());
+        size_t pos = sHostPort.rfind(':');
+        if (pos == std::string::npos) {
+            PrintLogMessage(LEVEL_ERROR, SUBSYSTEM_EXPORT,
+                            "IPFIX target %s is missing a port", sTarget.c_str());
+            return nullptr;
+        }
+        std::string sHost = sHostPort.substr(0, pos);
+        if (sHost.size() > 2 && sHost.front() == '[' && sHost.back() == ']') {
+            //Bracketed IPv6 literal (e.g. udp://[::1]:4739)
+            sHost = sHost.substr(1, sHost.size() - 2);
+        }
+        transport = std::make_shared<IPFIXUDPTransport>(sHost, sHostPort.substr(pos + 1));
+    } else {
+        transport = std::make_shared<IPFIXFileTransport>(sTarget);
+    }
+
+    if (!transport->open()) {
+        return nullptr;
+    }
+
+    return std::make_shared<IPFIXExporter>(transport, mtu);
+}
+
+//=============================================================================
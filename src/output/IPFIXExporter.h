@@ -0,0 +1,195 @@
+/**@file IPFIXExporter.h
+ */
+#ifndef IPFIX_EXPORTER_H_
+#define IPFIX_EXPORTER_H_
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "FlowSinkInterface.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define IPFIX_VERSION                   (10)
+#define IPFIX_TEMPLATE_SET_ID           (2)
+#define IPFIX_TEMPLATE_ID_IPV4          (256)
+#define IPFIX_TEMPLATE_ID_IPV6          (257)
+#define IPFIX_MESSAGE_HEADER_SIZE       (16)
+#define IPFIX_SET_HEADER_SIZE           (4)
+#define IPFIX_DEFAULT_MTU               (1500)
+#define IPFIX_IP_UDP_OVERHEAD           (28)
+#define IPFIX_MAX_MTU                   (65535)
+#define IPFIX_TEMPLATE_RESEND_INTERVAL  (64)
+
+/**
+ * Destination for encoded IPFIX messages. Each call to send()
+ * receives exactly one complete IPFIX message.
+ */
+class IPFIXTransport {
+public:
+    virtual ~IPFIXTransport (void) {}
+
+    virtual bool open (void) = 0;
+    virtual bool send (const uint8_t* pData, size_t dataSize) = 0;
+    virtual void close (void) = 0;
+
+    /**
+     * Datagram transports can lose messages, so templates must be
+     * periodically resent (RFC 7011 section 8.4).
+     *
+     * @return bool true for datagram transports.
+     */
+    virtual bool is_datagram (void) = 0;
+};
+
+/**
+ * Writes IPFIX messages back-to-back into a file (RFC 5655
+ * layout).
+ */
+class IPFIXFileTransport : public IPFIXTransport {
+public:
+    IPFIXFileTransport (std::string sPath);
+    virtual ~IPFIXFileTransport (void);
+
+    virtual bool open (void);
+    virtual bool send (const uint8_t* pData, size_t dataSize);
+    virtual void close (void);
+    virtual bool is_datagram (void);
+
+protected:
+    std::string m_sPath;
+    FILE* m_fp;
+};
+
+/**
+ * Sends one IPFIX message per UDP datagram to a collector.
+ */
+class IPFIXUDPTransport : public IPFIXTransport {
+public:
+    IPFIXUDPTransport (std::string sHost, std::string sPort);
+    virtual ~IPFIXUDPTransport (void);
+
+    virtual bool open (void);
+    virtual bool send (const uint8_t* pData, size_t dataSize);
+    virtual void close (void);
+    virtual bool is_datagram (void);
+
+protected:
+    std::string m_sHost;
+    std::string m_sPort;
+    int m_socket;
+};
+
+/**
+ * Converts completed connections into IPFIX (RFC 7011) flow
+ * records.
+ *
+ * The template set (one template for IPv4 flows, one for IPv6) is
+ * encoded once and cached. Data records are packed into the current
+ * message until the next record would exceed the MTU, at which point
+ * the message is handed to the transport. A new data set is started
+ * whenever the address family changes from one record to the next.
+ */
+class IPFIXExporter : public FlowSinkInterface {
+public:
+    IPFIXExporter (
+        std::shared_ptr<IPFIXTransport> transport,
+        size_t mtu = IPFIX_DEFAULT_MTU,
+        uint32_t domainId = 0
+    );
+    virtual ~IPFIXExporter (void);
+
+    virtual void on_flow_start (const ConnectionMetadata* meta);
+    virtual void on_flow_end (const ConnectionMetadata* meta);
+    virtual void flush (void);
+
+    /**
+     * Number of IPFIX messages handed to the transport.
+     */
+    virtual size_t get_messages (void);
+
+    /**
+     * Number of data records exported.
+     */
+    virtual size_t get_records (void);
+
+public:
+    /**
+     * Creates an exporter from a target string. Targets of the form
+     * udp://host:port use a UDP transport, anything else is treated
+     * as an output file path.
+     *
+     * @param sTarget Target string.
+     * @param mtu Link MTU used to size messages, from get_min_mtu() to
+     *            get_max_mtu().
+     * @return std::shared_ptr<IPFIXExporter> nullptr on failure.
+     */
+    static std::shared_ptr<IPFIXExporter> Create (std::string sTarget, size_t mtu);
+
+    /**
+     * Smallest MTU whose datagrams hold a message header, the template
+     * set and one record of either family.
+     */
+    static size_t get_min_mtu (void);
+
+    /**
+     * Largest MTU, the IPv4 total length limit. Messages sized for it
+     * also fit the 16-bit message length.
+     */
+    static size_t get_max_mtu (void);
+
+protected:
+    /**
+     * Builds the cached template set.
+     */
+    virtual void build_template_set (void);
+
+    /**
+     * Starts a new message in m_message (header and optional template
+     * set).
+     */
+    virtual void begin_message (void);
+
+    /**
+     * Closes the current data set, if any, and starts one for a
+     * template.
+     */
+    virtual void begin_data_set (uint16_t templateId);
+
+    /**
+     * Patches the length of the current data set.
+     */
+    virtual void end_data_set (void);
+
+    /**
+     * Patches the message/set lengths and sends the message.
+     */
+    virtual void finish_message (void);
+
+protected:
+    std::shared_ptr<IPFIXTransport> m_transport;
+    size_t m_maxMessageSize;
+    uint32_t m_domainId;
+
+    std::vector<uint8_t> m_templateSet;
+    size_t m_recordSize;
+    size_t m_recordSize6;
+
+    std::vector<uint8_t> m_message;
+    size_t m_dataSetOffset;
+    uint16_t m_dataSetTemplate;
+    size_t m_pendingRecords;
+
+    uint32_t m_sequence;
+    size_t m_messages;
+    size_t m_records;
+};
+
+//=============================================================================
+#endif //IPFIX_EXPORTER_H_
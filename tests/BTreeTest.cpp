@@ -0,0 +1,494 @@
+/**@file BTreeTest.cpp
+ *
+ * Checks BTree against std::map under random inserts, removes, bulk
+ * loads and range erases at several orders, validating the tree with
+ * is_a_valid_btree() after every step. Then runs readers and walkers
+ * against a writer, and expires flows through FlowExpiryIndex the way
+ * the UDP and ICMP trackers do, checking that a prune only looks at
+ * the flows keyed before its cutoff.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/common -Isrc/analysis tests/BTreeTest.cpp \
+ *       -lpthread -o btree_test && ./btree_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+#include "BTree.h"
+#include "FlowExpiryIndex.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_STEPS          (2000)
+#define TEST_SEEDS          (3)
+#define TEST_STABLE_KEYS    (2000)
+#define TEST_STABLE_STRIDE  (1000)
+#define TEST_WRITER_STEPS   (400)
+#define TEST_FLOWS          (5000)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+class TestValue {
+public:
+    TestValue (uint64_t k)
+      : key(k)
+    {
+    }
+
+    uint64_t addr (void) const {
+        return key;
+    }
+
+public:
+    uint64_t key;
+};
+
+typedef BTree<uint64_t, TestValue> TestTree_T;
+typedef std::map<uint64_t, std::shared_ptr<TestValue>> TestMap_T;
+
+/**
+ * Compares every value, in order and by identity, and the walk order.
+ */
+static bool same_contents (TestTree_T& tree, TestMap_T& ref) {
+    if (tree.size() != ref.size()) {
+        return false;
+    }
+
+    auto all = tree.find_range(0, UINT64_MAX);
+    if (all.size() != ref.size()) {
+        return false;
+    }
+    auto iter = ref.begin();
+    for (auto& value : all) {
+        if (value != iter->second) {
+            return false;
+        }
+        ++iter;
+    }
+
+    size_t count = 0;
+    bool bSorted = true;
+    uint64_t prev = 0;
+    tree.walk([&](TestValue& value, int) {
+        if (count > 0 && value.key <= prev) {
+            bSorted = false;
+        }
+        prev = value.key;
+        count++;
+    });
+    return bSorted && count == ref.size();
+}
+
+static void test_differential (size_t order, int seed) {
+    TestTree_T tree(order);
+    TestMap_T ref;
+    std::mt19937_64 rng(seed * 100 + order);
+    uint64_t range = 50 + rng() % 5000;
+
+    for (size_t step = 0; step < TEST_STEPS; step++) {
+        int op = rng() % 12;
+
+        if (op < 4) {
+            uint64_t k = rng() % range;
+            auto value = std::make_shared<TestValue>(k);
+            CHECK(tree.insert(value) == ref.emplace(k, value).second);
+        } else if (op < 6) {
+            uint64_t k = rng() % range;
+            CHECK(tree.remove(k) == (ref.erase(k) > 0));
+        } else if (op < 8) {
+            //A sorted run, sometimes with a value out of order and a null
+            std::vector<std::shared_ptr<TestValue>> in;
+            uint64_t k = rng() % range;
+            size_t n = rng() % 300;
+            for (size_t i = 0; i < n; i++) {
+                k += 1 + rng() % 5;
+                in.push_back(std::make_shared<TestValue>(k % range));
+            }
+            if (rng() % 4 == 0 && !in.empty()) {
+                std::swap(in[0], in[rng() % in.size()]);
+                in.push_back(nullptr);
+            }
+
+            size_t expected = 0;
+            for (auto& value : in) {
+                if (value && ref.emplace(value->key, value).second) {
+                    expected++;
+                }
+            }
+            CHECK(tree.bulk_load(in.begin(), in.end()) == expected);
+        } else if (op < 10) {
+            uint64_t start = rng() % range;
+            uint64_t stop = start + rng() % (range / (1 + rng() % 8) + 1);
+            if (rng() % 10 == 0) {
+                std::swap(start, stop);
+            }
+
+            size_t expected = 0;
+            if (!(stop < start)) {
+                auto iter = ref.lower_bound(start);
+                while (iter != ref.end() && iter->first <= stop) {
+                    iter = ref.erase(iter);
+                    expected++;
+                }
+            }
+            CHECK(tree.erase_range(start, stop) == expected);
+        } else {
+            uint64_t k = rng() % range;
+            auto found = tree.find(k);
+            CHECK((found != nullptr) == (ref.count(k) > 0));
+
+            uint64_t stop = k + rng() % 500;
+            auto values = tree.find_range(k, stop);
+            auto iter = ref.lower_bound(k);
+            for (auto& value : values) {
+                CHECK(iter != ref.end() && value == iter->second && value->key <= stop);
+                if (iter != ref.end()) {
+                    ++iter;
+                }
+            }
+            CHECK(iter == ref.end() || iter->first > stop);
+        }
+
+        CHECK(tree.is_a_valid_btree());
+        CHECK(same_contents(tree, ref));
+        if (gs_failures != 0) {
+            fprintf(stderr, "order %zu seed %d step %zu op %d\n", order, seed, step, op);
+            return;
+        }
+    }
+
+    //Drain in order, as expiry does
+    while (!ref.empty()) {
+        CHECK(tree.remove(ref.begin()->first));
+        ref.erase(ref.begin());
+    }
+    CHECK(tree.size() == 0);
+    CHECK(tree.is_a_valid_btree());
+}
+
+/**
+ * One writer churns the keys between multiples of TEST_STABLE_STRIDE
+ * while readers look up and range scan the stable keys and a walker
+ * walks the whole tree. Readers must always see every stable key, in
+ * order.
+ */
+static void test_concurrent (void) {
+    TestTree_T tree(8);
+    std::atomic<bool> bDone(false);
+    std::atomic<long> bad(0);
+    std::atomic<long> reads(0);
+    const uint64_t last = (TEST_STABLE_KEYS - 1) * TEST_STABLE_STRIDE;
+
+    for (uint64_t i = 0; i < TEST_STABLE_KEYS; i++) {
+        tree.insert(TestValue(i * TEST_STABLE_STRIDE));
+    }
+
+    std::vector<std::thread> readers;
+    for (int j = 0; j < 3; j++) {
+        readers.emplace_back([&, j] {
+            std::mt19937_64 rng(j);
+            while (!bDone) {
+                uint64_t k = (rng() % TEST_STABLE_KEYS) * TEST_STABLE_STRIDE;
+                uint64_t stop = k + 5 * TEST_STABLE_STRIDE;
+                if (!tree.find(k)) {
+                    bad++;
+                }
+
+                size_t stable = 0;
+                uint64_t prev = 0;
+                bool bFirst = true;
+                for (auto& value : tree.find_range(k, stop)) {
+                    if (!bFirst && value->key <= prev) {
+                        bad++;
+                    }
+                    bFirst = false;
+                    prev = value->key;
+                    if (value->key % TEST_STABLE_STRIDE == 0) {
+                        stable++;
+                    }
+                }
+                if (stable != (std::min(stop, last) - k) / TEST_STABLE_STRIDE + 1) {
+                    bad++;
+                }
+                reads++;
+            }
+        });
+    }
+    readers.emplace_back([&] {
+        while (!bDone) {
+            size_t stable = 0;
+            uint64_t prev = 0;
+            bool bFirst = true;
+            tree.walk([&](TestValue& value, int) {
+                if (!bFirst && value.key <= prev) {
+                    bad++;
+                }
+                bFirst = false;
+                prev = value.key;
+                if (value.key % TEST_STABLE_STRIDE == 0) {
+                    stable++;
+                }
+            });
+            if (stable != TEST_STABLE_KEYS) {
+                bad++;
+            }
+            reads++;
+        }
+    });
+
+    std::mt19937_64 rng(9);
+    for (size_t step = 0; step < TEST_WRITER_STEPS; step++) {
+        uint64_t gap = rng() % (TEST_STABLE_KEYS - 1);
+        uint64_t base = gap * TEST_STABLE_STRIDE;
+
+        if (step % 50 == 0) {
+            //Rebuild the whole tree, then empty every gap again
+            std::vector<std::shared_ptr<TestValue>> big;
+            for (uint64_t k = 1; k < last; k += 7) {
+                if (k % TEST_STABLE_STRIDE) {
+                    big.push_back(std::make_shared<TestValue>(k));
+                }
+            }
+            tree.bulk_load(big.begin(), big.end());
+            for (uint64_t g = 0; g < TEST_STABLE_KEYS; g++) {
+                tree.erase_range(g * TEST_STABLE_STRIDE + 1, g * TEST_STABLE_STRIDE + TEST_STABLE_STRIDE - 1);
+            }
+        }
+
+        std::vector<std::shared_ptr<TestValue>> in;
+        for (uint64_t k = base + 1; k < base + TEST_STABLE_STRIDE; k += 1 + rng() % 3) {
+            in.push_back(std::make_shared<TestValue>(k));
+        }
+        tree.bulk_load(in.begin(), in.end());
+
+        for (int i = 0; i < 50; i++) {
+            uint64_t k = (rng() % (TEST_STABLE_KEYS - 1)) * TEST_STABLE_STRIDE + 1 + rng() % (TEST_STABLE_STRIDE - 1);
+            if (rng() & 1) {
+                tree.insert(TestValue(k));
+            } else {
+                tree.remove(k);
+            }
+        }
+
+        gap = rng() % (TEST_STABLE_KEYS - 1);
+        uint64_t start = gap * TEST_STABLE_STRIDE + 1 + rng() % 500;
+        tree.erase_range(start, start + rng() % 499);
+    }
+
+    bDone = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    CHECK(bad == 0);
+    CHECK(reads > 0);
+    CHECK(tree.is_a_valid_btree());
+}
+
+/**
+ * A flow as the trackers keep it: its real last activity and the key
+ * it has in the index, which may be older.
+ */
+typedef struct {
+    uint64_t last_active;
+    uint64_t expiry_key;
+    size_t id;
+} TestFlow_T;
+
+/**
+ * Prunes flows idle since before cutoff the way the UDP and ICMP
+ * trackers do, filling gaps from the back of the list.
+ *
+ * @param visited Incremented for every flow looked at.
+ * @param expired Populated with the ids of the expired flows.
+ */
+static void test_prune (FlowExpiryIndex& index, std::vector<TestFlow_T>& flows, uint64_t cutoff,
+                        size_t& visited, std::set<size_t>& expired) {
+    std::vector<FlowExpiryEntry> idle;
+    std::vector<size_t> slots;
+
+    index.take_idle(cutoff, idle);
+    for (auto& entry : idle) {
+        TestFlow_T& flow = flows[entry.slot];
+        CHECK(flow.expiry_key == entry.key);
+        CHECK(FlowExpiryIndex::key_time(entry.key) < cutoff);
+        visited++;
+
+        if (flow.last_active >= cutoff) {
+            flow.expiry_key = index.add(flow.last_active, entry.slot);
+        } else {
+            expired.insert(flow.id);
+            slots.push_back(entry.slot);
+        }
+    }
+
+    std::sort(slots.begin(), slots.end(), std::greater<size_t>());
+    for (auto slot : slots) {
+        if (slot != flows.size() - 1) {
+            flows[slot] = flows.back();
+            index.move(flows[slot].expiry_key, slot);
+        }
+        flows.pop_back();
+    }
+}
+
+/**
+ * Flows active at random times, with packets only updating their last
+ * activity. Every prune must expire exactly the flows idle past the
+ * timeout, look at no flow keyed after the cutoff and look at each
+ * active flow about once per timeout, however often it prunes.
+ */
+static void test_expiry_index (void) {
+    FlowExpiryIndex index;
+    std::vector<TestFlow_T> flows;
+    std::mt19937_64 rng(5);
+    uint64_t now = 1600000000000000ULL;
+    uint64_t timeout = 1000000;
+    size_t nextId = 0;
+    size_t visited = 0;
+    size_t expiredCount = 0;
+    size_t prunes = 0;
+
+    for (size_t i = 0; i < TEST_FLOWS; i++) {
+        TestFlow_T flow = { now + i / 2, 0, nextId++ };
+        flow.expiry_key = index.add(flow.last_active, flows.size());
+        flows.push_back(flow);
+    }
+    CHECK(index.size() == TEST_FLOWS);
+    uint64_t start = now;
+
+    for (size_t step = 0; step < 100 * TEST_FLOWS; step++) {
+        now += rng() % 40;
+
+        //Most flows stay busy, some go quiet for good
+        if (!flows.empty() && rng() % 8 != 0) {
+            TestFlow_T& flow = flows[rng() % flows.size()];
+            if (flow.id % 10 != 0 || flow.last_active + timeout / 2 > now) {
+                flow.last_active = now;
+            }
+        }
+        if (rng() % 64 == 0) {
+            TestFlow_T flow = { now, 0, nextId++ };
+            flow.expiry_key = index.add(now, flows.size());
+            flows.push_back(flow);
+        }
+
+        //Prune every 1% of the timeout
+        if (step % 250 == 0) {
+            uint64_t cutoff = now - timeout;
+            std::set<size_t> idle;
+            std::set<size_t> expired;
+
+            for (auto& flow : flows) {
+                if (flow.last_active < cutoff) {
+                    idle.insert(flow.id);
+                }
+            }
+            test_prune(index, flows, cutoff, visited, expired);
+            CHECK(expired == idle);
+            CHECK(index.size() == flows.size());
+            expiredCount += expired.size();
+            prunes++;
+
+            //A second prune at the same time has nothing to look at
+            size_t before = visited;
+            test_prune(index, flows, cutoff, visited, expired);
+            CHECK(visited == before);
+        }
+    }
+    CHECK(expiredCount > 0);
+
+    //Each flow is looked at once per timeout it stays active plus once
+    //to expire it, not once per prune
+    size_t timeouts = (now - start) / timeout + 1;
+    CHECK(visited <= expiredCount + nextId * timeouts);
+    CHECK(visited < prunes * flows.size() / 10);
+
+    //Every key still points at its flow
+    for (size_t i = 0; i < flows.size(); i++) {
+        CHECK(FlowExpiryIndex::key_time(flows[i].expiry_key) <= flows[i].last_active);
+    }
+
+    //Reloading the index as a restored tracker does keys every flow at
+    //its last activity, so a prune looks at no active flow
+    std::vector<FlowExpiryEntry> loaded;
+    uint64_t oldest = UINT64_MAX;
+    for (size_t i = 0; i < flows.size(); i++) {
+        loaded.push_back(FlowExpiryEntry(flows[i].last_active, i));
+        oldest = std::min(oldest, flows[i].last_active);
+    }
+    index.load(loaded);
+    CHECK(index.size() == flows.size());
+    for (size_t i = 0; i < loaded.size(); i++) {
+        CHECK(i == 0 || loaded[i - 1].key < loaded[i].key);
+        CHECK(FlowExpiryIndex::key_time(loaded[i].key) >= flows[loaded[i].slot].last_active);
+        CHECK(FlowExpiryIndex::key_time(loaded[i].key) <= flows[loaded[i].slot].last_active + 1);
+        flows[loaded[i].slot].expiry_key = loaded[i].key;
+    }
+    size_t before = visited;
+    std::set<size_t> reloaded;
+    test_prune(index, flows, oldest, visited, reloaded);
+    CHECK(reloaded.empty());
+    CHECK(visited == before);
+    test_prune(index, flows, oldest + 1, visited, reloaded);
+    CHECK(reloaded.size() >= 1 && visited == before + reloaded.size());
+    std::set<size_t> expired;
+    test_prune(index, flows, UINT64_MAX >> FLOW_EXPIRY_SERIAL_BITS, visited, expired);
+    CHECK(flows.empty());
+    CHECK(index.size() == 0);
+
+    //More flows in one microsecond than there are serials spill over
+    //into the following microseconds
+    std::set<uint64_t> spilled;
+    for (uint64_t i = 0; i < 2 * (FLOW_EXPIRY_SERIAL_MASK + 1) + 1; i++) {
+        uint64_t key = index.add(now, i);
+        CHECK(spilled.insert(key).second);
+        CHECK(FlowExpiryIndex::key_time(key) >= now && FlowExpiryIndex::key_time(key) <= now + 2);
+    }
+    CHECK(index.size() == spilled.size());
+
+    std::vector<FlowExpiryEntry> idle;
+    index.take_idle(now, idle);
+    CHECK(idle.empty());
+    index.clear();
+    CHECK(index.size() == 0);
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    for (size_t order : { 3, 4, 5, 9, 10, 17, 33 }) {
+        for (int seed = 0; seed < TEST_SEEDS && gs_failures == 0; seed++) {
+            test_differential(order, seed);
+        }
+    }
+    test_concurrent();
+    test_expiry_index();
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("BTreeTest passed\n");
+    return 0;
+}
@@ -0,0 +1,495 @@
+/**@file ColumnarFlowFileTest.cpp
+ *
+ * Writes flows with ColumnarFlowWriter, reads them back with
+ * ColumnarFlowReader and checks every encoding and the footer based
+ * block pruning against a brute-force scan of the input rows, for
+ * IPv4 and IPv6 flows.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc -Isrc/common -Isrc/analysis -Isrc/messages \
+ *       -Isrc/output tests/ColumnarFlowFileTest.cpp \
+ *       src/output/ColumnarFlowFile.cpp src/analysis/FlowKey.cpp \
+ *       src/common/Logging.cpp -ltins -lcrypto \
+ *       -o columnar_test && ./columnar_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <random>
+
+#include "ColumnarFlowFile.h"
+#include "PacketConnectionTracker.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_BLOCKS         (4)
+#define TEST_ROWS           (TEST_BLOCKS * COLUMNAR_BLOCK_ROWS - 1000)
+#define TEST_DICT_HOSTS     (200)
+#define TEST_QUERIES        (200)
+#define TEST_BASE_US        (1600000000000000ULL)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+static FlowAddress_T v4 (uint32_t host) {
+    FlowAddress_T addr;
+    FlowAddressSetV4(addr, htonl(host));
+    return addr;
+}
+
+static FlowAddress_T v6 (const char* text) {
+    FlowAddress_T addr;
+    CHECK(inet_pton(AF_INET6, text, addr.bytes) == 1);
+    return addr;
+}
+
+static uint32_t host_v4 (const FlowAddress_T& addr) {
+    return ntohl(FlowAddressGetV4(addr));
+}
+
+static bool addr_equal (const FlowAddress_T& a, const FlowAddress_T& b) {
+    return memcmp(a.bytes, b.bytes, FLOW_ADDR_SIZE) == 0;
+}
+
+/**
+ * Determines if an address lies in prefix/prefixLen, a bit at a time.
+ */
+static bool in_prefix (const FlowAddress_T& addr, const FlowAddress_T& prefix, uint8_t prefixLen) {
+    for (size_t bit = 0; bit < prefixLen; bit++) {
+        uint8_t mask = 0x80 >> (bit % 8);
+        if ((addr.bytes[bit / 8] & mask) != (prefix.bytes[bit / 8] & mask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool row_equal (const ColumnarFlowRow_T& a, const ColumnarFlowRow_T& b) {
+    return a.start_us == b.start_us && a.end_us == b.end_us &&
+           addr_equal(a.src, b.src) && addr_equal(a.dst, b.dst) &&
+           a.sport == b.sport && a.dport == b.dport &&
+           a.protocol == b.protocol &&
+           a.packets == b.packets && a.bytes == b.bytes;
+}
+
+/**
+ * Builds rows whose columns pick every encoding:
+ * - start/end times increase, so they delta encode.
+ * - sources come from a small set of scattered hosts (dictionary),
+ *   except in the last block which uses its own /16 so that prefix
+ *   queries can prune the other blocks.
+ * - destinations are four adjacent hosts (one byte delta) and
+ *   destination ports are constant (zero width delta).
+ * - packet counts are random 64-bit values (plain).
+ */
+static void make_rows (std::vector<ColumnarFlowRow_T>& rows) {
+    std::mt19937_64 rng(1);
+    std::vector<uint32_t> hosts;
+
+    for (size_t i = 0; i < TEST_DICT_HOSTS; i++) {
+        hosts.push_back(0x0A000000 | (uint32_t)(rng() & 0x00FFFFFF));
+    }
+
+    rows.resize(TEST_ROWS);
+    for (size_t i = 0; i < rows.size(); i++) {
+        ColumnarFlowRow_T& row = rows[i];
+        bool bLast = i >= (TEST_BLOCKS - 1) * COLUMNAR_BLOCK_ROWS;
+
+        row.start_us = TEST_BASE_US + i * 1000;
+        row.end_us = row.start_us + (rng() % 5000000);
+        row.src = v4(bLast ? 0xC0A80000 | (uint32_t)(rng() & 0xFFFF) : hosts[rng() % hosts.size()]);
+        row.dst = v4(bLast ? 0xC0A80000 | (uint32_t)(rng() & 0xFFFF) : 0x08080808 + (uint32_t)(rng() % 4));
+        row.sport = 1024 + (rng() % 60000);
+        row.dport = 443;
+        row.protocol = (rng() & 1) ? 6 : 17;
+        row.packets = rng();
+        row.bytes = rng() % 1000000;
+    }
+}
+
+static void test_empty (std::string sPath) {
+    ColumnarFlowWriter writer(sPath);
+    CHECK(writer.open());
+    writer.close();
+
+    ColumnarFlowReader reader(sPath);
+    CHECK(reader.open());
+    CHECK(reader.blocks().empty());
+    CHECK(reader.scan(0, UINT64_MAX, 0, 0, [](const ColumnarFlowRow_T&) {}) == 0);
+}
+
+/**
+ * IPv6 flows are written alongside IPv4 ones and come back with their
+ * addresses intact.
+ */
+static void test_ipv6_round_trip (std::string sPath) {
+    ConnectionMetadata meta;
+    ColumnarFlowWriter writer(sPath);
+
+    CHECK(writer.open());
+    meta.src = v6("2001:db8::1");
+    meta.dst = v6("2001:db8:ffff::2");
+    meta.l4_src = 5353;
+    meta.l4_dst = 53;
+    meta.protocol = 17;
+    meta.timestamp_s = 10;
+    meta.timestamp_us = 5;
+    writer.on_flow_end(&meta);
+
+    meta.src = v4(0x0A000001);
+    meta.dst = v4(0x0A000002);
+    meta.timestamp_s = 11;
+    writer.on_flow_end(&meta);
+    CHECK(writer.get_rows() == 2);
+    writer.close();
+
+    ColumnarFlowReader reader(sPath);
+    std::vector<ColumnarFlowRow_T> found;
+    CHECK(reader.open());
+    reader.scan(0, UINT64_MAX, 0, 0, [&](const ColumnarFlowRow_T& row) { found.push_back(row); });
+    CHECK(found.size() == 2);
+    if (found.size() == 2) {
+        CHECK(addr_equal(found[0].src, v6("2001:db8::1")));
+        CHECK(addr_equal(found[0].dst, v6("2001:db8:ffff::2")));
+        CHECK(found[0].sport == 5353);
+        CHECK(found[0].dport == 53);
+        CHECK(found[0].start_us == 10000005);
+        CHECK(found[0].end_us == found[0].start_us);
+        CHECK(host_v4(found[1].src) == 0x0A000001);
+        CHECK(host_v4(found[1].dst) == 0x0A000002);
+    }
+
+    //IPv4 and IPv6 prefixes each only match their own flow
+    found.clear();
+    reader.scan(0, UINT64_MAX, v6("2001:db8:ffff::"), 48, [&](const ColumnarFlowRow_T& row) { found.push_back(row); });
+    CHECK(found.size() == 1 && found[0].start_us == 10000005);
+    found.clear();
+    reader.scan(0, UINT64_MAX, 0x0A000000, 8, [&](const ColumnarFlowRow_T& row) { found.push_back(row); });
+    CHECK(found.size() == 1 && found[0].start_us == 11000005);
+    found.clear();
+    reader.scan(0, UINT64_MAX, v6("2001:db8::1"), 128, [&](const ColumnarFlowRow_T& row) { found.push_back(row); });
+    CHECK(found.size() == 1);
+    found.clear();
+    reader.scan(0, UINT64_MAX, v6("2001:db8::2"), 128, [&](const ColumnarFlowRow_T& row) { found.push_back(row); });
+    CHECK(found.empty());
+}
+
+/**
+ * Blocks of IPv6 flows are pruned by prefix like IPv4 ones, whether
+ * the prefix ends in the high or the low half of the address.
+ */
+static void test_ipv6_blocks (std::string sPath) {
+    std::mt19937_64 rng(3);
+    std::vector<ColumnarFlowRow_T> rows(3 * COLUMNAR_BLOCK_ROWS);
+
+    //One block from 2001:db8:1::/48, one from 2001:db8:2::/64 with
+    //random hosts, one from scattered /64s of 2001:db8:3::/48
+    for (size_t i = 0; i < rows.size(); i++) {
+        ColumnarFlowRow_T& row = rows[i];
+        size_t block = i / COLUMNAR_BLOCK_ROWS;
+        char text[64];
+
+        if (block == 0) {
+            snprintf(text, sizeof(text), "2001:db8:1:%x::%x", (unsigned)(rng() & 0xFFFF), (unsigned)(rng() & 0xFFFF));
+        } else if (block == 1) {
+            snprintf(text, sizeof(text), "2001:db8:2:0:%x:%x:%x:%x", (unsigned)(rng() & 0xFFFF),
+                     (unsigned)(rng() & 0xFFFF), (unsigned)(rng() & 0xFFFF), (unsigned)(rng() & 0xFFFF));
+        } else {
+            snprintf(text, sizeof(text), "2001:db8:3:%x::1", (unsigned)(rng() & 0xFFFF));
+        }
+        row.start_us = TEST_BASE_US + i;
+        row.end_us = row.start_us;
+        row.src = v6(text);
+        row.dst = v6("2001:db8:ffff::53");
+        row.sport = rng();
+        row.dport = 53;
+        row.protocol = 17;
+        row.packets = 1;
+        row.bytes = rng() % 1500;
+    }
+
+    ColumnarFlowWriter writer(sPath);
+    CHECK(writer.open());
+    for (auto& row : rows) {
+        writer.append(row);
+    }
+    writer.close();
+
+    ColumnarFlowReader reader(sPath);
+    CHECK(reader.open());
+    CHECK(reader.blocks().size() == 3);
+
+    size_t next = 0;
+    CHECK(reader.scan(0, UINT64_MAX, 0, 0, [&](const ColumnarFlowRow_T& row) {
+        CHECK(next < rows.size() && row_equal(row, rows[next]));
+        next++;
+    }) == 3);
+    CHECK(next == rows.size());
+
+    //Prefixes ending in the high half
+    CHECK(reader.scan(0, UINT64_MAX, v6("2001:db8:1::"), 48, [](const ColumnarFlowRow_T&) {}) == 1);
+    CHECK(reader.scan(0, UINT64_MAX, v6("2001:db8:4::"), 48, [](const ColumnarFlowRow_T&) {}) == 0);
+
+    //Every block has the same destination, so only the low half of a
+    //single high half prunes them
+    CHECK(reader.scan(0, UINT64_MAX, v6("2001:db8:ffff::53"), 128, [](const ColumnarFlowRow_T&) {}) == 3);
+    CHECK(reader.scan(0, UINT64_MAX, v6("2001:db8:2::"), 80, [](const ColumnarFlowRow_T&) {}) == 1);
+    CHECK(reader.scan(0, UINT64_MAX, v6("2001:db8:2:1::"), 80, [](const ColumnarFlowRow_T&) {}) == 0);
+
+    //IPv4 prefixes rule out every IPv6 block
+    CHECK(reader.scan(0, UINT64_MAX, 0x0A000000, 8, [](const ColumnarFlowRow_T&) {}) == 0);
+
+    //Random prefixes match a brute-force scan
+    for (size_t q = 0; q < TEST_QUERIES; q++) {
+        const ColumnarFlowRow_T& pick = rows[rng() % rows.size()];
+        uint8_t prefixLen = (uint8_t)(rng() % 129);
+        size_t expected = 0;
+        size_t found = 0;
+
+        for (auto& row : rows) {
+            if (in_prefix(row.src, pick.src, prefixLen) || in_prefix(row.dst, pick.src, prefixLen)) {
+                expected++;
+            }
+        }
+        reader.scan(0, UINT64_MAX, pick.src, prefixLen, [&](const ColumnarFlowRow_T& row) {
+            CHECK(in_prefix(row.src, pick.src, prefixLen) || in_prefix(row.dst, pick.src, prefixLen));
+            found++;
+        });
+        CHECK(found == expected);
+    }
+}
+
+static void test_corrupt (std::string sPath, const std::vector<ColumnarFlowRow_T>& rows) {
+    {
+        ColumnarFlowWriter writer(sPath);
+        CHECK(writer.open());
+        for (size_t i = 0; i < 1000; i++) {
+            writer.append(rows[i]);
+        }
+    }
+
+    //Cutting off the trailer must fail the open, not misread the footer
+    FILE* fp = fopen(sPath.c_str(), "rb+");
+    CHECK(fp != NULL);
+    if (!fp) {
+        return;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    CHECK(truncate(sPath.c_str(), size - 1) == 0);
+
+    ColumnarFlowReader reader(sPath);
+    CHECK(!reader.open());
+}
+
+/**
+ * A chunk width no encoding can have makes its block unreadable
+ * instead of being used to read past the chunk.
+ */
+static void test_bad_width (std::string sPath, const std::vector<ColumnarFlowRow_T>& rows) {
+    {
+        ColumnarFlowWriter writer(sPath);
+        CHECK(writer.open());
+        for (size_t i = 0; i < 1000; i++) {
+            writer.append(rows[i]);
+        }
+    }
+
+    //Width of the first block's first column, past the block count and
+    //its row count, then offset, length and encoding
+    FILE* fp = fopen(sPath.c_str(), "rb+");
+    CHECK(fp != NULL);
+    if (!fp) {
+        return;
+    }
+    uint8_t trailer[12];
+    fseek(fp, -12, SEEK_END);
+    CHECK(fread(trailer, 1, sizeof(trailer), fp) == sizeof(trailer));
+    uint64_t footerOffset = 0;
+    memcpy(&footerOffset, trailer, 8);
+    uint8_t width = 9;
+    fseek(fp, footerOffset + 4 + 4 + 13, SEEK_SET);
+    CHECK(fwrite(&width, 1, 1, fp) == 1);
+    fclose(fp);
+
+    ColumnarFlowReader reader(sPath);
+    std::vector<uint64_t> values;
+    CHECK(reader.open());
+    CHECK(!reader.read_column(0, COL_START_US, values));
+    CHECK(reader.read_column(0, COL_END_US, values));
+    CHECK(reader.scan(0, UINT64_MAX, 0, 0, [](const ColumnarFlowRow_T&) {}) == 0);
+}
+
+/**
+ * A write that fails, here to a full device, is reported rather than
+ * leaving a file that looks complete.
+ */
+static void test_write_failure (const std::vector<ColumnarFlowRow_T>& rows) {
+    ColumnarFlowWriter writer("/dev/full");
+    if (!writer.open()) {
+        return;
+    }
+    for (size_t i = 0; i < COLUMNAR_BLOCK_ROWS + 10; i++) {
+        writer.append(rows[i]);
+    }
+    writer.close();
+    CHECK(writer.get_failed());
+}
+
+static void test_round_trip (std::string sPath, const std::vector<ColumnarFlowRow_T>& rows) {
+    ColumnarFlowWriter writer(sPath);
+    CHECK(writer.open());
+    for (auto& row : rows) {
+        writer.append(row);
+    }
+    CHECK(writer.get_rows() == rows.size());
+    CHECK(writer.get_blocks() == TEST_BLOCKS - 1);
+    writer.close();
+
+    ColumnarFlowReader reader(sPath);
+    CHECK(reader.open());
+    const std::vector<ColumnarBlockInfo_T>& blocks = reader.blocks();
+    CHECK(blocks.size() == TEST_BLOCKS);
+    if (blocks.size() != TEST_BLOCKS) {
+        return;
+    }
+
+    //Every encoding is exercised, including zero width deltas
+    const ColumnarBlockInfo_T& first = blocks[0];
+    CHECK(first.rows == COLUMNAR_BLOCK_ROWS);
+    CHECK(first.columns[COL_START_US].encoding == ENC_DELTA);
+    CHECK(first.columns[COL_SRC_HI].encoding == ENC_DELTA);
+    CHECK(first.columns[COL_SRC_HI].width == 0);
+    CHECK(first.columns[COL_SRC_LO].encoding == ENC_DICT);
+    CHECK(first.columns[COL_DST_LO].encoding == ENC_DELTA);
+    CHECK(first.columns[COL_DST_LO].width == 1);
+    CHECK(first.columns[COL_DPORT].encoding == ENC_DELTA);
+    CHECK(first.columns[COL_DPORT].width == 0);
+    CHECK(first.columns[COL_PROTO].encoding == ENC_PLAIN);
+    CHECK(first.columns[COL_PACKETS].encoding == ENC_PLAIN);
+    CHECK(blocks[TEST_BLOCKS - 1].rows == rows.size() - (TEST_BLOCKS - 1) * COLUMNAR_BLOCK_ROWS);
+
+    //Columns decode to exactly what was written
+    size_t base = 0;
+    for (size_t b = 0; b < blocks.size(); b++) {
+        std::vector<uint64_t> values[COL_COUNT];
+        for (size_t c = 0; c < COL_COUNT; c++) {
+            CHECK(reader.read_column(b, (ColumnarColumn_T)c, values[c]));
+            CHECK(values[c].size() == blocks[b].rows);
+            CHECK(blocks[b].columns[c].min <= blocks[b].columns[c].max);
+        }
+        for (size_t i = 0; i < blocks[b].rows && i < values[COL_COUNT - 1].size(); i++) {
+            const ColumnarFlowRow_T& row = rows[base + i];
+            CHECK(values[COL_START_US][i] == row.start_us);
+            CHECK(values[COL_END_US][i] == row.end_us);
+            CHECK(values[COL_SRC_HI][i] == 0);
+            CHECK(values[COL_SRC_LO][i] == (0xFFFF00000000ULL | host_v4(row.src)));
+            CHECK(values[COL_DST_HI][i] == 0);
+            CHECK(values[COL_DST_LO][i] == (0xFFFF00000000ULL | host_v4(row.dst)));
+            CHECK(values[COL_SPORT][i] == row.sport);
+            CHECK(values[COL_DPORT][i] == row.dport);
+            CHECK(values[COL_PROTO][i] == row.protocol);
+            CHECK(values[COL_PACKETS][i] == row.packets);
+            CHECK(values[COL_BYTES][i] == row.bytes);
+        }
+        base += blocks[b].rows;
+    }
+    std::vector<uint64_t> outOfRange;
+    CHECK(!reader.read_column(blocks.size(), COL_SRC_LO, outOfRange));
+
+    //A full scan returns every row in order
+    size_t next = 0;
+    CHECK(reader.scan(0, UINT64_MAX, 0, 0, [&](const ColumnarFlowRow_T& row) {
+        CHECK(next < rows.size() && row_equal(row, rows[next]));
+        next++;
+    }) == TEST_BLOCKS);
+    CHECK(next == rows.size());
+
+    //A window inside one block only reads that block. Flows last up to
+    //5s, so the window starts 10s into the block.
+    uint64_t windowStart = rows[COLUMNAR_BLOCK_ROWS + 10000].start_us;
+    uint64_t windowStop = rows[2 * COLUMNAR_BLOCK_ROWS - 100].start_us;
+    CHECK(reader.scan(windowStart, windowStop, 0, 0, [](const ColumnarFlowRow_T&) {}) == 1);
+
+    //So does a prefix only the last block uses
+    CHECK(reader.scan(0, UINT64_MAX, 0xC0A80000, 16, [](const ColumnarFlowRow_T&) {}) == 1);
+
+    //And a prefix no block covers reads nothing
+    CHECK(reader.scan(0, UINT64_MAX, 0xAC100000, 12, [](const ColumnarFlowRow_T&) {}) == 0);
+
+    //Random queries match a brute-force scan of the input
+    std::mt19937_64 rng(2);
+    uint64_t span = rows.back().end_us - TEST_BASE_US;
+    for (size_t q = 0; q < TEST_QUERIES; q++) {
+        uint64_t start = TEST_BASE_US + rng() % span;
+        uint64_t stop = start + rng() % (span / 4);
+        const ColumnarFlowRow_T& pick = rows[rng() % rows.size()];
+        uint8_t prefixLen = (q % 4 == 0) ? 0 : (uint8_t)(8 + rng() % 25);
+        uint32_t prefix = host_v4((q % 2) ? pick.src : pick.dst);
+        uint32_t mask = prefixLen == 0 ? 0 : (0xFFFFFFFF << (32 - prefixLen));
+
+        std::vector<const ColumnarFlowRow_T*> expected;
+        for (auto& row : rows) {
+            if (row.start_us <= stop && row.end_us >= start &&
+                ((host_v4(row.src) & mask) == (prefix & mask) || (host_v4(row.dst) & mask) == (prefix & mask))) {
+                expected.push_back(&row);
+            }
+        }
+
+        size_t found = 0;
+        size_t read = reader.scan(start, stop, prefix, prefixLen, [&](const ColumnarFlowRow_T& row) {
+            CHECK(found < expected.size() && row_equal(row, *expected[found]));
+            found++;
+        });
+        CHECK(found == expected.size());
+        CHECK(read <= TEST_BLOCKS);
+    }
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    char path[] = "/tmp/columnar_test_XXXXXX";
+    int fd = mkstemp(path);
+    std::vector<ColumnarFlowRow_T> rows;
+
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    make_rows(rows);
+    test_empty(path);
+    test_ipv6_round_trip(path);
+    test_round_trip(path, rows);
+    test_ipv6_blocks(path);
+    test_corrupt(path, rows);
+    test_bad_width(path, rows);
+    test_write_failure(rows);
+    unlink(path);
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("ColumnarFlowFileTest passed\n");
+    return 0;
+}
@@ -0,0 +1,175 @@
+/**@file DNSAnalyzerBench.cpp
+ *
+ * Times DNSAnalyzer::on_packet on a mix of queries and their
+ * responses, each response carrying a compressed CNAME and two A
+ * records, against the 1M packets/s goal. Packets are built up front
+ * and replayed with moving timestamps; records are dropped instead of
+ * being sent, so only parsing, interning and pairing are timed.
+ *
+ * Build and run from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/common -Isrc/analysis -Isrc/output \
+ *       -Isrc -Isrc/messages tests/DNSAnalyzerBench.cpp \
+ *       src/analysis/DNSAnalyzer.cpp src/analysis/FlowKey.cpp \
+ *       src/common/Logging.cpp -ltins -o dns_bench && ./dns_bench [packets]
+ *
+ * The packet count defaults to 10M.
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "DNSAnalyzer.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define BENCH_DEFAULT_PACKETS   (10000000)
+#define BENCH_TRANSACTIONS      (32768)
+#define BENCH_NAMES             (4096)
+#define BENCH_GOAL_PPS          (1000000.0)
+
+/**
+ * Drops its records as they are batched, so no proxy is needed.
+ */
+class BenchAnalyzer : public DNSAnalyzer {
+public:
+    BenchAnalyzer (void) :
+        DNSAnalyzer(nullptr)
+    {
+    }
+
+    void run (const std::vector<uint8_t>& pkt, uint64_t timestamp_us) {
+        on_packet(pkt.data(), (uint32_t)pkt.size(), 0, timestamp_us);
+        m_batch.clear();
+    }
+};
+
+static void put16 (std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+static void put32 (std::vector<uint8_t>& out, uint32_t v) {
+    put16(out, (uint16_t)(v >> 16));
+    put16(out, (uint16_t)v);
+}
+
+static void put_label (std::vector<uint8_t>& out, const std::string& sLabel) {
+    out.push_back((uint8_t)sLabel.size());
+    out.insert(out.end(), sLabel.begin(), sLabel.end());
+}
+
+static void put_answer (std::vector<uint8_t>& out, uint16_t type, uint16_t rdlen) {
+    put16(out, type);
+    put16(out, 1);
+    put32(out, 300);
+    put16(out, rdlen);
+}
+
+/**
+ * Builds the query or the response of one transaction for
+ * host<name>.example.com, wrapped in IPv4 and UDP.
+ */
+static std::vector<uint8_t> make_packet (size_t transaction, size_t name, bool bResponse) {
+    std::vector<uint8_t> msg;
+    std::vector<uint8_t> pkt;
+    uint32_t client = 0x0A000000 | (uint32_t)(transaction & 0xFFFF);
+    uint32_t server = 0x0A640035;
+    uint16_t port = (uint16_t)(1024 + transaction % 60000);
+
+    put16(msg, (uint16_t)(transaction * 7919));
+    put16(msg, bResponse ? 0x8180 : 0x0100);
+    put16(msg, 1);
+    put16(msg, bResponse ? 3 : 0);
+    put16(msg, 0);
+    put16(msg, 0);
+
+    put_label(msg, "host" + std::to_string(name));
+    put_label(msg, "example");
+    put_label(msg, "com");
+    msg.push_back(0);
+    put16(msg, DNS_TYPE_A);
+    put16(msg, 1);
+
+    if (bResponse) {
+        //CNAME to edge.<name>, then two A records for the target
+        put16(msg, 0xC000 | DNS_HEADER_SIZE);
+        put_answer(msg, DNS_TYPE_CNAME, 7);
+        uint16_t target = (uint16_t)msg.size();
+        put_label(msg, "edge");
+        put16(msg, 0xC000 | DNS_HEADER_SIZE);
+        for (uint32_t i = 0; i < 2; i++) {
+            put16(msg, 0xC000 | target);
+            put_answer(msg, DNS_TYPE_A, 4);
+            put32(msg, 0x5DB8D800 | (uint32_t)(name + i));
+        }
+    }
+
+    pkt.push_back(0x45);
+    pkt.push_back(0);
+    put16(pkt, (uint16_t)(28 + msg.size()));
+    put32(pkt, 0);
+    pkt.push_back(64);
+    pkt.push_back(17);
+    put16(pkt, 0);
+    put32(pkt, bResponse ? server : client);
+    put32(pkt, bResponse ? client : server);
+    put16(pkt, bResponse ? DNS_PORT : port);
+    put16(pkt, bResponse ? port : DNS_PORT);
+    put16(pkt, (uint16_t)(8 + msg.size()));
+    put16(pkt, 0);
+    pkt.insert(pkt.end(), msg.begin(), msg.end());
+    return pkt;
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    size_t count = BENCH_DEFAULT_PACKETS;
+
+    if (argc > 2 || (argc == 2 && (count = strtoull(argv[1], NULL, 10)) == 0)) {
+        fprintf(stderr, "usage: %s [packets]\n", argv[0]);
+        return 1;
+    }
+
+    //Each query is followed by its response a few transactions later,
+    //so several are pending at any time
+    std::vector<std::vector<uint8_t>> queries(BENCH_TRANSACTIONS);
+    std::vector<std::vector<uint8_t>> responses(BENCH_TRANSACTIONS);
+    for (size_t i = 0; i < BENCH_TRANSACTIONS; i++) {
+        queries[i] = make_packet(i, i % BENCH_NAMES, false);
+        responses[i] = make_packet(i, i % BENCH_NAMES, true);
+    }
+
+    BenchAnalyzer analyzer;
+    uint64_t timestamp_us = 1600000000ULL * 1000000;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; i++) {
+        size_t transaction = (i / 2) % BENCH_TRANSACTIONS;
+        if (i % 2 == 0) {
+            analyzer.run(queries[transaction], timestamp_us);
+        } else {
+            analyzer.run(responses[(transaction + BENCH_TRANSACTIONS - 8) % BENCH_TRANSACTIONS], timestamp_us);
+        }
+        timestamp_us++;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double pps = count / seconds;
+    printf("%zu packets in %.3f s: %.0f ns/packet, %.2fM packets/s (%s the %.0fM goal)\n",
+           count, seconds, seconds * 1e9 / count, pps / 1e6,
+           (pps >= BENCH_GOAL_PPS) ? "meets" : "misses", BENCH_GOAL_PPS / 1e6);
+    printf("%llu queries, %llu responses, %llu malformed\n",
+           (unsigned long long)analyzer.get_queries(), (unsigned long long)analyzer.get_responses(),
+           (unsigned long long)analyzer.get_malformed());
+    return 0;
+}
@@ -0,0 +1,378 @@
+/**@file DNSAnalyzerTest.cpp
+ *
+ * Feeds hand built DNS messages through DNSAnalyzer and checks the
+ * name decoder: compression pointers (including chains of them),
+ * pointer loops, truncated labels and names over 255 bytes. Records
+ * are read back from the analyzer's batch rather than sent anywhere.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/common -Isrc/analysis -Isrc/output \
+ *       -Isrc -Isrc/messages tests/DNSAnalyzerTest.cpp \
+ *       src/analysis/DNSAnalyzer.cpp src/analysis/FlowKey.cpp \
+ *       src/common/Logging.cpp -ltins -o dns_test && ./dns_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+
+#include "DNSAnalyzer.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_CLIENT         (0x0A000001)
+#define TEST_SERVER         (0x0A000035)
+#define TEST_CLIENT_PORT    (40000)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+/**
+ * Exposes the records batched so far. Nothing is ever flushed, so no
+ * proxy is needed.
+ */
+class TestAnalyzer : public DNSAnalyzer {
+public:
+    TestAnalyzer (void) :
+        DNSAnalyzer(nullptr)
+    {
+    }
+
+    const std::vector<DNSRecord_T>& batch (void) {
+        return m_batch;
+    }
+
+    std::string name (DNSName_T name) {
+        return m_names.str(name);
+    }
+};
+
+static void put16 (std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+static void put32 (std::vector<uint8_t>& out, uint32_t v) {
+    put16(out, (uint16_t)(v >> 16));
+    put16(out, (uint16_t)v);
+}
+
+static std::vector<uint8_t> make_header (uint16_t txid, uint16_t flags, uint16_t qdcount, uint16_t ancount) {
+    std::vector<uint8_t> msg;
+    put16(msg, txid);
+    put16(msg, flags);
+    put16(msg, qdcount);
+    put16(msg, ancount);
+    put16(msg, 0);
+    put16(msg, 0);
+    return msg;
+}
+
+/**
+ * Appends a dotted name as uncompressed labels.
+ */
+static void put_name (std::vector<uint8_t>& msg, const std::string& sName, bool bTerminate = true) {
+    size_t start = 0;
+    while (start < sName.size()) {
+        size_t dot = sName.find('.', start);
+        if (dot == std::string::npos) {
+            dot = sName.size();
+        }
+        msg.push_back((uint8_t)(dot - start));
+        msg.insert(msg.end(), sName.begin() + start, sName.begin() + dot);
+        start = dot + 1;
+    }
+    if (bTerminate) {
+        msg.push_back(0);
+    }
+}
+
+static void put_pointer (std::vector<uint8_t>& msg, uint16_t offset) {
+    put16(msg, 0xC000 | offset);
+}
+
+static void put_question (std::vector<uint8_t>& msg, const std::string& sName, uint16_t qtype) {
+    put_name(msg, sName);
+    put16(msg, qtype);
+    put16(msg, 1);
+}
+
+/**
+ * Appends the fixed part of an answer, its owner name already written.
+ */
+static void put_answer (std::vector<uint8_t>& msg, uint16_t type, uint32_t ttl, uint16_t rdlen) {
+    put16(msg, type);
+    put16(msg, 1);
+    put32(msg, ttl);
+    put16(msg, rdlen);
+}
+
+/**
+ * Wraps a DNS message in IPv4 and UDP headers.
+ */
+static std::vector<uint8_t> make_packet (const std::vector<uint8_t>& msg, bool bResponse) {
+    std::vector<uint8_t> pkt;
+    uint32_t src = bResponse ? TEST_SERVER : TEST_CLIENT;
+    uint32_t dst = bResponse ? TEST_CLIENT : TEST_SERVER;
+
+    pkt.push_back(0x45);
+    pkt.push_back(0);
+    put16(pkt, (uint16_t)(28 + msg.size()));
+    put32(pkt, 0);
+    pkt.push_back(64);
+    pkt.push_back(17);
+    put16(pkt, 0);
+    put32(pkt, src);
+    put32(pkt, dst);
+
+    put16(pkt, bResponse ? DNS_PORT : TEST_CLIENT_PORT);
+    put16(pkt, bResponse ? TEST_CLIENT_PORT : DNS_PORT);
+    put16(pkt, (uint16_t)(8 + msg.size()));
+    put16(pkt, 0);
+
+    pkt.insert(pkt.end(), msg.begin(), msg.end());
+    return pkt;
+}
+
+static void send (TestAnalyzer& analyzer, const std::vector<uint8_t>& msg, bool bResponse, uint64_t timestamp_us) {
+    std::vector<uint8_t> pkt = make_packet(msg, bResponse);
+    analyzer.on_packet(pkt.data(), (uint32_t)pkt.size(), 0, timestamp_us);
+}
+
+/**
+ * A CNAME whose target is compressed against the question, and an A
+ * record whose owner points at that target, so its name takes two
+ * jumps.
+ */
+static void test_compression (void) {
+    TestAnalyzer analyzer;
+
+    std::vector<uint8_t> query = make_header(0x1234, 0x0100, 1, 0);
+    put_question(query, "WWW.Example.com", DNS_TYPE_A);
+    send(analyzer, query, false, 1000);
+
+    std::vector<uint8_t> response = make_header(0x1234, 0x8180, 1, 2);
+    put_question(response, "www.example.com", DNS_TYPE_A);
+
+    //www.example.com CNAME cdn.example.com
+    put_pointer(response, DNS_HEADER_SIZE);
+    put_answer(response, DNS_TYPE_CNAME, 300, 6);
+    uint16_t target = (uint16_t)response.size();
+    put_name(response, "cdn", false);
+    put_pointer(response, DNS_HEADER_SIZE + 4);
+
+    //cdn.example.com A 93.184.216.34
+    put_pointer(response, target);
+    put_answer(response, DNS_TYPE_A, 60, 4);
+    put32(response, 0x5DB8D822);
+    send(analyzer, response, true, 3000);
+
+    CHECK(analyzer.get_malformed() == 0);
+    CHECK(analyzer.batch().size() == 1);
+    if (analyzer.batch().size() != 1) {
+        return;
+    }
+
+    const DNSRecord_T& record = analyzer.batch()[0];
+    CHECK(record.txid == 0x1234);
+    CHECK(record.query_us == 1000);
+    CHECK(record.response_us == 3000);
+    CHECK(record.qtype == DNS_TYPE_A);
+    CHECK(record.rcode == 0);
+    CHECK(record.key.sport == TEST_CLIENT_PORT);
+    CHECK(analyzer.name(record.qname) == "www.example.com");
+    CHECK(record.answer_count == 2);
+    CHECK(record.answers[0].type == DNS_TYPE_CNAME);
+    CHECK(record.answers[0].ttl == 300);
+    CHECK(analyzer.name(record.answers[0].name) == "cdn.example.com");
+    CHECK(record.answers[1].type == DNS_TYPE_A);
+    CHECK(record.answers[1].ttl == 60);
+    CHECK(FlowAddressGetV4(record.answers[1].addr) == htonl(0x5DB8D822));
+}
+
+/**
+ * Pointers that point at themselves, forwards, or at each other are
+ * rejected rather than followed.
+ */
+static void test_pointer_loops (void) {
+    TestAnalyzer analyzer;
+
+    //The question is a pointer to itself
+    std::vector<uint8_t> self = make_header(1, 0x0100, 1, 0);
+    put_pointer(self, DNS_HEADER_SIZE);
+    put16(self, DNS_TYPE_A);
+    put16(self, 1);
+    send(analyzer, self, false, 1000);
+    CHECK(analyzer.get_malformed() == 1);
+
+    //A label followed by a pointer back to the label
+    std::vector<uint8_t> back = make_header(2, 0x0100, 1, 0);
+    put_name(back, "a", false);
+    put_pointer(back, DNS_HEADER_SIZE);
+    put16(back, DNS_TYPE_A);
+    put16(back, 1);
+    send(analyzer, back, false, 1000);
+    CHECK(analyzer.get_malformed() == 2);
+
+    //A pointer past the end of the name
+    std::vector<uint8_t> forward = make_header(3, 0x0100, 1, 0);
+    put_pointer(forward, DNS_HEADER_SIZE + 6);
+    put16(forward, DNS_TYPE_A);
+    put16(forward, 1);
+    put_name(forward, "example.com");
+    send(analyzer, forward, false, 1000);
+    CHECK(analyzer.get_malformed() == 3);
+    CHECK(analyzer.get_queries() == 0);
+
+    //Two answer names pointing at each other end the answers, the
+    //response itself is still reported
+    std::vector<uint8_t> response = make_header(4, 0x8180, 1, 1);
+    put_question(response, "example.com", DNS_TYPE_A);
+    uint16_t first = (uint16_t)response.size();
+    put_pointer(response, first + 2);
+    put_pointer(response, first);
+    put_answer(response, DNS_TYPE_A, 60, 4);
+    put32(response, 0x01020304);
+    send(analyzer, response, true, 2000);
+
+    CHECK(analyzer.get_responses() == 1);
+    CHECK(analyzer.batch().size() == 1);
+    if (analyzer.batch().size() == 1) {
+        CHECK(analyzer.name(analyzer.batch()[0].qname) == "example.com");
+        CHECK(analyzer.batch()[0].answer_count == 0);
+    }
+}
+
+static void test_truncated (void) {
+    TestAnalyzer analyzer;
+
+    //Shorter than the header
+    std::vector<uint8_t> header = make_header(1, 0x0100, 1, 0);
+    header.resize(DNS_HEADER_SIZE - 2);
+    send(analyzer, header, false, 1000);
+    CHECK(analyzer.get_malformed() == 1);
+
+    //A label longer than what is left of the message
+    std::vector<uint8_t> label = make_header(2, 0x0100, 1, 0);
+    label.push_back(10);
+    label.insert(label.end(), { 'a', 'b', 'c' });
+    send(analyzer, label, false, 1000);
+    CHECK(analyzer.get_malformed() == 2);
+
+    //The message ends in the middle of a pointer
+    std::vector<uint8_t> pointer = make_header(3, 0x0100, 1, 0);
+    put_name(pointer, "example", false);
+    pointer.push_back(0xC0);
+    send(analyzer, pointer, false, 1000);
+    CHECK(analyzer.get_malformed() == 3);
+
+    //No terminating label
+    std::vector<uint8_t> unterminated = make_header(4, 0x0100, 1, 0);
+    put_name(unterminated, "example.com", false);
+    send(analyzer, unterminated, false, 1000);
+    CHECK(analyzer.get_malformed() == 4);
+
+    //Extended label types
+    std::vector<uint8_t> extended = make_header(5, 0x0100, 1, 0);
+    extended.push_back(0x41);
+    put_question(extended, "example.com", DNS_TYPE_A);
+    send(analyzer, extended, false, 1000);
+    CHECK(analyzer.get_malformed() == 5);
+    CHECK(analyzer.get_queries() == 0);
+
+    //An answer whose data runs past the end keeps the answers before it
+    std::vector<uint8_t> response = make_header(6, 0x8180, 1, 2);
+    put_question(response, "example.com", DNS_TYPE_A);
+    put_pointer(response, DNS_HEADER_SIZE);
+    put_answer(response, DNS_TYPE_A, 60, 4);
+    put32(response, 0x01020304);
+    put_pointer(response, DNS_HEADER_SIZE);
+    put_answer(response, DNS_TYPE_A, 60, 4);
+    put16(response, 0x0506);
+    send(analyzer, response, true, 2000);
+
+    CHECK(analyzer.get_malformed() == 5);
+    CHECK(analyzer.batch().size() == 1);
+    if (analyzer.batch().size() == 1) {
+        CHECK(analyzer.batch()[0].answer_count == 1);
+        CHECK(FlowAddressGetV4(analyzer.batch()[0].answers[0].addr) == htonl(0x01020304));
+    }
+}
+
+/**
+ * Names are limited to DNS_MAX_NAME bytes in dotted form, whether
+ * they are written out or assembled through a pointer.
+ */
+static void test_long_names (void) {
+    TestAnalyzer analyzer;
+    std::string sLabel(63, 'x');
+    std::string sLongest = sLabel + "." + sLabel + "." + sLabel + "." + sLabel;
+
+    CHECK(sLongest.size() == DNS_MAX_NAME);
+
+    std::vector<uint8_t> longest = make_header(1, 0x0100, 1, 0);
+    put_question(longest, sLongest, DNS_TYPE_A);
+    send(analyzer, longest, false, 1000);
+    CHECK(analyzer.get_malformed() == 0);
+    CHECK(analyzer.get_queries() == 1);
+
+    std::vector<uint8_t> over = make_header(2, 0x0100, 1, 0);
+    put_question(over, sLongest + ".y", DNS_TYPE_A);
+    send(analyzer, over, false, 1000);
+    CHECK(analyzer.get_malformed() == 1);
+
+    //Two labels in front of a pointer to a 191 byte name: the first
+    //CNAME fits, the second is one label too long and ends the answers
+    std::string sBase = sLabel + "." + sLabel + "." + sLabel;
+    std::vector<uint8_t> response = make_header(3, 0x8180, 1, 2);
+    put_question(response, sBase, DNS_TYPE_CNAME);
+
+    put_pointer(response, DNS_HEADER_SIZE);
+    put_answer(response, DNS_TYPE_CNAME, 60, 66);
+    put_name(response, sLabel, false);
+    put_pointer(response, DNS_HEADER_SIZE);
+
+    put_pointer(response, DNS_HEADER_SIZE);
+    put_answer(response, DNS_TYPE_CNAME, 60, 68);
+    put_name(response, "z." + sLabel, false);
+    put_pointer(response, DNS_HEADER_SIZE);
+    send(analyzer, response, true, 2000);
+
+    CHECK(analyzer.get_responses() == 1);
+    CHECK(analyzer.batch().size() == 1);
+    if (analyzer.batch().size() == 1) {
+        const DNSRecord_T& record = analyzer.batch()[0];
+        CHECK(analyzer.name(record.qname) == sBase);
+        CHECK(record.answer_count == 1);
+        CHECK(analyzer.name(record.answers[0].name) == sLabel + "." + sBase);
+    }
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    test_compression();
+    test_pointer_loops();
+    test_truncated();
+    test_long_names();
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("DNSAnalyzerTest passed\n");
+    return 0;
+}
@@ -0,0 +1,315 @@
+/**@file FragmentTrackerTest.cpp
+ *
+ * Feeds IPv4 and IPv6 fragments through FragmentTracker in order, out
+ * of order, overlapping and with a fragment missing, and checks which
+ * flow each is attributed to, when datagrams are released, and how
+ * fragments whose first fragment never arrives are counted once they
+ * time out or are evicted.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/analysis tests/FragmentTrackerTest.cpp \
+ *       src/analysis/FragmentTracker.cpp -o fragment_tracker_test && ./fragment_tracker_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <vector>
+
+#include "FragmentTracker.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_SPORT          (1234)
+#define TEST_DPORT          (5678)
+#define TEST_START_US       (1000000000ULL)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+/**
+ * Payload of a fragment at offset, the first one starting with a UDP
+ * header.
+ */
+static std::vector<uint8_t> make_payload (uint32_t offset, uint32_t len) {
+    std::vector<uint8_t> payload(len, (uint8_t)offset);
+    if (offset == 0 && len >= 8) {
+        payload[0] = TEST_SPORT >> 8;
+        payload[1] = TEST_SPORT & 0xFF;
+        payload[2] = TEST_DPORT >> 8;
+        payload[3] = TEST_DPORT & 0xFF;
+    }
+    return payload;
+}
+
+static std::vector<uint8_t> make_ipv4 (uint16_t id, uint32_t offset, bool bMore, uint32_t len,
+                                       uint32_t src = 0x0A000001) {
+    std::vector<uint8_t> pkt(20, 0);
+    std::vector<uint8_t> payload = make_payload(offset, len);
+    uint16_t totLen = (uint16_t)(20 + len);
+    uint16_t flags = (uint16_t)((offset / 8) | (bMore ? 0x2000 : 0));
+
+    pkt[0] = 0x45;
+    pkt[2] = totLen >> 8;
+    pkt[3] = totLen & 0xFF;
+    pkt[4] = id >> 8;
+    pkt[5] = id & 0xFF;
+    pkt[6] = flags >> 8;
+    pkt[7] = flags & 0xFF;
+    pkt[8] = 64;
+    pkt[9] = 17;
+    uint32_t v4 = htonl(src);
+    memcpy(&pkt[12], &v4, 4);
+    v4 = htonl(0x0A000002);
+    memcpy(&pkt[16], &v4, 4);
+    pkt.insert(pkt.end(), payload.begin(), payload.end());
+    return pkt;
+}
+
+/**
+ * IPv6 fragment, optionally behind a hop-by-hop options header.
+ */
+static std::vector<uint8_t> make_ipv6 (uint32_t id, uint32_t offset, bool bMore, uint32_t len,
+                                       bool bHopByHop) {
+    std::vector<uint8_t> pkt(40, 0);
+    std::vector<uint8_t> payload = make_payload(offset, len);
+    uint16_t payloadLen = (uint16_t)((bHopByHop ? 8 : 0) + 8 + len);
+    uint16_t flags = (uint16_t)(offset | (bMore ? 1 : 0));
+
+    pkt[0] = 0x60;
+    pkt[4] = payloadLen >> 8;
+    pkt[5] = payloadLen & 0xFF;
+    pkt[6] = bHopByHop ? 0 : 44;
+    pkt[7] = 64;
+    pkt[8] = 0x20;
+    pkt[9] = 0x01;
+    pkt[23] = 1;
+    pkt[24] = 0x20;
+    pkt[25] = 0x01;
+    pkt[39] = 2;
+
+    if (bHopByHop) {
+        uint8_t hop[8] = { 44, 0, 1, 4, 0, 0, 0, 0 };
+        pkt.insert(pkt.end(), hop, hop + 8);
+    }
+    uint8_t frag[8] = { 17, 0, (uint8_t)(flags >> 8), (uint8_t)(flags & 0xFF),
+                        (uint8_t)(id >> 24), (uint8_t)(id >> 16), (uint8_t)(id >> 8), (uint8_t)id };
+    pkt.insert(pkt.end(), frag, frag + 8);
+    pkt.insert(pkt.end(), payload.begin(), payload.end());
+    return pkt;
+}
+
+static bool feed (FragmentTracker& tracker, const std::vector<uint8_t>& pkt, uint64_t timestamp_us,
+                  FragmentResult_T& result) {
+    return tracker.on_packet(pkt.data(), (uint32_t)pkt.size(), timestamp_us, result);
+}
+
+static bool has_ports (const FragmentResult_T& result) {
+    return result.attributed && result.key.sport == TEST_SPORT &&
+           result.key.dport == TEST_DPORT && result.key.protocol == 17;
+}
+
+static void test_in_order (void) {
+    FragmentTracker tracker;
+    FragmentResult_T result;
+
+    //Packets that aren't fragments are left alone
+    std::vector<uint8_t> whole = make_ipv4(1, 0, false, 100);
+    CHECK(!feed(tracker, whole, TEST_START_US, result));
+
+    CHECK(feed(tracker, make_ipv4(2, 0, true, 32), TEST_START_US, result));
+    CHECK(has_ports(result));
+    CHECK(result.l4 != NULL && result.l4_len == 32);
+    CHECK(FlowAddressGetV4(result.key.src) == htonl(0x0A000001));
+    CHECK(result.packets == 1 && result.bytes == 52);
+
+    CHECK(feed(tracker, make_ipv4(2, 32, true, 32), TEST_START_US, result));
+    CHECK(has_ports(result));
+    CHECK(result.l4 == NULL);
+
+    CHECK(feed(tracker, make_ipv4(2, 64, false, 16), TEST_START_US, result));
+    CHECK(has_ports(result));
+
+    //Every byte has been seen, so the datagram was released and a late
+    //copy of the last fragment waits for a first fragment again
+    CHECK(feed(tracker, make_ipv4(2, 64, false, 16), TEST_START_US, result));
+    CHECK(!result.attributed);
+
+    CHECK(tracker.get_fragments() == 4);
+    CHECK(tracker.get_attributed() == 3);
+    CHECK(tracker.get_lost() == 0);
+}
+
+/**
+ * Fragments ahead of the first one are held and counted with it.
+ */
+static void test_out_of_order (void) {
+    FragmentTracker tracker;
+    FragmentResult_T result;
+
+    CHECK(feed(tracker, make_ipv4(7, 64, false, 16), TEST_START_US, result));
+    CHECK(!result.attributed);
+    CHECK(result.key.sport == 0);
+    CHECK(feed(tracker, make_ipv4(7, 32, true, 32), TEST_START_US + 1, result));
+    CHECK(!result.attributed);
+
+    CHECK(feed(tracker, make_ipv4(7, 0, true, 32), TEST_START_US + 2, result));
+    CHECK(has_ports(result));
+    CHECK(result.packets == 3);
+    CHECK(result.bytes == 36 + 52 + 52);
+    CHECK(tracker.get_attributed() == 3);
+
+    //A different ID is a different datagram
+    CHECK(feed(tracker, make_ipv4(8, 32, true, 32), TEST_START_US + 3, result));
+    CHECK(!result.attributed);
+    CHECK(tracker.get_lost() == 0);
+}
+
+/**
+ * Overlapping and duplicated fragments are attributed, and the
+ * datagram is released once the bytes seen cover its length.
+ */
+static void test_overlap (void) {
+    FragmentTracker tracker;
+    FragmentResult_T result;
+
+    CHECK(feed(tracker, make_ipv4(3, 0, true, 40), TEST_START_US, result));
+    CHECK(has_ports(result));
+    CHECK(feed(tracker, make_ipv4(3, 24, true, 40), TEST_START_US, result));
+    CHECK(has_ports(result));
+    CHECK(feed(tracker, make_ipv4(3, 24, true, 40), TEST_START_US, result));
+    CHECK(has_ports(result));
+
+    //The overlaps are counted twice, so the last fragment makes up the
+    //136 bytes of the datagram although bytes 64 to 120 are missing
+    CHECK(feed(tracker, make_ipv4(3, 120, false, 16), TEST_START_US, result));
+    CHECK(has_ports(result));
+
+    //The datagram was released early, so the gap starts a new one
+    CHECK(feed(tracker, make_ipv4(3, 64, true, 56), TEST_START_US, result));
+    CHECK(!result.attributed);
+    CHECK(tracker.get_attributed() == 4);
+}
+
+/**
+ * A datagram missing a middle fragment is kept until the timeout, so
+ * the fragment is still attributed if it turns up late. Fragments
+ * whose first fragment never arrives are counted as lost once their
+ * datagram times out.
+ */
+static void test_missing_and_timeout (void) {
+    FragmentTracker tracker;
+    FragmentResult_T result;
+
+    CHECK(feed(tracker, make_ipv4(4, 0, true, 32), TEST_START_US, result));
+    CHECK(feed(tracker, make_ipv4(4, 64, false, 16), TEST_START_US, result));
+    CHECK(has_ports(result));
+    CHECK(feed(tracker, make_ipv4(4, 32, true, 32), TEST_START_US + FRAGMENT_TIMEOUT_US - 1, result));
+    CHECK(has_ports(result));
+
+    //Only the first fragment is missing
+    CHECK(feed(tracker, make_ipv4(5, 32, true, 32), TEST_START_US, result));
+    CHECK(feed(tracker, make_ipv4(5, 64, false, 16), TEST_START_US, result));
+    CHECK(tracker.get_lost() == 0);
+
+    //It arrives after the timeout, the held fragments are dropped as
+    //lost when the slot is reclaimed and it starts a new datagram
+    CHECK(feed(tracker, make_ipv4(5, 0, true, 32), TEST_START_US + FRAGMENT_TIMEOUT_US, result));
+    CHECK(has_ports(result));
+    CHECK(result.packets == 1);
+    CHECK(tracker.get_lost() == 2);
+    CHECK(tracker.get_evicted() == 0);
+}
+
+/**
+ * The pool has a fixed size: past it the oldest datagrams in a probe
+ * window are evicted, and once they time out slots are reused without
+ * evicting anything.
+ */
+static void test_eviction (void) {
+    FragmentTracker tracker;
+    FragmentResult_T result;
+    const uint32_t datagrams = 2 * FRAGMENT_POOL_SIZE;
+
+    for (uint32_t i = 0; i < datagrams; i++) {
+        feed(tracker, make_ipv4((uint16_t)i, 32, true, 32, 0x0A000000 + (i >> 16)), TEST_START_US + i, result);
+    }
+    CHECK(tracker.get_evicted() >= datagrams - FRAGMENT_POOL_SIZE);
+    CHECK(tracker.get_lost() == tracker.get_evicted());
+
+    //The newest datagrams survived, so their first fragments collect
+    //the fragments held for them
+    size_t collected = 0;
+    for (uint32_t i = datagrams - 100; i < datagrams; i++) {
+        feed(tracker, make_ipv4((uint16_t)i, 0, true, 32, 0x0A000000 + (i >> 16)), TEST_START_US + datagrams, result);
+        collected += (result.packets == 2);
+    }
+    CHECK(collected >= 95);
+
+    uint64_t evicted = tracker.get_evicted();
+    uint64_t later = TEST_START_US + datagrams + FRAGMENT_TIMEOUT_US;
+    for (uint32_t i = 0; i < FRAGMENT_POOL_SIZE / 4; i++) {
+        feed(tracker, make_ipv4((uint16_t)i, 32, true, 32, 0x0B000000), later, result);
+    }
+    CHECK(tracker.get_evicted() == evicted);
+}
+
+static void test_ipv6 (void) {
+    FragmentTracker tracker;
+    FragmentResult_T result;
+
+    //Atomic fragments aren't fragments
+    CHECK(!feed(tracker, make_ipv6(9, 0, false, 40, false), TEST_START_US, result));
+
+    CHECK(feed(tracker, make_ipv6(0x12345678, 48, false, 24, false), TEST_START_US, result));
+    CHECK(!result.attributed);
+    CHECK(feed(tracker, make_ipv6(0x12345678, 0, true, 48, false), TEST_START_US, result));
+    CHECK(has_ports(result));
+    CHECK(result.packets == 2);
+    CHECK(result.bytes == (40 + 8 + 24) + (40 + 8 + 48));
+    CHECK(!FlowAddressIsV4(result.key.src));
+    CHECK(result.key.src.bytes[0] == 0x20 && result.key.src.bytes[15] == 1);
+    CHECK(result.key.dst.bytes[15] == 2);
+    CHECK(result.l4 != NULL && result.l4_len == 48);
+
+    //The fragment header can follow other extension headers, and the
+    //32-bit ID tells datagrams apart
+    CHECK(feed(tracker, make_ipv6(0x12345679, 0, true, 48, true), TEST_START_US, result));
+    CHECK(has_ports(result));
+    CHECK(feed(tracker, make_ipv6(0x12345679, 48, false, 8, true), TEST_START_US, result));
+    CHECK(has_ports(result));
+    CHECK(feed(tracker, make_ipv6(0x1234567A, 48, false, 8, true), TEST_START_US, result));
+    CHECK(!result.attributed);
+
+    CHECK(tracker.get_fragments() == 5);
+    CHECK(tracker.get_attributed() == 4);
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    test_in_order();
+    test_out_of_order();
+    test_overlap();
+    test_missing_and_timeout();
+    test_eviction();
+    test_ipv6();
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("FragmentTrackerTest passed\n");
+    return 0;
+}
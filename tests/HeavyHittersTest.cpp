@@ -0,0 +1,340 @@
+/**@file HeavyHittersTest.cpp
+ *
+ * Runs Zipf distributed streams through the heavy hitter structures
+ * and checks the Count-Min error bound, the recall of the Space-Saving
+ * top keys and that summaries built on two shards of a stream merge
+ * into what one instance would have reported, both for the structures
+ * on their own and for HeavyHitters fed with packets.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/common -Isrc/analysis -Isrc/output \
+ *       -Isrc -Isrc/messages tests/HeavyHittersTest.cpp \
+ *       src/analysis/HeavyHitters.cpp src/analysis/HyperLogLog.cpp \
+ *       src/analysis/FlowKey.cpp -ltins -o heavy_hitters_test && ./heavy_hitters_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "HeavyHitters.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_KEYS           (100000)
+#define TEST_ITEMS          (1000000)
+#define TEST_ZIPF_S         (1.1)
+#define TEST_PACKETS        (200000)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+/**
+ * Key ranks drawn from a Zipf distribution, rank 0 the most frequent.
+ */
+static std::vector<uint32_t> zipf_stream (size_t keys, size_t items, double s, uint32_t seed) {
+    std::vector<double> cdf(keys);
+    std::vector<uint32_t> stream(items);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double total = 0.0;
+
+    for (size_t i = 0; i < keys; i++) {
+        total += 1.0 / pow((double)(i + 1), s);
+        cdf[i] = total;
+    }
+    for (auto& item : stream) {
+        double u = uniform(rng) * total;
+        item = (uint32_t)std::min((size_t)(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()),
+                                  keys - 1);
+    }
+    return stream;
+}
+
+/**
+ * Source address key of a rank.
+ */
+static FlowKey_T rank_key (uint32_t rank) {
+    FlowKey_T key;
+    FlowKeyClear(key);
+    FlowAddressSetV4(key.src, htonl(0x0A000000 + rank));
+    return key;
+}
+
+/**
+ * Bytes of a packet of a rank, so the metrics rank keys differently.
+ */
+static uint64_t rank_bytes (uint32_t rank) {
+    return 64 + (rank % 7) * 200;
+}
+
+/**
+ * Counts a stream the way HeavyHitters counts one dimension.
+ */
+static void count_stream (const std::vector<uint32_t>& stream, size_t first, size_t step,
+                          CountMinSketch& sketch, SpaceSaving& top) {
+    bool bNew;
+
+    for (size_t i = first; i < stream.size(); i += step) {
+        FlowKey_T key = rank_key(stream[i]);
+        uint64_t hash = FlowKeyHash(key);
+        HeavyCounter_T estimate = sketch.add(hash, 1, rank_bytes(stream[i]));
+        top.offer(key, hash, 1, estimate.value[HEAVY_PACKETS], bNew);
+    }
+}
+
+static std::vector<uint64_t> true_counts (const std::vector<uint32_t>& stream) {
+    std::vector<uint64_t> counts(TEST_KEYS, 0);
+    for (auto rank : stream) {
+        counts[rank]++;
+    }
+    return counts;
+}
+
+/**
+ * Estimates never fall short, and overshoot by more than 2/width of
+ * the total for at most (1/2)^depth of the keys.
+ */
+static void test_error_bound (void) {
+    std::vector<uint32_t> stream = zipf_stream(TEST_KEYS, TEST_ITEMS, TEST_ZIPF_S, 1);
+    std::vector<uint64_t> counts = true_counts(stream);
+    std::vector<uint64_t> bytes(TEST_KEYS, 0);
+    CountMinSketch sketch;
+    uint64_t totalBytes = 0;
+
+    for (auto rank : stream) {
+        sketch.add(FlowKeyHash(rank_key(rank)), 1, rank_bytes(rank));
+        bytes[rank] += rank_bytes(rank);
+        totalBytes += rank_bytes(rank);
+    }
+
+    uint64_t packetBound = 2 * TEST_ITEMS / HEAVY_CMS_WIDTH;
+    uint64_t byteBound = 2 * totalBytes / HEAVY_CMS_WIDTH;
+    size_t under = 0;
+    size_t over[HEAVY_METRICS] = { 0, 0 };
+    for (uint32_t rank = 0; rank < TEST_KEYS; rank++) {
+        HeavyCounter_T estimate = sketch.estimate(FlowKeyHash(rank_key(rank)));
+        under += (estimate.value[HEAVY_PACKETS] < counts[rank]) || (estimate.value[HEAVY_BYTES] < bytes[rank]);
+        over[HEAVY_PACKETS] += (estimate.value[HEAVY_PACKETS] - counts[rank] > packetBound);
+        over[HEAVY_BYTES] += (estimate.value[HEAVY_BYTES] - bytes[rank] > byteBound);
+    }
+    CHECK(under == 0);
+    CHECK(over[HEAVY_PACKETS] <= TEST_KEYS >> HEAVY_CMS_DEPTH);
+    CHECK(over[HEAVY_BYTES] <= TEST_KEYS >> HEAVY_CMS_DEPTH);
+    printf("Count-Min: %zu packet and %zu byte estimates of %d past 2/width of the total\n",
+           over[HEAVY_PACKETS], over[HEAVY_BYTES], TEST_KEYS);
+}
+
+/**
+ * The reported top keys are the true top keys, and each true count
+ * lies within the entry's error.
+ */
+static void check_top (const SpaceSaving& top, const std::vector<uint64_t>& counts, const char* pName) {
+    std::vector<uint32_t> ranks(TEST_KEYS);
+    std::vector<int> entries;
+
+    for (uint32_t i = 0; i < TEST_KEYS; i++) {
+        ranks[i] = i;
+    }
+    std::partial_sort(ranks.begin(), ranks.begin() + HEAVY_TOP_K, ranks.end(), [&counts](uint32_t a, uint32_t b) {
+        return counts[a] > counts[b];
+    });
+
+    top.top(entries, HEAVY_TOP_K);
+    CHECK(entries.size() == HEAVY_TOP_K);
+
+    size_t recalled = 0;
+    size_t bounded = 0;
+    for (size_t i = 0; i < HEAVY_TOP_K; i++) {
+        FlowKey_T key = rank_key(ranks[i]);
+        recalled += (top.find(key, FlowKeyHash(key)) >= 0);
+    }
+    for (int index : entries) {
+        const HeavyEntry_T& entry = top.entry(index);
+        for (uint32_t rank = 0; rank < TEST_KEYS; rank++) {
+            if (FlowKeyEqual(entry.key, rank_key(rank))) {
+                bounded += (entry.count - entry.error <= counts[rank] && counts[rank] <= entry.count);
+                break;
+            }
+        }
+    }
+    CHECK(recalled == HEAVY_TOP_K);
+    CHECK(bounded == entries.size());
+    printf("%s: %zu of the top %d keys recalled\n", pName, recalled, HEAVY_TOP_K);
+}
+
+static void test_top_k (void) {
+    std::vector<uint32_t> stream = zipf_stream(TEST_KEYS, TEST_ITEMS, TEST_ZIPF_S, 2);
+    CountMinSketch sketch;
+    SpaceSaving top;
+
+    count_stream(stream, 0, 1, sketch, top);
+    check_top(top, true_counts(stream), "Space-Saving");
+}
+
+/**
+ * Sketches of two shards add up to the sketch of the whole stream,
+ * and the merged summary still finds the top keys.
+ */
+static void test_merge_shards (void) {
+    std::vector<uint32_t> stream = zipf_stream(TEST_KEYS, TEST_ITEMS, TEST_ZIPF_S, 3);
+    CountMinSketch whole;
+    CountMinSketch shards[2];
+    SpaceSaving wholeTop;
+    SpaceSaving shardTops[2];
+
+    count_stream(stream, 0, 1, whole, wholeTop);
+    count_stream(stream, 0, 2, shards[0], shardTops[0]);
+    count_stream(stream, 1, 2, shards[1], shardTops[1]);
+
+    shards[0].merge(shards[1]);
+    size_t differ = 0;
+    for (uint32_t rank = 0; rank < TEST_KEYS; rank++) {
+        uint64_t hash = FlowKeyHash(rank_key(rank));
+        HeavyCounter_T a = whole.estimate(hash);
+        HeavyCounter_T b = shards[0].estimate(hash);
+        differ += (a.value[HEAVY_PACKETS] != b.value[HEAVY_PACKETS]) ||
+                  (a.value[HEAVY_BYTES] != b.value[HEAVY_BYTES]);
+    }
+    CHECK(differ == 0);
+
+    std::vector<HeavyOrigin_T> origins;
+    shardTops[0].merge(shardTops[1], &origins);
+    check_top(shardTops[0], true_counts(stream), "Merged Space-Saving");
+
+    //Every merged entry came from at least one shard
+    size_t orphans = 0;
+    for (auto& origin : origins) {
+        orphans += (origin.self < 0 && origin.other < 0);
+    }
+    CHECK(origins.size() == HEAVY_CAPACITY);
+    CHECK(orphans == 0);
+}
+
+/**
+ * IPv4/UDP packet from the source of a rank to one of a few servers.
+ */
+static std::vector<uint8_t> make_packet (uint32_t rank, uint32_t server) {
+    std::vector<uint8_t> pkt(28 + 100, 0);
+    FlowKey_T key = rank_key(rank);
+
+    pkt[0] = 0x45;
+    pkt[2] = 0;
+    pkt[3] = (uint8_t)pkt.size();
+    pkt[9] = 17;
+    memcpy(&pkt[12], key.src.bytes + 12, 4);
+    pkt[16] = 192;
+    pkt[17] = 168;
+    pkt[19] = (uint8_t)(1 + server);
+    pkt[20] = 0x30;
+    pkt[21] = 0x39;
+    pkt[23] = 53;
+    return pkt;
+}
+
+/**
+ * Checks that the first k keys of a ranking are the same in both
+ * snapshots.
+ */
+static bool same_hitters (const std::vector<HeavyHitter_T>& a, const std::vector<HeavyHitter_T>& b,
+                          HeavyDimension_T dimension, HeavyMetric_T metric, size_t k) {
+    std::vector<const HeavyHitter_T*> ra;
+    std::vector<const HeavyHitter_T*> rb;
+
+    for (auto& hitter : a) {
+        if (hitter.dimension == dimension && hitter.metric == metric && ra.size() < k) {
+            ra.push_back(&hitter);
+        }
+    }
+    for (auto& hitter : b) {
+        if (hitter.dimension == dimension && hitter.metric == metric && rb.size() < k) {
+            rb.push_back(&hitter);
+        }
+    }
+    if (ra.size() != k || rb.size() != k) {
+        return false;
+    }
+    //Keys with close counts may swap places
+    for (size_t i = 0; i < k; i++) {
+        bool bFound = false;
+        for (size_t j = 0; j < k; j++) {
+            bFound |= FlowKeyEqual(ra[i]->entry.key, rb[j]->entry.key);
+        }
+        if (!bFound) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Two HeavyHitters given alternate packets of one window report the
+ * same leading keys and counts close to one given every packet.
+ */
+static void test_merge_instances (void) {
+    std::vector<uint32_t> stream = zipf_stream(TEST_KEYS, TEST_PACKETS, TEST_ZIPF_S, 4);
+    HeavyHitters whole(nullptr, 60 * 1000000ULL);
+    HeavyHitters shards[2] = { HeavyHitters(nullptr, 60 * 1000000ULL), HeavyHitters(nullptr, 60 * 1000000ULL) };
+    uint64_t timestamp_us = 1600000000ULL * 1000000;
+
+    for (size_t i = 0; i < stream.size(); i++) {
+        std::vector<uint8_t> pkt = make_packet(stream[i], (uint32_t)(i % 5));
+        whole.on_packet(pkt.data(), (uint32_t)pkt.size(), 0, timestamp_us + i);
+        shards[i % 2].on_packet(pkt.data(), (uint32_t)pkt.size(), 0, timestamp_us + i);
+    }
+    shards[0].merge(shards[1]);
+
+    std::vector<HeavyHitter_T> expected;
+    std::vector<HeavyHitter_T> merged;
+    whole.snapshot(expected);
+    shards[0].snapshot(merged);
+
+    CHECK(same_hitters(expected, merged, HEAVY_SRC, HEAVY_PACKETS, 5));
+    CHECK(same_hitters(expected, merged, HEAVY_DST, HEAVY_PACKETS, 5));
+    CHECK(same_hitters(expected, merged, HEAVY_DPORT, HEAVY_PACKETS, 1));
+
+    //The leading sources keep their destination counts through the merge
+    for (auto& hitter : merged) {
+        if (hitter.dimension == HEAVY_SRC && hitter.metric == HEAVY_PACKETS) {
+            CHECK(hitter.distinct == 5);
+            break;
+        }
+    }
+    for (auto& hitter : merged) {
+        if (hitter.dimension == HEAVY_DPORT) {
+            CHECK(hitter.entry.count == TEST_PACKETS);
+            break;
+        }
+    }
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    test_error_bound();
+    test_top_k();
+    test_merge_shards();
+    test_merge_instances();
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("HeavyHittersTest passed\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+/**@file HyperLogLogTest.cpp
+ *
+ * Checks HyperLogLog estimates at 1k and 1M distinct hashes against
+ * its standard error, that merging two counters gives the registers of
+ * one counter fed the union, and that registers survive serialization
+ * while malformed ones are rejected.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/analysis tests/HyperLogLogTest.cpp \
+ *       src/analysis/HyperLogLog.cpp -o hyper_log_log_test && ./hyper_log_log_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+
+#include "HyperLogLog.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+//Three standard errors
+#define TEST_MAX_ERROR      (3.0 * 1.04 / sqrt((double)HLL_REGISTERS))
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+/**
+ * Well mixed hash of i (splitmix64), as the callers' hashes are.
+ */
+static uint64_t mix (uint64_t i) {
+    uint64_t h = i + 0x9E3779B97F4A7C15ULL;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+static double relative_error (const HyperLogLog& hll, uint64_t count) {
+    return fabs((double)hll.estimate() - (double)count) / (double)count;
+}
+
+/**
+ * Estimates stay within three standard errors in the linear counting
+ * range and in the HyperLogLog range, whatever the seed, and repeated
+ * hashes don't count.
+ */
+static void test_cardinality (void) {
+    const uint64_t counts[] = { 1000, 1000000 };
+
+    for (uint64_t count : counts) {
+        double worst = 0.0;
+        for (uint64_t seed = 0; seed < 5; seed++) {
+            HyperLogLog hll;
+            for (uint64_t i = 0; i < count; i++) {
+                hll.add(mix(seed * 1000000000ULL + i));
+            }
+            uint64_t before = hll.estimate();
+            for (uint64_t i = 0; i < count; i += 3) {
+                hll.add(mix(seed * 1000000000ULL + i));
+            }
+            CHECK(hll.estimate() == before);
+
+            double error = relative_error(hll, count);
+            CHECK(error <= TEST_MAX_ERROR);
+            worst = (error > worst) ? error : worst;
+        }
+        printf("%llu distinct: worst error %.2f%% (limit %.2f%%)\n",
+               (unsigned long long)count, 100.0 * worst, 100.0 * TEST_MAX_ERROR);
+    }
+
+    HyperLogLog empty;
+    CHECK(empty.estimate() == 0);
+    empty.add(mix(1));
+    CHECK(empty.estimate() == 1);
+}
+
+/**
+ * Two overlapping sets merge into exactly the counter of their union.
+ */
+static void test_merge (void) {
+    HyperLogLog a;
+    HyperLogLog b;
+    HyperLogLog both;
+    std::vector<uint8_t> merged;
+    std::vector<uint8_t> expected;
+
+    for (uint64_t i = 0; i < 600000; i++) {
+        a.add(mix(i));
+        both.add(mix(i));
+    }
+    for (uint64_t i = 400000; i < 1000000; i++) {
+        b.add(mix(i));
+        both.add(mix(i));
+    }
+
+    a.merge(b);
+    a.serialize(merged);
+    both.serialize(expected);
+    CHECK(merged == expected);
+    CHECK(a.estimate() == both.estimate());
+    CHECK(relative_error(a, 1000000) <= TEST_MAX_ERROR);
+
+    //Merging is idempotent and an empty counter changes nothing
+    HyperLogLog empty;
+    a.merge(b);
+    a.merge(empty);
+    merged.clear();
+    a.serialize(merged);
+    CHECK(merged == expected);
+}
+
+static void test_serialize (void) {
+    HyperLogLog hll;
+    HyperLogLog copy;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> again;
+
+    for (uint64_t i = 0; i < 50000; i++) {
+        hll.add(mix(i));
+    }
+    //The highest rank add() can produce
+    hll.add(0);
+
+    hll.serialize(data);
+    CHECK(data.size() == 1 + HLL_REGISTERS);
+    CHECK(data[0] == HLL_PRECISION);
+    CHECK(data[1] == HLL_MAX_RANK);
+    CHECK(copy.deserialize(data.data(), data.size()));
+    CHECK(copy.estimate() == hll.estimate());
+    copy.serialize(again);
+    CHECK(again == data);
+
+    //Malformed data leaves the counter alone
+    HyperLogLog other;
+    other.add(mix(7));
+    CHECK(!other.deserialize(data.data(), data.size() - 1));
+    std::vector<uint8_t> precision = data;
+    precision[0] = HLL_PRECISION + 1;
+    CHECK(!other.deserialize(precision.data(), precision.size()));
+    std::vector<uint8_t> rank = data;
+    rank[HLL_REGISTERS] = HLL_MAX_RANK + 1;
+    CHECK(!other.deserialize(rank.data(), rank.size()));
+    CHECK(other.estimate() == 1);
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    test_cardinality();
+    test_merge();
+    test_serialize();
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("HyperLogLogTest passed\n");
+    return 0;
+}
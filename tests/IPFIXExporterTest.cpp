@@ -0,0 +1,232 @@
+/**@file IPFIXExporterTest.cpp
+ *
+ * Round-trips flow records through IPFIXExporter over UDP loopback
+ * and checks the MTU limits enforced by IPFIXExporter::Create().
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/common -Isrc/analysis -Isrc/output \
+ *       -Isrc -Isrc/messages tests/IPFIXExporterTest.cpp \
+ *       src/output/IPFIXExporter.cpp src/common/Logging.cpp \
+ *       -lcrypto -o ipfix_test && ./ipfix_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+#include "IPFIXExporter.h"
+#include "PacketConnectionTracker.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_RECORDS        (5000)
+#define TEST_MTU            (576)
+#define TEST_RECV_BUFFER    (65536)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+static uint16_t get16 (const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32 (const uint8_t* p) {
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static uint64_t get64 (const uint8_t* p) {
+    return ((uint64_t)get32(p) << 32) | get32(p + 4);
+}
+
+static void make_flow (ConnectionMetadata& meta, size_t i) {
+    if (i % 3 == 2) {
+        //Every third flow is IPv6 so data sets switch templates
+        for (size_t b = 0; b < FLOW_ADDR_SIZE; b++) {
+            meta.src.bytes[b] = (uint8_t)(0x20 + b);
+            meta.dst.bytes[b] = (uint8_t)(0x40 + b);
+        }
+        meta.src.bytes[FLOW_ADDR_SIZE - 1] = (uint8_t)i;
+    } else {
+        FlowAddressSetV4(meta.src, htonl(0x0A000000 | (uint32_t)i));
+        FlowAddressSetV4(meta.dst, htonl(0xC0A80001));
+    }
+    meta.l4_src = (uint16_t)(1024 + i);
+    meta.l4_dst = 443;
+    meta.protocol = 6;
+    meta.timestamp_s = 1600000000 + (long)i;
+    meta.timestamp_us = 250000;
+    meta.end_timestamp_s = 1600000010 + (long)i;
+    meta.end_timestamp_us = 500000;
+    meta.packets = i + 1;
+    meta.bytes = (i + 1) * 100;
+}
+
+/**
+ * Checks one received message and every record in it against the
+ * flows that were exported, in order.
+ */
+static void check_message (const uint8_t* pData, size_t dataSize, size_t mtu,
+                           uint32_t& sequence, size_t& next) {
+    CHECK(dataSize <= mtu - IPFIX_IP_UDP_OVERHEAD);
+    CHECK(dataSize >= IPFIX_MESSAGE_HEADER_SIZE);
+    if (dataSize < IPFIX_MESSAGE_HEADER_SIZE) {
+        return;
+    }
+
+    CHECK(get16(pData) == IPFIX_VERSION);
+    CHECK(get16(pData + 2) == dataSize);
+    CHECK(get32(pData + 8) == sequence);
+
+    size_t offset = IPFIX_MESSAGE_HEADER_SIZE;
+    while (offset + IPFIX_SET_HEADER_SIZE <= dataSize) {
+        uint16_t setId = get16(pData + offset);
+        uint16_t setLen = get16(pData + offset + 2);
+        CHECK(setLen >= IPFIX_SET_HEADER_SIZE && offset + setLen <= dataSize);
+        if (setLen < IPFIX_SET_HEADER_SIZE || offset + setLen > dataSize) {
+            return;
+        }
+
+        if (setId == IPFIX_TEMPLATE_SET_ID) {
+            CHECK(get16(pData + offset + 4) == IPFIX_TEMPLATE_ID_IPV4);
+        } else {
+            bool bIPv4 = setId == IPFIX_TEMPLATE_ID_IPV4;
+            size_t addrSize = bIPv4 ? 4 : FLOW_ADDR_SIZE;
+            size_t recordSize = 2 * addrSize + 2 + 2 + 1 + 2 + 4 * 8;
+            CHECK(setId == IPFIX_TEMPLATE_ID_IPV4 || setId == IPFIX_TEMPLATE_ID_IPV6);
+            CHECK((setLen - IPFIX_SET_HEADER_SIZE) % recordSize == 0);
+
+            for (size_t r = offset + IPFIX_SET_HEADER_SIZE; r + recordSize <= offset + setLen; r += recordSize) {
+                ConnectionMetadata meta;
+                make_flow(meta, next);
+                CHECK(meta.is_ipv4() == bIPv4);
+
+                const uint8_t* pSrc = bIPv4 ? meta.src.bytes + FLOW_ADDR_SIZE - 4 : meta.src.bytes;
+                const uint8_t* p = pData + r;
+                CHECK(memcmp(p, pSrc, addrSize) == 0);
+                p += 2 * addrSize;
+                CHECK(get16(p) == meta.l4_src);
+                CHECK(get16(p + 2) == meta.l4_dst);
+                CHECK(p[4] == meta.protocol);
+                p += 7;
+                CHECK(get64(p) == (uint64_t)meta.timestamp_s * 1000 + 250);
+                CHECK(get64(p + 8) == (uint64_t)meta.end_timestamp_s * 1000 + 500);
+                CHECK(get64(p + 16) == meta.packets);
+                CHECK(get64(p + 24) == meta.bytes);
+
+                next++;
+                sequence++;
+            }
+        }
+        offset += setLen;
+    }
+    CHECK(offset == dataSize);
+}
+
+/**
+ * Reads every datagram already queued on the collector socket.
+ */
+static void drain (int sock, size_t mtu, std::vector<uint8_t>& buffer,
+                   size_t& messages, uint32_t& sequence, size_t& next) {
+    ssize_t n;
+    while ((n = recv(sock, buffer.data(), buffer.size(), MSG_DONTWAIT)) > 0) {
+        //The first message must carry the templates
+        if (messages == 0) {
+            CHECK(get16(buffer.data() + IPFIX_MESSAGE_HEADER_SIZE) == IPFIX_TEMPLATE_SET_ID);
+        }
+        check_message(buffer.data(), n, mtu, sequence, next);
+        messages++;
+    }
+}
+
+static void test_loopback (size_t mtu) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(sock >= 0);
+    CHECK(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(getsockname(sock, (struct sockaddr*)&addr, &addrLen) == 0);
+
+    std::string sTarget = "udp://127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    std::shared_ptr<IPFIXExporter> exporter = IPFIXExporter::Create(sTarget, mtu);
+    CHECK(exporter != nullptr);
+    if (!exporter) {
+        close(sock);
+        return;
+    }
+
+    //Loopback delivery is synchronous, so draining after every record
+    //keeps the receive buffer from overflowing at small MTUs
+    std::vector<uint8_t> buffer(TEST_RECV_BUFFER);
+    size_t messages = 0;
+    uint32_t sequence = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < TEST_RECORDS; i++) {
+        ConnectionMetadata meta;
+        make_flow(meta, i);
+        exporter->on_flow_end(&meta);
+        drain(sock, mtu, buffer, messages, sequence, next);
+    }
+    exporter->flush();
+    drain(sock, mtu, buffer, messages, sequence, next);
+
+    CHECK(exporter->get_records() == TEST_RECORDS);
+    CHECK(messages == exporter->get_messages());
+    CHECK(next == TEST_RECORDS);
+    if (mtu < IPFIX_MAX_MTU) {
+        CHECK(messages > 1);
+    }
+
+    close(sock);
+}
+
+static void test_mtu_limits (void) {
+    size_t minMtu = IPFIXExporter::get_min_mtu();
+    size_t maxMtu = IPFIXExporter::get_max_mtu();
+
+    CHECK(minMtu > IPFIX_IP_UDP_OVERHEAD + IPFIX_MESSAGE_HEADER_SIZE);
+    CHECK(maxMtu - IPFIX_IP_UDP_OVERHEAD <= 65535);
+
+    CHECK(IPFIXExporter::Create("udp://127.0.0.1:4739", 0) == nullptr);
+    CHECK(IPFIXExporter::Create("udp://127.0.0.1:4739", IPFIX_IP_UDP_OVERHEAD - 1) == nullptr);
+    CHECK(IPFIXExporter::Create("udp://127.0.0.1:4739", minMtu - 1) == nullptr);
+    CHECK(IPFIXExporter::Create("udp://127.0.0.1:4739", maxMtu + 1) == nullptr);
+    CHECK(IPFIXExporter::Create("udp://127.0.0.1:4739", minMtu) != nullptr);
+    CHECK(IPFIXExporter::Create("udp://127.0.0.1:4739", maxMtu) != nullptr);
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    test_mtu_limits();
+    test_loopback(IPFIXExporter::get_min_mtu());
+    test_loopback(TEST_MTU);
+    test_loopback(IPFIX_DEFAULT_MTU);
+    test_loopback(IPFIXExporter::get_max_mtu());
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("IPFIXExporterTest passed\n");
+    return 0;
+}
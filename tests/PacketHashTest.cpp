@@ -0,0 +1,260 @@
+/**@file PacketHashTest.cpp
+ *
+ * Checks which packet fields PacketHashInvariant() covers, and the
+ * cuckoo filter behind PacketDeduplicator: lookups of inserted hashes,
+ * the dedup window, eviction when both buckets are full and the false
+ * positive rate for hashes never inserted.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/analysis tests/PacketHashTest.cpp \
+ *       src/analysis/PacketHash.cpp -o packet_hash_test && ./packet_hash_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <random>
+
+#include "PacketHash.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_WINDOW_US      (1000)
+#define TEST_CAPACITY       (DEDUP_BUCKETS * DEDUP_BUCKET_SLOTS)
+#define TEST_PROBES         (4000000)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+/**
+ * Exposes the filter, so it can be filled with hashes directly.
+ */
+class TestDeduplicator : public PacketDeduplicator {
+public:
+    TestDeduplicator (void) :
+        PacketDeduplicator(TEST_WINDOW_US)
+    {
+    }
+
+    bool find (uint64_t hash, uint64_t timestamp_us) {
+        return lookup(hash, timestamp_us);
+    }
+
+    void add (uint64_t hash, uint64_t timestamp_us) {
+        insert(hash, timestamp_us);
+    }
+};
+
+/**
+ * IPv4/UDP packet with a payload of the given size.
+ */
+static std::vector<uint8_t> make_ipv4 (uint32_t payload) {
+    std::vector<uint8_t> pkt(20 + 8 + payload, 0);
+    uint16_t totLen = (uint16_t)pkt.size();
+
+    pkt[0] = 0x45;
+    pkt[2] = (uint8_t)(totLen >> 8);
+    pkt[3] = (uint8_t)totLen;
+    pkt[4] = 0x12;
+    pkt[8] = 64;
+    pkt[9] = 17;
+    pkt[12] = 10;
+    pkt[15] = 1;
+    pkt[16] = 10;
+    pkt[19] = 2;
+    pkt[21] = 53;
+    for (uint32_t i = 0; i < payload; i++) {
+        pkt[28 + i] = (uint8_t)i;
+    }
+    return pkt;
+}
+
+static uint64_t hash_of (const std::vector<uint8_t>& pkt) {
+    return PacketHashInvariant(pkt.data(), (uint32_t)pkt.size());
+}
+
+static void test_invariant (void) {
+    std::vector<uint8_t> pkt = make_ipv4(100);
+    uint64_t h = hash_of(pkt);
+    CHECK(h != 0);
+
+    //TTL and checksum change hop by hop
+    std::vector<uint8_t> hop = pkt;
+    hop[8] = 63;
+    hop[10] = 0xAB;
+    hop[11] = 0xCD;
+    CHECK(hash_of(hop) == h);
+
+    //Ethernet padding after the IP total length
+    std::vector<uint8_t> padded = pkt;
+    padded.resize(pkt.size() + 6, 0xEE);
+    CHECK(hash_of(padded) == h);
+
+    //Payload past the hashed prefix
+    std::vector<uint8_t> tail = pkt;
+    tail[28 + DEDUP_PAYLOAD_PREFIX] ^= 0xFF;
+    CHECK(hash_of(tail) == h);
+
+    //Anything else tells packets apart
+    std::vector<uint8_t> payload = pkt;
+    payload[28 + DEDUP_PAYLOAD_PREFIX - 1] ^= 0xFF;
+    CHECK(hash_of(payload) != h);
+    std::vector<uint8_t> id = pkt;
+    id[5] = 0x34;
+    CHECK(hash_of(id) != h);
+    std::vector<uint8_t> port = pkt;
+    port[20] = 1;
+    CHECK(hash_of(port) != h);
+
+    //IPv6 without the hop limit
+    std::vector<uint8_t> v6(40 + 8 + 16, 0);
+    v6[0] = 0x60;
+    v6[5] = 8 + 16;
+    v6[6] = 17;
+    v6[7] = 64;
+    v6[23] = 1;
+    v6[39] = 2;
+    uint64_t h6 = hash_of(v6);
+    CHECK(h6 != 0);
+    v6[7] = 10;
+    CHECK(hash_of(v6) == h6);
+    v6[39] = 3;
+    CHECK(hash_of(v6) != h6);
+
+    //Not IP or too short
+    uint8_t arp[28] = { 0x00, 0x01 };
+    CHECK(PacketHashInvariant(arp, sizeof(arp)) == 0);
+    CHECK(PacketHashInvariant(pkt.data(), 19) == 0);
+    CHECK(PacketHashInvariant(pkt.data(), 0) == 0);
+}
+
+/**
+ * A copy within the window is a duplicate, one after it is not, in
+ * either direction of time.
+ */
+static void test_window (void) {
+    PacketDeduplicator dedup(TEST_WINDOW_US);
+    std::vector<uint8_t> pkt = make_ipv4(64);
+    std::vector<uint8_t> other = make_ipv4(65);
+
+    CHECK(!dedup.is_duplicate(pkt.data(), (uint32_t)pkt.size(), 10000));
+    CHECK(!dedup.is_duplicate(other.data(), (uint32_t)other.size(), 10000));
+    CHECK(dedup.is_duplicate(pkt.data(), (uint32_t)pkt.size(), 10000 + TEST_WINDOW_US));
+    CHECK(dedup.is_duplicate(pkt.data(), (uint32_t)pkt.size(), 10000 - TEST_WINDOW_US));
+    CHECK(!dedup.is_duplicate(pkt.data(), (uint32_t)pkt.size(), 10000 + TEST_WINDOW_US + 1));
+
+    //Non-IP packets are never duplicates
+    uint8_t arp[28] = { 0x00, 0x01 };
+    CHECK(!dedup.is_duplicate(arp, sizeof(arp), 10000));
+    CHECK(!dedup.is_duplicate(arp, sizeof(arp), 10000));
+
+    CHECK(dedup.get_packets() == 7);
+    CHECK(dedup.get_duplicates() == 2);
+}
+
+/**
+ * Every hash inserted up to a high load is found again, and hashes
+ * never inserted are almost never found.
+ */
+static void test_insert_lookup (void) {
+    TestDeduplicator dedup;
+    std::mt19937_64 rng(1);
+    std::vector<uint64_t> hashes(TEST_CAPACITY * 9 / 10);
+
+    for (auto& hash : hashes) {
+        hash = rng();
+        dedup.add(hash, 0);
+    }
+
+    size_t missing = 0;
+    for (auto hash : hashes) {
+        missing += !dedup.find(hash, 0);
+    }
+    //Only an insert that runs out of kicks forgets an entry
+    CHECK(missing <= hashes.size() / 1000);
+
+    size_t falsePositives = 0;
+    for (size_t i = 0; i < TEST_PROBES; i++) {
+        falsePositives += dedup.find(rng(), 0);
+    }
+    //Eight 32-bit fingerprints are compared per lookup, about 2e-9
+    CHECK(falsePositives <= 2);
+    printf("90%% load: %zu of %zu entries lost, %zu false positives in %d lookups\n",
+           missing, hashes.size(), falsePositives, TEST_PROBES);
+}
+
+/**
+ * Past capacity, inserts displace live entries rather than fail, and
+ * recently inserted hashes are the ones kept. Once the window has
+ * passed the stale entries are overwritten without displacing anything.
+ */
+static void test_evict (void) {
+    TestDeduplicator dedup;
+    std::mt19937_64 rng(2);
+    std::vector<uint64_t> hashes(2 * TEST_CAPACITY);
+
+    for (auto& hash : hashes) {
+        hash = rng();
+        dedup.add(hash, 0);
+    }
+
+    size_t found = 0;
+    for (auto hash : hashes) {
+        found += dedup.find(hash, 0);
+    }
+    CHECK(found <= TEST_CAPACITY);
+    CHECK(found >= TEST_CAPACITY * 9 / 10);
+
+    size_t recent = 0;
+    for (size_t i = hashes.size() - 1000; i < hashes.size(); i++) {
+        recent += dedup.find(hashes[i], 0);
+    }
+    CHECK(recent >= 900);
+
+    //Nothing is live a window later, so a high load fits again
+    uint64_t later = TEST_WINDOW_US + 1;
+    size_t stale = 0;
+    for (auto hash : hashes) {
+        stale += dedup.find(hash, later);
+    }
+    CHECK(stale == 0);
+
+    size_t refill = TEST_CAPACITY * 9 / 10;
+    for (size_t i = 0; i < refill; i++) {
+        hashes[i] = rng();
+        dedup.add(hashes[i], later);
+    }
+    size_t lost = 0;
+    for (size_t i = 0; i < refill; i++) {
+        lost += !dedup.find(hashes[i], later);
+    }
+    CHECK(lost <= refill / 1000);
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    test_invariant();
+    test_window();
+    test_insert_lookup();
+    test_evict();
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("PacketHashTest passed\n");
+    return 0;
+}
@@ -0,0 +1,188 @@
+/**@file PooledBTreeBench.cpp
+ *
+ * Times PooledBTree against the shared_ptr based BTree on the same
+ * random 64-bit keys: inserts, lookups of keys that are present, short
+ * range scans and removal of every key, in ns per operation. BTree
+ * values are allocated with make_shared as the trackers do; PooledBTree
+ * values live in an array, since the tree doesn't own them.
+ *
+ * Build and run from the repository root (add -mavx2 to time BTree's
+ * AVX2 node search):
+ *
+ *   g++ -std=c++14 -O2 -Isrc/common tests/PooledBTreeBench.cpp \
+ *       src/common/EpochManager.cpp -lpthread \
+ *       -o pooled_btree_bench && ./pooled_btree_bench [keys]
+ *
+ * The key count defaults to 1M. The 10M and 100M sizes are run with
+ *
+ *   ./pooled_btree_bench 10000000
+ *   ./pooled_btree_bench 100000000
+ *
+ * or all three in turn with
+ *
+ *   for keys in 1000000 10000000 100000000; do ./pooled_btree_bench $keys; done
+ *
+ * At 100M keys the shared_ptr tree needs well over 10 GB, so on smaller
+ * machines pass -p to time PooledBTree alone:
+ *
+ *   ./pooled_btree_bench -p 100000000
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <memory>
+
+#include "BTree.h"
+#include "PooledBTree.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define BENCH_DEFAULT_KEYS  (1000000)
+#define BENCH_LOOKUPS       (2000000)
+#define BENCH_SCANS         (200000)
+#define BENCH_SCAN_WIDTH    (100)
+
+class BenchValue {
+public:
+    BenchValue (void)
+      : key(0)
+    {
+    }
+
+    uint64_t addr (void) const {
+        return key;
+    }
+
+public:
+    uint64_t key;
+};
+
+typedef struct {
+    double insert;
+    double lookup;
+    double scan;
+    double remove;
+} BenchResult_T;
+
+static double now_ns (void) {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Runs every operation on one tree. Insert takes a key index, so each
+ * tree can store its values its own way.
+ */
+template <typename Tree, typename Insert>
+static BenchResult_T run (Tree& tree, Insert insert, const std::vector<uint64_t>& keys,
+                          const std::vector<uint64_t>& probes, const std::vector<uint64_t>& scans,
+                          uint64_t& checksum) {
+    BenchResult_T result;
+    double start = now_ns();
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        insert(i);
+    }
+    result.insert = (now_ns() - start) / keys.size();
+
+    start = now_ns();
+    for (auto key : probes) {
+        checksum += tree.find(key)->key;
+    }
+    result.lookup = (now_ns() - start) / probes.size();
+
+    //Keys are spread over all 64 bits, so a scan's width is a share of
+    //the key space rather than a key count
+    uint64_t width = (UINT64_MAX / keys.size()) * BENCH_SCAN_WIDTH;
+    start = now_ns();
+    for (auto key : scans) {
+        uint64_t stop = (key > UINT64_MAX - width) ? UINT64_MAX : key + width;
+        tree.for_range(key, stop, [&checksum](const auto& value) {
+            checksum += value->key;
+            return true;
+        });
+    }
+    result.scan = (now_ns() - start) / scans.size();
+
+    start = now_ns();
+    for (auto key : keys) {
+        tree.remove(key);
+    }
+    result.remove = (now_ns() - start) / keys.size();
+    return result;
+}
+
+static void print_result (const char* name, const BenchResult_T& result) {
+    printf("%-8s %10.0f %10.0f %10.0f %10.0f\n", name,
+           result.insert, result.lookup, result.scan, result.remove);
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    bool bPooledOnly = false;
+    size_t count = BENCH_DEFAULT_KEYS;
+    std::mt19937_64 rng(7);
+    uint64_t checksum = 0;
+    int arg = 1;
+
+    if ((arg < argc) && (strcmp(argv[arg], "-p") == 0)) {
+        bPooledOnly = true;
+        arg++;
+    }
+    if (arg < argc) {
+        count = strtoull(argv[arg++], NULL, 10);
+    }
+    if ((count == 0) || (arg != argc)) {
+        fprintf(stderr, "usage: %s [-p] [keys]\n", argv[0]);
+        return 1;
+    }
+
+    //Distinct keys, so every insert adds one
+    std::vector<uint64_t> keys(count);
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = (rng() & ~0xFFFFFULL) | (i & 0xFFFFF);
+    }
+    std::vector<uint64_t> probes(BENCH_LOOKUPS);
+    for (auto& probe : probes) {
+        probe = keys[rng() % count];
+    }
+    std::vector<uint64_t> scans(BENCH_SCANS);
+    for (auto& scan : scans) {
+        scan = keys[rng() % count];
+    }
+
+    BenchResult_T sharedResult = {};
+    if (!bPooledOnly) {
+        BTree<uint64_t, BenchValue> shared;
+        sharedResult = run(shared, [&](size_t i) {
+            auto value = std::make_shared<BenchValue>();
+            value->key = keys[i];
+            shared.insert(value);
+        }, keys, probes, scans, checksum);
+    }
+
+    std::vector<BenchValue> values(count);
+    PooledBTree<uint64_t, BenchValue> pooled;
+    BenchResult_T pooledResult = run(pooled, [&](size_t i) {
+        values[i].key = keys[i];
+        pooled.insert(&values[i]);
+    }, keys, probes, scans, checksum);
+
+    printf("%zu keys, ns/op (checksum %llx)\n", count, (unsigned long long)checksum);
+    printf("%-8s %10s %10s %10s %10s\n", "tree", "insert", "lookup", "scan", "remove");
+    if (!bPooledOnly) {
+        print_result("BTree", sharedResult);
+    }
+    print_result("Pooled", pooledResult);
+    return 0;
+}
@@ -0,0 +1,256 @@
+/**@file PooledBTreeTest.cpp
+ *
+ * Checks PooledBTree against std::map at several node sizes, runs
+ * readers against a writer, and checks that replaced nodes are only
+ * reused once no reader can still see them, both through EpochManager
+ * directly and through a range walk that changes the tree.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/common tests/PooledBTreeTest.cpp \
+ *       src/common/EpochManager.cpp -lpthread \
+ *       -o pooled_btree_test && ./pooled_btree_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+
+#include "PooledBTree.h"
+#include "EpochManager.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_STEPS          (100000)
+#define TEST_CONCURRENT     (200000)
+#define TEST_WALK_KEYS      (20000)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+class TestValue {
+public:
+    TestValue (void)
+      : key(0)
+    {
+    }
+
+    uint64_t addr (void) const {
+        return key;
+    }
+
+public:
+    uint64_t key;
+};
+
+template <size_t Bytes>
+static void test_differential (int seed, uint64_t range) {
+    PooledBTree<uint64_t, TestValue, Bytes> tree;
+    std::map<uint64_t, TestValue*> ref;
+    std::vector<TestValue> values(range);
+    std::mt19937_64 rng(seed);
+
+    for (uint64_t i = 0; i < range; i++) {
+        values[i].key = i;
+    }
+
+    for (size_t step = 0; step < TEST_STEPS; step++) {
+        uint64_t k = rng() % range;
+
+        if (rng() % 3 < 2) {
+            CHECK(tree.insert(&values[k]) == ref.emplace(k, &values[k]).second);
+        } else {
+            CHECK(tree.remove(k) == (ref.erase(k) > 0));
+        }
+        CHECK(tree.find(k) == (ref.count(k) ? ref[k] : nullptr));
+
+        if (step % 997 == 0) {
+            CHECK(tree.is_a_valid_btree());
+            CHECK(tree.size() == ref.size());
+
+            uint64_t start = rng() % range;
+            uint64_t stop = start + rng() % 200;
+            auto iter = ref.lower_bound(start);
+            for (auto value : tree.find_range(start, stop)) {
+                CHECK(iter != ref.end() && iter->second == value);
+                if (iter != ref.end()) {
+                    ++iter;
+                }
+            }
+            CHECK(iter == ref.end() || iter->first > stop);
+        }
+        if (gs_failures != 0) {
+            fprintf(stderr, "node bytes %zu seed %d step %zu\n", Bytes, seed, step);
+            return;
+        }
+    }
+
+    //Drain oldest first, as expiry does
+    for (auto& entry : ref) {
+        CHECK(tree.remove(entry.first));
+    }
+    CHECK(tree.size() == 0);
+    CHECK(tree.is_a_valid_btree());
+    CHECK(tree.find(1) == nullptr);
+}
+
+/**
+ * Readers look up and range scan while one writer fills the tree and
+ * then removes every even key.
+ */
+static void test_concurrent (void) {
+    PooledBTree<uint64_t, TestValue> tree;
+    std::vector<TestValue> values(TEST_CONCURRENT);
+    std::atomic<bool> bDone(false);
+    std::atomic<long> bad(0);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i].key = i;
+    }
+
+    std::vector<std::thread> readers;
+    for (int j = 0; j < 3; j++) {
+        readers.emplace_back([&, j] {
+            std::mt19937 rng(j);
+            while (!bDone) {
+                uint64_t k = rng() % TEST_CONCURRENT;
+                TestValue* value = tree.find(k);
+                if (value && value->key != k) {
+                    bad++;
+                }
+
+                uint64_t prev = 0;
+                bool bFirst = true;
+                tree.for_range(k, k + 100, [&](TestValue* v) {
+                    if ((!bFirst && v->key <= prev) || v->key < k || v->key > k + 100) {
+                        bad++;
+                    }
+                    bFirst = false;
+                    prev = v->key;
+                    return true;
+                });
+            }
+        });
+    }
+
+    for (size_t i = 0; i < values.size(); i++) {
+        tree.insert(&values[i]);
+    }
+    for (size_t i = 0; i < values.size(); i += 2) {
+        tree.remove(i);
+    }
+
+    bDone = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    CHECK(bad == 0);
+    CHECK(tree.is_a_valid_btree());
+    CHECK(tree.size() == TEST_CONCURRENT / 2);
+}
+
+/**
+ * An epoch announced by a reader holds back what advance() reports as
+ * safe until the reader leaves.
+ */
+static void test_epochs (void) {
+    EpochManager epochs;
+
+    uint64_t before = epochs.current();
+    size_t slot = epochs.enter();
+    for (int i = 0; i < 10; i++) {
+        CHECK(epochs.advance() <= before);
+    }
+
+    //A second reader doesn't release the first
+    {
+        EpochGuard guard(epochs);
+        CHECK(epochs.advance() <= before);
+    }
+    CHECK(epochs.advance() <= before);
+
+    epochs.exit(slot);
+    uint64_t stamped = epochs.current();
+    CHECK(epochs.advance() > stamped);
+}
+
+/**
+ * Nodes replaced while a walk is in progress must stay intact until it
+ * ends, and are reused afterwards.
+ */
+static void test_reclaim (void) {
+    PooledBTree<uint64_t, TestValue> tree;
+    std::vector<TestValue> values(2 * TEST_WALK_KEYS);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i].key = i;
+    }
+    for (size_t i = 0; i < TEST_WALK_KEYS; i++) {
+        tree.insert(&values[i]);
+    }
+    size_t settled = tree.get_nodes();
+
+    //The walk pins the snapshot it started from while every key in it
+    //is removed and the upper half is inserted
+    size_t seen = 0;
+    size_t pinned = 0;
+    bool bOrdered = true;
+    tree.for_range(0, UINT64_MAX, [&](TestValue* value) {
+        if (value->key != seen) {
+            bOrdered = false;
+        }
+        seen++;
+        tree.remove(value->key);
+        tree.insert(&values[TEST_WALK_KEYS + value->key]);
+        pinned = std::max(pinned, tree.get_nodes());
+        return true;
+    });
+    CHECK(bOrdered);
+    CHECK(seen == TEST_WALK_KEYS);
+    CHECK(pinned > 2 * settled);
+    CHECK(tree.size() == TEST_WALK_KEYS);
+
+    //Without a reader, churn returns the replaced nodes to the pool
+    for (size_t round = 0; round < 4; round++) {
+        for (size_t i = TEST_WALK_KEYS; i < values.size(); i++) {
+            tree.remove(i);
+            tree.insert(&values[i]);
+        }
+    }
+    CHECK(tree.get_nodes() < pinned / 4);
+    CHECK(tree.get_nodes() <= settled + 2 * POOLED_BTREE_RECLAIM);
+    CHECK(tree.is_a_valid_btree());
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    test_differential<64>(1, 5000);
+    test_differential<128>(2, 50000);
+    test_differential<256>(3, 100000);
+    test_differential<512>(4, 3000);
+    test_concurrent();
+    test_epochs();
+    test_reclaim();
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("PooledBTreeTest passed\n");
+    return 0;
+}
@@ -0,0 +1,348 @@
+/**@file TLSInspectorTest.cpp
+ *
+ * Feeds hand built ClientHellos through TLSInspector and checks the
+ * server name and the JA3 hash against fingerprints worked out by hand:
+ * the example from the JA3 documentation and a Chrome hello. GREASE
+ * values must not change the hash, and hellos with truncated or
+ * oversized lengths must be rejected without reading past them.
+ *
+ * Build from the repository root:
+ *
+ *   g++ -std=c++14 -O2 -Isrc/common -Isrc/analysis -Isrc/output \
+ *       -Isrc -Isrc/messages tests/TLSInspectorTest.cpp \
+ *       src/analysis/TLSInspector.cpp src/analysis/DNSAnalyzer.cpp \
+ *       src/analysis/FlowKey.cpp src/common/MD5ByteContainer.cpp \
+ *       src/common/UnsignedByteContainer.cpp src/common/Logging.cpp \
+ *       -ltins -lcrypto -o tls_test && ./tls_test
+ */
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "TLSInspector.h"
+
+//=============================================================================
+// DEFINITIONS
+//=============================================================================
+#define TEST_SEQ            (1000)
+#define TEST_GREASE         (0x0A0A)
+
+//Offsets in a record built by make_hello: the session ID length
+//follows the headers, version and random, the cipher suites length the
+//32 byte session ID, the extensions length one compression method
+#define TEST_SESSION_AT         (5 + 4 + 34)
+#define TEST_CIPHERS_AT         (TEST_SESSION_AT + 1 + 32)
+#define TEST_EXT_AT(ciphers)    (TEST_CIPHERS_AT + 2 + 2 * (ciphers) + 2)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        gs_failures++; \
+    } \
+} while (0)
+
+static int gs_failures = 0;
+
+typedef std::vector<uint8_t> Bytes_T;
+
+//Example from the JA3 documentation:
+//769,47-53-5-10-49161-49162-49171-49172-50-56-19-4,0-10-11,23-24-25,0
+static const uint16_t gs_exampleCiphers[] = {
+    47, 53, 5, 10, 49161, 49162, 49171, 49172, 50, 56, 19, 4
+};
+static const char* gs_exampleJa3 = "ada70206e40642a3e4461f35503241d5";
+
+//Chrome 70 and later, GREASE removed: 771,4865-4866-4867-49195-49199-
+//49196-49200-52393-52392-49171-49172-156-157-47-53,0-23-65281-10-11-35-
+//16-5-13-18-51-45-43-27-21,29-23-24,0
+static const uint16_t gs_chromeCiphers[] = {
+    4865, 4866, 4867, 49195, 49199, 49196, 49200, 52393, 52392, 49171, 49172, 156, 157, 47, 53
+};
+static const uint16_t gs_chromeExtensions[] = {
+    0, 23, 65281, 10, 11, 35, 16, 5, 13, 18, 51, 45, 43, 27, 21
+};
+static const char* gs_chromeJa3 = "b32309a26951912be7dba376398abc3b";
+
+static void put16 (Bytes_T& out, uint16_t v) {
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+static Bytes_T make_extension (uint16_t type, const Bytes_T& body) {
+    Bytes_T ext;
+    put16(ext, type);
+    put16(ext, (uint16_t)body.size());
+    ext.insert(ext.end(), body.begin(), body.end());
+    return ext;
+}
+
+static Bytes_T make_sni (const std::string& sName) {
+    Bytes_T body;
+    put16(body, (uint16_t)(sName.size() + 3));
+    body.push_back(0);
+    put16(body, (uint16_t)sName.size());
+    body.insert(body.end(), sName.begin(), sName.end());
+    return make_extension(0, body);
+}
+
+static Bytes_T make_groups (const std::vector<uint16_t>& groups) {
+    Bytes_T body;
+    put16(body, (uint16_t)(groups.size() * 2));
+    for (uint16_t group : groups) {
+        put16(body, group);
+    }
+    return make_extension(10, body);
+}
+
+static Bytes_T make_formats (void) {
+    return make_extension(11, Bytes_T{ 1, 0 });
+}
+
+/**
+ * ClientHello record with a 32 byte session ID, no compression and the
+ * given extensions, none at all if bExtensions is false.
+ */
+static Bytes_T make_hello (uint16_t version, const std::vector<uint16_t>& ciphers,
+                           const std::vector<Bytes_T>& extensions, bool bExtensions = true) {
+    Bytes_T hello;
+    Bytes_T exts;
+
+    put16(hello, version);
+    hello.insert(hello.end(), 32, 0x5A);
+    hello.push_back(32);
+    hello.insert(hello.end(), 32, 0xA5);
+    put16(hello, (uint16_t)(ciphers.size() * 2));
+    for (uint16_t cipher : ciphers) {
+        put16(hello, cipher);
+    }
+    hello.push_back(1);
+    hello.push_back(0);
+
+    for (const Bytes_T& ext : extensions) {
+        exts.insert(exts.end(), ext.begin(), ext.end());
+    }
+    if (bExtensions) {
+        put16(hello, (uint16_t)exts.size());
+        hello.insert(hello.end(), exts.begin(), exts.end());
+    }
+
+    Bytes_T record = { 22, 3, 1 };
+    put16(record, (uint16_t)(hello.size() + 4));
+    record.push_back(1);
+    record.push_back(0);
+    put16(record, (uint16_t)hello.size());
+    record.insert(record.end(), hello.begin(), hello.end());
+    return record;
+}
+
+static Bytes_T make_example (void) {
+    std::vector<uint16_t> ciphers(gs_exampleCiphers, gs_exampleCiphers + 12);
+    return make_hello(0x0301, ciphers, { make_sni("Example.COM"), make_groups({ 23, 24, 25 }), make_formats() });
+}
+
+/**
+ * Chrome hello, with GREASE values where Chrome puts them if bGrease.
+ */
+static Bytes_T make_chrome (bool bGrease) {
+    std::vector<uint16_t> ciphers(gs_chromeCiphers, gs_chromeCiphers + 15);
+    std::vector<uint16_t> groups = { 29, 23, 24 };
+    std::vector<Bytes_T> extensions;
+
+    if (bGrease) {
+        ciphers.insert(ciphers.begin(), TEST_GREASE);
+        groups.insert(groups.begin(), 0x4A4A);
+        extensions.push_back(make_extension(0x1A1A, Bytes_T()));
+    }
+    for (uint16_t type : gs_chromeExtensions) {
+        if (type == 0) {
+            extensions.push_back(make_sni("www.google.com"));
+        } else if (type == 10) {
+            extensions.push_back(make_groups(groups));
+        } else if (type == 11) {
+            extensions.push_back(make_formats());
+        } else {
+            extensions.push_back(make_extension(type, Bytes_T{ 0 }));
+        }
+    }
+    if (bGrease) {
+        extensions.push_back(make_extension(0xFAFA, Bytes_T{ 0 }));
+    }
+    return make_hello(0x0303, ciphers, extensions);
+}
+
+static TLSFlowState_T new_flow (void) {
+    TLSFlowState_T flow;
+    memset(&flow, 0, sizeof(flow));
+    flow.state = TLS_INSPECT;
+    return flow;
+}
+
+static TLSFlowState_T inspect (TLSInspector& inspector, const Bytes_T& record) {
+    TLSFlowState_T flow = new_flow();
+    inspector.on_segment(flow, TEST_SEQ, record.data(), (uint32_t)record.size());
+    CHECK(flow.state == TLS_DONE);
+    return flow;
+}
+
+static void test_known_vectors (void) {
+    TLSInspector inspector;
+
+    TLSFlowState_T flow = inspect(inspector, make_example());
+    CHECK(inspector.ja3(flow) == gs_exampleJa3);
+    CHECK(inspector.sni(flow) == "example.com");
+
+    flow = inspect(inspector, make_chrome(false));
+    CHECK(inspector.ja3(flow) == gs_chromeJa3);
+    CHECK(inspector.sni(flow) == "www.google.com");
+
+    //771,4865,,,
+    flow = inspect(inspector, make_hello(0x0303, { 4865 }, {}, false));
+    CHECK(inspector.ja3(flow) == "ea1e247991e541e39bf918cb7cfa5139");
+    CHECK(flow.sni == 0);
+
+    //Split over two segments, with the first one retransmitted
+    Bytes_T record = make_chrome(false);
+    uint32_t split = 100;
+    flow = new_flow();
+    inspector.on_segment(flow, TEST_SEQ, record.data(), split);
+    CHECK(flow.state == TLS_BUFFERED);
+    inspector.on_segment(flow, TEST_SEQ, record.data(), split);
+    CHECK(flow.state == TLS_BUFFERED);
+    inspector.on_segment(flow, TEST_SEQ + split, record.data() + split, (uint32_t)record.size() - split);
+    CHECK(flow.state == TLS_DONE);
+    CHECK(inspector.ja3(flow) == gs_chromeJa3);
+
+    CHECK(inspector.get_hellos() == 4);
+    CHECK(inspector.get_reassembled() == 1);
+}
+
+/**
+ * GREASE cipher suites, extensions and groups are left out of the
+ * fingerprint, values that only look similar are not.
+ */
+static void test_grease (void) {
+    TLSInspector inspector;
+
+    TLSFlowState_T flow = inspect(inspector, make_chrome(true));
+    CHECK(inspector.ja3(flow) == gs_chromeJa3);
+    CHECK(inspector.sni(flow) == "www.google.com");
+
+    const uint16_t notGrease[] = { 0x0A1A, 0x0B0B, 0x1A0A, 0x0A0B };
+    for (uint16_t value : notGrease) {
+        flow = inspect(inspector, make_hello(0x0303, { 4865, value }, {}, false));
+        std::string sJa3 = inspector.ja3(flow);
+        CHECK(!sJa3.empty() && sJa3 != "ea1e247991e541e39bf918cb7cfa5139");
+    }
+
+    //Every one of the 16 GREASE values
+    for (uint16_t i = 0; i < 16; i++) {
+        uint16_t grease = (uint16_t)(TEST_GREASE + i * 0x1010);
+        flow = inspect(inspector, make_hello(0x0303, { grease, 4865 }, {}, false));
+        CHECK(inspector.ja3(flow) == "ea1e247991e541e39bf918cb7cfa5139");
+    }
+}
+
+static void check_rejected (const Bytes_T& record) {
+    TLSInspector inspector;
+    TLSFlowState_T flow = inspect(inspector, record);
+    CHECK(inspector.get_hellos() == 0);
+    CHECK(inspector.ja3(flow).empty());
+    CHECK(flow.sni == 0);
+}
+
+/**
+ * Lengths that run past the data they describe reject the hello, or
+ * just the field they belong to when it is inside an extension.
+ */
+static void test_lengths (void) {
+    Bytes_T record = make_example();
+    size_t ext = TEST_EXT_AT(12);
+
+    //An extension running past the end of the extensions block
+    Bytes_T longExt = record;
+    longExt[ext + 2 + make_sni("Example.COM").size() + 3] += 1;
+    check_rejected(longExt);
+
+    //The extensions block longer than the hello
+    Bytes_T longBlock = record;
+    longBlock[ext + 1] += 1;
+    check_rejected(longBlock);
+
+    //Compression methods past the end of a hello without extensions
+    Bytes_T compression = make_hello(0x0303, { 4865 }, {}, false);
+    compression[compression.size() - 2] = 2;
+    check_rejected(compression);
+
+    //Cipher suites past the end of the hello
+    Bytes_T ciphers = make_hello(0x0303, { 4865 }, {}, false);
+    ciphers[TEST_CIPHERS_AT] = 0xFF;
+    check_rejected(ciphers);
+
+    //Session ID past the end of the hello
+    Bytes_T session = make_hello(0x0303, { 4865 }, {}, false);
+    session[TEST_SESSION_AT] = 0xFF;
+    check_rejected(session);
+
+    //A hello longer than its record
+    Bytes_T hello = record;
+    hello[8] += 1;
+    check_rejected(hello);
+
+    //The hello cut short, by its own length and by the segment
+    Bytes_T cut = record;
+    cut.resize(cut.size() - 1);
+    cut[8] -= 1;
+    cut[4] -= 1;
+    check_rejected(cut);
+    TLSInspector inspector;
+    TLSFlowState_T flow = new_flow();
+    inspector.on_segment(flow, TEST_SEQ, record.data(), (uint32_t)record.size() - 1);
+    CHECK(flow.state == TLS_BUFFERED);
+    inspector.on_segment(flow, TEST_SEQ + 1000, record.data(), 1);
+    CHECK(flow.state == TLS_DONE);
+    CHECK(inspector.get_hellos() == 0);
+    CHECK(inspector.ja3(flow).empty());
+
+    //A host name longer than its extension is skipped, the rest of the
+    //hello still counts
+    Bytes_T sni = make_sni("example.com");
+    sni[8] = 0xFF;
+    flow = inspect(inspector, make_hello(0x0301, std::vector<uint16_t>(gs_exampleCiphers, gs_exampleCiphers + 12),
+                                         { sni, make_groups({ 23, 24, 25 }), make_formats() }));
+    CHECK(flow.sni == 0);
+    CHECK(inspector.ja3(flow) == gs_exampleJa3);
+
+    //A group list longer than its extension is cut to the extension
+    Bytes_T groups = make_groups({ 23, 24, 25 });
+    groups[5] = 0xFF;
+    flow = inspect(inspector, make_hello(0x0301, std::vector<uint16_t>(gs_exampleCiphers, gs_exampleCiphers + 12),
+                                         { make_sni("example.com"), groups, make_formats() }));
+    CHECK(inspector.sni(flow) == "example.com");
+    CHECK(inspector.ja3(flow) == gs_exampleJa3);
+
+    //A JA3 string over TLS_JA3_MAX only reports the server name
+    flow = inspect(inspector, make_hello(0x0303, std::vector<uint16_t>(TLS_JA3_MAX / 5, 49195),
+                                         { make_sni("example.com") }));
+    CHECK(inspector.sni(flow) == "example.com");
+    CHECK(inspector.ja3(flow).empty());
+}
+
+//=============================================================================
+// IMPLEMENTATION
+//=============================================================================
+int main (int argc, char** argv) {
+    test_known_vectors();
+    test_grease();
+    test_lengths();
+
+    if (gs_failures != 0) {
+        fprintf(stderr, "%d checks failed\n", gs_failures);
+        return 1;
+    }
+    printf("TLSInspectorTest passed\n");
+    return 0;
+}